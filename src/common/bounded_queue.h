@@ -0,0 +1,200 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+
+/**
+ * @brief Bounded lock free multi-producer multi-consumer queue.
+ *
+ * Each slot carries a sequence number telling producers and consumers whose
+ * turn it is (Vyukov's algorithm), so a push or pop is one compare and swap
+ * on the shared position plus one store to the slot.  The capacity is
+ * rounded up to a power of two, and to at least two as with a single slot
+ * the sequence numbers of full and empty would be the same.
+ *
+ * push() and pop() wait for room or for an element by spinning and then
+ * sleeping with a growing backoff, they give up if stop is requested.
+ */
+template<typename T>
+    requires std::default_initializable<T> and std::movable<T>
+class bounded_queue {
+
+    private:
+
+        /* Keep the positions on their own cache lines so producers and
+         * consumers don't contend */
+        static constexpr std::size_t cache_line = 64;
+
+        struct slot {
+            std::atomic<std::size_t> sequence;
+            T value;
+        };
+
+        std::size_t _mask;
+        std::unique_ptr<slot[]> _slots;
+
+        alignas(cache_line) std::atomic<std::size_t> _tail{0};
+        alignas(cache_line) std::atomic<std::size_t> _head{0};
+
+        /* Spin briefly then back off up to a millisecond */
+        static void _backoff(unsigned &attempt) {
+
+            if(attempt < 64) {
+                std::this_thread::yield();
+            } else {
+                auto shift = std::min(attempt - 64, 10U);
+                std::this_thread::sleep_for(std::chrono::microseconds(1U << shift));
+            }
+
+            ++attempt;
+        }
+
+    public:
+
+        explicit bounded_queue(std::size_t capacity) {
+
+            if(capacity == 0) {
+                throw std::invalid_argument("Queue capacity must be positive");
+            }
+
+            auto size = std::bit_ceil(std::max<std::size_t>(capacity, 2));
+
+            _mask = size - 1;
+            _slots = std::make_unique<slot[]>(size);
+
+            for(std::size_t i = 0; i < size; ++i) {
+                _slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bounded_queue(const bounded_queue &) = delete;
+        bounded_queue &operator=(const bounded_queue &) = delete;
+
+        /* Adds value unless the queue is full, value is left untouched if
+         * it is */
+        bool try_push(T &value) {
+
+            auto pos = _tail.load(std::memory_order_relaxed);
+
+            while(true) {
+
+                auto &s = _slots[pos & _mask];
+                auto seq = s.sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+                if(diff == 0) {
+
+                    if(_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        s.value = std::move(value);
+                        s.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+
+                /* Full, the consumer of this slot hasn't got to it yet */
+                } else if(diff < 0) {
+                    return false;
+
+                } else {
+                    pos = _tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /* Takes the oldest element if there is one */
+        bool try_pop(T &value) {
+
+            auto pos = _head.load(std::memory_order_relaxed);
+
+            while(true) {
+
+                auto &s = _slots[pos & _mask];
+                auto seq = s.sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+
+                if(diff == 0) {
+
+                    if(_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        value = std::move(s.value);
+                        s.value = T();
+                        s.sequence.store(pos + _mask + 1, std::memory_order_release);
+                        return true;
+                    }
+
+                /* Empty */
+                } else if(diff < 0) {
+                    return false;
+
+                } else {
+                    pos = _head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /* Waits for room, returns false if stop was requested first */
+        bool push(T value, std::stop_token stoken = {}) {
+
+            unsigned attempt = 0;
+
+            while(not try_push(value)) {
+
+                if(stoken.stop_requested()) {
+                    return false;
+                }
+
+                _backoff(attempt);
+            }
+
+            return true;
+        }
+
+        /* Waits for an element, returns false if stop was requested first */
+        bool pop(T &value, std::stop_token stoken = {}) {
+
+            unsigned attempt = 0;
+
+            while(not try_pop(value)) {
+
+                if(stoken.stop_requested()) {
+                    return false;
+                }
+
+                _backoff(attempt);
+            }
+
+            return true;
+        }
+
+        std::size_t capacity() const {
+            return _mask + 1;
+        }
+
+        /* Approximate when other threads are using the queue */
+        std::size_t size() const {
+
+            auto head = _head.load(std::memory_order_relaxed);
+            auto tail = _tail.load(std::memory_order_relaxed);
+
+            return (tail > head) ? tail - head : 0;
+        }
+};
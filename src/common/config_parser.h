@@ -39,6 +39,7 @@ namespace qs::common {
                 std::string_view{}) } -> std::same_as<std::map<std::string, std::string>>;
         { impl.get_agent_types() } -> std::same_as<std::vector<std::string>>;
         { impl.get_agent_properties_by_id(std::string_view{}) } -> std::same_as<std::map<std::string, std::string>>;
+        { impl.get_policy_rules_by_name(std::string_view{}) } -> std::same_as<std::vector<std::map<std::string, std::string>>>;
     };
 
     class config {
@@ -156,6 +157,20 @@ namespace qs::common {
                     return impl.get_agent_properties_by_id(id);
                 }, *_pimpl);
             }
+
+            /**
+             * @brief Get the rules of a named policy in order of precedence,
+             *        each a map of its name, match and action.
+             * 
+             * @throws Runtime exception if there is no such policy.
+             * @return std::vector<std::map<std::string, std::string>> 
+             */
+            std::vector<std::map<std::string, std::string>> 
+            get_policy_rules_by_name(std::string_view name) const {
+                return std::visit([name](auto &&impl) -> std::vector<std::map<std::string, std::string>> {
+                    return impl.get_policy_rules_by_name(name);
+                }, *_pimpl);
+            }
     };
 
     template<ConfigType type>
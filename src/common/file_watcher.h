@@ -0,0 +1,150 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+
+/**
+ * @brief Calls a function on its own thread whenever a file is rewritten.
+ *
+ * The file's directory is watched rather than the file so replacing it by
+ * renaming another file over it, as editors and configuration management
+ * tools do, is seen as well.  A burst of events, e.g. a file written in
+ * several pieces, results in a single call once the file has been quiet for
+ * the settle time.  Exceptions thrown by the callback are logged.
+ */
+class file_watcher {
+
+    private:
+
+        int _fd = -1;
+        std::string _name;
+        std::function<void()> _on_change;
+        std::chrono::milliseconds _settle;
+
+        /* Declared last so it stops before the rest goes away */
+        std::jthread _thread;
+
+        /* Whether any of the events read concern our file */
+        bool _read_events() {
+
+            alignas(inotify_event) std::array<char, 4096> buffer;
+            bool changed = false;
+
+            while(true) {
+
+                auto n = read(_fd, buffer.data(), buffer.size());
+
+                if(n <= 0) {
+                    return changed;
+                }
+
+                for(auto *p = buffer.data(); p < buffer.data() + n; ) {
+
+                    const auto *event = reinterpret_cast<const inotify_event *>(p);
+
+                    if(event->len > 0 and _name == event->name) {
+                        changed = true;
+                    }
+
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+
+        void _run(std::stop_token stoken) {
+
+            std::optional<std::chrono::steady_clock::time_point> due;
+
+            while(not stoken.stop_requested()) {
+
+                pollfd pfd { .fd = _fd, .events = POLLIN, .revents = 0 };
+
+                /* Wake up regularly to notice stop requests */
+                if(poll(&pfd, 1, 100) > 0 and _read_events()) {
+                    due = std::chrono::steady_clock::now() + _settle;
+                }
+
+                if(not due or std::chrono::steady_clock::now() < *due) {
+                    continue;
+                }
+
+                due.reset();
+
+                try {
+                    _on_change();
+
+                } catch(const std::exception &e) {
+                    std::clog << "File watcher(" << std::this_thread::get_id() << "): "
+                              << "Error handling change of " << _name << ": " 
+                              << e.what() << std::endl;
+                }
+            }
+        }
+
+    public:
+
+        /* @throws std::system_error if the directory can't be watched */
+        file_watcher(const std::filesystem::path &file, std::function<void()> on_change,
+                     std::chrono::milliseconds settle = std::chrono::milliseconds(200)) :
+            _name(file.filename().string()), _on_change(std::move(on_change)), 
+            _settle(settle) {
+
+            auto directory = file.parent_path().empty() ? std::filesystem::path(".") : 
+                                                          file.parent_path();
+
+            _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+            if(_fd == -1) {
+                throw std::system_error(errno, std::generic_category(), "inotify_init1");
+            }
+
+            if(inotify_add_watch(_fd, directory.c_str(), 
+                                 IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) == -1) {
+                auto error = errno;
+                close(_fd);
+                throw std::system_error(error, std::generic_category(), 
+                                        "Watching " + directory.string());
+            }
+
+            _thread = std::jthread([this](std::stop_token stoken) { _run(stoken); });
+        }
+
+        file_watcher(const file_watcher &) = delete;
+        file_watcher &operator=(const file_watcher &) = delete;
+
+        ~file_watcher() {
+
+            _thread.request_stop();
+
+            if(_thread.joinable()) {
+                _thread.join();
+            }
+
+            close(_fd);
+        }
+};
@@ -50,6 +50,9 @@ namespace qs::common::impl {
             
             std::map<std::string, std::string> 
             get_agent_properties_by_id(std::string_view id) const;
+
+            std::vector<std::map<std::string, std::string>> 
+            get_policy_rules_by_name(std::string_view name) const;
     };
 
 
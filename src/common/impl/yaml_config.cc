@@ -236,4 +236,32 @@ namespace qs::common::impl {
 
         throw std::runtime_error(std::string("Config error: no agent with id: ") + id.data());
     }
+
+
+    std::vector<std::map<std::string, std::string>> 
+    yaml_config_parser::get_policy_rules_by_name(std::string_view name) const {
+
+        auto node = root_node["policies"][name.data()];
+
+        if(not node) {
+            throw std::runtime_error(std::string("Config error: no policy named: ") + name.data());
+        }
+
+        /* Build a map of the properties of each rule, keeping their order */
+        std::vector<std::map<std::string, std::string>> rules;
+
+        for(const auto &rule : node) {
+
+            auto properties = std::map<std::string, std::string>();
+
+            for(const auto &property : rule) {
+                properties.emplace(property.first.as<std::string>(), 
+                                    property.second.as<std::string>());
+            }
+
+            rules.emplace_back(std::move(properties));
+        }
+
+        return rules;
+    }
 }
\ No newline at end of file
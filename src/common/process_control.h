@@ -67,9 +67,9 @@ class process {
         
         template<typename list>
         requires std::ranges::range<list>
-        process(const list &args)  {
-            std::ranges::copy(args, std::begin(_args));
-        }
+        process(const list &args) :
+            _pid(-1), _pipefds{-1, -1},
+            _args(std::ranges::begin(args), std::ranges::end(args)) { };
 
 
         ~process() {
@@ -166,6 +166,9 @@ class process {
                                         "Error waiting on process");
             }
 
+            /* Reaped, so cleanup mustn't signal a pid that may be reused */
+            this->_pid = -1;
+
             return WEXITSTATUS(status);
         }
 
@@ -0,0 +1,179 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @brief Fixed size thread pool where each worker has its own task deque.
+ *
+ * A worker runs the newest task of its own deque first, which keeps the
+ * data a task just produced in its cache, and when that is empty steals the
+ * oldest task of another worker.  Tasks submitted from outside the pool are
+ * spread round robin over the workers, tasks submitted by a worker go to its
+ * own deque.
+ *
+ * Tasks are given the index of the worker running them so they can use per
+ * worker state without locking.  A task must not throw.
+ */
+class work_stealing_pool {
+
+    public:
+
+        using task = std::function<void(std::size_t worker)>;
+
+    private:
+
+        struct worker_queue {
+            std::mutex mutex;
+            std::deque<task> tasks;
+        };
+
+        std::vector<std::unique_ptr<worker_queue>> _queues;
+
+        /* Round robin position for tasks submitted from outside the pool */
+        std::atomic<std::size_t> _next{0};
+
+        /* Tasks queued but not started, idle workers sleep while it is 0 */
+        std::atomic<std::size_t> _queued{0};
+
+        std::mutex _idle_mutex;
+        std::condition_variable_any _idle;
+
+        /* Declared last so the workers stop before the queues go away */
+        std::vector<std::jthread> _workers;
+
+        /* Index of the worker the calling thread is, if any */
+        static std::size_t &_current_worker() {
+            static thread_local std::size_t worker = SIZE_MAX;
+            return worker;
+        }
+
+        bool _take(std::size_t worker, task &t) {
+
+            /* Newest of our own first */
+            {
+                auto &own = *_queues[worker];
+                std::lock_guard<std::mutex> lock(own.mutex);
+
+                if(not own.tasks.empty()) {
+                    t = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    return true;
+                }
+            }
+
+            /* Then the oldest of someone else's, skipping busy deques */
+            for(std::size_t i = 1; i < _queues.size(); ++i) {
+
+                auto &victim = *_queues[(worker + i) % _queues.size()];
+                std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+
+                if(lock.owns_lock() and not victim.tasks.empty()) {
+                    t = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void _run(std::stop_token stoken, std::size_t worker) {
+
+            _current_worker() = worker;
+
+            task t;
+
+            while(not stoken.stop_requested()) {
+
+                if(_take(worker, t)) {
+                    _queued.fetch_sub(1, std::memory_order_relaxed);
+                    t(worker);
+                    t = nullptr;
+                    continue;
+                }
+
+                /* A steal may have missed a task behind a busy lock, so only
+                 * sleep when nothing is queued anywhere */
+                std::unique_lock<std::mutex> lock(_idle_mutex);
+
+                _idle.wait_for(lock, stoken, std::chrono::milliseconds(10), [this] {
+                    return _queued.load(std::memory_order_relaxed) > 0;
+                });
+            }
+        }
+
+    public:
+
+        explicit work_stealing_pool(std::size_t threads) {
+
+            if(threads == 0) {
+                throw std::invalid_argument("Pool needs at least one thread");
+            }
+
+            for(std::size_t i = 0; i < threads; ++i) {
+                _queues.emplace_back(std::make_unique<worker_queue>());
+            }
+
+            for(std::size_t i = 0; i < threads; ++i) {
+                _workers.emplace_back([this, i](std::stop_token stoken) { _run(stoken, i); });
+            }
+        }
+
+        work_stealing_pool(const work_stealing_pool &) = delete;
+        work_stealing_pool &operator=(const work_stealing_pool &) = delete;
+
+        ~work_stealing_pool() {
+
+            for(auto &worker : _workers) {
+                worker.request_stop();
+            }
+
+            _idle.notify_all();
+        }
+
+        void submit(task t) {
+
+            auto worker = _current_worker();
+
+            if(worker >= _queues.size()) {
+                worker = _next.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+            }
+
+            {
+                auto &queue = *_queues[worker];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks.emplace_back(std::move(t));
+            }
+
+            _queued.fetch_add(1, std::memory_order_relaxed);
+
+            /* Taking the lock orders this with a worker about to sleep */
+            { std::lock_guard<std::mutex> lock(_idle_mutex); }
+            _idle.notify_one();
+        }
+
+        std::size_t size() const {
+            return _queues.size();
+        }
+};
@@ -26,6 +26,10 @@
 #include <atomic>
 #include <cmath>
 #include <array>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <mutex>
 #include <charconv>
 #include <cassert>
 #include <regex>
@@ -510,14 +514,8 @@ static const char * _jsError_GetText(jsErrCode errCode) {
 
 
 
-void jetstream_message_queue_publisher_impl::_send(std::string_view sv) {
-
-    /* Aliases */
-    using unique_jsPubAck_ptr_t = std::unique_ptr<jsPubAck, decltype(&jsPubAck_Destroy)>;
-    
-    natsStatus status = NATS_OK;
-    jsErrCode jerr = static_cast<jsErrCode>(0);
-    unique_jsPubAck_ptr_t jsPubAck_ptr(nullptr, jsPubAck_Destroy);
+void jetstream_message_queue_publisher_impl::_send(std::string_view sv, 
+                                                   const std::string &subject) {
 
     /* TODO see if we can avoid copy here on each call */
     char msg_id_as_cstr[_client_id.length() + UINT64_BUFSIZE + 1];
@@ -531,28 +529,93 @@ void jetstream_message_queue_publisher_impl::_send(std::string_view sv) {
                                     _msg_id.fetch_add(1, std::memory_order_relaxed));
     *end_ptr2 = '\0';
 
+    /* Spooled messages keep their id so a replay after a crash is 
+     * deduplicated by JetStream */
+    if(_state->spool_ptr) {
+        _state->spool_ptr->append(subject, 
+                       std::string_view(msg_id_as_cstr, end_ptr2), 
+                       sv);
+        return;
+    }
+
+    _state->publish(sv, subject.c_str(), msg_id_as_cstr);
+}
+
+
+void jetstream_message_queue_publisher_impl::publish_state::drain(std::stop_token stoken) {
+
+    spool::record rec;
+
+    while(spool_ptr->front(rec, stoken)) {
 
-    /* TODO not thread safe, need to fix */
-    _jsPubOpts.MsgId = msg_id_as_cstr;
+        /* The views aren't null terminated */
+        std::string subject(rec.subject);
+        std::string msg_id(rec.msg_id);
+
+        try {
+            publish(rec.payload, subject.c_str(), msg_id.c_str(), stoken);
+            spool_ptr->pop();
+
+        /* Leave it in the spool and try again */
+        } catch(const std::exception &e) {
+
+            std::clog << "Spool drainer: " << e.what() << std::endl;
+
+            std::mutex m;
+            std::unique_lock<std::mutex> lock(m);
+            std::condition_variable_any().wait_for(lock, stoken, 
+                                                   std::chrono::seconds(1), 
+                                                   [] { return false; });
+        }
+    }
+}
+
+
+void jetstream_message_queue_publisher_impl::publish_state::publish(std::string_view sv, 
+                                                            const char *subject,
+                                                            const char *msg_id,
+                                                            std::stop_token stoken) {
+
+    /* Aliases */
+    using unique_jsPubAck_ptr_t = std::unique_ptr<jsPubAck, decltype(&jsPubAck_Destroy)>;
+    
+    natsStatus status = NATS_OK;
+    jsErrCode jerr = static_cast<jsErrCode>(0);
+    unique_jsPubAck_ptr_t jsPubAck_ptr(nullptr, jsPubAck_Destroy);
 
-    std::cout << "msg id: " << _jsPubOpts.MsgId << std::endl;
+    /* Copy so concurrent publishes don't share the message id */
+    jsPubOptions pub_opts = jsPubOpts;
+    pub_opts.MsgId = msg_id;
 
+    /* Sample how full the stream is every so often */
+    if(rate_ctl.fill_level_due()) {
+        sample_fill_level();
+    }
 
     do {    
+
+        /* Wait for the rate controller to allow the publish */
+        rate_ctl.acquire();
+
+        auto start = std::chrono::steady_clock::now();
+
         {
             jsPubAck *pa = nullptr;
 
             status = js_Publish(&pa, 
-                                _jsCtx_ptr.get(), 
-                                _subject.c_str(), 
+                                jsCtx_ptr.get(), 
+                                subject, 
                                 sv.data(), 
                                 sv.length(), 
-                                &_jsPubOpts, 
+                                &pub_opts, 
                                 &jerr);
 
             jsPubAck_ptr.reset(pa);
         }
 
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - start);
+
 
 
         /* TODO not sure if this is a necessary check */
@@ -575,24 +638,28 @@ void jetstream_message_queue_publisher_impl::_send(std::string_view sv) {
 
             /* Success */
             case NATS_OK:
+                rate_ctl.on_ack(latency);
+                stats.latency.record(latency);
+                stats.count_message(sv.size());
                 break;
 
             /* Generic NATS ERROR */
             case NATS_ERR:
 
-                /* TODO print statement to find errors we should handle */
-                std::clog << "Publish NATS error: " 
-                            << natsStatus_GetText(status) 
-                            << " JS err: " 
-                            << _jsError_GetText(jerr)
-                            << std::endl;
+                log_publish_error(status, jerr);
                             
                 /* Process js errors */
                 switch(jerr) {
 
-                    /* Stream may be full so wait and resend */
+                    /* Stream may be full, slow down and back off before 
+                     * resending */
                     case JSStreamStoreFailedErr:
-                        nats_Sleep(1000);
+                        stats.retries.fetch_add(1, std::memory_order_relaxed);
+                        std::this_thread::sleep_for(rate_ctl.on_store_failure());
+
+                        if(stoken.stop_requested()) {
+                            throw std::runtime_error("Publish cancelled");
+                        }
                         break;  
                 
                 
@@ -607,24 +674,26 @@ void jetstream_message_queue_publisher_impl::_send(std::string_view sv) {
 
                 break;
 
-            /* For timeout explicitly try again */
+            /* For timeout slow down and try again */
             case NATS_TIMEOUT:
-                /* TODO print statement to find errors we should handle */
-                std::clog << "Publish NATS error: " 
-                            << natsStatus_GetText(status) 
-                            << " JS err: " 
-                            << _jsError_GetText(jerr)
-                            << std::endl;
+                log_publish_error(status, jerr);
+                stats.retries.fetch_add(1, std::memory_order_relaxed);
+                rate_ctl.on_timeout();
+
+                if(stoken.stop_requested()) {
+                    throw std::runtime_error("Publish cancelled");
+                }
                 continue;
 
             /* No servers are reachable so let's try again in 5 seconds */
             case NATS_NO_RESPONDERS:
-                /* TODO print statement to find errors we should handle */
-                std::clog << "Publish NATS error: " 
-                            << natsStatus_GetText(status) 
-                            << " JS err: " 
-                            << _jsError_GetText(jerr)
-                            << std::endl;
+                log_publish_error(status, jerr);
+                stats.retries.fetch_add(1, std::memory_order_relaxed);
+
+                if(stoken.stop_requested()) {
+                    throw std::runtime_error("Publish cancelled");
+                }
+
                 nats_Sleep(5000);
                 continue;
 
@@ -663,6 +732,8 @@ void jetstream_message_queue_publisher_impl::_send(std::string_view sv) {
             case NATS_MISMATCH:
             case NATS_MISSED_HEARTBEAT:
 
+                stats.errors.fetch_add(1, std::memory_order_relaxed);
+
                 /* TODO print statement to find errors we should handle */
                 std::clog << "Publish NATS error: " 
                             << natsStatus_GetText(status) 
@@ -695,25 +766,175 @@ void jetstream_message_queue_publisher_impl::_send(std::string_view sv) {
     } while(status != NATS_OK);
 
     /* Flush the connection */
-    natsConnection_Flush(_conn_ptr.get());
+    natsConnection_Flush(conn_ptr.get());
 }
 
 
-void jetstream_message_queue_subscriber_impl::_receive(
-    const unique_natsMsgList_ptr_t &msgListPtr) {
+void jetstream_message_queue_publisher_impl::publish_state::sample_fill_level() {
+
+    /* Aliases */
+    using unique_jsStreamInfo_ptr_t = std::unique_ptr<jsStreamInfo, decltype(&jsStreamInfo_Destroy)>;
+
+    jsStreamInfo *si = nullptr;
+    jsErrCode jerr   = static_cast<jsErrCode>(0);
+
+    natsStatus status = js_GetStreamInfo(&si, 
+                                         jsCtx_ptr.get(), 
+                                         stream_name.c_str(), 
+                                         nullptr, 
+                                         &jerr);
+
+    unique_jsStreamInfo_ptr_t si_ptr(si, jsStreamInfo_Destroy);
+
+    /* Sampling is best effort, the publish path reports real errors */
+    if(status != NATS_OK or si == nullptr or si->Config == nullptr) {
+        return;
+    }
+
+    /* Fill level is the most used of the limits, unlimited streams are 
+     * never full */
+    double fill_level = 0.0;
+
+    if(si->Config->MaxMsgs > 0) {
+        fill_level = std::max(fill_level, 
+                              static_cast<double>(si->State.Msgs) / si->Config->MaxMsgs);
+    }
+
+    if(si->Config->MaxBytes > 0) {
+        fill_level = std::max(fill_level, 
+                              static_cast<double>(si->State.Bytes) / si->Config->MaxBytes);
+    }
+
+    rate_ctl.on_fill_level(fill_level);
+}
+
+
+/* Counters from the NATS connection, best effort */
+static connection_stats _connection_stats(natsConnection *conn) {
+
+    using unique_natsStatistics_ptr_t = std::unique_ptr<natsStatistics, decltype(&natsStatistics_Destroy)>;
+
+    connection_stats stats;
+    natsStatistics *nats_stats = nullptr;
+
+    if(conn == nullptr or natsStatistics_Create(&nats_stats) != NATS_OK) {
+        return stats;
+    }
+
+    unique_natsStatistics_ptr_t stats_ptr(nats_stats, natsStatistics_Destroy);
+
+    if(natsConnection_GetStats(conn, nats_stats) == NATS_OK) {
+        natsStatistics_GetCounts(nats_stats, 
+                                 &stats.in_msgs, 
+                                 &stats.in_bytes, 
+                                 &stats.out_msgs, 
+                                 &stats.out_bytes, 
+                                 &stats.reconnects);
+    }
+
+    return stats;
+}
+
+
+messaging_stats_snapshot jetstream_message_queue_publisher_impl::stats() const {
+
+    auto snap = _state->stats.snapshot();
+    snap.connection = _connection_stats(_state->conn_ptr.get());
+
+    return snap;
+}
+
+
+messaging_stats_snapshot jetstream_message_queue_subscriber_impl::stats() const {
+
+    auto snap = _stats->snapshot();
+    snap.connection = _connection_stats(_conn_ptr.get());
+
+    return snap;
+}
+
+
+void jetstream_message_queue_publisher_impl::publish_state::log_publish_error(natsStatus status, 
+                                                                      jsErrCode jerr) {
+
+    stats.errors.fetch_add(1, std::memory_order_relaxed);
+
+    std::uint64_t suppressed = 0;
+
+    if(not throttle.should_log(suppressed)) {
+        return;
+    }
+
+    std::clog << "Publish NATS error: " 
+              << natsStatus_GetText(status) 
+              << " JS err: " 
+              << _jsError_GetText(jerr)
+              << " rate: " 
+              << rate_ctl.rate()
+              << " msgs/s";
+
+    if(suppressed > 0) {
+        std::clog << " (" << suppressed << " similar errors suppressed)";
+    }
+
+    std::clog << std::endl;
+}
+
+
+void jetstream_message_queue_subscriber_impl::_count_fetch(
+    const unique_natsMsgList_ptr_t &msgListPtr,
+    std::chrono::steady_clock::time_point start) {
+
+    _stats->latency.record(std::chrono::steady_clock::now() - start);
+
+    for(int i = 0; i < msgListPtr->Count; ++i) {
+        _stats->count_message(natsMsg_GetDataLength(msgListPtr->Msgs[i]));
+    }
+}
+
+
+void jetstream_message_queue_subscriber_impl::_fetch(
+    const unique_natsMsgList_ptr_t &msgListPtr, int batch) {
+
+    if(_scheduler) {
+        _fetch_lanes(msgListPtr, batch);
+        return;
+    }
      
     natsStatus status = static_cast<natsStatus>(~NATS_OK);
     jsErrCode jerr    = static_cast<jsErrCode>(0);
 
+    /* When bound to several partitions, round robin over them with a short 
+     * fetch expiry so an idle partition does not hold up the others */
+    const std::size_t num_subs = _sub_ptrs.size();
+    const int64_t fetch_timeout = (num_subs > 1) ? 100 : 5000;
+
     while(status != NATS_OK) {
+
+        natsSubscription *sub = _sub_ptrs[_next_sub].get();
+        _next_sub = (_next_sub + 1) % num_subs;
+
+        auto start = std::chrono::steady_clock::now();
+
         status = natsSubscription_Fetch(msgListPtr.get(), 
-                                        _sub_ptr.get(), 
-                                        1, 
-                                        5000, 
+                                        sub, 
+                                        batch, 
+                                        fetch_timeout, 
                                         &jerr);
 
+        if(status == NATS_OK) {
+            _count_fetch(msgListPtr, start);
+        }
+
+        /* An empty partition is expected, don't log it */
+        if(status == NATS_TIMEOUT and num_subs > 1) {
+            continue;
+        }
+
         if(status != NATS_OK) {
 
+            _stats->errors.fetch_add(1, std::memory_order_relaxed);
+
             /* TODO print statement to find errors we should handle */
             std::clog << "Subscriber NATS error: " 
                         << natsStatus_GetText(status) 
@@ -722,19 +943,366 @@ void jetstream_message_queue_subscriber_impl::_receive(
                         << std::endl;
         }
     }
+}
+
+
+void jetstream_message_queue_subscriber_impl::_fetch_lanes(
+    const unique_natsMsgList_ptr_t &msgListPtr, int batch) {
+
+    jsErrCode jerr = static_cast<jsErrCode>(0);
+
+    while(true) {
+
+        for(auto priority : _scheduler->next()) {
+
+            const auto lane = static_cast<std::size_t>(priority);
+            const auto &subs = (priority == message_priority::NORMAL) ? _sub_ptrs : _lane_sub_ptrs[lane];
+            auto &next = _next_lane_sub[lane];
+
+            /* Don't wait on a lane, an empty one gives its turn to the 
+             * next, but try each of its partitions first */
+            for(std::size_t tries = 0; tries < subs.size(); ++tries) {
+
+                natsSubscription *sub = subs[next].get();
+                next = (next + 1) % subs.size();
+
+                jsFetchRequest request;
+                jsFetchRequest_Init(&request);
+
+                request.Batch   = batch;
+                request.NoWait  = true;
+                request.Expires = 100 * 1000 * 1000;
+
+                auto start = std::chrono::steady_clock::now();
+
+                natsStatus status = natsSubscription_FetchRequest(msgListPtr.get(), sub, &request);
+
+                if(status == NATS_OK) {
+                    _count_fetch(msgListPtr, start);
+                    _scheduler->served(priority);
+                    return;
+                }
+
+                if(status != NATS_NOT_FOUND and status != NATS_TIMEOUT) {
+
+                    _stats->errors.fetch_add(1, std::memory_order_relaxed);
+
+                    std::clog << "Subscriber NATS error: " 
+                              << natsStatus_GetText(status) 
+                              << std::endl;
+                }
+            }
+
+            _scheduler->idle(priority);
+        }
+
+        /* Everything is drained, wait on the high priority lane so an 
+         * urgent message is received as soon as it is published */
+        const auto &subs = _lane_sub_ptrs[static_cast<std::size_t>(message_priority::HIGH)];
+        auto &next = _next_lane_sub[static_cast<std::size_t>(message_priority::HIGH)];
+
+        natsSubscription *sub = subs[next].get();
+        next = (next + 1) % subs.size();
+
+        auto start = std::chrono::steady_clock::now();
+
+        natsStatus status = natsSubscription_Fetch(msgListPtr.get(), sub, batch, 100, &jerr);
+
+        if(status == NATS_OK) {
+            _count_fetch(msgListPtr, start);
+            _scheduler->served(message_priority::HIGH);
+            return;
+        }
+
+        if(status != NATS_TIMEOUT) {
+
+            _stats->errors.fetch_add(1, std::memory_order_relaxed);
+
+            std::clog << "Subscriber NATS error: " 
+                      << natsStatus_GetText(status) 
+                      << " JS err: " 
+                      << _jsError_GetText(jerr)
+                      << std::endl;
+        }
+    }
+}
+
+
+std::uint64_t jetstream_message_queue_subscriber_impl::_stream_sequence(natsMsg *msg) {
+
+    jsMsgMetaData *meta = nullptr;
+
+    if(natsMsg_GetMetaData(&meta, msg) != NATS_OK) {
+        return 0;
+    }
+
+    auto sequence = meta->Sequence.Stream;
+
+    jsMsgMetaData_Destroy(meta);
+
+    return sequence;
+}
+
+
+void jetstream_message_queue_subscriber_impl::replay_from(std::uint64_t sequence) {
+
+    /* Aliases */
+    using unique_jsConsumerInfo_ptr_t = std::unique_ptr<jsConsumerInfo, decltype(&jsConsumerInfo_Destroy)>;
+
+    _replays.clear();
+
+    for(const auto &sub_ptr : _sub_ptrs) {
+
+        jsErrCode jerr = static_cast<jsErrCode>(0);
+        jsConsumerInfo *info = nullptr;
+
+        natsStatus status = natsSubscription_GetConsumerInfo(&info, sub_ptr.get(), nullptr, &jerr);
+
+        if(status != NATS_OK) {
+            throw std::runtime_error(std::string("Replay: ") + natsStatus_GetText(status) +
+                ((jerr != 0) ? (std::string(" JS err: ") + _jsError_GetText(jerr)) : ""));
+        }
+
+        unique_jsConsumerInfo_ptr_t info_ptr(info, jsConsumerInfo_Destroy);
+
+        /* Everything after the floor is still pending on the durable 
+         * consumer and is delivered by it */
+        const std::uint64_t end = info->AckFloor.Stream;
+
+        if(end < sequence) {
+            continue;
+        }
+
+        jsSubOptions sub_opts;
+        jsSubOptions_Init(&sub_opts);
+
+        sub_opts.Stream = _stream_name.c_str();
+        sub_opts.Config.DeliverPolicy = js_DeliverByStartSequence;
+        sub_opts.Config.OptStartSeq = sequence;
+
+        /* An ephemeral consumer on the same subjects */
+        natsSubscription *replay = nullptr;
+
+        status = js_PullSubscribe(&replay, 
+                                  _jsCtx_ptr.get(), 
+                                  info->Config->FilterSubject, 
+                                  nullptr, 
+                                  nullptr, 
+                                  &sub_opts, 
+                                  &jerr);
+
+        if(status != NATS_OK) {
+            throw std::runtime_error(std::string("Replay: ") + natsStatus_GetText(status) +
+                ((jerr != 0) ? (std::string(" JS err: ") + _jsError_GetText(jerr)) : ""));
+        }
+
+        _replays.emplace_back(shared_natsSubscription_ptr(replay, [](natsSubscription *sub) {
+                                  natsSubscription_Unsubscribe(sub);
+                                  natsSubscription_Destroy(sub);
+                              }), end);
+    }
+}
+
+
+bool jetstream_message_queue_subscriber_impl::_fetch_replay(
+    const unique_natsMsgList_ptr_t &msgListPtr, int batch) {
+
+    while(not _replays.empty()) {
+
+        auto &[sub_ptr, end] = _replays.back();
+        jsErrCode jerr = static_cast<jsErrCode>(0);
+
+        natsStatus status = natsSubscription_Fetch(msgListPtr.get(), sub_ptr.get(), batch, 1000, &jerr);
+
+        /* Caught up, or the stream no longer has the messages */
+        if(status != NATS_OK) {
+            _replays.pop_back();
+            continue;
+        }
+
+        bool done = false;
+
+        /* Past the floor the durable consumer delivers them, the holes left
+         * are skipped by receive_batch() and freed with the list */
+        for(int i = 0; i < msgListPtr->Count; ++i) {
+
+            if(_stream_sequence(msgListPtr->Msgs[i]) > end) {
+                natsMsg_Destroy(msgListPtr->Msgs[i]);
+                msgListPtr->Msgs[i] = nullptr;
+                done = true;
+            }
+        }
+
+        if(done) {
+            _replays.pop_back();
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+
+void jetstream_message_queue_subscriber_impl::_receive(
+    const unique_natsMsgList_ptr_t &msgListPtr) {
+
+    _fetch(msgListPtr);
+
+    _ack(msgListPtr->Msgs[0]);
+};
+
+
+void jetstream_message_queue_subscriber_impl::_ack(natsMsg *msg_ptr, bool flush) {
 
-    natsMsg *msg_ptr = msgListPtr->Msgs[0];
-   
     /* Acknowledge the message */
-    status = natsMsg_Ack(msg_ptr, nullptr);
+    natsStatus status = natsMsg_Ack(msg_ptr, nullptr);
 
     if(status != NATS_OK) {
+        _stats->errors.fetch_add(1, std::memory_order_relaxed);
         throw std::runtime_error(std::string("Subscriber NATS error: ")+
                     natsStatus_GetText(status));
     }  
 
+    if(flush) {
+        natsConnection_Flush(_conn_ptr.get());
+    }
+}
+
+
+void jetstream_message_queue_subscriber_impl::_retry(natsMsg *msg_ptr, 
+                                                     const std::string &reason) {
+
+    /* Aliases */
+    using unique_jsMsgMetaData_ptr_t = std::unique_ptr<jsMsgMetaData, decltype(&jsMsgMetaData_Destroy)>;
+
+    jsMsgMetaData *meta = nullptr;
+
+    natsStatus status = natsMsg_GetMetaData(&meta, msg_ptr);
+
+    unique_jsMsgMetaData_ptr_t meta_ptr(meta, jsMsgMetaData_Destroy);
+
+    /* Without the delivery count we can't tell how many times it has 
+     * failed so treat it as the first */
+    std::uint64_t num_delivered = (status == NATS_OK) ? meta->NumDelivered : 1;
+
+    if(_retry_policy.exhausted(num_delivered)) {
+        _dead_letter(msg_ptr, reason);
+        return;
+    }
+
+    auto delay = _retry_policy.backoff(num_delivered);
+
+    _stats->naks.fetch_add(1, std::memory_order_relaxed);
+
+    std::clog << "Subscriber: processing failed (delivery " 
+              << num_delivered << " of " << _retry_policy.max_deliveries 
+              << "), retrying in " << delay.count() << "ms: " 
+              << reason << std::endl;
+
+    /* Let the server redeliver it later, in the mean time we carry on with
+     * the rest of the queue */
+    status = natsMsg_NakWithDelay(msg_ptr, delay.count(), nullptr);
+
+    if(status != NATS_OK) {
+        throw std::runtime_error(std::string("Subscriber NATS error: ")+
+                    natsStatus_GetText(status));
+    }
+}
+
+
+/* Header values can't span lines, keep them short too */
+static std::string _header_value(std::string_view sv) {
+
+    std::string value(sv.substr(0, 512));
+
+    std::ranges::replace_if(value, [](char c) { return c == '\r' or c == '\n'; }, ' ');
+
+    return value;
+}
+
+
+void jetstream_message_queue_subscriber_impl::_dead_letter(natsMsg *msg_ptr, 
+                                                           const std::string &reason) {
+
+    /* Aliases */
+    using unique_jsMsgMetaData_ptr_t = std::unique_ptr<jsMsgMetaData, decltype(&jsMsgMetaData_Destroy)>;
+    using unique_natsMsg_ptr_t = std::unique_ptr<natsMsg, decltype(&natsMsg_Destroy)>;
+    using unique_jsPubAck_ptr_t = std::unique_ptr<jsPubAck, decltype(&jsPubAck_Destroy)>;
+
+    _stats->dead_lettered.fetch_add(1, std::memory_order_relaxed);
+
+    std::clog << "Subscriber: dead lettering message from " 
+              << natsMsg_GetSubject(msg_ptr) << ": " << reason << std::endl;
+
+    /* No dead letter queue so it can only be dropped */
+    if(_retry_policy.dead_letter_subject.empty()) {
+        natsMsg_Term(msg_ptr, nullptr);
+        return;
+    }
+
+    jsMsgMetaData *meta = nullptr;
+    natsStatus status = natsMsg_GetMetaData(&meta, msg_ptr);
+    unique_jsMsgMetaData_ptr_t meta_ptr((status == NATS_OK) ? meta : nullptr, 
+                                        jsMsgMetaData_Destroy);
+
+    natsMsg *dlq_msg = nullptr;
+
+    status = natsMsg_Create(&dlq_msg, 
+                            _retry_policy.dead_letter_subject.c_str(), 
+                            nullptr, 
+                            natsMsg_GetData(msg_ptr), 
+                            natsMsg_GetDataLength(msg_ptr));
+
+    unique_natsMsg_ptr_t dlq_msg_ptr(dlq_msg, natsMsg_Destroy);
+
+    /* Attach the failure metadata */
+    if(status == NATS_OK) {
+        
+        std::initializer_list<std::pair<const char *, std::string>> headers = {
+            { "Polimor-Failure-Reason", _header_value(reason) },
+            { "Polimor-Original-Subject", _header_value(natsMsg_GetSubject(msg_ptr)) },
+            { "Polimor-Original-Stream", _stream_name },
+            { "Polimor-Original-Consumer", _consumer_name },
+            { "Polimor-Stream-Sequence", meta_ptr ? std::to_string(meta_ptr->Sequence.Stream) : "" },
+            { "Polimor-Num-Delivered", meta_ptr ? std::to_string(meta_ptr->NumDelivered) : "" },
+            { "Polimor-Failed-At", std::to_string(nats_Now()) },
+        };
+
+        for(const auto &[key, value] : headers) {
+
+            if(status == NATS_OK and not value.empty()) {
+                status = natsMsgHeader_Set(dlq_msg, key, value.c_str());
+            }
+        }
+    }
+
+    jsErrCode jerr = static_cast<jsErrCode>(0);
+
+    if(status == NATS_OK) {
+        jsPubAck *pa = nullptr;
+        status = js_PublishMsg(&pa, _jsCtx_ptr.get(), dlq_msg, nullptr, &jerr);
+        unique_jsPubAck_ptr_t pa_ptr(pa, jsPubAck_Destroy);
+    }
+
+    /* Couldn't dead letter it, rather than lose it have it redelivered 
+     * after the longest backoff */
+    if(status != NATS_OK) {
+
+        std::clog << "Subscriber: failed to publish to dead letter subject " 
+                  << _retry_policy.dead_letter_subject << ": "
+                  << natsStatus_GetText(status) 
+                  << ((jerr != 0) ? std::string(" JS err: ") + _jsError_GetText(jerr) : "")
+                  << std::endl;
+
+        natsMsg_NakWithDelay(msg_ptr, _retry_policy.max_backoff.count(), nullptr);
+        return;
+    }
+
+    /* Never redeliver it */
+    natsMsg_Term(msg_ptr, nullptr);
     natsConnection_Flush(_conn_ptr.get());
-};
+}
 
 
 // static std::tuple<std::string, std::string, std::string> 
@@ -771,16 +1339,24 @@ void jetstream_message_queue_subscriber_impl::_receive(
 //     return { stream_name, consumer_name, subject };
 // }
 
-auto jetstream_messaging_service_impl::create_queue_publisher(
-        std::string_view stream, 
-        std::string_view consumer, 
-        std::string_view subject) -> jetstream_message_queue_publisher_impl {
+/**
+ * @brief Waits for the stream to become available, retrying with increasing
+ *        timeouts when there are no responders.
+ * 
+ * @param jsctx JetStream context.
+ * @param stream Name of the stream.
+ * @param caller Name of the caller used as the prefix for errors.
+ * @throws std::runtime_error if the stream does not exist or can not be 
+ *         reached.
+ */
+static void _wait_for_stream(jsCtx *jsctx, 
+                             std::string_view stream, 
+                             const std::string &caller) {
 
     using unique_jsStreamInfo_ptr_t = std::unique_ptr<jsStreamInfo, decltype(&jsStreamInfo_Destroy)>;
     
     natsStatus status = static_cast<natsStatus>(~NATS_OK);
 
-
     /* Timeout lengths to use by default */
     auto timeouts = {5, 30, 60, 120};
 
@@ -792,7 +1368,7 @@ auto jetstream_messaging_service_impl::create_queue_publisher(
 
         /* Checks for the existance of the stream */
         status = js_GetStreamInfo(&si, 
-                                    _jsCtx_ptr.get(), 
+                                    jsctx, 
                                     stream.data(), 
                                     nullptr, 
                                     &jerr);
@@ -810,8 +1386,7 @@ auto jetstream_messaging_service_impl::create_queue_publisher(
 
             /* Failure, stream not found */
             case NATS_NOT_FOUND:
-                throw std::runtime_error(std::string("Create_queue_publisher: ") 
-                                        + natsStatus_GetText(status));
+                throw std::runtime_error(caller + ": " + natsStatus_GetText(status));
                 break;
 
             /* For timeout and no responders, let's wait and 
@@ -824,7 +1399,7 @@ auto jetstream_messaging_service_impl::create_queue_publisher(
             /* Default error handler */
             default:
                 throw std::runtime_error(
-                    std::string("Create_queue_publisher: ")+
+                    caller + ": " +
                     natsStatus_GetText(status) + 
                     ((jerr != 0) ? (std::string(" JS err: ") + _jsError_GetText(jerr)) : ""));
         }     
@@ -832,104 +1407,33 @@ auto jetstream_messaging_service_impl::create_queue_publisher(
 
     /* Timeout occurred */
     if(status == NATS_TIMEOUT || status == NATS_NO_RESPONDERS) {
-        throw std::runtime_error(
-                    std::string("Create_queue_publisher: ") + 
-                    "Timeout or no responses");
+        throw std::runtime_error(caller + ": Timeout or no responses");
     }
+}
 
-    /* Generate a client id */
-    boost::uuids::uuid client_uuid = boost::uuids::random_generator()();
 
-    /* Create the message queue publisher */
-    return jetstream_message_queue_publisher_impl(
-                stream,
-                consumer,
-                subject,
-                _conn_ptr, 
-                _jsCtx_ptr, 
-                boost::uuids::to_string(client_uuid));
-}
-        
-auto jetstream_messaging_service_impl::create_queue_subscriber(
-        std::string_view stream, 
-        std::string_view consumer, 
-        std::string_view subject) -> jetstream_message_queue_subscriber_impl {
+/**
+ * @brief Verifies the durable consumer exists and creates a pull 
+ *        subscription on the subject through it.
+ */
+static shared_natsSubscription_ptr _pull_subscribe(jsCtx *jsctx,
+                                                   std::string_view stream, 
+                                                   const std::string &consumer, 
+                                                   const std::string &subject) {
 
     /* Aliases */
-    using unique_jsStreamInfo_ptr_t = std::unique_ptr<jsStreamInfo, decltype(&jsStreamInfo_Destroy)>;
-    using unique_natsSubscription_ptr_t = std::unique_ptr<natsSubscription, decltype(&natsSubscription_Destroy)>;
     using unique_jsConsumerInfo_ptr_t = std::unique_ptr<jsConsumerInfo, decltype(&jsConsumerInfo_Destroy)>;
 
-    
-    natsStatus status = static_cast<natsStatus>(~NATS_OK);
+    natsStatus status = NATS_OK;
     jsErrCode jerr    = static_cast<jsErrCode>(0);
 
-    /* Timeout lengths to use by default */
-    auto timeouts = {5, 30, 60, 120};
-
-
-    for(auto timeout = timeouts.begin(); 
-        status != NATS_OK and timeout != timeouts.end(); ++timeout) {
-        
-        jsStreamInfo *si = nullptr;
-        
-        /* Checks for the existance of the stream */
-        status = js_GetStreamInfo(&si, 
-                                    _jsCtx_ptr.get(), 
-                                    stream.data(), 
-                                    nullptr, 
-                                    &jerr);
-
-        /* Assign stream info to a unique pointer so it will be 
-            * released regardless of how we exit. */                
-        unique_jsStreamInfo_ptr_t si_ptr(si, jsStreamInfo_Destroy);
-
-        /* Process the result of the operation */
-        switch(status) {
-
-            /* Success */
-            case NATS_OK:
-                break;
-
-            /* Failure, stream not found */
-            case NATS_NOT_FOUND:
-                throw std::runtime_error(
-                    std::string("Create_queue_subscriber: ") 
-                                + natsStatus_GetText(status));
-                break;
-
-            /* For timeout and no responders, let's wait and 
-             * then attempt to join */
-            case NATS_TIMEOUT:
-            case NATS_NO_RESPONDERS:
-                nats_Sleep(*timeout * 1000);
-                break;
-
-            /* Default error handler */
-            default:
-                throw std::runtime_error(
-                    std::string("Create_queue_subscriber: ")+
-                    natsStatus_GetText(status) + 
-                    ((jerr != 0) ? (std::string(" JS err: ") + _jsError_GetText(jerr)) : ""));
-                break;
-        }
-    } 
-
-    /* Timeout occurred */
-    if(status == NATS_TIMEOUT || status == NATS_NO_RESPONDERS) {
-        throw std::runtime_error(
-                    std::string("Create_queue_subscriber: ") + 
-                    "Timeout or no responses");
-    }
-
-
     /* Retrieve info for the consumer and verify it exists. */    
     jsConsumerInfo *jsConsumerInfo = nullptr;
 
     status = js_GetConsumerInfo(&jsConsumerInfo, 
-                                _jsCtx_ptr.get(),
+                                jsctx,
                                 stream.data(), 
-                                consumer.data(),
+                                consumer.c_str(),
                                 nullptr,
                                 &jerr); 
 
@@ -937,6 +1441,7 @@ auto jetstream_messaging_service_impl::create_queue_subscriber(
         throw std::runtime_error(
                 std::string("Create_queue_subscriber: ")+
                 natsStatus_GetText(status) + 
+                " consumer: " + consumer +
                 ((jerr != 0) ? (std::string(" JS err: ") + _jsError_GetText(jerr)) : ""));
     }
 
@@ -948,9 +1453,9 @@ auto jetstream_messaging_service_impl::create_queue_subscriber(
 
     /* Create the pull subscriber */
     status = js_PullSubscribe(&subscription, 
-                            _jsCtx_ptr.get(), 
-                            subject.data(), 
-                            consumer.data(), 
+                            jsctx, 
+                            subject.c_str(), 
+                            consumer.c_str(), 
                             nullptr, 
                             nullptr, 
                             &jerr);
@@ -961,9 +1466,108 @@ auto jetstream_messaging_service_impl::create_queue_subscriber(
                 ((jerr != 0) ? std::string(" JS err: ") +_jsError_GetText(jerr) : ""));
     }
 
-    /* Assign to unique pointer so it will get destroyed */
-    unique_natsSubscription_ptr_t sub_ptr(subscription, 
-                                            natsSubscription_Destroy);
+    /* Assign to a shared pointer so it will get destroyed */
+    return shared_natsSubscription_ptr(subscription, natsSubscription_Destroy);
+}
+
+
+void jetstream_message_queue_subscriber_impl::enable_priority_lanes(
+    const priority_weights &weights) {
+
+    /* Aliases */
+    using unique_jsConsumerInfo_ptr_t = std::unique_ptr<jsConsumerInfo, decltype(&jsConsumerInfo_Destroy)>;
+
+    std::array<std::vector<shared_natsSubscription_ptr>, 3> lane_sub_ptrs;
+
+    /* Each bound consumer, i.e. each partition, has a consumer per lane
+     * named and filtered after it */
+    for(const auto &sub_ptr : _sub_ptrs) {
+
+        jsErrCode jerr = static_cast<jsErrCode>(0);
+        jsConsumerInfo *info = nullptr;
+
+        natsStatus status = natsSubscription_GetConsumerInfo(&info, sub_ptr.get(), nullptr, &jerr);
+
+        if(status != NATS_OK) {
+            throw std::runtime_error(std::string("Priority lanes: ") + natsStatus_GetText(status) +
+                ((jerr != 0) ? (std::string(" JS err: ") + _jsError_GetText(jerr)) : ""));
+        }
+
+        unique_jsConsumerInfo_ptr_t info_ptr(info, jsConsumerInfo_Destroy);
+
+        for(auto priority : { message_priority::HIGH, message_priority::LOW }) {
+            lane_sub_ptrs[static_cast<std::size_t>(priority)].push_back(
+                _pull_subscribe(_jsCtx_ptr.get(),
+                                _stream_name,
+                                lane_consumer(info->Name, priority),
+                                lane_subject(info->Config->FilterSubject, priority)));
+        }
+    }
+
+    _lane_sub_ptrs = std::move(lane_sub_ptrs);
+    _next_lane_sub = {};
+    _scheduler = std::make_unique<priority_scheduler>(weights);
+}
+
+
+auto jetstream_messaging_service_impl::create_queue_publisher(
+        std::string_view stream, 
+        std::string_view consumer, 
+        std::string_view subject) -> jetstream_message_queue_publisher_impl {
+
+    _wait_for_stream(_jsCtx_ptr.get(), stream, "Create_queue_publisher");
+
+    /* Generate a client id */
+    boost::uuids::uuid client_uuid = boost::uuids::random_generator()();
+
+    /* Create the message queue publisher */
+    return jetstream_message_queue_publisher_impl(
+                stream,
+                consumer,
+                subject,
+                _conn_ptr, 
+                _jsCtx_ptr, 
+                boost::uuids::to_string(client_uuid));
+}
+
+auto jetstream_messaging_service_impl::create_queue_publisher(
+        std::string_view stream, 
+        std::string_view consumer, 
+        std::string_view subject,
+        std::string_view partitions,
+        std::string_view partition_by) -> jetstream_message_queue_publisher_impl {
+
+    auto num_partitions = parse_partitions(partitions);
+    auto by = parse_partition_by(partition_by);
+
+    _wait_for_stream(_jsCtx_ptr.get(), stream, "Create_queue_publisher");
+
+    /* Generate a client id */
+    boost::uuids::uuid client_uuid = boost::uuids::random_generator()();
+
+    /* Create the partitioned message queue publisher */
+    return jetstream_message_queue_publisher_impl(
+                stream,
+                consumer,
+                subject,
+                _conn_ptr, 
+                _jsCtx_ptr, 
+                boost::uuids::to_string(client_uuid),
+                num_partitions,
+                by);
+}
+        
+auto jetstream_messaging_service_impl::create_queue_subscriber(
+        std::string_view stream, 
+        std::string_view consumer, 
+        std::string_view subject) -> jetstream_message_queue_subscriber_impl {
+
+    _wait_for_stream(_jsCtx_ptr.get(), stream, "Create_queue_subscriber");
+
+    auto sub_ptr = _pull_subscribe(_jsCtx_ptr.get(), 
+                                   stream, 
+                                   std::string(consumer), 
+                                   std::string(subject));
     
     /* Return an instance of the jetstream message queue wrapper */
     return jetstream_message_queue_subscriber_impl(
@@ -971,9 +1575,42 @@ auto jetstream_messaging_service_impl::create_queue_subscriber(
                 consumer,
                 subject, 
                 _conn_ptr, 
-                std::move(sub_ptr));
+                _jsCtx_ptr,
+                { std::move(sub_ptr) });
 }   
 
+auto jetstream_messaging_service_impl::create_queue_subscriber(
+        std::string_view stream, 
+        std::string_view consumer, 
+        std::string_view subject,
+        std::string_view partitions,
+        std::string_view partition_range) -> jetstream_message_queue_subscriber_impl {
+
+    auto num_partitions = parse_partitions(partitions);
+    auto [first, last] = parse_partition_range(partition_range, num_partitions);
+
+    _wait_for_stream(_jsCtx_ptr.get(), stream, "Create_queue_subscriber");
+
+    /* Bind to each partition in the range through its own durable consumer */
+    std::vector<shared_natsSubscription_ptr> sub_ptrs;
+
+    for(auto k = first; k <= last; ++k) {
+        sub_ptrs.emplace_back(
+            _pull_subscribe(_jsCtx_ptr.get(), 
+                            stream, 
+                            std::string(consumer) + "-" + std::to_string(k),
+                            std::string(subject) + "." + std::to_string(k)));
+    }
+
+    return jetstream_message_queue_subscriber_impl(
+                stream,
+                consumer,
+                subject, 
+                _conn_ptr, 
+                _jsCtx_ptr,
+                std::move(sub_ptrs));
+}
+
 jetstream_messaging_service_impl _create_messaging_service(
     std::string_view urls) {
 
@@ -11,8 +11,20 @@
 #pragma once
 
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
 #include <initializer_list>
 #include <memory>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <nats/nats.h>
 
@@ -20,6 +32,12 @@
 #include "./serializers.h"
 #include "./message_json_deserializer_boost_impl.h"
 #include "./message_json_serializer_boost_impl.h"
+#include "./partitioning.h"
+#include "./priority_lanes.h"
+#include "./rate_controller.h"
+#include "./retry_policy.h"
+#include "./spool.h"
+#include "./messaging_stats.h"
 
 
 /* Aliases for shared_ptr types */
@@ -41,19 +59,96 @@ class jetstream_message_queue_publisher_impl {
     friend class jetstream_messaging_service_impl;
 
     private:
-        std::string _stream_name;
+        /* What publishing uses, on the heap so the drainer thread keeps
+         * publishing from the same state when the publisher is moved */
+        struct publish_state {
+
+            std::string stream_name;
+            shared_natsConnection_ptr_t conn_ptr;
+            shared_jsCtx_ptr_t jsCtx_ptr;
+            jsPubOptions jsPubOpts;
+
+            /* Paces publishes based on broker backpressure */
+            rate_controller rate_ctl;
+
+            /* Keeps repeated publish errors from flooding the log */
+            log_throttle throttle;
+
+            messaging_stats stats;
+
+            /* Optional disk spool, when set messages are appended to it and 
+             * published by the drainer thread */
+            std::unique_ptr<spool> spool_ptr;
+
+            /* Must be last so it is stopped before anything it uses goes
+             * away */
+            std::jthread drainer;
+
+            /* Publishes to JetStream retrying until it is stored, gives up
+             * with an exception if stop is requested while retrying */
+            void publish(std::string_view sv, 
+                         const char *subject, 
+                         const char *msg_id,
+                         std::stop_token stoken = {});
+
+            /* Replays the spool to JetStream */
+            void drain(std::stop_token stoken);
+
+            /* Feeds the stream fill level to the rate controller */
+            void sample_fill_level();
+
+            void log_publish_error(natsStatus status, jsErrCode jerr);
+        };
+
         std::string _consumer_name;
         std::string _subject;    
-        shared_natsConnection_ptr_t _conn_ptr;
-        shared_jsCtx_ptr_t _jsCtx_ptr;
-        jsPubOptions    _jsPubOpts;
         std::string _client_id;
 
         std::atomic<std::uint64_t> _msg_id;
+
+        /* Number of subject partitions, 0 means the subject is not 
+         * partitioned.  Partitioned subjects are "<subject>.<k>". */
+        std::uint32_t _partitions = 0;
+        partition_by _partition_by = partition_by::FID;
+        std::vector<std::string> _partition_subjects;
+
+        /* Subjects of the high and low priority lanes by partition, indexed
+         * by message_priority.  Empty until priority lanes are enabled */
+        std::array<std::vector<std::string>, 3> _lane_subjects;
+
+        std::unique_ptr<publish_state> _state;
   
         constexpr static std::size_t UINT64_BUFSIZE = _find_buffer_size_for_number(UINT64_MAX);// std::ceil(std::log(UINT64_MAX)) + 1;
 
-        void _send(std::string_view);
+        void _send(std::string_view, const std::string &subject);
+
+        /* Returns the subject the message should be published on */
+        template<typename MSG>
+        const std::string &_select_subject(const MSG &msg) const {
+
+            std::size_t k = 0;
+
+            /* Messages without a key can't be partitioned */
+            if constexpr (requires { partition_key(msg, _partition_by); }) {
+
+                if(_partitions > 0) {
+                    k = stable_hash(partition_key(msg, _partition_by)) % _partitions;
+                }
+            }
+
+            /* Normal messages stay on the subject whether or not there are
+             * lanes */
+            if constexpr (HasPriority<MSG>) {
+
+                auto &lane = _lane_subjects[static_cast<std::size_t>(msg.priority)];
+
+                if(not lane.empty()) {
+                    return lane[k];
+                }
+            }
+
+            return (_partitions > 0) ? _partition_subjects[k] : _subject;
+        }
 
     public:
         explicit jetstream_message_queue_publisher_impl() = delete;
@@ -64,17 +159,24 @@ class jetstream_message_queue_publisher_impl {
                                                std::string_view subject, 
                                                shared_natsConnection_ptr_t conn_ptr,
                                                shared_jsCtx_ptr_t jsctx_ptr,
-                                               std::string client_id): 
-            _stream_name(stream_name),
+                                               std::string client_id,
+                                               std::uint32_t partitions = 0,
+                                               partition_by by = partition_by::FID): 
             _consumer_name(consumer_name),
             _subject(subject), 
-            _conn_ptr(std::move(conn_ptr)), 
-            _jsCtx_ptr(std::move(jsctx_ptr)),
-            _client_id(std::move(client_id)) { 
+            _client_id(std::move(client_id)),
+            _partitions(partitions),
+            _partition_by(by),
+            _partition_subjects(partition_subjects(subject, partitions)),
+            _state(std::make_unique<publish_state>()) { 
+
+            _state->stream_name = stream_name;
+            _state->conn_ptr    = std::move(conn_ptr);
+            _state->jsCtx_ptr   = std::move(jsctx_ptr);
 
-            jsPubOptions_Init(&_jsPubOpts);
-            _jsPubOpts.MaxWait = 30000;
-            _jsPubOpts.MsgId = nullptr;
+            jsPubOptions_Init(&_state->jsPubOpts);
+            _state->jsPubOpts.MaxWait = 30000;
+            _state->jsPubOpts.MsgId = nullptr;
 
             _msg_id = 0;
         };
@@ -83,27 +185,29 @@ class jetstream_message_queue_publisher_impl {
         
         jetstream_message_queue_publisher_impl(jetstream_message_queue_publisher_impl &&o) {
 
-            _stream_name   = std::move(o._stream_name);
             _consumer_name = std::move(o._consumer_name);
             _subject       = std::move(o._subject);
-            _conn_ptr      = std::move(o._conn_ptr);
-            _jsCtx_ptr     = std::move(o._jsCtx_ptr);
             _client_id     = std::move(o._client_id);
-            _jsPubOpts     = o._jsPubOpts;
             _msg_id        = o._msg_id.exchange(0);
+            _partitions    = o._partitions;
+            _partition_by  = o._partition_by;
+            _partition_subjects = std::move(o._partition_subjects);
+            _lane_subjects = std::move(o._lane_subjects);
+            _state         = std::move(o._state);
         };
 
         jetstream_message_queue_publisher_impl &operator=(const jetstream_message_queue_publisher_impl &) = delete;
         jetstream_message_queue_publisher_impl &operator=(jetstream_message_queue_publisher_impl &&rhs) {
 
-            _stream_name   = std::move(rhs._stream_name);
             _consumer_name = std::move(rhs._consumer_name);
             _subject       = std::move(rhs._subject);
-            _conn_ptr      = std::move(rhs._conn_ptr);
-            _jsCtx_ptr     = std::move(rhs._jsCtx_ptr);
             _client_id     = std::move(rhs._client_id);
-            _jsPubOpts     = rhs._jsPubOpts;
             _msg_id        = rhs._msg_id.exchange(0);
+            _partitions    = rhs._partitions;
+            _partition_by  = rhs._partition_by;
+            _partition_subjects = std::move(rhs._partition_subjects);
+            _lane_subjects = std::move(rhs._lane_subjects);
+            _state         = std::move(rhs._state);
 
             return *this;
         }
@@ -122,9 +226,58 @@ class jetstream_message_queue_publisher_impl {
             static SERIALIZER<MSG> serializer;
             char buffer[8192];
 
-            auto sv = serializer(msg, { buffer, sizeof(buffer) } );
+            std::string_view sv;
 
-            _send(sv);
+            {
+                scoped_timer timer(_state->stats.codec_time);
+                sv = serializer(msg, { buffer, sizeof(buffer) } );
+            }
+
+            _send(sv, _select_subject(msg));
+        }
+
+        /* Counters and latencies of this publisher and its connection */
+        messaging_stats_snapshot stats() const;
+
+        /**
+         * @brief Spool messages to disk in directory and publish them in the
+         *        background so sends don't block while JetStream is 
+         *        unreachable.  Messages left in the spool from a previous run
+         *        are published first.
+         *
+         * Must not be called again.  The drainer publishes from the
+         * publisher's heap state, so the publisher may still be moved.
+         */
+        void enable_spool(std::string_view directory, std::size_t segment_size) {
+
+            auto *state = _state.get();
+
+            state->spool_ptr = std::make_unique<spool>(directory, segment_size);
+            state->drainer = std::jthread([state](std::stop_token stoken) { state->drain(stoken); });
+        }
+
+        /**
+         * @brief Send high and low priority messages on their own lanes,
+         *        "<subject>.high" and "<subject>.low", or
+         *        "<subject>.<k>.high" and "<subject>.<k>.low" when
+         *        partitioned, so subscribers can receive urgent ones ahead of
+         *        the backlog.  The stream has to capture the lane subjects.
+         */
+        void enable_priority_lanes() {
+
+            for(auto priority : { message_priority::HIGH, message_priority::LOW }) {
+
+                auto &lane = _lane_subjects[static_cast<std::size_t>(priority)];
+                lane.clear();
+
+                if(_partitions == 0) {
+                    lane.push_back(lane_subject(_subject, priority));
+                }
+
+                for(const auto &subject : _partition_subjects) {
+                    lane.push_back(lane_subject(subject, priority));
+                }
+            }
         }
 };
 
@@ -138,13 +291,70 @@ class jetstream_message_queue_subscriber_impl {
         std::string _consumer_name;
         std::string _subject;    
         shared_natsConnection_ptr_t _conn_ptr = nullptr;
-        shared_natsSubscription_ptr _sub_ptr  = nullptr;
+
+        /* One subscription per bound partition, or a single subscription 
+         * when the subject is not partitioned */
+        std::vector<shared_natsSubscription_ptr> _sub_ptrs;
+
+        /* Next subscription to fetch from when bound to several partitions */
+        std::size_t _next_sub = 0;
+
+        /* Subscriptions of the high and low priority lanes, one per bound
+         * partition, indexed by message_priority.  The normal lane is
+         * _sub_ptrs */
+        std::array<std::vector<shared_natsSubscription_ptr>, 3> _lane_sub_ptrs;
+        std::array<std::size_t, 3> _next_lane_sub = {};
+
+        /* Chooses the lane to fetch from, null without priority lanes */
+        std::unique_ptr<priority_scheduler> _scheduler;
+
+        /* Ephemeral subscriptions replaying the stream for replay_from(),
+         * each with the last stream sequence to deliver, the acknowledgement
+         * floor of its partition's durable consumer */
+        std::vector<std::pair<shared_natsSubscription_ptr, std::uint64_t>> _replays;
+
+        /* Used to publish dead lettered messages */
+        shared_jsCtx_ptr_t _jsCtx_ptr = nullptr;
+
+        retry_policy _retry_policy;
+
+        std::unique_ptr<messaging_stats> _stats = std::make_unique<messaging_stats>();
 
         /* Aliases */
         using unique_natsMsgList_ptr_t = std::unique_ptr<natsMsgList, decltype(&natsMsgList_Destroy)>;
 
+        /* Fetches between one and batch messages without acknowledging 
+         * them */
+        void _fetch(const unique_natsMsgList_ptr_t &, int batch = 1);
+
+        /* Fetches from the lanes in the scheduler's order, waiting on the
+         * high priority lane while they are all empty */
+        void _fetch_lanes(const unique_natsMsgList_ptr_t &, int batch);
+
+        /* Counts the messages and latency of a successful fetch */
+        void _count_fetch(const unique_natsMsgList_ptr_t &, 
+                          std::chrono::steady_clock::time_point start);
+
+        /* Fetches and acknowledges one message */
         void _receive(const unique_natsMsgList_ptr_t &);
 
+        /* Fetches from the replays, false once they are all done */
+        bool _fetch_replay(const unique_natsMsgList_ptr_t &, int batch);
+
+        /* The stream sequence of a message, 0 if it has no metadata */
+        static std::uint64_t _stream_sequence(natsMsg *msg);
+
+        /* Acknowledges the message, several acks can share one flush */
+        void _ack(natsMsg *msg, bool flush = true);
+
+        /* Asks for redelivery after a backoff or dead letters the message 
+         * if it has been delivered too many times */
+        void _retry(natsMsg *msg, const std::string &reason);
+
+        /* Publishes the message with the failure metadata to the dead letter
+         * subject and terminates it */
+        void _dead_letter(natsMsg *msg, const std::string &reason);
+
     public:
         jetstream_message_queue_subscriber_impl() = delete;
 
@@ -153,12 +363,14 @@ class jetstream_message_queue_subscriber_impl {
             std::string_view consumer_name, 
             std::string_view subject,
             shared_natsConnection_ptr_t conn_ptr,
-            shared_natsSubscription_ptr sub_ptr): 
+            shared_jsCtx_ptr_t jsctx_ptr,
+            std::vector<shared_natsSubscription_ptr> sub_ptrs): 
             _stream_name(stream_name), 
             _consumer_name(consumer_name), 
             _subject(subject), 
             _conn_ptr(std::move(conn_ptr)), 
-            _sub_ptr(std::move(sub_ptr)) { };
+            _sub_ptrs(std::move(sub_ptrs)),
+            _jsCtx_ptr(std::move(jsctx_ptr)) { };
 
         jetstream_message_queue_subscriber_impl(const jetstream_message_queue_subscriber_impl &) = delete;
         jetstream_message_queue_subscriber_impl(jetstream_message_queue_subscriber_impl &&) = default;
@@ -190,9 +402,258 @@ class jetstream_message_queue_subscriber_impl {
 
             assert(sizeof(std::string_view::size_type) >= sizeof(int));
 
+            scoped_timer timer(_stats->codec_time);
+
             return _deserializer({ natsMsg_GetData(msgList.Msgs[0]), 
                                    static_cast<std::string_view::size_type>(natsMsg_GetDataLength(msgList.Msgs[0])) }); 
         }
+
+        /**
+         * @brief Receive one message and pass it to the handler.  The 
+         *        message is acknowledged only if the handler returns, if it 
+         *        throws the message is retried according to the retry policy.
+         *        Messages that can't be deserialized are dead lettered.
+         */
+        template<typename MSG, 
+                 template<typename> typename DESERIALIZER=json_deserializer_impl,
+                 typename HANDLER>
+            requires IsMsg<MSG> and 
+                     MsgDeserializerLike<DESERIALIZER, MSG> and 
+                     std::default_initializable<MSG> and
+                     std::invocable<HANDLER, const MSG &>
+        void process(HANDLER &&handler) {
+
+            static DESERIALIZER<MSG> _deserializer; 
+            
+            natsMsgList msgList = { nullptr, 0 };
+            
+            unique_natsMsgList_ptr_t msgListPtr(&msgList, 
+                                                natsMsgList_Destroy);
+
+            _fetch(msgListPtr);
+
+            natsMsg *nmsg = msgList.Msgs[0];
+
+            MSG msg;
+
+            /* A message that can't be deserialized will never succeed so 
+             * don't bother retrying it */
+            try {
+                scoped_timer timer(_stats->codec_time);
+
+                msg = _deserializer({ natsMsg_GetData(nmsg), 
+                                      static_cast<std::string_view::size_type>(natsMsg_GetDataLength(nmsg)) });
+
+            } catch(const std::exception &e) {
+                _dead_letter(nmsg, std::string("Deserialization failed: ") + e.what());
+                return;
+            }
+
+            try {
+                handler(std::as_const(msg));
+
+            } catch(const std::exception &e) {
+                _retry(nmsg, e.what());
+                return;
+            }
+
+            _ack(nmsg);
+        }
+
+        /**
+         * @brief Receive up to max_batch messages, waiting only for the 
+         *        first, and pass them to the handler together.  The batch is
+         *        acknowledged if the handler returns and retried as a whole if
+         *        it throws, so handlers must tolerate seeing a message again.
+         *        Messages that can't be deserialized are dead lettered and 
+         *        left out of the batch.
+         */
+        template<typename MSG, 
+                 template<typename> typename DESERIALIZER=json_deserializer_impl,
+                 typename HANDLER>
+            requires IsMsg<MSG> and 
+                     MsgDeserializerLike<DESERIALIZER, MSG> and 
+                     std::default_initializable<MSG> and
+                     std::invocable<HANDLER, std::span<const MSG>>
+        void process_batch(HANDLER &&handler, std::size_t max_batch) {
+
+            static DESERIALIZER<MSG> _deserializer; 
+            
+            natsMsgList msgList = { nullptr, 0 };
+            
+            unique_natsMsgList_ptr_t msgListPtr(&msgList, 
+                                                natsMsgList_Destroy);
+
+            _fetch(msgListPtr, static_cast<int>(std::clamp<std::size_t>(max_batch, 1, INT_MAX)));
+
+            std::vector<MSG> msgs;
+            std::vector<natsMsg *> nmsgs;
+
+            msgs.reserve(msgList.Count);
+            nmsgs.reserve(msgList.Count);
+
+            for(int i = 0; i < msgList.Count; ++i) {
+
+                natsMsg *nmsg = msgList.Msgs[i];
+
+                try {
+                    scoped_timer timer(_stats->codec_time);
+
+                    msgs.emplace_back(_deserializer({ natsMsg_GetData(nmsg), 
+                                                      static_cast<std::string_view::size_type>(natsMsg_GetDataLength(nmsg)) }));
+
+                } catch(const std::exception &e) {
+                    _dead_letter(nmsg, std::string("Deserialization failed: ") + e.what());
+                    continue;
+                }
+
+                nmsgs.push_back(nmsg);
+            }
+
+            if(msgs.empty()) {
+                return;
+            }
+
+            try {
+                handler(std::span<const MSG>(msgs));
+
+            } catch(const std::exception &e) {
+
+                for(auto *nmsg : nmsgs) {
+                    _retry(nmsg, e.what());
+                }
+
+                return;
+            }
+
+            for(auto *nmsg : nmsgs) {
+                _ack(nmsg, false);
+            }
+
+            natsConnection_Flush(_conn_ptr.get());
+        }
+
+        /**
+         * @brief Receive up to max_batch messages, waiting only for the 
+         *        first, leaving them unacknowledged until the batch's ack or
+         *        retry is called.  Messages that can't be deserialized are
+         *        dead lettered and left out of the batch.
+         */
+        template<typename MSG, 
+                 template<typename> typename DESERIALIZER=json_deserializer_impl>
+            requires IsMsg<MSG> and 
+                     MsgDeserializerLike<DESERIALIZER, MSG> and 
+                     std::default_initializable<MSG>
+        received_batch<MSG> receive_batch(std::size_t max_batch) {
+
+            static DESERIALIZER<MSG> _deserializer; 
+
+            /* The NATS messages live until the batch has been acknowledged
+             * or retried, wherever that happens */
+            std::shared_ptr<natsMsgList> msgList(new natsMsgList{ nullptr, 0 }, 
+                                                 [](natsMsgList *list) {
+                                                     natsMsgList_Destroy(list);
+                                                     delete list;
+                                                 });
+
+            unique_natsMsgList_ptr_t msgListPtr(msgList.get(), [](natsMsgList *) { });
+
+            const int count = static_cast<int>(std::clamp<std::size_t>(max_batch, 1, INT_MAX));
+
+            /* Replayed messages were acknowledged on the durable consumer
+             * before, they are neither retried nor dead lettered again */
+            const bool replayed = _fetch_replay(msgListPtr, count);
+
+            if(not replayed) {
+                _fetch(msgListPtr, count);
+            }
+
+            received_batch<MSG> batch;
+            auto nmsgs = std::make_shared<std::vector<natsMsg *>>();
+
+            batch.messages.reserve(msgList->Count);
+            nmsgs->reserve(msgList->Count);
+
+            for(int i = 0; i < msgList->Count; ++i) {
+
+                natsMsg *nmsg = msgList->Msgs[i];
+
+                if(nmsg == nullptr) {
+                    continue;
+                }
+
+                try {
+                    scoped_timer timer(_stats->codec_time);
+
+                    batch.messages.emplace_back(_deserializer({ natsMsg_GetData(nmsg), 
+                                                                static_cast<std::string_view::size_type>(natsMsg_GetDataLength(nmsg)) }));
+
+                } catch(const std::exception &e) {
+
+                    if(replayed) {
+                        natsMsg_Ack(nmsg, nullptr);
+                    } else {
+                        _dead_letter(nmsg, std::string("Deserialization failed: ") + e.what());
+                    }
+
+                    continue;
+                }
+
+                batch.last_sequence = std::max(batch.last_sequence, _stream_sequence(nmsg));
+                nmsgs->push_back(nmsg);
+            }
+
+            batch.ack = [this, msgList, nmsgs] {
+
+                for(auto *nmsg : *nmsgs) {
+                    _ack(nmsg, false);
+                }
+
+                natsConnection_Flush(_conn_ptr.get());
+            };
+
+            batch.retry = [this, msgList, nmsgs](const std::string &reason) {
+
+                for(auto *nmsg : *nmsgs) {
+                    _retry(nmsg, reason);
+                }
+            };
+
+            /* Acknowledged on the replay's consumer either way, the next scan
+             * sees the files of a failed one again */
+            if(replayed) {
+                batch.retry = [ack = batch.ack](const std::string &) { ack(); };
+            }
+
+            return batch;
+        }
+
+        /**
+         * @brief Replays the messages of the bound subjects from stream
+         *        sequence on that their durable consumers have already 
+         *        acknowledged, through receive_batch() before any new ones.
+         *
+         * @throws std::runtime_error if the replay can't be set up.
+         */
+        void replay_from(std::uint64_t sequence);
+
+        void set_retry_policy(const retry_policy &policy) {
+            _retry_policy = policy;
+        }
+
+        /**
+         * @brief Also receive from the high and low priority lanes of the
+         *        bound subjects, through the durable consumers 
+         *        "<consumer>-high" and "<consumer>-low" of each bound 
+         *        consumer, sharing the receives by weights while the lanes
+         *        have messages.
+         *
+         * @throws std::runtime_error if a lane's consumer doesn't exist.
+         */
+        void enable_priority_lanes(const priority_weights &weights);
+
+        /* Counters and latencies of this subscriber and its connection */
+        messaging_stats_snapshot stats() const;
 };
 
 
@@ -233,32 +694,58 @@ class jetstream_messaging_service_impl {
         /* TODO see if we can put the concept constraint back on the left */
         auto create_queue_publisher(std::string_view stream, std::string_view consumer, std::string_view subject) -> jetstream_message_queue_publisher_impl; 
         
+        /* Publisher that spreads messages over "<subject>.<k>" for k in 
+         * [0, partitions) using a stable hash of the FID or parent directory */
+        auto create_queue_publisher(std::string_view stream, 
+                                    std::string_view consumer, 
+                                    std::string_view subject,
+                                    std::string_view partitions,
+                                    std::string_view partition_by) -> jetstream_message_queue_publisher_impl; 
         
         auto create_queue_publisher(std::initializer_list<std::string_view> l) -> jetstream_message_queue_publisher_impl {
             
-            [[unlikely]]
-            if(l.size() != 3) {
-                throw std::runtime_error("Invalid number of arguments for creating jetstream publisher");
-            } 
-
             auto v = std::data(l);
-            
-            return create_queue_publisher(v[0], v[1], v[2]); 
+
+            switch(l.size()) {
+                case 3:
+                    return create_queue_publisher(v[0], v[1], v[2]); 
+
+                case 5:
+                    return create_queue_publisher(v[0], v[1], v[2], v[3], v[4]); 
+
+                [[unlikely]]
+                default:
+                    throw std::runtime_error("Invalid number of arguments for creating jetstream publisher");
+            }
         }
 
         auto create_queue_subscriber(std::string_view stream, std::string_view consumer, std::string_view subject) -> jetstream_message_queue_subscriber_impl;
 
+        /* Subscriber bound to the partitions in the inclusive range 
+         * "first-last" of a partitioned subject.  Each partition k is pulled
+         * through the durable consumer "<consumer>-<k>". */
+        auto create_queue_subscriber(std::string_view stream, 
+                                     std::string_view consumer, 
+                                     std::string_view subject,
+                                     std::string_view partitions,
+                                     std::string_view partition_range) -> jetstream_message_queue_subscriber_impl;
 
-        auto create_queue_subscriber(std::initializer_list<std::string_view> l) -> jetstream_message_queue_subscriber_impl {
 
-            [[unlikely]]
-            if(l.size() != 3) {
-                throw std::runtime_error("Invalid number of arguments for creating jetstream subscriber");
-            } 
+        auto create_queue_subscriber(std::initializer_list<std::string_view> l) -> jetstream_message_queue_subscriber_impl {
 
             auto v = std::data(l);
 
-            return create_queue_subscriber(v[0], v[1], v[2]); 
+            switch(l.size()) {
+                case 3:
+                    return create_queue_subscriber(v[0], v[1], v[2]); 
+
+                case 5:
+                    return create_queue_subscriber(v[0], v[1], v[2], v[3], v[4]); 
+
+                [[unlikely]]
+                default:
+                    throw std::runtime_error("Invalid number of arguments for creating jetstream subscriber");
+            }
         }
 };
 
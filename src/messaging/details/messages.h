@@ -11,10 +11,12 @@
 #ifndef __MESSAGES_H__
 #define __MESSAGES_H__
 
+#include <cstdint>
 #include <chrono>
 #include <string_view>
 #include <string>
 #include <iostream>
+#include <vector>
 
 
 /* Top level message class that exists currently just for tagging the message
@@ -28,7 +30,8 @@ concept IsMsg = std::derived_from<MsgImpl, message_tag>;
 
 struct scan_message : public message_tag {
 
-    scan_message() : size(0), uid(0), gid(0), stripe_count(0), type(0) { }
+    scan_message() : size(0), uid(0), gid(0), stripe_count(0), type(0), 
+                     sampled(false), probe(0), weight(1.0), deleted(false) { }
 
     scan_message(const scan_message& other) = default;
     scan_message(scan_message&& other) = default;
@@ -53,6 +56,27 @@ struct scan_message : public message_tag {
     std::string fid;
 
     char type;
+
+    /* Set on records of a sampling scan.  Each stands for weight records of
+     * the namespace, so sums of weights estimate the totals of a full scan,
+     * and probe numbers the sampler's independent descents from 1 so the
+     * spread of their totals gives the error of an estimate */
+    bool sampled;
+    std::uint32_t probe;
+    double weight;
+
+    /* Set on the records a change filtering scan sends for files that are
+     * gone, only the type, filesys and fid of those are known */
+    bool deleted;
+};
+
+
+/* How urgently an action has to reach its agents.  It isn't part of the
+ * message's JSON, the queue it is sent on carries it */
+enum class message_priority : std::uint8_t {
+    HIGH = 0,
+    NORMAL = 1,
+    LOW = 2,
 };
 
 
@@ -72,14 +96,19 @@ struct purge_message : public message_tag {
 
     /* Properties */ 
     std::string path;
+
+    /* Further paths sent in the same message, handled together with path */
+    std::vector<std::string> paths;
+
+    message_priority priority = message_priority::NORMAL;
 };
 
 
 struct migration_message : public message_tag {
 
     
-    migration_message() = default;
-    migration_message(std::string_view sv) : path(sv) { }
+    migration_message() : stripe_count(0) { }
+    migration_message(std::string_view sv) : path(sv), stripe_count(0) { }
 
     migration_message(const migration_message&) = default;
     migration_message(migration_message &&) = default;
@@ -91,13 +120,24 @@ struct migration_message : public message_tag {
 
     /* Properties */ 
     std::string path;
+
+    /* Further paths sent in the same message, migrated to the same layout */
+    std::vector<std::string> paths;
+
+    /* Layout chosen by the policy engine, an empty pool leaves it to the
+     * migration agent and no OSTs leaves their choice to Lustre */
+    std::string pool;
+    std::uint64_t stripe_count;
+    std::vector<std::uint32_t> osts;
+
+    message_priority priority = message_priority::NORMAL;
 };
 
 struct recorder_message : public message_tag {
 
 
     recorder_message(): size(0), uid(0), gid(0), 
-                        stripe_count(0), type(0) { }
+                        stripe_count(0), type(0), deleted(false) { }
 
     recorder_message(const recorder_message&) = default;
     recorder_message(recorder_message &&) = default;
@@ -121,6 +161,9 @@ struct recorder_message : public message_tag {
     std::string fid;
 
     char type;
+
+    /* A file a change filtering scan found gone, see scan_message */
+    bool deleted;
 };
 
 
@@ -11,8 +11,18 @@
 #pragma once
 
 #include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "./messages.h"
+#include "./priority_lanes.h"
+#include "./retry_policy.h"
+#include "./messaging_stats.h"
 
 
 /* All supported messaging_service services must be listed here */
@@ -23,6 +33,31 @@ enum class messaging_services {
 
 
 
+/**
+ * @brief Messages received together whose acknowledgement is left to the
+ *        caller, so they can be processed and acknowledged on other threads.
+ *        Exactly one of ack or retry should be called once processing is
+ *        done, from any thread, while the subscriber is still alive.
+ */
+template<typename MSG>
+struct received_batch {
+
+    std::vector<MSG> messages;
+
+    /* Highest stream sequence number in the batch, 0 if the service has
+     * none */
+    std::uint64_t last_sequence = 0;
+
+    /* Acknowledges every message in the batch */
+    std::function<void()> ack = [] { };
+
+    /* Hands every message back for redelivery, or dead letters the ones
+     * that have run out of deliveries */
+    std::function<void(const std::string &reason)> retry = [](const std::string &) { };
+};
+
+
+
 template<typename MsgPublisherImpl>
 concept MsgPublisher = requires(MsgPublisherImpl impl,
                                 const scan_message &scan_msg,
@@ -39,12 +74,22 @@ concept MsgPublisher = requires(MsgPublisherImpl impl,
     { impl.template send<purge_message>(purge_msg) } -> std::same_as<void>;
     { impl.template send<migration_message>(migration_msg) } -> std::same_as<void>;
     { impl.template send<recorder_message>(record_msg) } -> std::same_as<void>;
+
+    { impl.enable_spool(std::string_view{}, std::size_t{}) } -> std::same_as<void>;
+    { impl.enable_priority_lanes() } -> std::same_as<void>;
+
+    { impl.stats() } -> std::same_as<messaging_stats_snapshot>;
 };
 
 
 
 template<typename MsgSubscriberImpl>
-concept MsgSubscriber = requires(MsgSubscriberImpl impl) {
+concept MsgSubscriber = requires(MsgSubscriberImpl impl,
+                                 void (*scan_handler)(const scan_message &),
+                                 void (*purge_handler)(const purge_message &),
+                                 void (*migration_handler)(const migration_message &),
+                                 void (*scan_batch_handler)(std::span<const scan_message>),
+                                 const retry_policy &policy) {
        
     requires IsMsg<scan_message>;
     requires IsMsg<purge_message>;
@@ -53,6 +98,19 @@ concept MsgSubscriber = requires(MsgSubscriberImpl impl) {
     {  impl.template receive<purge_message>() } -> std::same_as<purge_message>;
     {  impl.template receive<migration_message>() } -> std::same_as<migration_message>;
     {  impl.template receive<recorder_message>() } -> std::same_as<recorder_message>;
+
+    {  impl.template process<scan_message>(scan_handler) } -> std::same_as<void>;
+    {  impl.template process<purge_message>(purge_handler) } -> std::same_as<void>;
+    {  impl.template process<migration_message>(migration_handler) } -> std::same_as<void>;
+
+    {  impl.template process_batch<scan_message>(scan_batch_handler, std::size_t{}) } -> std::same_as<void>;
+    {  impl.template receive_batch<scan_message>(std::size_t{}) } -> std::same_as<received_batch<scan_message>>;
+
+    {  impl.set_retry_policy(policy) } -> std::same_as<void>;
+    {  impl.replay_from(std::uint64_t{}) } -> std::same_as<void>;
+    {  impl.enable_priority_lanes(default_priority_weights) } -> std::same_as<void>;
+
+    {  impl.stats() } -> std::same_as<messaging_stats_snapshot>;
 };
 
 template<typename MsgServiceImpl> 
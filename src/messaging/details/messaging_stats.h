@@ -0,0 +1,276 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+
+/**
+ * @brief Point in time copy of a latency_histogram.
+ */
+struct histogram_snapshot {
+
+    std::uint64_t count = 0;
+    std::uint64_t sum = 0;
+    std::uint64_t max = 0;
+
+    std::vector<std::uint64_t> buckets;
+
+    /* Lower bound of the value of the bucket */
+    static std::uint64_t bucket_value(std::size_t index);
+
+    /**
+     * @brief Value at or below which the fraction q of the recorded values
+     *        fall, e.g. q = 0.99 for the 99th percentile.  Accurate to the
+     *        bucket width, about 3%.
+     */
+    std::uint64_t quantile(double q) const {
+
+        if(count == 0) {
+            return 0;
+        }
+
+        auto rank = static_cast<std::uint64_t>(q * (count - 1)) + 1;
+        std::uint64_t seen = 0;
+
+        for(std::size_t i = 0; i < buckets.size(); ++i) {
+
+            seen += buckets[i];
+
+            if(seen >= rank) {
+                return std::min(bucket_value(i), max);
+            }
+        }
+
+        return max;
+    }
+
+    std::uint64_t mean() const {
+        return (count == 0) ? 0 : sum / count;
+    }
+};
+
+
+/**
+ * @brief Lock free log-linear (HDR style) histogram of nanosecond values.
+ *
+ * Values below 2^sub_bucket_bits are counted exactly, above that each power
+ * of two is split into 2^(sub_bucket_bits - 1) linear buckets so the
+ * relative error is bounded by 2^-(sub_bucket_bits - 1) across the whole
+ * 64-bit range.  Recording is a few relaxed atomic adds.
+ */
+class latency_histogram {
+
+    public:
+        static constexpr unsigned sub_bucket_bits = 6;
+        static constexpr std::size_t sub_bucket_half = std::size_t(1) << (sub_bucket_bits - 1);
+        static constexpr std::size_t num_buckets =
+            (64 - sub_bucket_bits + 1) * sub_bucket_half + sub_bucket_half;
+
+        static constexpr std::size_t bucket_index(std::uint64_t value) {
+
+            if(value < (std::uint64_t(1) << sub_bucket_bits)) {
+                return value;
+            }
+
+            unsigned shift = std::bit_width(value) - sub_bucket_bits;
+
+            return shift * sub_bucket_half + (value >> shift);
+        }
+
+        static constexpr std::uint64_t bucket_value(std::size_t index) {
+
+            if(index < (std::size_t(1) << sub_bucket_bits)) {
+                return index;
+            }
+
+            std::size_t shift = index / sub_bucket_half - 1;
+
+            return static_cast<std::uint64_t>(index - shift * sub_bucket_half) << shift;
+        }
+
+    private:
+        std::array<std::atomic<std::uint64_t>, num_buckets> _buckets{};
+        std::atomic<std::uint64_t> _count{0};
+        std::atomic<std::uint64_t> _sum{0};
+        std::atomic<std::uint64_t> _max{0};
+
+    public:
+        void record(std::uint64_t value) {
+
+            _buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+            _count.fetch_add(1, std::memory_order_relaxed);
+            _sum.fetch_add(value, std::memory_order_relaxed);
+
+            auto max = _max.load(std::memory_order_relaxed);
+
+            while(value > max and
+                  not _max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+        }
+
+        void record(std::chrono::nanoseconds duration) {
+            record(static_cast<std::uint64_t>(std::max<std::int64_t>(0, duration.count())));
+        }
+
+        histogram_snapshot snapshot() const {
+
+            histogram_snapshot snap;
+
+            snap.buckets.resize(num_buckets);
+
+            for(std::size_t i = 0; i < num_buckets; ++i) {
+                snap.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+                snap.count += snap.buckets[i];
+            }
+
+            snap.sum = _sum.load(std::memory_order_relaxed);
+            snap.max = _max.load(std::memory_order_relaxed);
+
+            return snap;
+        }
+};
+
+
+inline std::uint64_t histogram_snapshot::bucket_value(std::size_t index) {
+    return latency_histogram::bucket_value(index);
+}
+
+
+/* Counters reported by the NATS connection */
+struct connection_stats {
+    std::uint64_t in_msgs = 0;
+    std::uint64_t in_bytes = 0;
+    std::uint64_t out_msgs = 0;
+    std::uint64_t out_bytes = 0;
+    std::uint64_t reconnects = 0;
+};
+
+
+/**
+ * @brief Snapshot of the statistics of a publisher or subscriber.  Latencies
+ *        are in nanoseconds.
+ */
+struct messaging_stats_snapshot {
+
+    std::uint64_t messages = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t retries = 0;
+    std::uint64_t errors = 0;
+
+    /* Subscribers only */
+    std::uint64_t naks = 0;
+    std::uint64_t dead_lettered = 0;
+
+    /* Publish to ack for publishers, fetch for subscribers */
+    histogram_snapshot latency;
+
+    /* Serialize for publishers, deserialize for subscribers */
+    histogram_snapshot codec_time;
+
+    connection_stats connection;
+};
+
+
+/**
+ * @brief Statistics kept by each publisher and subscriber.  All updates are
+ *        relaxed atomics so they are safe to make from any thread.
+ */
+struct messaging_stats {
+
+    std::atomic<std::uint64_t> messages{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> retries{0};
+    std::atomic<std::uint64_t> errors{0};
+    std::atomic<std::uint64_t> naks{0};
+    std::atomic<std::uint64_t> dead_lettered{0};
+
+    latency_histogram latency;
+    latency_histogram codec_time;
+
+    void count_message(std::size_t size) {
+        messages.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    messaging_stats_snapshot snapshot() const {
+
+        messaging_stats_snapshot snap;
+
+        snap.messages = messages.load(std::memory_order_relaxed);
+        snap.bytes = bytes.load(std::memory_order_relaxed);
+        snap.retries = retries.load(std::memory_order_relaxed);
+        snap.errors = errors.load(std::memory_order_relaxed);
+        snap.naks = naks.load(std::memory_order_relaxed);
+        snap.dead_lettered = dead_lettered.load(std::memory_order_relaxed);
+        snap.latency = latency.snapshot();
+        snap.codec_time = codec_time.snapshot();
+
+        return snap;
+    }
+};
+
+
+/* Times a scope into a histogram */
+class scoped_timer {
+
+    private:
+        latency_histogram &_histogram;
+        std::chrono::steady_clock::time_point _start;
+
+    public:
+        explicit scoped_timer(latency_histogram &histogram):
+            _histogram(histogram), _start(std::chrono::steady_clock::now()) { }
+
+        scoped_timer(const scoped_timer &) = delete;
+        scoped_timer &operator=(const scoped_timer &) = delete;
+
+        ~scoped_timer() {
+            _histogram.record(std::chrono::steady_clock::now() - _start);
+        }
+};
+
+
+inline std::ostream &operator<<(std::ostream &os, const histogram_snapshot &h) {
+
+    return os << "count=" << h.count
+              << " mean=" << h.mean() / 1000 << "us"
+              << " p50=" << h.quantile(0.50) / 1000 << "us"
+              << " p99=" << h.quantile(0.99) / 1000 << "us"
+              << " max=" << h.max / 1000 << "us";
+}
+
+
+inline std::ostream &operator<<(std::ostream &os, const messaging_stats_snapshot &s) {
+
+    os << "messages=" << s.messages
+       << " bytes=" << s.bytes
+       << " retries=" << s.retries
+       << " errors=" << s.errors;
+
+    if(s.naks > 0 or s.dead_lettered > 0) {
+        os << " naks=" << s.naks << " dead_lettered=" << s.dead_lettered;
+    }
+
+    os << " latency[" << s.latency << "]"
+       << " codec[" << s.codec_time << "]"
+       << " connection[in_msgs=" << s.connection.in_msgs
+       << " out_msgs=" << s.connection.out_msgs
+       << " reconnects=" << s.connection.reconnects << "]";
+
+    return os;
+}
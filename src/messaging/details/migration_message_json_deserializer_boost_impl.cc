@@ -57,6 +57,40 @@ object_handler _migration_message_object_handler = { {
             msg.path = value;
         }),
     },  
+    {
+        std::string("paths"),
+        value_handler(
+            std::in_place_type<array_handler>,
+            value_handler(
+                std::in_place_type<string_handler>,
+                [](string_view value, migration_message &msg) {
+                    msg.paths.emplace_back(value.data(), value.size());
+                }))
+    },
+    {
+        std::string("pool"), 
+        value_handler([](string_view value, migration_message &msg) noexcept {
+            msg.pool = value;
+        }),
+    },
+    {
+        std::string("stripe_count"),
+        value_handler(
+            std::in_place_type<integer_handler>,
+            [](std::uint64_t value, migration_message &msg) noexcept {
+                msg.stripe_count = value;
+            })
+    },
+    {
+        std::string("osts"),
+        value_handler(
+            std::in_place_type<array_handler>,
+            value_handler(
+                std::in_place_type<integer_handler>,
+                [](std::uint64_t value, migration_message &msg) {
+                    msg.osts.push_back(static_cast<std::uint32_t>(value));
+                }))
+    },
     
 } };
 
@@ -10,6 +10,7 @@
 
 
 
+#include <cinttypes>
 #include <string>
 #include <string_view>
 #include <cstdio>
@@ -20,19 +21,81 @@
 #include "./messages.h"
 #include "./message_json_serializer_boost_impl.h"
 
+
+/* The further paths as the elements of a JSON array */
+static std::string _path_list(const migration_message &msg) {
+
+    std::string list;
+
+    for(const auto &path : msg.paths) {
+
+        if(not list.empty()) {
+            list += ", ";
+        }
+
+        list += "\"" + path + "\"";
+    }
+
+    return list;
+}
+
+
+/* The OST indices as the elements of a JSON array */
+static std::string _ost_list(const migration_message &msg) {
+
+    std::string list;
+
+    for(auto ost : msg.osts) {
+
+        if(not list.empty()) {
+            list += ", ";
+        }
+
+        list += std::to_string(ost);
+    }
+
+    return list;
+}
+
+
 template<>
 std::string_view 
 json_serializer_impl<migration_message>::operator()(
         const migration_message &msg, 
         const std::string_view buffer) const {
 
-    /* Write the data to a buffer */
-    int rc = snprintf(const_cast<char *>(buffer.data()),
+    /* The further paths only if there are any */
+    auto paths = msg.paths.empty() ? std::string() : ", \"paths\": [" + _path_list(msg) + "]";
+
+    int rc;
+
+    /* Write the data to a buffer, the layout only if one was chosen */
+    if(msg.pool.empty() and msg.stripe_count == 0 and msg.osts.empty()) {
+
+        rc = snprintf(const_cast<char *>(buffer.data()),
                       buffer.size(), 
                       "{ "
-                        "\"path\": \"%s\" "
+                        "\"path\": \"%s\"%s "
                       "}",
-                      msg.path.c_str());
+                      msg.path.c_str(),
+                      paths.c_str());
+
+    } else {
+
+        rc = snprintf(const_cast<char *>(buffer.data()),
+                      buffer.size(), 
+                      "{ "
+                        "\"path\": \"%s\"%s, "
+                        "\"pool\": \"%s\", "
+                        "\"stripe_count\": %" PRIu64 ", "
+                        "\"osts\": [%s] "
+                      "}",
+                      msg.path.c_str(),
+                      paths.c_str(),
+                      msg.pool.c_str(),
+                      msg.stripe_count,
+                      _ost_list(msg).c_str());
+    }
 
     /* Error serializing the message */
     if(rc < 0) {
@@ -58,7 +121,18 @@ json_serializer_impl<migration_message>::operator()(const migration_message& msg
 
   std::stringstream buffer;
 
-  buffer << "{ \"path\": \"" << msg.path << "\" }";
+  buffer << "{ \"path\": \"" << msg.path << "\"";
+
+  if(not msg.paths.empty()) {
+      buffer << ", \"paths\": [" << _path_list(msg) << "]";
+  }
+
+  if(not msg.pool.empty() or msg.stripe_count != 0 or not msg.osts.empty()) {
+      buffer << ", \"pool\": \"" << msg.pool << "\", \"stripe_count\": " << msg.stripe_count 
+             << ", \"osts\": [" << _ost_list(msg) << "]";
+  }
+
+  buffer << " }";
   
   return buffer.str();
 }
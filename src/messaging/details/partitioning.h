@@ -0,0 +1,194 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "./messages.h"
+
+
+/* What part of a message is hashed to select the partition of a subject */
+enum class partition_by {
+    FID,
+    PARENT_DIRECTORY,
+};
+
+
+/**
+ * @brief Stable 64-bit FNV-1a hash.  This must never change since publishers
+ *        and subscribers running different builds have to agree on which
+ *        partition a key lands on.
+ *
+ * @param key Bytes to hash.
+ * @return std::uint64_t
+ */
+constexpr std::uint64_t stable_hash(std::string_view key) noexcept {
+
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for(unsigned char c : key) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+
+/**
+ * @brief Returns the parent directory portion of a path without the trailing
+ *        separator, i.e. "/a/b/c" -> "/a/b".
+ */
+constexpr std::string_view parent_directory(std::string_view path) noexcept {
+
+    auto pos = path.find_last_of('/');
+
+    if(pos == std::string_view::npos) {
+        return {};
+    }
+
+    return path.substr(0, (pos == 0) ? 1 : pos);
+}
+
+
+/* Scan records carry a FID so use it when asked, otherwise hash the parent */
+inline std::string_view partition_key(const scan_message &msg,
+                                      partition_by by) noexcept {
+    return (by == partition_by::FID and not msg.fid.empty()) ?
+                std::string_view(msg.fid) : parent_directory(msg.path);
+}
+
+inline std::string_view partition_key(const recorder_message &msg,
+                                      partition_by by) noexcept {
+    return (by == partition_by::FID and not msg.fid.empty()) ?
+                std::string_view(msg.fid) : parent_directory(msg.path);
+}
+
+/* Action messages only have a path so they are always partitioned by the
+ * parent directory */
+template<typename MSG>
+    requires IsMsg<MSG> and requires(const MSG &msg) { msg.path; }
+std::string_view partition_key(const MSG &msg, partition_by) noexcept {
+    return parent_directory(msg.path);
+}
+
+
+/**
+ * @brief Parse the partition_by property from the config or command line.
+ *
+ * @throws std::invalid_argument if the value is not fid or parent.
+ */
+inline partition_by parse_partition_by(std::string_view sv) {
+
+    if(sv == "fid") {
+        return partition_by::FID;
+
+    } else if(sv == "parent" or sv == "parent_directory") {
+        return partition_by::PARENT_DIRECTORY;
+    }
+
+    throw std::invalid_argument(std::string("Invalid partition_by: ") +
+                                std::string(sv));
+}
+
+
+/**
+ * @brief Parse the number of partitions of a subject.
+ *
+ * @throws std::invalid_argument if it isn't a number of at least 1.
+ */
+inline std::uint32_t parse_partitions(std::string_view sv) {
+
+    std::uint32_t partitions = 0;
+
+    auto [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), partitions);
+
+    if(ec != std::errc() or ptr != sv.data() + sv.size() or partitions == 0) {
+        throw std::invalid_argument(std::string("Invalid number of partitions: ") + 
+                                    std::string(sv));
+    }
+
+    return partitions;
+}
+
+
+/**
+ * @brief The range of every partition of a subject with partitions 
+ *        partitions, "0-<partitions - 1>".
+ *
+ * @throws std::invalid_argument if partitions isn't a number of at least 1.
+ */
+inline std::string full_partition_range(std::string_view partitions) {
+    return "0-" + std::to_string(parse_partitions(partitions) - 1);
+}
+
+
+/**
+ * @brief Parse a partition range of the form "first-last" or a single
+ *        partition "k" and return the inclusive range.
+ *
+ * @throws std::invalid_argument if the range is malformed or falls outside
+ *         of [0, partitions).
+ */
+inline std::pair<std::uint32_t, std::uint32_t>
+parse_partition_range(std::string_view sv, std::uint32_t partitions) {
+
+    auto to_uint = [sv](std::string_view part) -> std::uint32_t {
+
+        std::uint32_t value = 0;
+        auto [ptr, ec] = std::from_chars(part.data(),
+                                         part.data() + part.size(),
+                                         value);
+
+        if(ec != std::errc() or ptr != part.data() + part.size()) {
+            throw std::invalid_argument(std::string("Invalid partition range: ") +
+                                        std::string(sv));
+        }
+
+        return value;
+    };
+
+    auto pos = sv.find('-');
+
+    std::uint32_t first = to_uint(sv.substr(0, pos));
+    std::uint32_t last = (pos == std::string_view::npos) ?
+                            first : to_uint(sv.substr(pos + 1));
+
+    if(first > last or last >= partitions) {
+        throw std::invalid_argument(std::string("Invalid partition range: ") +
+                                    std::string(sv));
+    }
+
+    return { first, last };
+}
+
+
+/**
+ * @brief Builds the list of partitioned subjects "<subject>.<k>".
+ */
+inline std::vector<std::string> partition_subjects(std::string_view subject,
+                                                   std::uint32_t partitions) {
+
+    std::vector<std::string> subjects;
+    subjects.reserve(partitions);
+
+    for(std::uint32_t k = 0; k < partitions; ++k) {
+        subjects.emplace_back(std::string(subject) + "." + std::to_string(k));
+    }
+
+    return subjects;
+}
@@ -14,7 +14,17 @@
 #include <sys/stat.h>
 #include <mqueue.h>
 
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
 #include "./messaging_common.h"
+#include "./retry_policy.h"
+#include "./messaging_stats.h"
 #include "./message_json_serializer_boost_impl.h"
 #include "./message_json_deserializer_boost_impl.h"
 
@@ -24,6 +34,19 @@ class posix_message_queue_publisher_impl {
 
     private:
         mqd_t _mqd = -1;
+        std::unique_ptr<messaging_stats> _stats = std::make_unique<messaging_stats>();
+
+        /* A POSIX queue always delivers its most urgent message first, so 
+         * the message's priority is the queue's */
+        template<typename MSG>
+        static unsigned int _mq_priority(const MSG &msg) {
+
+            if constexpr (HasPriority<MSG>) {
+                return 2 - static_cast<unsigned int>(msg.priority);
+            }
+
+            return 1;
+        }
 
     public:
 
@@ -34,12 +57,14 @@ class posix_message_queue_publisher_impl {
 
         posix_message_queue_publisher_impl(posix_message_queue_publisher_impl &&other) {
             std::swap(this->_mqd, other._mqd);
+            std::swap(this->_stats, other._stats);
         }
 
         posix_message_queue_publisher_impl &operator=(const posix_message_queue_publisher_impl &) = delete;
 
         posix_message_queue_publisher_impl &operator=(posix_message_queue_publisher_impl &&other) {
             std::swap(this->_mqd, other._mqd);
+            std::swap(this->_stats, other._stats);
             return *this;
         }
 
@@ -60,15 +85,39 @@ class posix_message_queue_publisher_impl {
             static SERIALIZER<MSG> serializer;
             char buffer[8192];
 
-            auto sv = serializer(msg, { buffer, sizeof(buffer) } );
+            std::string_view sv;
 
-            int rc = mq_send(this->_mqd, sv.data(), sv.size(), 1);
+            {
+                scoped_timer timer(_stats->codec_time);
+                sv = serializer(msg, { buffer, sizeof(buffer) } );
+            }
+
+            int rc;
+
+            {
+                scoped_timer timer(_stats->latency);
+                rc = mq_send(this->_mqd, sv.data(), sv.size(), _mq_priority(msg));
+            }
 
             switch(rc) {
                 case -1:
+                    _stats->errors.fetch_add(1, std::memory_order_relaxed);
                     throw std::system_error(errno, std::generic_category());
             }
+
+            _stats->count_message(sv.size());
+        }
+
+        messaging_stats_snapshot stats() const {
+            return _stats->snapshot();
         }
+
+        /* POSIX message queues are local to the host and always available so
+         * there is nothing to spool */
+        void enable_spool(std::string_view, std::size_t) { }
+
+        /* Every POSIX message is sent with its priority already */
+        void enable_priority_lanes() { }
 };
 
 class posix_message_queue_subscriber_impl {
@@ -77,6 +126,51 @@ class posix_message_queue_subscriber_impl {
 
     private:
         mqd_t _mqd = -1;
+        std::unique_ptr<messaging_stats> _stats = std::make_unique<messaging_stats>();
+
+        /* Receives one message into buf and returns its size */
+        std::string_view::size_type _receive(char *buf, std::size_t size) {
+
+            ssize_t msg_size;
+
+            {
+                scoped_timer timer(_stats->latency);
+                msg_size = mq_receive(this->_mqd, buf, size, NULL);
+            }
+
+            if(msg_size == -1) {
+                _stats->errors.fetch_add(1, std::memory_order_relaxed);
+                throw std::system_error(errno, std::generic_category());
+            }
+
+            _stats->count_message(msg_size);
+
+            return static_cast<std::string_view::size_type>(msg_size);
+        }
+
+        /* Receives one message into buf if one is queued, never blocks */
+        std::optional<std::string_view::size_type> _try_receive(char *buf, std::size_t size) {
+
+            /* An absolute timeout in the past makes the receive return 
+             * straight away when the queue is empty */
+            struct timespec expired = { 0, 0 };
+
+            ssize_t msg_size = mq_timedreceive(this->_mqd, buf, size, NULL, &expired);
+
+            if(msg_size == -1) {
+
+                if(errno == ETIMEDOUT or errno == EAGAIN) {
+                    return std::nullopt;
+                }
+
+                _stats->errors.fetch_add(1, std::memory_order_relaxed);
+                throw std::system_error(errno, std::generic_category());
+            }
+
+            _stats->count_message(msg_size);
+
+            return static_cast<std::string_view::size_type>(msg_size);
+        }
 
     public:
 
@@ -87,12 +181,14 @@ class posix_message_queue_subscriber_impl {
 
         posix_message_queue_subscriber_impl(posix_message_queue_subscriber_impl &&other) {
             std::swap(this->_mqd, other._mqd);
+            std::swap(this->_stats, other._stats);
         }
 
         posix_message_queue_subscriber_impl &operator=(const posix_message_queue_subscriber_impl &) = delete;
 
         posix_message_queue_subscriber_impl &operator=(posix_message_queue_subscriber_impl &&other) {
             std::swap(this->_mqd, other._mqd);
+            std::swap(this->_stats, other._stats);
 
             return *this;
         }
@@ -117,20 +213,161 @@ class posix_message_queue_subscriber_impl {
             /* TODO page align this. find maximum message size and queue size */
             char buf[8192];
 
+            auto msg_size = _receive(buf, sizeof(buf));
 
-            ssize_t msg_size = mq_receive(this->_mqd, buf, sizeof(buf), NULL);
+            scoped_timer timer(_stats->codec_time);
 
-            switch(msg_size) {
+            return _deserializer( { buf, msg_size } );
+       }
 
-                case -1:
-                    throw std::system_error(errno, std::generic_category());
+        /**
+         * @brief Receive one message and pass it to the handler.  POSIX 
+         *        message queues can't redeliver a message so failures are 
+         *        logged and the message dropped.
+         */
+        template<typename MSG, 
+                 template<typename> typename DESERIALIZER=json_deserializer_impl,
+                 typename HANDLER>
+            requires IsMsg<MSG> and 
+                     MsgDeserializerLike<DESERIALIZER, MSG> and 
+                     std::default_initializable<MSG> and
+                     std::invocable<HANDLER, const MSG &>
+        void process(HANDLER &&handler) {
+
+            static DESERIALIZER<MSG> _deserializer; 
+            
+            char buf[8192];
+
+            auto msg_size = _receive(buf, sizeof(buf));
+
+            MSG msg;
+
+            try {
+                {
+                    scoped_timer timer(_stats->codec_time);
+                    msg = _deserializer( { buf, msg_size } );
+                }
+
+                handler(std::as_const(msg));
 
-                default:
-                    return _deserializer( { 
-                        buf, 
-                        static_cast<std::string_view::size_type>(msg_size) } );
+            } catch(const std::exception &e) {
+                _stats->errors.fetch_add(1, std::memory_order_relaxed);
+                std::clog << "Posix subscriber: dropping message: " 
+                          << e.what() << std::endl;
             }
-       }
+        }
+
+        /**
+         * @brief Receive up to max_batch messages, waiting only for the 
+         *        first, and pass them to the handler together.  As with 
+         *        process() failures are logged and the messages dropped.
+         */
+        template<typename MSG, 
+                 template<typename> typename DESERIALIZER=json_deserializer_impl,
+                 typename HANDLER>
+            requires IsMsg<MSG> and 
+                     MsgDeserializerLike<DESERIALIZER, MSG> and 
+                     std::default_initializable<MSG> and
+                     std::invocable<HANDLER, std::span<const MSG>>
+        void process_batch(HANDLER &&handler, std::size_t max_batch) {
+
+            static DESERIALIZER<MSG> _deserializer; 
+            
+            char buf[8192];
+
+            std::vector<MSG> msgs;
+
+            std::optional<std::string_view::size_type> msg_size = _receive(buf, sizeof(buf));
+
+            while(msg_size) {
+
+                try {
+                    scoped_timer timer(_stats->codec_time);
+                    msgs.emplace_back(_deserializer( { buf, *msg_size } ));
+
+                } catch(const std::exception &e) {
+                    _stats->errors.fetch_add(1, std::memory_order_relaxed);
+                    std::clog << "Posix subscriber: dropping message: " 
+                              << e.what() << std::endl;
+                }
+
+                msg_size = (msgs.size() < max_batch) ? 
+                    _try_receive(buf, sizeof(buf)) : std::nullopt;
+            }
+
+            if(msgs.empty()) {
+                return;
+            }
+
+            try {
+                handler(std::span<const MSG>(msgs));
+
+            } catch(const std::exception &e) {
+                _stats->errors.fetch_add(1, std::memory_order_relaxed);
+                std::clog << "Posix subscriber: dropping " << msgs.size() 
+                          << " messages: " << e.what() << std::endl;
+            }
+        }
+
+        /**
+         * @brief Receive up to max_batch messages, waiting only for the 
+         *        first.  POSIX message queues have no acknowledgements so 
+         *        acking does nothing and retrying logs and drops the batch.
+         */
+        template<typename MSG, 
+                 template<typename> typename DESERIALIZER=json_deserializer_impl>
+            requires IsMsg<MSG> and 
+                     MsgDeserializerLike<DESERIALIZER, MSG> and 
+                     std::default_initializable<MSG>
+        received_batch<MSG> receive_batch(std::size_t max_batch) {
+
+            static DESERIALIZER<MSG> _deserializer; 
+            
+            char buf[8192];
+
+            received_batch<MSG> batch;
+
+            std::optional<std::string_view::size_type> msg_size = _receive(buf, sizeof(buf));
+
+            while(msg_size) {
+
+                try {
+                    scoped_timer timer(_stats->codec_time);
+                    batch.messages.emplace_back(_deserializer( { buf, *msg_size } ));
+
+                } catch(const std::exception &e) {
+                    _stats->errors.fetch_add(1, std::memory_order_relaxed);
+                    std::clog << "Posix subscriber: dropping message: " 
+                              << e.what() << std::endl;
+                }
+
+                msg_size = (batch.messages.size() < max_batch) ? 
+                    _try_receive(buf, sizeof(buf)) : std::nullopt;
+            }
+
+            batch.retry = [stats = _stats.get(), count = batch.messages.size()](const std::string &reason) {
+                stats->errors.fetch_add(1, std::memory_order_relaxed);
+                std::clog << "Posix subscriber: dropping " << count 
+                          << " messages: " << reason << std::endl;
+            };
+
+            return batch;
+        }
+
+        messaging_stats_snapshot stats() const {
+            return _stats->snapshot();
+        }
+
+        /* No redelivery with POSIX message queues so there is nothing to 
+         * configure */
+        void set_retry_policy(const retry_policy &) { }
+
+        /* POSIX message queues keep no history to replay */
+        void replay_from(std::uint64_t) { }
+
+        /* mq_receive() takes the most urgent message first, strictly rather
+         * than by weights */
+        void enable_priority_lanes(const priority_weights &) { }
 };
 
 
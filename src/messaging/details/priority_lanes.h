@@ -0,0 +1,184 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "./messages.h"
+
+
+/* The lanes of a queue from the most to the least urgent */
+constexpr std::array<message_priority, 3> message_priorities = {
+    message_priority::HIGH,
+    message_priority::NORMAL,
+    message_priority::LOW,
+};
+
+
+/* Share of the receives each lane gets while all of them have messages,
+ * indexed by message_priority */
+using priority_weights = std::array<std::uint32_t, 3>;
+
+constexpr priority_weights default_priority_weights = { 8, 2, 1 };
+
+
+/* Whether a message type carries a priority */
+template<typename MSG>
+concept HasPriority = requires(const MSG &msg) {
+    { msg.priority } -> std::convertible_to<message_priority>;
+};
+
+
+/**
+ * @brief The subject of a lane of subject.  Normal messages stay on subject
+ *        so queues without lanes keep working, "<subject>.high" and
+ *        "<subject>.low" carry the others.
+ */
+inline std::string lane_subject(std::string_view subject, message_priority priority) {
+
+    switch(priority) {
+        case message_priority::HIGH:
+            return std::string(subject) + ".high";
+
+        case message_priority::LOW:
+            return std::string(subject) + ".low";
+
+        default:
+            return std::string(subject);
+    }
+}
+
+
+/**
+ * @brief The durable consumer of a lane, "<consumer>-high" and
+ *        "<consumer>-low" next to consumer for the normal lane.
+ */
+inline std::string lane_consumer(std::string_view consumer, message_priority priority) {
+
+    switch(priority) {
+        case message_priority::HIGH:
+            return std::string(consumer) + "-high";
+
+        case message_priority::LOW:
+            return std::string(consumer) + "-low";
+
+        default:
+            return std::string(consumer);
+    }
+}
+
+
+/**
+ * @brief Parse the priority_weights property, "high,normal,low", e.g.
+ *        "8,2,1".
+ *
+ * @throws std::invalid_argument if there aren't three weights of at least 1.
+ */
+inline priority_weights parse_priority_weights(std::string_view sv) {
+
+    priority_weights weights = {};
+    auto rest = sv;
+
+    for(std::size_t i = 0; i < weights.size(); ++i) {
+
+        auto pos = rest.find(',');
+        auto part = rest.substr(0, pos);
+
+        auto [ptr, ec] = std::from_chars(part.data(), part.data() + part.size(), weights[i]);
+
+        bool last = (i + 1 == weights.size());
+
+        if(ec != std::errc() or ptr != part.data() + part.size() or weights[i] == 0 or
+           (pos == std::string_view::npos) != last) {
+            throw std::invalid_argument(std::string("Invalid priority_weights: ") +
+                                        std::string(sv));
+        }
+
+        rest = last ? std::string_view() : rest.substr(pos + 1);
+    }
+
+    return weights;
+}
+
+
+/**
+ * @brief Picks the lane to receive from next with smooth weighted round
+ *        robin, so while every lane has messages they are served in
+ *        proportion to their weights and interleaved rather than in bursts,
+ *        and a lane that runs dry gives its turns to the others.
+ *
+ * Each pick adds every lane's weight to its credit and the caller tries the
+ * lanes in order of credit.  The lane it receives from pays the total of the
+ * weights, a lane found empty drops its credit so it doesn't bank turns
+ * while there is nothing in it.
+ */
+class priority_scheduler {
+
+    private:
+
+        priority_weights _weights;
+        std::array<std::int64_t, 3> _credits = {};
+        std::int64_t _total;
+
+        static std::size_t _index(message_priority priority) {
+            return static_cast<std::size_t>(priority);
+        }
+
+    public:
+
+        explicit priority_scheduler(const priority_weights &weights = default_priority_weights) :
+            _weights(weights), _total(0) {
+
+            for(auto w : _weights) {
+                _total += w;
+            }
+        }
+
+        /* The lanes in the order they should be tried */
+        std::array<message_priority, 3> next() {
+
+            for(std::size_t i = 0; i < _credits.size(); ++i) {
+                _credits[i] += _weights[i];
+            }
+
+            auto order = message_priorities;
+
+            /* Ties go to the more urgent lane */
+            std::stable_sort(order.begin(), order.end(),
+                             [this](message_priority a, message_priority b) {
+                return _credits[_index(a)] > _credits[_index(b)];
+            });
+
+            return order;
+        }
+
+        /* A message was received from the lane */
+        void served(message_priority priority) {
+            _credits[_index(priority)] -= _total;
+        }
+
+        /* The lane had nothing to receive */
+        void idle(message_priority priority) {
+            _credits[_index(priority)] = std::min<std::int64_t>(_credits[_index(priority)], 0);
+        }
+
+        const priority_weights &weights() const {
+            return _weights;
+        }
+};
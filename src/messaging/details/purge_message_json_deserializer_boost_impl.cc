@@ -54,6 +54,16 @@ object_handler _purge_message_object_handler = { {
             msg.path = value;
         }),
     },  
+    {
+        std::string("paths"),
+        value_handler(
+            std::in_place_type<array_handler>,
+            value_handler(
+                std::in_place_type<string_handler>,
+                [](string_view value, purge_message &msg) {
+                    msg.paths.emplace_back(value.data(), value.size());
+                }))
+    },
     
 } };
 
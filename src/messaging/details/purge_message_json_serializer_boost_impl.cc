@@ -19,19 +19,42 @@
 #include "./messages.h"
 #include "./message_json_serializer_boost_impl.h"
 
+
+/* The further paths as the elements of a JSON array */
+static std::string _path_list(const purge_message &msg) {
+
+    std::string list;
+
+    for(const auto &path : msg.paths) {
+
+        if(not list.empty()) {
+            list += ", ";
+        }
+
+        list += "\"" + path + "\"";
+    }
+
+    return list;
+}
+
+
 template<>
 std::string_view 
 json_serializer_impl<purge_message>::operator()(
         const purge_message &msg, 
         const std::string_view buffer) const {
 
+    /* The further paths only if there are any */
+    auto paths = msg.paths.empty() ? std::string() : ", \"paths\": [" + _path_list(msg) + "]";
+
     /* Write the data to a buffer */
     int rc = snprintf(const_cast<char *>(buffer.data()),
                       buffer.size(), 
                       "{ "
-                        "\"path\": \"%s\" "
+                        "\"path\": \"%s\"%s "
                       "}",
-                      msg.path.c_str());
+                      msg.path.c_str(),
+                      paths.c_str());
 
     /* Error serializing the message */
     if(rc < 0) {
@@ -59,7 +82,13 @@ json_serializer_impl<purge_message>::operator()(const purge_message& msg) const
 
   std::stringstream buffer;
 
-  buffer << "{ \"path\": \"" << msg.path << "\" }";
+  buffer << "{ \"path\": \"" << msg.path << "\"";
+
+  if(not msg.paths.empty()) {
+      buffer << ", \"paths\": [" << _path_list(msg) << "]";
+  }
+
+  buffer << " }";
   
   return buffer.str();
 }
\ No newline at end of file
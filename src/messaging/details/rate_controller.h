@@ -0,0 +1,307 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+
+/* Tuning of the rate_controller */
+struct rate_controller_config {
+
+    /* Rates are in messages per second */
+    double initial_rate = 1000.0;
+    double min_rate = 10.0;
+    double max_rate = 100000.0;
+
+    /* Rate added per second once out of slow start */
+    double additive_increase = 100.0;
+
+    /* Rate is multiplied by this on a congestion signal */
+    double decrease_factor = 0.5;
+
+    /* Ack latency above which the broker is considered congested */
+    std::chrono::microseconds target_latency = std::chrono::milliseconds(50);
+
+    /* Stream fill fractions, above high the rate is cut, between low
+     * and high the rate is held */
+    double low_watermark = 0.70;
+    double high_watermark = 0.90;
+
+    /* Minimum time between two decreases so a burst of failures from
+     * the same congestion event only cuts the rate once */
+    std::chrono::microseconds decrease_interval = std::chrono::milliseconds(250);
+
+    /* Seconds of tokens the bucket may accumulate */
+    double burst_seconds = 0.1;
+
+    /* How often the stream fill level should be sampled */
+    std::chrono::microseconds fill_level_interval = std::chrono::seconds(1);
+
+    /* Retry backoff bounds after a store failure */
+    std::chrono::microseconds min_backoff = std::chrono::milliseconds(10);
+    std::chrono::microseconds max_backoff = std::chrono::seconds(5);
+};
+
+
+/**
+ * @brief Adaptive publish rate controller.
+ *
+ * The allowed publish rate is adjusted AIMD style from the signals the broker
+ * gives us: publish ack latency, store failures (stream full), publish
+ * timeouts and the fill level of the stream.  Publishes are paced with a
+ * token bucket at the current rate so a publisher slows down smoothly instead
+ * of hammering a full stream and then sleeping.
+ *
+ * Like TCP the controller starts in slow start, growing the rate
+ * exponentially until the first congestion signal, after which it grows
+ * additively.
+ *
+ * All methods are thread safe.
+ */
+class rate_controller {
+
+    public:
+        using clock = std::chrono::steady_clock;
+
+        using config = rate_controller_config;
+
+    private:
+        mutable std::mutex _mutex;
+
+        config _config;
+
+        double _rate;
+        double _ssthresh;
+        double _tokens;
+        double _fill_level = 0.0;
+
+        clock::time_point _last_refill;
+        clock::time_point _last_decrease;
+        clock::time_point _last_fill_sample;
+
+        std::chrono::microseconds _backoff;
+
+        /* Must hold the lock */
+        void _decrease(clock::time_point now) {
+
+            if(now - _last_decrease < _config.decrease_interval) {
+                return;
+            }
+
+            _last_decrease = now;
+            _ssthresh = std::max(_config.min_rate, _rate * _config.decrease_factor);
+            _rate = _ssthresh;
+            _tokens = std::min(_tokens, _capacity());
+        }
+
+        /* Must hold the lock */
+        double _capacity() const {
+            return std::max(1.0, _rate * _config.burst_seconds);
+        }
+
+    public:
+        explicit rate_controller(const config &c = config(),
+                                 clock::time_point now = clock::now()):
+            _config(c),
+            _rate(std::clamp(c.initial_rate, c.min_rate, c.max_rate)),
+            _ssthresh(c.max_rate),
+            _tokens(1.0),
+            _last_refill(now),
+            _last_decrease(now - c.decrease_interval),
+            _last_fill_sample(now - c.fill_level_interval),
+            _backoff(c.min_backoff) { }
+
+        rate_controller(const rate_controller &) = delete;
+        rate_controller &operator=(const rate_controller &) = delete;
+
+        /**
+         * @brief Take a token for one publish.
+         *
+         * @return How long the caller must wait before publishing, zero if it
+         *         may publish now.  Tokens are borrowed so concurrent
+         *         publishers queue up behind each other at the current rate.
+         */
+        std::chrono::microseconds reserve(clock::time_point now = clock::now()) {
+
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            std::chrono::duration<double> elapsed = now - _last_refill;
+            _last_refill = now;
+
+            _tokens = std::min(_capacity(), _tokens + elapsed.count() * _rate);
+            _tokens -= 1.0;
+
+            if(_tokens >= 0.0) {
+                return std::chrono::microseconds(0);
+            }
+
+            return std::chrono::microseconds(
+                        static_cast<std::int64_t>(-_tokens / _rate * 1e6));
+        }
+
+        /* Blocks until a publish is allowed */
+        void acquire() {
+
+            auto wait = reserve();
+
+            if(wait.count() > 0) {
+                std::this_thread::sleep_for(wait);
+            }
+        }
+
+        /**
+         * @brief Record a successful publish and its ack latency.
+         */
+        void on_ack(std::chrono::microseconds latency,
+                    clock::time_point now = clock::now()) {
+
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _backoff = _config.min_backoff;
+
+            /* Broker is slow to persist, treat as congestion */
+            if(latency > 2 * _config.target_latency) {
+                _decrease(now);
+                return;
+            }
+
+            /* Don't grow when latency is creeping up or the stream is filling */
+            if(latency > _config.target_latency or
+               _fill_level >= _config.low_watermark) {
+                return;
+            }
+
+            /* Increase per ack is scaled by the rate so the rate doubles
+             * each second in slow start and grows by additive_increase each
+             * second after. */
+            if(_rate < _ssthresh) {
+                _rate += 1.0;
+
+            } else {
+                _rate += _config.additive_increase / _rate;
+            }
+
+            _rate = std::min(_rate, _config.max_rate);
+        }
+
+        /**
+         * @brief Record a store failure, i.e. the stream is full.
+         *
+         * @return How long to wait before retrying the publish.  The backoff
+         *         doubles on consecutive failures and resets on an ack.
+         */
+        std::chrono::microseconds on_store_failure(clock::time_point now = clock::now()) {
+
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _decrease(now);
+
+            auto backoff = _backoff;
+            _backoff = std::min(_config.max_backoff, 2 * _backoff);
+
+            return backoff;
+        }
+
+        /* Record a publish that timed out waiting for its ack */
+        void on_timeout(clock::time_point now = clock::now()) {
+
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _decrease(now);
+        }
+
+        /**
+         * @brief Record the fraction, 0 to 1, of the stream limits in use.
+         */
+        void on_fill_level(double fill_level, clock::time_point now = clock::now()) {
+
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _fill_level = std::clamp(fill_level, 0.0, 1.0);
+            _last_fill_sample = now;
+
+            if(_fill_level >= _config.high_watermark) {
+                _decrease(now);
+            }
+        }
+
+        /**
+         * @brief Whether the stream fill level should be sampled again.
+         *        Returns true at most once per fill_level_interval.
+         */
+        bool fill_level_due(clock::time_point now = clock::now()) {
+
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            if(now - _last_fill_sample < _config.fill_level_interval) {
+                return false;
+            }
+
+            /* Claim the sample so concurrent publishers don't all query */
+            _last_fill_sample = now;
+            return true;
+        }
+
+        double rate() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _rate;
+        }
+
+        double fill_level() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _fill_level;
+        }
+};
+
+
+/**
+ * @brief Limits how often a recurring error is logged.  The first occurrence
+ *        is logged and after that at most once per interval along with the
+ *        number of occurrences suppressed in between.
+ */
+class log_throttle {
+
+    private:
+        std::mutex _mutex;
+        std::chrono::steady_clock::duration _interval;
+        std::chrono::steady_clock::time_point _last;
+        std::uint64_t _suppressed = 0;
+        bool _first = true;
+
+    public:
+        explicit log_throttle(std::chrono::steady_clock::duration interval = std::chrono::seconds(10)):
+            _interval(interval) { }
+
+        /**
+         * @brief Returns true if the caller should log now and sets
+         *        suppressed to the number of skipped occurrences.
+         */
+        bool should_log(std::uint64_t &suppressed,
+                        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) {
+
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            if(_first or now - _last >= _interval) {
+                _first = false;
+                _last = now;
+                suppressed = _suppressed;
+                _suppressed = 0;
+                return true;
+            }
+
+            ++_suppressed;
+            return false;
+        }
+};
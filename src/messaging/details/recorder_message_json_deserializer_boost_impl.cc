@@ -42,6 +42,19 @@ void json_deserializer_impl<recorder_message>::_validate_message(const recorder_
     
     std::chrono::time_point<std::chrono::system_clock> epoch;
 
+    /* A deleted file is only known by its FID */
+    if(msg.deleted) {
+
+        if(msg.filesys.empty()) {
+            throw qs_exception("Error deserializing recorder message: filesys is invalid");
+
+        } else if(msg.fid.empty()) {
+            throw qs_exception("Error deserializing recorder message: fid is invalid");
+        }
+
+        return;
+    }
+
     if(msg.atime == epoch) {
         throw qs_exception("Error deserializing recorder message: atime is invalid");
         
@@ -157,6 +170,14 @@ object_handler _recorder_message_object_handler = { {
     {
         std::string("format"),
         value_handler(std::move(_recorder_message_format_object_handler))          
+    },
+    {
+        std::string("deleted"),
+        value_handler(
+            std::in_place_type<bool_handler>,
+            [](bool value, recorder_message &msg) noexcept {
+                msg.deleted = value;
+            })
     }
 } };
 
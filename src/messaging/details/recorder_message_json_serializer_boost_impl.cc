@@ -44,6 +44,7 @@ json_serializer_impl<recorder_message>::operator()(
                             "\"stripe_count\": %" PRIu64 ", "
                             "\"fid\": \"%s\" "
                          "}" 
+                         "%s"
                       "}",
                       msg.type, 
                       msg.path.c_str(), 
@@ -55,7 +56,8 @@ json_serializer_impl<recorder_message>::operator()(
                       msg.filesys.c_str(), 
                       msg.ost_pool.c_str(), 
                       msg.stripe_count, 
-                      msg.fid.c_str());
+                      msg.fid.c_str(),
+                      msg.deleted ? ", \"deleted\": true" : "");
 
     /* Error serializing the message */
     if(rc < 0) {
@@ -94,8 +96,13 @@ json_serializer_impl<recorder_message>::operator()(const recorder_message &msg)
                     "\"ost_pool\": \"" << msg.ost_pool << "\", "
                     "\"stripe_count\": " << msg.stripe_count << ", "
                     "\"fid\": \"" << msg.fid << "\" "
-                    "}" 
-              "}";
+                    "}";
+
+    if(msg.deleted) {
+        buffer << ", \"deleted\": true";
+    }
+
+    buffer << "}";
                      
                       
     return buffer.str();
@@ -0,0 +1,114 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+
+/**
+ * @brief How a subscriber handles messages that fail processing.
+ *
+ * A failed message is handed back to the broker to be redelivered after an
+ * exponential backoff, leaving the subscriber free to process healthy
+ * messages in the meantime.  Once it has been delivered max_deliveries times,
+ * or immediately if it can not be deserialized, it is published to the dead
+ * letter subject along with the reason for the failure and then terminated
+ * so it is never redelivered.
+ */
+struct retry_policy {
+
+    /* Deliveries before a message is dead lettered, includes the first */
+    std::uint64_t max_deliveries = 5;
+
+    /* Delay before the first redelivery, doubles on each redelivery */
+    std::chrono::milliseconds initial_backoff = std::chrono::seconds(1);
+    std::chrono::milliseconds max_backoff = std::chrono::minutes(5);
+
+    /* Subject dead lettered messages are published to, if empty they are
+     * only logged and dropped */
+    std::string dead_letter_subject;
+
+    /**
+     * @brief Delay before redelivering a message that failed on its
+     *        num_delivered'th delivery.
+     */
+    std::chrono::milliseconds backoff(std::uint64_t num_delivered) const {
+
+        auto delay = initial_backoff;
+
+        for(std::uint64_t i = 1; i < num_delivered and delay < max_backoff; ++i) {
+            delay *= 2;
+        }
+
+        return std::min(delay, max_backoff);
+    }
+
+    /* Whether a message that failed on its num_delivered'th delivery
+     * should be dead lettered */
+    bool exhausted(std::uint64_t num_delivered) const {
+        return num_delivered >= max_deliveries;
+    }
+};
+
+
+/* A positive count or delay of the named queue property, stoul would wrap
+ * a negative one around */
+inline std::uint64_t parse_retry_property(const std::string &name, const std::string &text) {
+
+    auto value = std::stoll(text);
+
+    if(value < 1) {
+        throw std::invalid_argument(name + " must be at least 1, not " + text);
+    }
+
+    return static_cast<std::uint64_t>(value);
+}
+
+
+/**
+ * @brief Build the retry policy from the optional queue properties
+ *        max_deliveries, retry_backoff_ms, max_retry_backoff_ms and
+ *        dead_letter_subject.
+ *
+ * @throws std::invalid_argument or std::out_of_range on malformed numbers,
+ *         numbers below 1 or a maximum backoff below the initial one.
+ */
+inline retry_policy make_retry_policy(const std::map<std::string, std::string> &properties) {
+
+    retry_policy policy;
+
+    if(auto it = properties.find("max_deliveries"); it != properties.end()) {
+        policy.max_deliveries = parse_retry_property(it->first, it->second);
+    }
+
+    if(auto it = properties.find("retry_backoff_ms"); it != properties.end()) {
+        policy.initial_backoff = std::chrono::milliseconds(parse_retry_property(it->first, it->second));
+    }
+
+    if(auto it = properties.find("max_retry_backoff_ms"); it != properties.end()) {
+        policy.max_backoff = std::chrono::milliseconds(parse_retry_property(it->first, it->second));
+    }
+
+    if(policy.max_backoff < policy.initial_backoff) {
+        throw std::invalid_argument("max_retry_backoff_ms must be at least retry_backoff_ms");
+    }
+
+    if(auto it = properties.find("dead_letter_subject"); it != properties.end()) {
+        policy.dead_letter_subject = it->second;
+    }
+
+    return policy;
+}
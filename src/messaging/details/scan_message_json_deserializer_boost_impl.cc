@@ -46,6 +46,22 @@ void json_deserializer_impl<scan_message>::_validate_message(const scan_message
     
     std::chrono::time_point<std::chrono::system_clock> epoch;
 
+    /* A deleted file is only known by its FID */
+    if(msg.deleted) {
+
+        if(msg.type != 'f' and msg.type != 'd') {
+            throw qs_exception("Error deserializing scan message: type is invalid");
+
+        } else if(msg.filesys.empty()) {
+            throw qs_exception("Error deserializing scan message: filesys is invalid");
+
+        } else if(msg.fid.empty()) {
+            throw qs_exception("Error deserializing scan message: fid is invalid");
+        }
+
+        return;
+    }
+
     if(msg.atime == epoch) {
         throw qs_exception("Error deserializing scan message: atime is invalid");
         
@@ -97,6 +113,28 @@ static object_handler _scan_message_format_object_handler({
 });
 
 
+/* Only records of a sampling scan have one, the probe marks them sampled */
+static object_handler _scan_message_sample_object_handler({ 
+    { 
+        std::string("probe"),
+        value_handler(
+            std::in_place_type<integer_handler>,
+            [](std::uint64_t value, scan_message &msg) noexcept {
+                msg.sampled = true;
+                msg.probe = static_cast<std::uint32_t>(value); 
+            })
+    },
+    { 
+        std::string("weight"),
+        value_handler(
+            std::in_place_type<floating_point_handler>,
+            [](double value, scan_message &msg) noexcept {
+                msg.weight = value; 
+            })
+    }
+});
+
+
 object_handler _scan_message_object_handler = { {
 
     {
@@ -162,6 +200,18 @@ object_handler _scan_message_object_handler = { {
     {
         std::string("format"),
         value_handler(std::move(_scan_message_format_object_handler))          
+    },
+    {
+        std::string("sample"),
+        value_handler(std::move(_scan_message_sample_object_handler))
+    },
+    {
+        std::string("deleted"),
+        value_handler(
+            std::in_place_type<bool_handler>,
+            [](bool value, scan_message &msg) noexcept {
+                msg.deleted = value;
+            })
     }
 } };
 
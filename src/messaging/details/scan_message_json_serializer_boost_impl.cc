@@ -10,6 +10,7 @@
 
 #include <chrono>
 #include <string>
+#include <iomanip>
 #include <sstream>
 #include <string_view>
 #include <cstdio>
@@ -26,6 +27,16 @@ json_serializer_impl<scan_message>::operator()(
         const scan_message &msg, 
         const std::string_view buffer) const {
 
+    /* Only records of a sampling scan carry a sample, the weight is written
+     * with an exponent so it always reads back as a double */
+    char sample[80] = "";
+
+    if(msg.sampled) {
+        snprintf(sample, sizeof(sample), 
+                 ", \"sample\": { \"probe\": %" PRIu32 ", \"weight\": %.17e }",
+                 msg.probe, msg.weight);
+    }
+
     /* Write the data to a buffer */
     int rc = snprintf(const_cast<char *>(buffer.data()),
                       buffer.size(), 
@@ -43,6 +54,8 @@ json_serializer_impl<scan_message>::operator()(
                             "\"stripe_count\": %" PRIu64 ", "
                             "\"fid\": \"%s\" "
                          "}" 
+                         "%s"
+                         "%s"
                       "}",
                       msg.type, 
                       msg.path.c_str(), 
@@ -54,7 +67,9 @@ json_serializer_impl<scan_message>::operator()(
                       msg.filesys.c_str(), 
                       msg.ost_pool.c_str(), 
                       msg.stripe_count, 
-                      msg.fid.c_str());
+                      msg.fid.c_str(),
+                      sample,
+                      msg.deleted ? ", \"deleted\": true" : "");
 
     /* Error serializing the message */
     if(rc < 0) {
@@ -95,8 +110,18 @@ json_serializer_impl<scan_message>::operator()(const scan_message &msg) const {
                     "\"ost_pool\": \"" << msg.ost_pool << "\", "
                     "\"stripe_count\": " << msg.stripe_count << ", "
                     "\"fid\": \"" << msg.fid << "\" "
-                    "}" 
-              "}";
+                    "}";
+
+    if(msg.sampled) {
+        buffer << ", \"sample\": { \"probe\": " << msg.probe << ", \"weight\": "
+               << std::scientific << std::setprecision(17) << msg.weight << " }";
+    }
+
+    if(msg.deleted) {
+        buffer << ", \"deleted\": true";
+    }
+
+    buffer << "}";
                      
                       
     return buffer.str();
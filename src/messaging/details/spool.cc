@@ -0,0 +1,363 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./spool.h"
+
+
+/* Magic number at the start of a segment, "PMSPOOL1" */
+static constexpr std::uint64_t segment_magic = 0x314c4f4f50534d50ULL;
+
+/* Bytes before the subject in a record */
+static constexpr std::size_t record_header_size = 12;
+
+
+/* 32-bit FNV-1a, enough to detect a torn write */
+static std::uint32_t _checksum(const char *data, std::size_t len) {
+
+    std::uint32_t hash = 0x811c9dc5U;
+
+    for(std::size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x01000193U;
+    }
+
+    return hash;
+}
+
+
+static std::filesystem::path _segment_path(const std::filesystem::path &directory,
+                                           std::uint64_t number) {
+
+    char name[32];
+
+    auto [end, ec] = std::to_chars(name, name + sizeof(name), number);
+
+    std::string padded(20 - std::min<std::size_t>(20, end - name), '0');
+    padded.append(name, end);
+
+    return directory / (padded + ".seg");
+}
+
+
+spool::spool(const std::filesystem::path &directory, std::size_t segment_size):
+    _directory(directory), _segment_size(segment_size) {
+
+    if(_segment_size < 64 * 1024) {
+        throw std::invalid_argument("Spool segment size must be at least 64KiB");
+    }
+
+    std::filesystem::create_directories(_directory);
+
+    /* Find the segments left from a previous run */
+    std::vector<std::uint64_t> numbers;
+
+    for(const auto &entry : std::filesystem::directory_iterator(_directory)) {
+
+        if(entry.path().extension() != ".seg") {
+            continue;
+        }
+
+        auto stem = entry.path().stem().string();
+        std::uint64_t number = 0;
+
+        auto [ptr, ec] = std::from_chars(stem.data(), stem.data() + stem.size(), number);
+
+        if(ec == std::errc() and ptr == stem.data() + stem.size()) {
+            numbers.push_back(number);
+        }
+    }
+
+    std::ranges::sort(numbers);
+
+    for(auto number : numbers) {
+
+        auto seg = _open_segment(number, false);
+        _recover(seg);
+        _segments.emplace_back(std::move(seg));
+    }
+
+    /* Drop fully consumed segments, except the last which we keep
+     * appending to */
+    while(_segments.size() > 1) {
+
+        auto &front = _segments.front();
+        std::uint64_t consumed;
+        std::memcpy(&consumed, front.base + 8, sizeof(consumed));
+
+        if(consumed < front.write_offset) {
+            break;
+        }
+
+        _close_segment(front, true);
+        _segments.pop_front();
+    }
+
+    if(_segments.empty()) {
+        _segments.emplace_back(_open_segment(0, true));
+    }
+
+    std::memcpy(&_read_offset, _segments.front().base + 8, sizeof(std::uint64_t));
+}
+
+
+spool::~spool() {
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for(auto &seg : _segments) {
+        _close_segment(seg, false);
+    }
+}
+
+
+spool::segment spool::_open_segment(std::uint64_t number, bool create) {
+
+    segment seg;
+
+    seg.number = number;
+    seg.path = _segment_path(_directory, number);
+
+    int fd = open(seg.path.c_str(), O_RDWR | (create ? (O_CREAT | O_EXCL) : 0), 0600);
+
+    if(fd == -1) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Unable to open spool segment " + seg.path.string());
+    }
+
+    /* Allocate the whole segment up front so running out of space shows up
+     * here rather than as a SIGBUS when writing to the mapping */
+    if(create) {
+
+        int rc = posix_fallocate(fd, 0, _segment_size);
+
+        if(rc != 0) {
+            close(fd);
+            unlink(seg.path.c_str());
+            throw std::system_error(rc, std::generic_category(),
+                                    "Unable to allocate spool segment " + seg.path.string());
+        }
+    }
+
+    void *base = mmap(nullptr, _segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    int mmap_errno = errno;
+    close(fd);
+
+    if(base == MAP_FAILED) {
+        throw std::system_error(mmap_errno, std::generic_category(),
+                                "Unable to map spool segment " + seg.path.string());
+    }
+
+    seg.base = static_cast<char *>(base);
+
+    if(create) {
+        std::uint64_t read_offset = header_size;
+        std::memcpy(seg.base, &segment_magic, sizeof(segment_magic));
+        std::memcpy(seg.base + 8, &read_offset, sizeof(read_offset));
+    }
+
+    seg.write_offset = header_size;
+
+    return seg;
+}
+
+
+void spool::_close_segment(segment &seg, bool remove) {
+
+    if(seg.base != nullptr) {
+        msync(seg.base, _segment_size, MS_ASYNC);
+        munmap(seg.base, _segment_size);
+        seg.base = nullptr;
+    }
+
+    if(remove) {
+        std::error_code ec;
+        std::filesystem::remove(seg.path, ec);
+    }
+}
+
+
+void spool::_recover(segment &seg) {
+
+    std::uint64_t magic;
+    std::memcpy(&magic, seg.base, sizeof(magic));
+
+    /* Not a segment we wrote, treat as empty */
+    if(magic != segment_magic) {
+        std::uint64_t read_offset = header_size;
+        std::memcpy(seg.base, &segment_magic, sizeof(segment_magic));
+        std::memcpy(seg.base + 8, &read_offset, sizeof(read_offset));
+        std::memset(seg.base + header_size, 0, sizeof(std::uint32_t));
+        return;
+    }
+
+    std::uint64_t read_offset;
+    std::memcpy(&read_offset, seg.base + 8, sizeof(read_offset));
+
+    std::size_t offset = header_size;
+
+    /* Walk the records until the end marker or a torn write */
+    while(offset + record_header_size <= _segment_size) {
+
+        std::uint32_t length, checksum;
+        std::memcpy(&length, seg.base + offset, sizeof(length));
+        std::memcpy(&checksum, seg.base + offset + 4, sizeof(checksum));
+
+        if(length == 0 or offset + 8 + length > _segment_size or
+           _checksum(seg.base + offset + 8, length) != checksum) {
+            break;
+        }
+
+        if(offset >= read_offset) {
+            ++_pending;
+        }
+
+        offset += 8 + length;
+    }
+
+    /* Clear whatever is past the last good record so it isn't mistaken for
+     * a record after we append */
+    if(offset + sizeof(std::uint32_t) <= _segment_size) {
+        std::memset(seg.base + offset, 0, sizeof(std::uint32_t));
+    }
+
+    seg.write_offset = offset;
+}
+
+
+void spool::_store_read_offset() {
+
+    std::uint64_t read_offset = _read_offset;
+    std::memcpy(_segments.front().base + 8, &read_offset, sizeof(read_offset));
+}
+
+
+void spool::append(std::string_view subject,
+                   std::string_view msg_id,
+                   std::string_view payload) {
+
+    std::size_t length = 4 + subject.size() + msg_id.size() + payload.size();
+
+    /* Leave room for the end marker */
+    if(subject.size() > UINT16_MAX or msg_id.size() > UINT16_MAX or
+       header_size + 8 + length + 4 > _segment_size) {
+        throw std::invalid_argument("Message is too large for the spool");
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    /* Start a new segment when this one is full */
+    if(_segments.back().write_offset + 8 + length + 4 > _segment_size) {
+
+        auto number = _segments.back().number + 1;
+
+        msync(_segments.back().base, _segment_size, MS_ASYNC);
+        _segments.emplace_back(_open_segment(number, true));
+    }
+
+    segment &seg = _segments.back();
+    char *out = seg.base + seg.write_offset;
+
+    std::uint16_t subject_len = subject.size();
+    std::uint16_t msg_id_len = msg_id.size();
+
+    std::memcpy(out + 8, &subject_len, sizeof(subject_len));
+    std::memcpy(out + 10, &msg_id_len, sizeof(msg_id_len));
+    std::memcpy(out + 12, subject.data(), subject.size());
+    std::memcpy(out + 12 + subject.size(), msg_id.data(), msg_id.size());
+    std::memcpy(out + 12 + subject.size() + msg_id.size(), payload.data(), payload.size());
+
+    std::uint32_t checksum = _checksum(out + 8, length);
+    std::memcpy(out + 4, &checksum, sizeof(checksum));
+
+    /* End marker after the record, then the length which makes the record
+     * visible */
+    std::memset(out + 8 + length, 0, sizeof(std::uint32_t));
+
+    std::uint32_t length32 = length;
+    std::memcpy(out, &length32, sizeof(length32));
+
+    seg.write_offset += 8 + length;
+    ++_pending;
+
+    lock.unlock();
+    _cv.notify_one();
+}
+
+
+bool spool::front(record &rec, std::stop_token stoken) {
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if(not _cv.wait(lock, stoken, [this] { return _pending > 0; })) {
+        return false;
+    }
+
+    /* Move past segments that have been consumed, there is always a record
+     * after them since pending is non zero */
+    while(_read_offset >= _segments.front().write_offset) {
+
+        _close_segment(_segments.front(), true);
+        _segments.pop_front();
+
+        _read_offset = header_size;
+        _store_read_offset();
+    }
+
+    const char *in = _segments.front().base + _read_offset;
+
+    std::uint32_t length;
+    std::uint16_t subject_len, msg_id_len;
+
+    std::memcpy(&length, in, sizeof(length));
+    std::memcpy(&subject_len, in + 8, sizeof(subject_len));
+    std::memcpy(&msg_id_len, in + 10, sizeof(msg_id_len));
+
+    rec.subject = { in + 12, subject_len };
+    rec.msg_id  = { in + 12 + subject_len, msg_id_len };
+    rec.payload = { in + 12 + subject_len + msg_id_len,
+                    length - 4 - subject_len - msg_id_len };
+
+    return true;
+}
+
+
+void spool::pop() {
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::uint32_t length;
+    std::memcpy(&length, _segments.front().base + _read_offset, sizeof(length));
+
+    _read_offset += 8 + length;
+    --_pending;
+
+    _store_read_offset();
+}
+
+
+std::uint64_t spool::pending() const {
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pending;
+}
@@ -0,0 +1,127 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <string_view>
+
+
+/**
+ * @brief Disk backed, append only spool of outgoing messages.
+ *
+ * The spool is a sequence of fixed size segment files that are memory mapped
+ * and appended to.  Each segment starts with a small header holding the
+ * offset of the first record that has not been consumed yet, so after a
+ * restart only the records that were never delivered are replayed.  A
+ * segment file is removed once every record in it has been consumed.
+ *
+ * Records are written as
+ *
+ *      u32 length | u32 checksum | u16 subject length | u16 id length |
+ *      subject | id | payload
+ *
+ * where length covers everything after the checksum.  A zero length marks
+ * the end of the written records and a bad checksum a torn write from a
+ * crash, both end recovery of the segment.
+ *
+ * One thread may consume the spool while any number of threads append.
+ */
+class spool {
+
+    public:
+
+        /* A record read back from the spool, views are valid until pop() */
+        struct record {
+            std::string_view subject;
+            std::string_view msg_id;
+            std::string_view payload;
+        };
+
+    private:
+
+        struct segment {
+            std::uint64_t number = 0;
+            std::filesystem::path path;
+            char *base = nullptr;
+
+            /* End of the written records */
+            std::size_t write_offset = 0;
+        };
+
+        std::filesystem::path _directory;
+        std::size_t _segment_size;
+
+        mutable std::mutex _mutex;
+        std::condition_variable_any _cv;
+
+        /* Oldest first, the back is the segment being appended to */
+        std::deque<segment> _segments;
+
+        /* Offset in the front segment of the next record to consume */
+        std::size_t _read_offset = 0;
+
+        std::uint64_t _pending = 0;
+
+        segment _open_segment(std::uint64_t number, bool create);
+        void _close_segment(segment &seg, bool remove);
+        void _recover(segment &seg);
+        void _store_read_offset();
+
+    public:
+
+        /* Bytes at the start of each segment reserved for the header */
+        static constexpr std::size_t header_size = 16;
+
+        /**
+         * @brief Opens the spool in directory, creating it if needed, and
+         *        recovers any records left by a previous run.
+         *
+         * @throws std::system_error if the segments can't be created or
+         *         mapped.
+         */
+        spool(const std::filesystem::path &directory,
+              std::size_t segment_size = 64 * 1024 * 1024);
+
+        spool(const spool &) = delete;
+        spool &operator=(const spool &) = delete;
+
+        ~spool();
+
+        /**
+         * @brief Appends a record, never blocks on the consumer.
+         *
+         * @throws std::invalid_argument if the record can't fit in a segment.
+         * @throws std::system_error if a new segment can't be created.
+         */
+        void append(std::string_view subject,
+                    std::string_view msg_id,
+                    std::string_view payload);
+
+        /**
+         * @brief Waits for the oldest unconsumed record.
+         *
+         * @return false if stop was requested before a record was available.
+         */
+        bool front(record &rec, std::stop_token stoken);
+
+        /* Marks the record returned by front() as consumed */
+        void pop();
+
+        /* Number of records not yet consumed */
+        std::uint64_t pending() const;
+};
@@ -16,6 +16,7 @@
 #include <string_view>
 #include <memory>
 #include <algorithm>
+#include <span>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -91,6 +92,27 @@ class message_queue_publisher {
                     impl.template send<MSG, SERIALIZER>(msg); 
                 }, *_pimpl);
         };
+
+        /* Snapshot of the counters and latency histograms */
+        messaging_stats_snapshot stats() const {
+            return std::visit([](auto &&impl) { 
+                    return impl.stats(); 
+                }, *_pimpl);
+        }
+
+        /* Spool messages to disk and publish them in the background */
+        void enable_spool(std::string_view directory, std::size_t segment_size) {
+            std::visit([directory, segment_size](auto &&impl) { 
+                    impl.enable_spool(directory, segment_size); 
+                }, *_pimpl);
+        }
+
+        /* Send high and low priority messages on their own lanes */
+        void enable_priority_lanes() {
+            std::visit([](auto &&impl) { 
+                    impl.enable_priority_lanes(); 
+                }, *_pimpl);
+        }
 };
 
 
@@ -159,6 +181,78 @@ class message_queue_subscriber {
                     return impl.template receive<MSG, DESERIALIZER>(); 
                 }, *(this->_pimpl));
         }
+
+        /* Receive one message and hand it to the handler, the message is 
+         * only acknowledged if the handler returns without throwing */
+        template<typename MSG, 
+                 template<typename> typename DESERIALIZER=json_deserializer_impl,
+                 typename HANDLER>
+            requires MsgDeserializerLike<DESERIALIZER, MSG> &&  
+                     std::default_initializable<MSG> &&
+                     std::invocable<HANDLER, const MSG &>
+        void process(HANDLER &&handler) {
+            std::visit([&handler](auto &&impl) { 
+                    impl.template process<MSG, DESERIALIZER>(handler); 
+                }, *(this->_pimpl));
+        }
+
+        /* Receive up to max_batch messages, waiting only for the first, and
+         * hand them to the handler together.  The batch is acknowledged if 
+         * the handler returns and retried as a whole if it throws */
+        template<typename MSG, 
+                 template<typename> typename DESERIALIZER=json_deserializer_impl,
+                 typename HANDLER>
+            requires MsgDeserializerLike<DESERIALIZER, MSG> &&  
+                     std::default_initializable<MSG> &&
+                     std::invocable<HANDLER, std::span<const MSG>>
+        void process_batch(HANDLER &&handler, std::size_t max_batch) {
+            std::visit([&handler, max_batch](auto &&impl) { 
+                    impl.template process_batch<MSG, DESERIALIZER>(handler, max_batch); 
+                }, *(this->_pimpl));
+        }
+
+        /* Receive up to max_batch messages, waiting only for the first, 
+         * and leave acknowledging them to the caller, possibly on another 
+         * thread */
+        template<typename MSG, 
+                 template<typename> typename DESERIALIZER=json_deserializer_impl>
+            requires MsgDeserializerLike<DESERIALIZER, MSG> &&  
+                     std::default_initializable<MSG>
+        received_batch<MSG> receive_batch(std::size_t max_batch) {
+            return std::visit([max_batch](auto &&impl) { 
+                    return impl.template receive_batch<MSG, DESERIALIZER>(max_batch); 
+                }, *(this->_pimpl));
+        }
+
+        /* Snapshot of the counters and latency histograms */
+        messaging_stats_snapshot stats() const {
+            return std::visit([](auto &&impl) { 
+                    return impl.stats(); 
+                }, *(this->_pimpl));
+        }
+
+        void set_retry_policy(const retry_policy &policy) {
+            std::visit([&policy](auto &&impl) { 
+                    impl.set_retry_policy(policy); 
+                }, *(this->_pimpl));
+        }
+
+        /* Have receive_batch() first deliver again the messages from stream
+         * sequence on that were already acknowledged, e.g. to rebuild state
+         * saved at sequence - 1.  A no-op for services without history */
+        void replay_from(std::uint64_t sequence) {
+            std::visit([sequence](auto &&impl) { 
+                    impl.replay_from(sequence); 
+                }, *(this->_pimpl));
+        }
+
+        /* Also receive from the high and low priority lanes, sharing the
+         * receives by weights while they all have messages */
+        void enable_priority_lanes(const priority_weights &weights) {
+            std::visit([&weights](auto &&impl) { 
+                    impl.enable_priority_lanes(weights); 
+                }, *(this->_pimpl));
+        }
 };
 
 
@@ -9,7 +9,9 @@
  ****************************************************************************/
 
 
+#include <filesystem>
 #include <functional>
+#include <stdexcept>
 #include <iostream>
 #include <string>
 #include <string_view>
@@ -28,35 +30,100 @@ void lfs_migrate_migration_agent_impl::run() {
 
     std::vector<std::string> process_args = (_dry_run) ? 
         std::move(std::vector<std::string> { "/bin/echo" }) :
-        std::move(std::vector<std::string> { this->_executable, "migrate", "-p", "capacity" });
+        std::move(std::vector<std::string> { this->_executable, "migrate" });
         
     while(this->_stop == false) {
 
         try {
-            auto msg = _mq_sub.receive<migration_message>();
+            /* The message is only acknowledged if the migration succeeds, 
+             * otherwise it is retried and eventually dead lettered */
+            _mq_sub.process<migration_message>([&process_args](const migration_message &msg) {
 
-            std::clog << "Migration agent(" << std::this_thread::get_id() <<"): " 
-                    << "Received message" << std::endl;
+                std::clog << "Migration agent(" << std::this_thread::get_id() <<"): " 
+                        << "Received message" << std::endl;
 
 
-            /* TODO need to have a way specifing the destination pool,
-            * right now it is just "capacity" */
+                /* Build a reference array for passing the temp args */
+                /* TODO look at boost::static_vector for stack storage array */
+                std::vector<std::string> args { process_args.begin(), process_args.end() };
 
-            /* Build a reference array for passing the temp args */
-            /* TODO look at boost::static_vector for stack storage array */
-            std::vector<std::string> args { process_args.begin(), process_args.end() };
-            args.emplace_back(msg.path);
+                /* The layout the policy engine chose, older engines don't
+                 * send one and everything went to "capacity" */
+                args.insert(args.end(), { "-p", msg.pool.empty() ? "capacity" : msg.pool });
 
-            process migration_process(args);
-            
-            std::basic_filebuf<char> filebuf = migration_process.launch();
-        
-            /* Read line by line until there is no more data */
-            for(std::string buffer; std::getline(std::istream(&filebuf), buffer);) {
-                std::clog << "output: " << buffer << std::endl;
-            }
+                if(not msg.osts.empty()) {
+
+                    std::string osts;
+
+                    for(auto ost : msg.osts) {
+                        osts += (osts.empty() ? "" : ",") + std::to_string(ost);
+                    }
+
+                    args.insert(args.end(), { "-c", std::to_string(msg.osts.size()), "-o", osts });
+
+                } else if(msg.stripe_count > 0) {
+                    args.insert(args.end(), { "-c", std::to_string(msg.stripe_count) });
+                }
+
+                auto migrate = [&msg, &args, base = args.size()]() {
+
+                    process migration_process(args);
+                    
+                    std::basic_filebuf<char> filebuf = migration_process.launch();
+                
+                    /* Read line by line until there is no more data */
+                    for(std::string buffer; std::getline(std::istream(&filebuf), buffer);) {
+                        std::clog << "output: " << buffer << std::endl;
+                    }
+
+                    if(int rc = migration_process.wait(); rc != 0) {
+                        throw std::runtime_error("Migration of " + msg.path + 
+                                                 " exited with " + std::to_string(rc));
+                    }
+
+                    args.resize(base);
+                };
+
+                /* Directory rules decide whole directories and the policy 
+                 * engine batches files, lfs migrate takes files so they are
+                 * migrated a batch at a time */
+                constexpr std::size_t files_per_process = 256;
+
+                const auto layout = args.size();
+
+                auto add = [&](const std::string &path) {
+
+                    args.emplace_back(path);
+
+                    if(args.size() - layout == files_per_process) {
+                        migrate();
+                    }
+                };
+
+                auto add_tree = [&](const std::string &path) {
+
+                    if(not std::filesystem::is_directory(std::filesystem::symlink_status(path))) {
+                        add(path);
+                        return;
+                    }
+
+                    for(const auto &entry : std::filesystem::recursive_directory_iterator(path)) {
+                        if(entry.is_regular_file() and not entry.is_symlink()) {
+                            add(entry.path().string());
+                        }
+                    }
+                };
+
+                add_tree(msg.path);
+
+                for(const auto &path : msg.paths) {
+                    add_tree(path);
+                }
 
-            migration_process.wait(); 
+                if(args.size() > layout) {
+                    migrate();
+                }
+            });
 
         } catch(const std::exception &e) {
             std::clog << "Error handling message: " << e.what() << std::endl;
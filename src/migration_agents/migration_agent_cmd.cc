@@ -12,6 +12,7 @@
 #include <iostream>
 #include <string_view>
 #include <numeric>
+#include <optional>
 
 #include <boost/program_options.hpp>
 
@@ -35,6 +36,13 @@ struct args {
     std::string migration_subject;  
 
     bool dry_run;
+
+    /* How failed migration requests are retried and dead lettered */
+    retry_policy migration_retry_policy;
+
+    /* Weights of the high, normal and low priority lanes, none when the
+     * queue has no lanes */
+    std::optional<priority_weights> migration_priority_weights;
 };
 
 
@@ -105,7 +113,11 @@ struct args parse_config_file(std::string_view config_file,
             .nats_url           = std::move(nats_url),
             .migration_stream   = std::move(queue_properties.at("stream_name")),
             .migration_consumer = std::move(queue_properties.at("consumer_name")),
-            .migration_subject  = std::move(queue_properties.at("subject"))
+            .migration_subject  = std::move(queue_properties.at("subject")),
+            .migration_retry_policy = make_retry_policy(queue_properties),
+            .migration_priority_weights = queue_properties.contains("priority_weights") ?
+                std::optional(parse_priority_weights(queue_properties.at("priority_weights"))) :
+                std::nullopt
         };
 
     } catch(const std::out_of_range &e) {
@@ -257,6 +269,12 @@ int main(int argc, char* argv[]) {
             std::string_view(args.migration_consumer), 
             std::string_view(args.migration_subject));
 
+    mq_sub.set_retry_policy(args.migration_retry_policy);
+
+    if(args.migration_priority_weights) {
+        mq_sub.enable_priority_lanes(*args.migration_priority_weights);
+    }
+
     migration_agent agent = create_migration_agent<migration_agents::LFS_MIGRATE>(mq_sub, args.dry_run);
 
     agent.run();
@@ -0,0 +1,180 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "./decision_cache.h"
+
+
+decision_cache::decision_cache(std::size_t capacity, std::chrono::steady_clock::duration ttl, 
+                               std::size_t shards) : _ttl(ttl) {
+
+    if(capacity == 0 or shards == 0) {
+        throw std::invalid_argument("Decision cache capacity and shards must be positive");
+    }
+
+    /* Fewer shards than entries would leave some shards empty */
+    shards = std::min(shards, capacity);
+
+    _shard_capacity = (capacity + shards - 1) / shards;
+
+    for(std::size_t i = 0; i < shards; ++i) {
+        _shards.emplace_back(std::make_unique<shard>());
+    }
+}
+
+
+decision_cache::shard &decision_cache::_shard(std::string_view key) {
+    return *_shards[std::hash<std::string_view>()(key) % _shards.size()];
+}
+
+
+bool decision_cache::admit(std::string_view key, const scan_message &msg, policy_action action,
+                           std::string_view rule, std::chrono::steady_clock::time_point now) {
+
+    auto mtime = std::chrono::duration_cast<std::chrono::seconds>(msg.mtime.time_since_epoch()).count();
+    auto pool = std::hash<std::string_view>()(msg.ost_pool);
+    auto decision = std::hash<std::string_view>()(rule) ^ static_cast<std::size_t>(action);
+
+    auto &s = _shard(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    if(auto it = s.index.find(key); it != s.index.end()) {
+
+        auto &e = *it->second;
+
+        if(e.mtime == mtime and e.size == msg.size and e.pool == pool and 
+           e.decision == decision and now < e.expires) {
+
+            s.entries.splice(s.entries.begin(), s.entries, it->second);
+            _suppressed.fetch_add(1, std::memory_order_relaxed);
+
+            return false;
+        }
+
+        /* Changed or expired, remembered again below.  The index is keyed
+         * by a view of the entry so it goes first */
+        auto pos = it->second;
+
+        s.index.erase(it);
+        s.entries.erase(pos);
+    }
+
+    if(s.entries.size() >= _shard_capacity) {
+        s.index.erase(s.entries.back().key);
+        s.entries.pop_back();
+    }
+
+    s.entries.push_front({ .key = std::string(key), .mtime = mtime, .size = msg.size, 
+                           .pool = pool, .decision = decision, .expires = now + _ttl });
+    s.index.emplace(s.entries.front().key, s.entries.begin());
+
+    return true;
+}
+
+
+void decision_cache::erase(std::string_view key) {
+
+    auto &s = _shard(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    if(auto it = s.index.find(key); it != s.index.end()) {
+        auto pos = it->second;
+
+        s.index.erase(it);
+        s.entries.erase(pos);
+    }
+}
+
+
+std::size_t decision_cache::size() const {
+
+    std::size_t size = 0;
+
+    for(const auto &s : _shards) {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        size += s->entries.size();
+    }
+
+    return size;
+}
+
+
+void decision_cache::save(snapshot_writer &out) const {
+
+    const auto steady_now = std::chrono::steady_clock::now();
+    const auto system_now = std::chrono::system_clock::now();
+
+    for(const auto &s : _shards) {
+
+        std::lock_guard<std::mutex> lock(s->mutex);
+
+        out.put(static_cast<std::uint64_t>(s->entries.size()));
+
+        for(const auto &e : s->entries) {
+
+            auto expires = system_now + std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                                            e.expires - steady_now);
+
+            out.put_string(e.key);
+            out.put(e.mtime);
+            out.put(e.size);
+            out.put(static_cast<std::uint64_t>(e.pool));
+            out.put(static_cast<std::uint64_t>(e.decision));
+            out.put(static_cast<std::int64_t>(
+                std::chrono::duration_cast<std::chrono::seconds>(expires.time_since_epoch()).count()));
+        }
+    }
+}
+
+
+void decision_cache::load(snapshot_reader &in) {
+
+    const auto steady_now = std::chrono::steady_clock::now();
+    const auto system_now = std::chrono::system_clock::now();
+
+    /* The shards may differ from the ones saved */
+    while(not in.empty()) {
+
+        for(auto count = in.get<std::uint64_t>(); count > 0; --count) {
+
+            entry e;
+
+            auto key = in.get_string();
+
+            e.mtime = in.get<std::int64_t>();
+            e.size = in.get<std::uint64_t>();
+            e.pool = static_cast<std::size_t>(in.get<std::uint64_t>());
+            e.decision = static_cast<std::size_t>(in.get<std::uint64_t>());
+
+            auto expires = std::chrono::system_clock::time_point(std::chrono::seconds(in.get<std::int64_t>()));
+
+            if(expires <= system_now) {
+                continue;
+            }
+
+            e.expires = steady_now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                         expires - system_now);
+
+            auto &s = _shard(key);
+            std::lock_guard<std::mutex> lock(s.mutex);
+
+            if(s.entries.size() >= _shard_capacity or s.index.contains(key)) {
+                continue;
+            }
+
+            e.key = std::string(key);
+
+            s.entries.push_back(std::move(e));
+            s.index.emplace(s.entries.back().key, std::prev(s.entries.end()));
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "./engine_snapshot.h"
+#include "./policy_compiler.h"
+
+
+/**
+ * @brief Remembers the actions recently sent for files so a file scanned 
+ *        again in the same state doesn't get the same action again.
+ *
+ * Entries are keyed by the file's usage_store key, its FID or its path if
+ * it has none, and hold the file's mtime, size and pool with the action and
+ * rule decided for it.  A decision is only suppressed while all of those are
+ * unchanged and the entry hasn't outlived its time to live, so a file that 
+ * is modified, migrated to another pool or decided differently is sent 
+ * again, and so is one whose action never completed once the time to live
+ * is up.  Each shard is a least recently used list bounded to its share of
+ * the capacity.  Safe to use from several threads.
+ */
+class decision_cache {
+
+    private:
+
+        struct entry {
+            std::string key;
+            std::int64_t mtime;
+            std::uint64_t size;
+
+            /* Hashes of the pool and of the action and rule */
+            std::size_t pool;
+            std::size_t decision;
+
+            std::chrono::steady_clock::time_point expires;
+        };
+
+        struct string_hash : std::hash<std::string_view> {
+            using is_transparent = void;
+        };
+
+        /* Most recently used first */
+        using lru_list = std::list<entry>;
+
+        struct shard {
+            std::mutex mutex;
+            lru_list entries;
+            std::unordered_map<std::string_view, lru_list::iterator, string_hash> index;
+        };
+
+        std::vector<std::unique_ptr<shard>> _shards;
+        std::size_t _shard_capacity;
+        std::chrono::steady_clock::duration _ttl;
+
+        std::atomic<std::uint64_t> _suppressed{0};
+
+        shard &_shard(std::string_view key);
+
+    public:
+
+        decision_cache(std::size_t capacity, std::chrono::steady_clock::duration ttl, 
+                       std::size_t shards = 64);
+
+        decision_cache(const decision_cache &) = delete;
+        decision_cache &operator=(const decision_cache &) = delete;
+
+        /**
+         * @brief Whether the decision should be sent, false if it was 
+         *        already sent for the file in the same state.  A decision
+         *        that should be sent is remembered.
+         */
+        bool admit(std::string_view key, const scan_message &msg, policy_action action, 
+                   std::string_view rule,
+                   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+        /* Forgets the file, e.g. when sending its action failed */
+        void erase(std::string_view key);
+
+        std::size_t size() const;
+
+        /* Writes the entries, most recently used first, for a snapshot.  The
+         * time left to live is kept as a wall clock time so it runs on while
+         * the engine is down */
+        void save(snapshot_writer &out) const;
+
+        /* Adds the entries save() wrote that are still alive and fit, after
+         * any already cached.
+         * @throws std::runtime_error if the section is damaged */
+        void load(snapshot_reader &in);
+
+        /* Decisions not sent again so far */
+        std::uint64_t suppressed() const {
+            return _suppressed.load(std::memory_order_relaxed);
+        }
+};
@@ -0,0 +1,376 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+
+#include "./directory_tracker.h"
+
+
+directory_tracker::directory_tracker(const compiled_policy &policy) {
+
+    const auto &rules = policy.rules();
+
+    _rules.resize(rules.size());
+
+    for(std::size_t r = 0; r < rules.size(); ++r) {
+
+        if(not rules[r].directory) {
+            continue;
+        }
+
+        auto state = std::make_unique<rule_state>();
+
+        state->rule = r;
+        state->name = rules[r].name;
+        state->settings = *rules[r].directory;
+        state->shard_capacity = std::max<std::size_t>(1, (state->settings.max_directories + 
+                                                          _num_shards - 1) / _num_shards);
+
+        for(std::size_t i = 0; i < _num_shards; ++i) {
+            state->shards.emplace_back(std::make_unique<shard>());
+        }
+
+        _rules[r] = std::move(state);
+        _directory_rules.push_back(r);
+    }
+}
+
+
+std::string_view directory_tracker::directory_of(std::string_view path, std::size_t depth) {
+
+    if(depth == 0) {
+
+        auto slash = path.rfind('/');
+
+        /* The root isn't a directory to act on */
+        return (slash == std::string_view::npos or slash == 0) ? std::string_view() : 
+                                                                  path.substr(0, slash);
+    }
+
+    /* The end of the depth'th component, which must not be the last one */
+    std::size_t end = 0;
+
+    for(std::size_t component = 0; component < depth; ++component) {
+
+        auto start = path.find_first_not_of('/', end);
+
+        if(start == std::string_view::npos) {
+            return {};
+        }
+
+        end = path.find('/', start);
+
+        if(end == std::string_view::npos) {
+            return {};
+        }
+    }
+
+    return (path.find_first_not_of('/', end) == std::string_view::npos) ? std::string_view() :
+                                                                          path.substr(0, end);
+}
+
+
+/* Settled and idle, whichever comes last */
+std::chrono::system_clock::time_point 
+directory_tracker::_due_time(const directory &d, const directory_settings &settings) {
+
+    auto accessed = std::chrono::system_clock::time_point(std::chrono::seconds(d.max_atime));
+
+    return std::max(d.last_seen + settings.settle, accessed + settings.idle);
+}
+
+
+void directory_tracker::_erase(shard &s, lru_list::iterator it,
+                               const directory_settings &settings) {
+
+    if(_pending(*it)) {
+        s.due.erase({ _due_time(*it, settings), &*it });
+    }
+
+    /* The index is keyed by a view of the entry's key */
+    s.index.erase(it->key);
+    s.lru.erase(it);
+}
+
+
+void directory_tracker::record(const scan_message &msg, std::optional<std::size_t> rule,
+                               std::chrono::system_clock::time_point now) {
+
+    for(auto r : _directory_rules) {
+
+        auto &state = *_rules[r];
+
+        /* A subdirectory's files are below the directory at a depth, but
+         * are their own directory when each file's parent is decided */
+        if(msg.type == 'd') {
+
+            if(state.settings.depth == 0) {
+
+                auto parent = directory_of(msg.path, 0);
+
+                if(not parent.empty()) {
+                    _record(state, parent, msg, false, now);
+                }
+            }
+
+            continue;
+        }
+
+        auto path = directory_of(msg.path, state.settings.depth);
+
+        if(not path.empty()) {
+            _record(state, path, msg, rule == r, now);
+        }
+    }
+}
+
+
+void directory_tracker::_record(rule_state &state, std::string_view path, const scan_message &msg,
+                                bool eligible, std::chrono::system_clock::time_point now) {
+
+    const auto &settings = state.settings;
+
+    std::string key;
+
+    key.reserve(msg.filesys.size() + 1 + path.size());
+    key.append(msg.filesys).push_back('\0');
+    key.append(path);
+
+    auto &s = *state.shards[std::hash<std::string>{}(key) % _num_shards];
+    auto atime = std::chrono::duration_cast<std::chrono::seconds>(msg.atime.time_since_epoch()).count();
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto found = s.index.find(key);
+    lru_list::iterator it;
+
+    if(found == s.index.end()) {
+
+        s.lru.push_front(directory {
+            .key = std::move(key),
+            .path_offset = msg.filesys.size() + 1,
+            .max_atime = atime,
+            .files = 0,
+            .bytes = 0,
+            .last_seen = now,
+            .decided = false,
+            .ineligible = false
+        });
+
+        it = s.lru.begin();
+        s.index.emplace(it->key, it);
+
+        if(s.lru.size() > state.shard_capacity) {
+            _erase(s, std::prev(s.lru.end()), settings);
+            _evicted.fetch_add(1, std::memory_order_relaxed);
+        }
+
+    } else {
+
+        it = found->second;
+        s.lru.splice(s.lru.begin(), s.lru, it);
+
+        if(_pending(*it)) {
+            s.due.erase({ _due_time(*it, settings), &*it });
+        }
+
+        /* A new pass of the scan */
+        if(now - it->last_seen > settings.settle) {
+            it->files = 0;
+            it->bytes = 0;
+            it->ineligible = false;
+        }
+
+        /* Accessed since it was decided, it is decided again once idle */
+        if(atime > it->max_atime) {
+            it->max_atime = atime;
+            it->decided = false;
+        }
+
+        it->last_seen = now;
+    }
+
+    if(eligible) {
+        it->files += 1;
+        it->bytes += static_cast<std::int64_t>(msg.size);
+    } else {
+        it->ineligible = true;
+    }
+
+    if(_pending(*it)) {
+        s.due.emplace(_due_time(*it, settings), &*it);
+    }
+}
+
+
+std::vector<directory_decision> 
+directory_tracker::due(std::chrono::system_clock::time_point now, bool scanned) {
+
+    std::vector<directory_decision> decisions;
+
+    for(auto r : _directory_rules) {
+
+        const auto &state = *_rules[r];
+        const auto &settings = state.settings;
+
+        for(const auto &sp : state.shards) {
+
+            auto &s = *sp;
+            std::lock_guard<std::mutex> lock(s.mutex);
+
+            for(auto it = s.due.begin(); it != s.due.end();) {
+
+                auto &d = *it->second;
+
+                if(it->first > now) {
+
+                    if(not scanned) {
+                        break;
+                    }
+
+                    /* Only the settle time can be waived */
+                    auto accessed = std::chrono::system_clock::time_point(std::chrono::seconds(d.max_atime));
+
+                    if(accessed + settings.idle > now) {
+                        ++it;
+                        continue;
+                    }
+                }
+
+                d.decided = true;
+
+                decisions.push_back({
+                    .rule = r,
+                    .filesys = d.key.substr(0, d.path_offset - 1),
+                    .path = d.key.substr(d.path_offset),
+                    .files = d.files,
+                    .bytes = d.bytes,
+                    .atime = std::chrono::system_clock::time_point(std::chrono::seconds(d.max_atime))
+                });
+
+                it = s.due.erase(it);
+            }
+        }
+    }
+
+    return decisions;
+}
+
+
+std::size_t directory_tracker::size() const {
+
+    std::size_t size = 0;
+
+    for(auto r : _directory_rules) {
+        for(const auto &sp : _rules[r]->shards) {
+            std::lock_guard<std::mutex> lock(sp->mutex);
+            size += sp->lru.size();
+        }
+    }
+
+    return size;
+}
+
+
+void directory_tracker::save(snapshot_writer &out) const {
+
+    out.put(static_cast<std::uint32_t>(_directory_rules.size()));
+
+    for(auto r : _directory_rules) {
+
+        const auto &state = *_rules[r];
+
+        out.put_string(state.name);
+        out.put(static_cast<std::uint32_t>(state.shards.size()));
+
+        for(const auto &sp : state.shards) {
+
+            std::lock_guard<std::mutex> lock(sp->mutex);
+
+            out.put(static_cast<std::uint64_t>(sp->lru.size()));
+
+            for(const auto &d : sp->lru) {
+                out.put_string(d.key);
+                out.put(d.max_atime);
+                out.put(d.files);
+                out.put(d.bytes);
+                out.put(static_cast<std::int64_t>(
+                    std::chrono::duration_cast<std::chrono::seconds>(d.last_seen.time_since_epoch()).count()));
+                out.put(static_cast<std::uint8_t>(d.decided));
+                out.put(static_cast<std::uint8_t>(d.ineligible));
+            }
+        }
+    }
+}
+
+
+void directory_tracker::load(snapshot_reader &in) {
+
+    for(auto rules = in.get<std::uint32_t>(); rules > 0; --rules) {
+
+        auto name = in.get_string();
+
+        /* Null if the rule is gone or no longer a directory rule, its 
+         * directories are read and dropped */
+        rule_state *state = nullptr;
+
+        for(auto r : _directory_rules) {
+            if(_rules[r]->name == name) {
+                state = _rules[r].get();
+            }
+        }
+
+        for(auto shards = in.get<std::uint32_t>(); shards > 0; --shards) {
+
+            for(auto count = in.get<std::uint64_t>(); count > 0; --count) {
+
+                auto key = in.get_string();
+                auto max_atime = in.get<std::int64_t>();
+                auto files = in.get<std::int64_t>();
+                auto bytes = in.get<std::int64_t>();
+                auto last_seen = std::chrono::system_clock::time_point(std::chrono::seconds(in.get<std::int64_t>()));
+                bool decided = in.get<std::uint8_t>() != 0;
+                bool ineligible = in.get<std::uint8_t>() != 0;
+
+                auto separator = key.find('\0');
+
+                if(state == nullptr or separator == std::string_view::npos) {
+                    continue;
+                }
+
+                auto &s = *state->shards[std::hash<std::string_view>{}(key) % _num_shards];
+                std::lock_guard<std::mutex> lock(s.mutex);
+
+                /* Saved most recently seen first */
+                if(s.lru.size() >= state->shard_capacity or s.index.contains(key)) {
+                    continue;
+                }
+
+                s.lru.push_back(directory {
+                    .key = std::string(key),
+                    .path_offset = separator + 1,
+                    .max_atime = max_atime,
+                    .files = files,
+                    .bytes = bytes,
+                    .last_seen = last_seen,
+                    .decided = decided,
+                    .ineligible = ineligible
+                });
+
+                auto &d = s.lru.back();
+                s.index.emplace(d.key, std::prev(s.lru.end()));
+
+                if(_pending(d)) {
+                    s.due.emplace(_due_time(d, state->settings), &d);
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
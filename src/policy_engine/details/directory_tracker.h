@@ -0,0 +1,176 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "./engine_snapshot.h"
+#include "./policy_compiler.h"
+
+
+/* A directory a directory rule has decided */
+struct directory_decision {
+    std::size_t rule;
+    std::string filesys;
+    std::string path;
+
+    /* Of the files seen in the last pass of the scan over it */
+    std::int64_t files;
+    std::int64_t bytes;
+
+    /* Latest access of any file seen in it */
+    std::chrono::system_clock::time_point atime;
+};
+
+
+/**
+ * @brief Per directory state of a policy's directory rules, built from the
+ *        scan stream in bounded memory.
+ *
+ * Every record is folded into the state of its directory at each directory
+ * rule's depth: the latest atime, and the files and bytes seen in the 
+ * current pass of the scan, which starts over when a directory is seen 
+ * again after settling.  The agents act on the whole tree of a decided
+ * directory, so a file below it that the rule didn't decide, because an
+ * earlier rule exempted or decided it or it didn't match, makes the
+ * directory ineligible for the pass.  So does a subdirectory of a rule
+ * deciding each file's parent, whose files are tracked as their own
+ * directory.  Scans walk the tree, so a directory that has had no records
+ * for the settle time is taken as fully scanned, and it is due once it has
+ * also been idle long enough.  Each directory is decided once, until a 
+ * newer atime shows one of its files was accessed again.
+ *
+ * The directories are kept in least recently seen order per shard and the
+ * oldest are dropped past each rule's max_directories.  Safe to use from
+ * several threads.
+ */
+class directory_tracker {
+
+    private:
+
+        struct directory {
+            std::string key;            /* File system and path */
+            std::size_t path_offset;
+
+            std::int64_t max_atime;     /* Seconds since the epoch */
+            std::int64_t files = 0;
+            std::int64_t bytes = 0;
+
+            std::chrono::system_clock::time_point last_seen;
+
+            bool decided = false;
+
+            /* Something below it wasn't decided by the rule this pass */
+            bool ineligible = false;
+        };
+
+        using lru_list = std::list<directory>;
+        using due_set = std::set<std::pair<std::chrono::system_clock::time_point, directory *>>;
+
+        struct shard {
+            std::mutex mutex;
+            lru_list lru;
+            std::unordered_map<std::string_view, lru_list::iterator> index;
+
+            /* Undecided, eligible directories by when they will be due */
+            due_set due;
+        };
+
+        struct rule_state {
+            std::size_t rule;
+            std::string name;
+            directory_settings settings;
+            std::size_t shard_capacity;
+            std::vector<std::unique_ptr<shard>> shards;
+        };
+
+        /* Indexed by rule, null for the other rules */
+        std::vector<std::unique_ptr<rule_state>> _rules;
+        std::vector<std::size_t> _directory_rules;
+
+        std::atomic<std::size_t> _evicted{0};
+
+        static constexpr std::size_t _num_shards = 16;
+
+        static std::chrono::system_clock::time_point _due_time(const directory &d,
+                                                                const directory_settings &settings);
+
+        static void _erase(shard &s, lru_list::iterator it,
+                           const directory_settings &settings);
+
+        /* Whether the directory waits in the due set */
+        static bool _pending(const directory &d) {
+            return not d.decided and not d.ineligible;
+        }
+
+        /* Folds a record into the directory at path of rule_state's rule,
+         * eligible if the rule decided it */
+        void _record(rule_state &state, std::string_view path, const scan_message &msg,
+                     bool eligible, std::chrono::system_clock::time_point now);
+
+    public:
+
+        explicit directory_tracker(const compiled_policy &policy);
+
+        directory_tracker(const directory_tracker &) = delete;
+        directory_tracker &operator=(const directory_tracker &) = delete;
+
+        /* The directory at depth of path, or its parent for depth 0, empty 
+         * if the path isn't below one */
+        static std::string_view directory_of(std::string_view path, std::size_t depth);
+
+        /* Whether the policy has any directory rules */
+        bool empty() const {
+            return _directory_rules.empty();
+        }
+
+        /* Any record but a deletion, with the index of the rule that
+         * decided it if one did */
+        void record(const scan_message &msg, std::optional<std::size_t> rule,
+                    std::chrono::system_clock::time_point now);
+
+        /* The directories settled and idle at now.  With scanned the whole
+         * scan has been seen, e.g. at the end of a replay, and directories
+         * don't wait to settle */
+        std::vector<directory_decision> due(std::chrono::system_clock::time_point now,
+                                            bool scanned = false);
+
+        /* Writes the directories of each directory rule by the rule's name,
+         * for a snapshot */
+        void save(snapshot_writer &out) const;
+
+        /* Adds the directories save() wrote of the rules that are still 
+         * directory rules, up to their max_directories.
+         * @throws std::runtime_error if the section is damaged */
+        void load(snapshot_reader &in);
+
+        /* Number of directories tracked */
+        std::size_t size() const;
+
+        /* Directories dropped for room */
+        std::size_t evicted() const {
+            return _evicted.load(std::memory_order_relaxed);
+        }
+};
@@ -0,0 +1,212 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./engine_snapshot.h"
+
+
+/* Magic number at the start of a snapshot, "PMSNAP01" */
+static constexpr std::uint64_t snapshot_magic = 0x313050414e534d50ULL;
+
+/* Bytes before the first section */
+static constexpr std::size_t snapshot_header_size = 40;
+
+
+/* 32-bit FNV-1a, enough to detect a damaged file */
+static std::uint32_t _checksum(const char *data, std::size_t len) {
+
+    std::uint32_t hash = 0x811c9dc5U;
+
+    for(std::size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x01000193U;
+    }
+
+    return hash;
+}
+
+
+void write_snapshot(const std::filesystem::path &path, std::uint64_t sequence,
+                    std::chrono::system_clock::time_point taken,
+                    const std::map<std::string, std::string_view> &sections) {
+
+    std::size_t size = snapshot_header_size;
+
+    for(const auto &[name, data] : sections) {
+        size += sizeof(std::uint16_t) + name.size() + sizeof(std::uint64_t) + data.size();
+    }
+
+    auto tmp = path;
+    tmp += ".tmp";
+
+    int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+    if(fd == -1) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Unable to create snapshot " + tmp.string());
+    }
+
+    auto fail = [&](const std::string &what) {
+        int err = errno;
+        close(fd);
+        unlink(tmp.c_str());
+        throw std::system_error(err, std::generic_category(), what + " " + tmp.string());
+    };
+
+    /* Allocated up front so running out of space shows up here rather than
+     * as a SIGBUS when writing to the mapping */
+    if(int rc = posix_fallocate(fd, 0, static_cast<off_t>(size)); rc != 0) {
+        errno = rc;
+        fail("Unable to allocate snapshot");
+    }
+
+    void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if(mapped == MAP_FAILED) {
+        fail("Unable to map snapshot");
+    }
+
+    auto *base = static_cast<char *>(mapped);
+    auto *out = base + snapshot_header_size;
+
+    for(const auto &[name, data] : sections) {
+
+        auto name_size = static_cast<std::uint16_t>(name.size());
+        auto data_size = static_cast<std::uint64_t>(data.size());
+
+        std::memcpy(out, &name_size, sizeof(name_size));
+        out += sizeof(name_size);
+        std::memcpy(out, name.data(), name.size());
+        out += name.size();
+        std::memcpy(out, &data_size, sizeof(data_size));
+        out += sizeof(data_size);
+        std::memcpy(out, data.data(), data.size());
+        out += data.size();
+    }
+
+    auto count = static_cast<std::uint32_t>(sections.size());
+    auto checksum = _checksum(base + snapshot_header_size, size - snapshot_header_size);
+    auto body_size = static_cast<std::uint64_t>(size - snapshot_header_size);
+    auto seconds = static_cast<std::int64_t>(
+        std::chrono::duration_cast<std::chrono::seconds>(taken.time_since_epoch()).count());
+
+    std::memcpy(base, &snapshot_magic, 8);
+    std::memcpy(base + 8, &sequence, 8);
+    std::memcpy(base + 16, &seconds, 8);
+    std::memcpy(base + 24, &count, 4);
+    std::memcpy(base + 28, &checksum, 4);
+    std::memcpy(base + 32, &body_size, 8);
+
+    int rc = msync(base, size, MS_SYNC);
+    munmap(base, size);
+
+    if(rc != 0 or fsync(fd) != 0) {
+        fail("Unable to sync snapshot");
+    }
+
+    close(fd);
+
+    if(rename(tmp.c_str(), path.c_str()) != 0) {
+        int err = errno;
+        unlink(tmp.c_str());
+        throw std::system_error(err, std::generic_category(),
+                                "Unable to replace snapshot " + path.string());
+    }
+}
+
+
+mapped_snapshot::mapped_snapshot(const std::filesystem::path &path) {
+
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if(fd == -1) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Unable to open snapshot " + path.string());
+    }
+
+    struct stat st;
+
+    if(fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(),
+                                "Unable to stat snapshot " + path.string());
+    }
+
+    _size = static_cast<std::size_t>(st.st_size);
+
+    if(_size < snapshot_header_size) {
+        close(fd);
+        throw std::runtime_error("Snapshot " + path.string() + " is truncated");
+    }
+
+    void *mapped = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    int mmap_errno = errno;
+    close(fd);
+
+    if(mapped == MAP_FAILED) {
+        throw std::system_error(mmap_errno, std::generic_category(),
+                                "Unable to map snapshot " + path.string());
+    }
+
+    _base = static_cast<const char *>(mapped);
+
+    try {
+
+        std::uint64_t magic, body_size;
+        std::int64_t seconds;
+        std::uint32_t count, checksum;
+
+        std::memcpy(&magic, _base, 8);
+        std::memcpy(&_sequence, _base + 8, 8);
+        std::memcpy(&seconds, _base + 16, 8);
+        std::memcpy(&count, _base + 24, 4);
+        std::memcpy(&checksum, _base + 28, 4);
+        std::memcpy(&body_size, _base + 32, 8);
+
+        if(magic != snapshot_magic) {
+            throw std::runtime_error("Not a policy engine snapshot");
+        }
+
+        if(body_size != _size - snapshot_header_size or
+           checksum != _checksum(_base + snapshot_header_size, body_size)) {
+            throw std::runtime_error("Snapshot is damaged");
+        }
+
+        _taken = std::chrono::system_clock::time_point(std::chrono::seconds(seconds));
+
+        snapshot_reader in({ _base + snapshot_header_size, body_size });
+
+        for(std::uint32_t i = 0; i < count; ++i) {
+
+            auto name = in.get_bytes(in.get<std::uint16_t>());
+            auto data = in.get_bytes(in.get<std::uint64_t>());
+
+            _sections.emplace(std::string(name), data);
+        }
+
+    } catch(const std::exception &e) {
+        munmap(const_cast<char *>(_base), _size);
+        throw std::runtime_error("Snapshot " + path.string() + ": " + e.what());
+    }
+}
+
+
+mapped_snapshot::~mapped_snapshot() {
+    munmap(const_cast<char *>(_base), _size);
+}
@@ -0,0 +1,168 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+
+/* Serializes the state of one part of the engine into a snapshot section,
+ * values are stored in the machine's byte order */
+class snapshot_writer {
+
+    private:
+
+        std::string _data;
+
+    public:
+
+        template<typename T>
+            requires std::is_trivially_copyable_v<T>
+        void put(const T &value) {
+            _data.append(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+
+        void put_string(std::string_view sv) {
+            put(static_cast<std::uint32_t>(sv.size()));
+            _data.append(sv);
+        }
+
+        const std::string &data() const {
+            return _data;
+        }
+};
+
+
+/* Reads back what a snapshot_writer wrote */
+class snapshot_reader {
+
+    private:
+
+        std::string_view _data;
+
+        void _need(std::size_t bytes) const {
+            if(_data.size() < bytes) {
+                throw std::runtime_error("Snapshot section is truncated");
+            }
+        }
+
+    public:
+
+        explicit snapshot_reader(std::string_view data) : _data(data) {}
+
+        template<typename T>
+            requires std::is_trivially_copyable_v<T>
+        T get() {
+
+            _need(sizeof(T));
+
+            T value;
+            std::memcpy(&value, _data.data(), sizeof(T));
+            _data.remove_prefix(sizeof(T));
+
+            return value;
+        }
+
+        /* The next size bytes, a view into the snapshot */
+        std::string_view get_bytes(std::size_t size) {
+
+            _need(size);
+
+            auto sv = _data.substr(0, size);
+            _data.remove_prefix(size);
+
+            return sv;
+        }
+
+        std::string_view get_string() {
+            return get_bytes(get<std::uint32_t>());
+        }
+
+        bool empty() const {
+            return _data.empty();
+        }
+};
+
+
+/**
+ * @brief Writes a snapshot of the engine's state taken once it had processed
+ *        the scan stream up to sequence.
+ *
+ * The snapshot is written to a temporary file through a mapping of it,
+ * synced and renamed over path, so a crash while writing leaves the previous
+ * snapshot.  The file is
+ *
+ *      "PMSNAP01" | u64 sequence | i64 taken | u32 sections | u32 checksum |
+ *      u64 size | { u16 name length | name | u64 length | bytes } ...
+ *
+ * where size and checksum cover the sections.
+ *
+ * @throws std::system_error if the file can't be written.
+ */
+void write_snapshot(const std::filesystem::path &path, std::uint64_t sequence,
+                    std::chrono::system_clock::time_point taken,
+                    const std::map<std::string, std::string_view> &sections);
+
+
+/**
+ * @brief A snapshot file mapped read only, the sections are views into the
+ *        mapping.
+ */
+class mapped_snapshot {
+
+    private:
+
+        const char *_base = nullptr;
+        std::size_t _size = 0;
+
+        std::uint64_t _sequence = 0;
+        std::chrono::system_clock::time_point _taken;
+
+        std::map<std::string, std::string_view, std::less<>> _sections;
+
+    public:
+
+        /**
+         * @brief Maps and checks the snapshot at path.
+         *
+         * @throws std::system_error if it can't be opened or mapped.
+         * @throws std::runtime_error if it isn't a complete snapshot.
+         */
+        explicit mapped_snapshot(const std::filesystem::path &path);
+
+        mapped_snapshot(const mapped_snapshot &) = delete;
+        mapped_snapshot &operator=(const mapped_snapshot &) = delete;
+
+        ~mapped_snapshot();
+
+        /* The last sequence of the scan stream the state includes */
+        std::uint64_t sequence() const {
+            return _sequence;
+        }
+
+        std::chrono::system_clock::time_point taken() const {
+            return _taken;
+        }
+
+        /* Empty if the snapshot has no such section */
+        std::string_view section(std::string_view name) const {
+            auto it = _sections.find(name);
+            return it == _sections.end() ? std::string_view() : it->second;
+        }
+};
@@ -0,0 +1,533 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "./namespace_sketches.h"
+
+
+/* 64-bit FNV-1a with a splitmix64 finish so the high bits the registers are
+ * picked by are as good as the low ones */
+static std::uint64_t _hash(std::string_view key) {
+
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for(auto c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+
+    return hash;
+}
+
+
+quantile_sketch::quantile_sketch(std::size_t k, std::uint64_t seed) :
+    _k(std::max<std::size_t>(k, 8)), _levels(1), _random(seed | 1) {
+
+    _max_size = _capacity(0);
+}
+
+
+std::size_t quantile_sketch::_capacity(std::size_t level) const {
+
+    auto depth = _levels.size() - 1 - level;
+
+    return std::max<std::size_t>(2, static_cast<std::size_t>(
+        std::ceil(static_cast<double>(_k) * std::pow(2.0 / 3.0, static_cast<double>(depth)))));
+}
+
+
+void quantile_sketch::add(std::int64_t value) {
+
+    if(_count == 0) {
+        _min = _max = value;
+    } else {
+        _min = std::min(_min, value);
+        _max = std::max(_max, value);
+    }
+
+    ++_count;
+
+    _levels[0].push_back(value);
+
+    if(++_size >= _max_size) {
+        _compress();
+    }
+}
+
+
+void quantile_sketch::_compress() {
+
+    while(_size >= _max_size) {
+
+        std::size_t level = 0;
+
+        while(_levels[level].size() < _capacity(level)) {
+            ++level;
+        }
+
+        if(level + 1 == _levels.size()) {
+            _levels.emplace_back();
+        }
+
+        auto &values = _levels[level];
+        auto &above = _levels[level + 1];
+
+        std::sort(values.begin(), values.end());
+
+        /* xorshift64 */
+        _random ^= _random << 13;
+        _random ^= _random >> 7;
+        _random ^= _random << 17;
+
+        /* An odd value out stays behind */
+        auto pairs = values.size() & ~std::size_t(1);
+
+        for(auto i = static_cast<std::size_t>(_random & 1); i < pairs; i += 2) {
+            above.push_back(values[i]);
+        }
+
+        values.erase(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(pairs));
+
+        _size -= pairs / 2;
+        _max_size = 0;
+
+        for(std::size_t h = 0; h < _levels.size(); ++h) {
+            _max_size += _capacity(h);
+        }
+    }
+}
+
+
+void quantile_sketch::merge(const quantile_sketch &other) {
+
+    if(other._count == 0) {
+        return;
+    }
+
+    if(_count == 0) {
+        _min = other._min;
+        _max = other._max;
+    } else {
+        _min = std::min(_min, other._min);
+        _max = std::max(_max, other._max);
+    }
+
+    _count += other._count;
+
+    while(_levels.size() < other._levels.size()) {
+        _levels.emplace_back();
+    }
+
+    for(std::size_t h = 0; h < other._levels.size(); ++h) {
+        _levels[h].insert(_levels[h].end(), other._levels[h].begin(), other._levels[h].end());
+        _size += other._levels[h].size();
+    }
+
+    _max_size = 0;
+
+    for(std::size_t h = 0; h < _levels.size(); ++h) {
+        _max_size += _capacity(h);
+    }
+
+    _compress();
+}
+
+
+std::vector<std::pair<std::int64_t, std::uint64_t>> quantile_sketch::_weighted() const {
+
+    std::vector<std::pair<std::int64_t, std::uint64_t>> weighted;
+    weighted.reserve(_size);
+
+    for(std::size_t h = 0; h < _levels.size(); ++h) {
+        for(auto value : _levels[h]) {
+            weighted.emplace_back(value, std::uint64_t(1) << h);
+        }
+    }
+
+    std::sort(weighted.begin(), weighted.end());
+
+    return weighted;
+}
+
+
+std::int64_t quantile_sketch::quantile(double q) const {
+
+    if(_count == 0) {
+        return 0;
+    }
+
+    if(q <= 0) {
+        return _min;
+    }
+
+    if(q >= 1) {
+        return _max;
+    }
+
+    auto weighted = _weighted();
+
+    std::uint64_t total = 0;
+
+    for(const auto &[value, weight] : weighted) {
+        total += weight;
+    }
+
+    auto target = q * static_cast<double>(total);
+    std::uint64_t seen = 0;
+
+    for(const auto &[value, weight] : weighted) {
+        seen += weight;
+        if(static_cast<double>(seen) >= target) {
+            return value;
+        }
+    }
+
+    return _max;
+}
+
+
+double quantile_sketch::rank(std::int64_t value) const {
+
+    std::uint64_t total = 0, below = 0;
+
+    for(std::size_t h = 0; h < _levels.size(); ++h) {
+        for(auto v : _levels[h]) {
+            total += std::uint64_t(1) << h;
+            below += v <= value ? std::uint64_t(1) << h : 0;
+        }
+    }
+
+    return total == 0 ? 0.0 : static_cast<double>(below) / static_cast<double>(total);
+}
+
+
+void heavy_hitters::add(std::uint64_t key, std::uint64_t count, std::uint64_t error) {
+
+    if(auto it = _index.find(key); it != _index.end()) {
+        _counters[it->second].count += count;
+        _counters[it->second].error += error;
+        return;
+    }
+
+    if(_counters.size() < _capacity) {
+        _index.emplace(key, _counters.size());
+        _counters.push_back({ key, count, error });
+        return;
+    }
+
+    /* Capacities are small enough that a scan for the smallest beats
+     * keeping the counters ordered */
+    auto smallest = std::min_element(_counters.begin(), _counters.end(),
+        [](const auto &a, const auto &b) { return a.count < b.count; });
+
+    _index.erase(smallest->key);
+    _index.emplace(key, static_cast<std::size_t>(smallest - _counters.begin()));
+
+    *smallest = { key, smallest->count + count, smallest->count + error };
+}
+
+
+void heavy_hitters::merge(const heavy_hitters &other) {
+
+    for(const auto &c : other._counters) {
+        add(c.key, c.count, c.error);
+    }
+}
+
+
+std::vector<heavy_hitters::counter> heavy_hitters::top(std::size_t n) const {
+
+    auto top = _counters;
+
+    std::sort(top.begin(), top.end(), [](const auto &a, const auto &b) {
+        return a.count > b.count or (a.count == b.count and a.key < b.key);
+    });
+
+    top.resize(std::min(n, top.size()));
+
+    return top;
+}
+
+
+void distinct_counter::add(std::string_view key) {
+
+    auto hash = _hash(key);
+
+    /* The top bits pick the register, the rest give the run of zeros, with
+     * a bit set so the run stops within them */
+    auto index = static_cast<std::size_t>(hash >> (64 - _bits));
+    auto rest = (hash << _bits) | (std::uint64_t(1) << (_bits - 1));
+    auto rho = static_cast<std::uint8_t>(std::countl_zero(rest) + 1);
+
+    _registers[index] = std::max(_registers[index], rho);
+}
+
+
+void distinct_counter::merge(const distinct_counter &other) {
+
+    for(std::size_t i = 0; i < _registers.size(); ++i) {
+        _registers[i] = std::max(_registers[i], other._registers[i]);
+    }
+}
+
+
+double distinct_counter::estimate() const {
+
+    const auto m = static_cast<double>(_registers.size());
+    const auto alpha = 0.7213 / (1 + 1.079 / m);
+
+    double sum = 0;
+    std::size_t zeros = 0;
+
+    for(auto r : _registers) {
+        sum += std::ldexp(1.0, -static_cast<int>(r));
+        zeros += r == 0;
+    }
+
+    auto estimate = alpha * m * m / sum;
+
+    /* Small counts leave registers empty, linear counting is closer */
+    if(estimate <= 2.5 * m and zeros > 0) {
+        estimate = m * std::log(m / static_cast<double>(zeros));
+    }
+
+    return estimate;
+}
+
+
+void namespace_sketches::add(const scan_message &msg) {
+
+    auto fs = _filesystems.find(msg.filesys);
+
+    if(fs == _filesystems.end()) {
+        fs = _filesystems.try_emplace(msg.filesys).first;
+    }
+
+    auto &sketches = fs->second;
+
+    /* Directories are counted from the files in them as well, the scan may
+     * not send directory records */
+    if(msg.type == 'd') {
+        sketches.directories.add(msg.path);
+    } else if(auto slash = msg.path.rfind('/'); slash != std::string::npos) {
+        sketches.directories.add(std::string_view(msg.path).substr(0, std::max<std::size_t>(slash, 1)));
+    }
+
+    if(msg.type != 'f') {
+        return;
+    }
+
+    sketches.uids.add(msg.uid);
+
+    auto pool = sketches.pools.find(msg.ost_pool);
+
+    if(pool == sketches.pools.end()) {
+        pool = sketches.pools.try_emplace(msg.ost_pool).first;
+    }
+
+    using std::chrono::duration_cast;
+    using std::chrono::seconds;
+
+    pool->second.atimes.add(duration_cast<seconds>(msg.atime.time_since_epoch()).count());
+    pool->second.sizes.add(static_cast<std::int64_t>(msg.size));
+}
+
+
+void namespace_sketches::merge(const namespace_sketches &other) {
+
+    for(const auto &[name, theirs] : other._filesystems) {
+
+        auto &ours = _filesystems[name];
+
+        for(const auto &[pool, sketches] : theirs.pools) {
+            auto &mine = ours.pools[pool];
+            mine.atimes.merge(sketches.atimes);
+            mine.sizes.merge(sketches.sizes);
+        }
+
+        ours.uids.merge(theirs.uids);
+        ours.directories.merge(theirs.directories);
+    }
+}
+
+
+namespace_summary namespace_sketches::summarize(std::chrono::system_clock::time_point now) const {
+
+    namespace_summary summary;
+
+    summary._taken = now;
+
+    for(const auto &[name, sketches] : _filesystems) {
+
+        auto &fs = summary._filesystems[name];
+
+        for(const auto &[pool, pool_sketches] : sketches.pools) {
+            fs.pools.emplace(pool, namespace_summary::pool_summary{
+                .files = pool_sketches.atimes.count(),
+                .atimes = namespace_summary::rank_table(pool_sketches.atimes),
+                .sizes = namespace_summary::rank_table(pool_sketches.sizes)
+            });
+        }
+
+        fs.top_uids = sketches.uids.top(namespace_summary::top_uids);
+        fs.directories = sketches.directories.estimate();
+    }
+
+    return summary;
+}
+
+
+namespace_summary::rank_table::rank_table(const quantile_sketch &sketch) {
+
+    auto weighted = sketch._weighted();
+
+    std::uint64_t total = 0;
+
+    /* Equal values are folded into one entry */
+    for(const auto &[value, weight] : weighted) {
+
+        total += weight;
+
+        if(not values.empty() and values.back() == value) {
+            cumulative.back() = total;
+        } else {
+            values.push_back(value);
+            cumulative.push_back(total);
+        }
+    }
+}
+
+
+double namespace_summary::rank_table::below(std::int64_t value) const {
+
+    auto it = std::lower_bound(values.begin(), values.end(), value);
+
+    if(it == values.begin()) {
+        return 0.0;
+    }
+
+    return static_cast<double>(cumulative[static_cast<std::size_t>(it - values.begin()) - 1]) /
+           static_cast<double>(cumulative.back());
+}
+
+
+double namespace_summary::rank_table::at_or_below(std::int64_t value) const {
+
+    auto it = std::upper_bound(values.begin(), values.end(), value);
+
+    if(it == values.begin()) {
+        return 0.0;
+    }
+
+    return static_cast<double>(cumulative[static_cast<std::size_t>(it - values.begin()) - 1]) /
+           static_cast<double>(cumulative.back());
+}
+
+
+std::int64_t namespace_summary::rank_table::quantile(double q) const {
+
+    if(values.empty()) {
+        return 0;
+    }
+
+    auto target = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(cumulative.back())));
+    auto it = std::lower_bound(cumulative.begin(), cumulative.end(), std::max<std::uint64_t>(target, 1));
+
+    return values[std::min(static_cast<std::size_t>(it - cumulative.begin()), values.size() - 1)];
+}
+
+
+void namespace_summary::rank(const scan_message &msg, usage_totals &totals) const {
+
+    totals.atime_age_rank = 0;
+    totals.size_rank = 0;
+
+    auto fs = _filesystems.find(msg.filesys);
+
+    if(fs == _filesystems.end()) {
+        return;
+    }
+
+    auto pool = fs->second.pools.find(msg.ost_pool);
+
+    if(pool == fs->second.pools.end() or pool->second.atimes.values.empty()) {
+        return;
+    }
+
+    using std::chrono::duration_cast;
+    using std::chrono::seconds;
+
+    auto atime = duration_cast<seconds>(msg.atime.time_since_epoch()).count();
+
+    totals.atime_age_rank = static_cast<std::int64_t>(
+        std::floor(100 * (1 - pool->second.atimes.below(atime))));
+    totals.size_rank = static_cast<std::int64_t>(
+        std::floor(100 * pool->second.sizes.at_or_below(static_cast<std::int64_t>(msg.size))));
+}
+
+
+std::ostream &operator<<(std::ostream &os, const namespace_summary &summary) {
+
+    using std::chrono::duration_cast;
+    using std::chrono::seconds;
+
+    const auto taken = duration_cast<seconds>(summary._taken.time_since_epoch()).count();
+
+    static constexpr std::array<double, 3> percentiles = { 0.5, 0.9, 0.99 };
+
+    for(const auto &[name, fs] : summary._filesystems) {
+
+        std::uint64_t files = 0;
+
+        for(const auto &[pool, stats] : fs.pools) {
+            files += stats.files;
+        }
+
+        os << name << ": " << files << " files, ~"
+           << static_cast<std::uint64_t>(std::llround(fs.directories)) << " directories, top owners";
+
+        for(const auto &c : fs.top_uids) {
+            os << ' ' << c.key << " (" << c.count << ')';
+        }
+
+        os << '\n';
+
+        for(const auto &[pool, stats] : fs.pools) {
+
+            os << name << '/' << (pool.empty() ? "-" : pool) << ": " << stats.files
+               << " files, atime age days";
+
+            /* The oldest atimes are the low quantiles */
+            for(auto p : percentiles) {
+                os << " p" << std::lround(p * 100) << ' '
+                   << (taken - stats.atimes.quantile(1 - p)) / (24 * 60 * 60);
+            }
+
+            os << ", size";
+
+            for(auto p : percentiles) {
+                os << " p" << std::lround(p * 100) << ' ' << stats.sizes.quantile(p);
+            }
+
+            os << '\n';
+        }
+    }
+
+    return os;
+}
@@ -0,0 +1,277 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "./policy_compiler.h"
+
+
+/**
+ * @brief Approximate quantiles of a stream of integers in bounded memory.
+ *
+ * A KLL sketch: values go into a stack of compactors, level h holding
+ * values that each stand for 2^h of the stream.  When the sketch is full
+ * the lowest level over its capacity is sorted and every other value moves
+ * up a level, starting from a random one of the first two.  Capacities
+ * shrink by 2/3 per level down from the top, so the sketch holds about 3k
+ * values whatever the length of the stream and a rank is off by about
+ * 1.7/k of the count.  Sketches of parts of a stream merge into one of the
+ * whole stream.
+ */
+class quantile_sketch {
+
+    private:
+
+        std::size_t _k;
+
+        std::vector<std::vector<std::int64_t>> _levels;
+
+        /* Values held and the most the levels may hold */
+        std::size_t _size = 0;
+        std::size_t _max_size = 0;
+
+        std::uint64_t _count = 0;
+        std::int64_t _min = 0;
+        std::int64_t _max = 0;
+
+        /* Picks which half of a compacted level is kept */
+        std::uint64_t _random;
+
+        std::size_t _capacity(std::size_t level) const;
+
+        void _compress();
+
+        /* The values with their weights, sorted by value */
+        std::vector<std::pair<std::int64_t, std::uint64_t>> _weighted() const;
+
+        friend class namespace_summary;
+
+    public:
+
+        explicit quantile_sketch(std::size_t k = 200, std::uint64_t seed = 0x9e3779b97f4a7c15ULL);
+
+        void add(std::int64_t value);
+
+        void merge(const quantile_sketch &other);
+
+        /* Values added, which the sketch holds only a few of */
+        std::uint64_t count() const {
+            return _count;
+        }
+
+        bool empty() const {
+            return _count == 0;
+        }
+
+        /* The value at fraction q of the stream, 0 if empty */
+        std::int64_t quantile(double q) const;
+
+        /* Fraction of the stream at or below value */
+        double rank(std::int64_t value) const;
+};
+
+
+/**
+ * @brief The most frequent keys of a stream and their approximate counts.
+ *
+ * Space-saving: up to capacity keys are counted, a key that isn't counted
+ * takes over the smallest counter and inherits its count as the error. Any
+ * key with more than 1/capacity of the stream is among the counters and no
+ * count is over by more than its error.
+ */
+class heavy_hitters {
+
+    public:
+
+        struct counter {
+            std::uint64_t key;
+            std::uint64_t count;
+
+            /* Most count may be over the true one */
+            std::uint64_t error;
+        };
+
+    private:
+
+        std::size_t _capacity;
+
+        std::vector<counter> _counters;
+        std::unordered_map<std::uint64_t, std::size_t> _index;
+
+    public:
+
+        explicit heavy_hitters(std::size_t capacity = 128) : _capacity(capacity) {}
+
+        void add(std::uint64_t key, std::uint64_t count = 1, std::uint64_t error = 0);
+
+        /* The other's counts added, with their errors */
+        void merge(const heavy_hitters &other);
+
+        /* Up to n counters with the highest counts, highest first */
+        std::vector<counter> top(std::size_t n) const;
+};
+
+
+/**
+ * @brief Approximate count of distinct keys in a stream, a HyperLogLog of
+ *        2^12 registers, about 1.6% off and 4 KiB whatever the count.
+ */
+class distinct_counter {
+
+    private:
+
+        static constexpr unsigned _bits = 12;
+
+        std::array<std::uint8_t, std::size_t(1) << _bits> _registers{};
+
+    public:
+
+        void add(std::string_view key);
+
+        void merge(const distinct_counter &other);
+
+        double estimate() const;
+};
+
+
+class namespace_summary;
+
+
+/**
+ * @brief Statistics of the namespace gathered from the scan stream.
+ *
+ * For each file system the sketches keep the distribution of the atimes
+ * and sizes of the files of each OST pool, the owners with the most files
+ * and the number of distinct directories.  A file scanned again counts
+ * again, so the statistics are of a window of the stream no longer than a
+ * scan cycle.  Not thread safe, each evaluator keeps its own and they are
+ * merged for a summary.
+ */
+class namespace_sketches {
+
+    private:
+
+        struct pool_sketches {
+            quantile_sketch atimes;
+            quantile_sketch sizes;
+        };
+
+        struct filesys_sketches {
+            std::map<std::string, pool_sketches, std::less<>> pools;
+            heavy_hitters uids;
+            distinct_counter directories;
+        };
+
+        std::map<std::string, filesys_sketches, std::less<>> _filesystems;
+
+    public:
+
+        void add(const scan_message &msg);
+
+        void merge(const namespace_sketches &other);
+
+        void clear() {
+            _filesystems.clear();
+        }
+
+        bool empty() const {
+            return _filesystems.empty();
+        }
+
+        /* The statistics as of now, for ranking records and reporting */
+        namespace_summary summarize(std::chrono::system_clock::time_point now) const;
+};
+
+
+/**
+ * @brief Statistics taken from the namespace sketches at one point, and the
+ *        ranks of records within their OST pool.
+ *
+ * The sketches' values are flattened into sorted tables of values and their
+ * cumulative weights, so ranking a record is two map lookups and two binary
+ * searches of a few hundred values.  Immutable, so it can be shared by the
+ * evaluators while the sketches go on.
+ */
+class namespace_summary {
+
+    private:
+
+        struct rank_table {
+            std::vector<std::int64_t> values;
+
+            /* Weight of the values up to and including each one */
+            std::vector<std::uint64_t> cumulative;
+
+            explicit rank_table(const quantile_sketch &sketch);
+
+            /* Fractions of the stream below and at or below value */
+            double below(std::int64_t value) const;
+            double at_or_below(std::int64_t value) const;
+
+            std::int64_t quantile(double q) const;
+        };
+
+        struct pool_summary {
+            std::uint64_t files;
+            rank_table atimes;
+            rank_table sizes;
+        };
+
+        struct filesys_summary {
+            std::map<std::string, pool_summary, std::less<>> pools;
+            std::vector<heavy_hitters::counter> top_uids;
+            double directories;
+        };
+
+        std::chrono::system_clock::time_point _taken;
+        std::map<std::string, filesys_summary, std::less<>> _filesystems;
+
+        friend class namespace_sketches;
+
+        friend std::ostream &operator<<(std::ostream &os, const namespace_summary &summary);
+
+    public:
+
+        /* Owners reported for each file system */
+        static constexpr std::size_t top_uids = 5;
+
+        /**
+         * @brief Sets the rank fields of totals for msg: atime_age_rank, the
+         *        percentage of the files of its pool with an atime no earlier, so
+         *        the oldest files rank near 100, and size_rank, the
+         *        percentage no larger than it.  Both are 0 for a pool with
+         *        no statistics.
+         */
+        void rank(const scan_message &msg, usage_totals &totals) const;
+
+        bool empty() const {
+            return _filesystems.empty();
+        }
+
+        std::chrono::system_clock::time_point taken() const {
+            return _taken;
+        }
+};
+
+/* Files, distinct directories and top owners of each file system and the
+ * atime age and size percentiles of each pool, a line each */
+std::ostream &operator<<(std::ostream &os, const namespace_summary &summary);
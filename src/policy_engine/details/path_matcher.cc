@@ -0,0 +1,608 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <stdexcept>
+
+#include "./path_matcher.h"
+
+
+static std::bitset<256> single(char c) {
+
+    std::bitset<256> bytes;
+    bytes.set(static_cast<unsigned char>(c));
+
+    return bytes;
+}
+
+
+static std::bitset<256> any_but_slash() {
+    return ~single('/');
+}
+
+
+/* The bytes of \d, \w and \s in regular expressions, otherwise the
+ * escaped character itself */
+static std::bitset<256> escaped(char c, path_matcher::syntax type) {
+
+    if(type != path_matcher::syntax::REGEX or (c != 'd' and c != 'w' and c != 's')) {
+        return single(c);
+    }
+
+    std::bitset<256> bytes;
+
+    for(int b = 0; b < 256; ++b) {
+
+        bool in = (c == 'd') ? std::isdigit(b) :
+                  (c == 'w') ? (std::isalnum(b) or b == '_') : std::isspace(b);
+
+        bytes.set(static_cast<std::size_t>(b), in);
+    }
+
+    return bytes;
+}
+
+
+/* A [...] class starting after the '[', leaves pos after the ']' */
+static std::bitset<256> parse_class(std::string_view pattern, std::size_t &pos, 
+                                    path_matcher::syntax type) {
+
+    std::bitset<256> bytes;
+    bool negated = false;
+
+    if(pos < pattern.size() and 
+       (pattern[pos] == '^' or (type == path_matcher::syntax::GLOB and pattern[pos] == '!'))) {
+        negated = true;
+        ++pos;
+    }
+
+    /* A ] right after the [ is part of the class */
+    for(bool first = true; ; first = false) {
+
+        if(pos >= pattern.size()) {
+            throw std::invalid_argument("Unterminated [ in '" + std::string(pattern) + "'");
+        }
+
+        char c = pattern[pos++];
+
+        if(c == ']' and not first) {
+            break;
+        }
+
+        if(c == '\\') {
+
+            if(pos >= pattern.size()) {
+                throw std::invalid_argument("Trailing \\ in '" + std::string(pattern) + "'");
+            }
+
+            bytes |= escaped(pattern[pos++], type);
+            continue;
+        }
+
+        /* A range, unless the - ends the class */
+        if(pos + 1 < pattern.size() and pattern[pos] == '-' and pattern[pos + 1] != ']') {
+
+            auto low = static_cast<unsigned char>(c);
+            auto high = static_cast<unsigned char>(pattern[pos + 1]);
+
+            if(low > high) {
+                throw std::invalid_argument("Invalid range in '" + std::string(pattern) + "'");
+            }
+
+            for(auto b = low; ; ++b) {
+                bytes.set(b);
+                if(b == high) break;
+            }
+
+            pos += 2;
+            continue;
+        }
+
+        bytes.set(static_cast<unsigned char>(c));
+    }
+
+    if(negated) {
+        bytes.flip();
+    }
+
+    /* Globs never match across components */
+    if(type == path_matcher::syntax::GLOB) {
+        bytes.reset('/');
+    }
+
+    return bytes;
+}
+
+
+path_matcher::node path_matcher::_parse_glob(std::string_view pattern) {
+
+    using kind = node::kind;
+
+    auto bytes = [](std::bitset<256> b) { return node { .type = kind::BYTES, .bytes = b, .children = {} }; };
+    auto star = [](node child) { return node { .type = kind::STAR, .bytes = {}, .children = { std::move(child) } }; };
+
+    node seq;
+
+    for(std::size_t i = 0; i < pattern.size();) {
+
+        char c = pattern[i];
+
+        if(c == '*' and i + 1 < pattern.size() and pattern[i + 1] == '*') {
+
+            /* As a component of its own it also matches no components */
+            bool component = (i == 0 or pattern[i - 1] == '/') and 
+                             i + 2 < pattern.size() and pattern[i + 2] == '/';
+
+            if(component) {
+
+                node dirs { .type = kind::CONCAT, .bytes = {}, 
+                            .children = { star(bytes(~std::bitset<256>())), bytes(single('/')) } };
+
+                seq.children.push_back({ .type = kind::OPT, .bytes = {}, .children = { std::move(dirs) } });
+                i += 3;
+                continue;
+            }
+
+            seq.children.push_back(star(bytes(~std::bitset<256>())));
+
+            while(i < pattern.size() and pattern[i] == '*') {
+                ++i;
+            }
+
+            continue;
+        }
+
+        ++i;
+
+        switch(c) {
+
+            case '*':
+                seq.children.push_back(star(bytes(any_but_slash())));
+                break;
+
+            case '?':
+                seq.children.push_back(bytes(any_but_slash()));
+                break;
+
+            case '[':
+                seq.children.push_back(bytes(parse_class(pattern, i, syntax::GLOB)));
+                break;
+
+            case '\\':
+
+                if(i >= pattern.size()) {
+                    throw std::invalid_argument("Trailing \\ in '" + std::string(pattern) + "'");
+                }
+
+                seq.children.push_back(bytes(single(pattern[i++])));
+                break;
+
+            default:
+                seq.children.push_back(bytes(single(c)));
+                break;
+        }
+    }
+
+    return seq;
+}
+
+
+/* Recursive descent over
+ *
+ *      alt    := concat ('|' concat)*
+ *      concat := repeat*
+ *      repeat := atom ('*' | '+' | '?')*
+ *      atom   := '(' alt ')' | '[' class ']' | '.' | '\' char | char
+ */
+class regex_parser {
+
+    private:
+
+        using node = path_matcher::node;
+        using kind = node::kind;
+
+        std::string_view _pattern;
+        std::size_t _pos = 0;
+
+        [[noreturn]] void _error(const std::string &what) const {
+            throw std::invalid_argument(what + " in '" + std::string(_pattern) + "'");
+        }
+
+        node _alt() {
+
+            node first = _concat();
+
+            if(_pos >= _pattern.size() or _pattern[_pos] != '|') {
+                return first;
+            }
+
+            node alt { .type = kind::ALT, .bytes = {}, .children = { std::move(first) } };
+
+            while(_pos < _pattern.size() and _pattern[_pos] == '|') {
+                ++_pos;
+                alt.children.push_back(_concat());
+            }
+
+            return alt;
+        }
+
+        node _concat() {
+
+            node seq;
+
+            while(_pos < _pattern.size() and _pattern[_pos] != '|' and _pattern[_pos] != ')') {
+                seq.children.push_back(_repeat());
+            }
+
+            return seq;
+        }
+
+        node _repeat() {
+
+            node atom = _atom();
+
+            while(_pos < _pattern.size()) {
+
+                kind type;
+
+                switch(_pattern[_pos]) {
+                    case '*': type = kind::STAR; break;
+                    case '+': type = kind::PLUS; break;
+                    case '?': type = kind::OPT; break;
+                    case '{': _error("Repetition counts are not supported");
+                    default:  return atom;
+                }
+
+                ++_pos;
+                atom = node { .type = type, .bytes = {}, .children = { std::move(atom) } };
+            }
+
+            return atom;
+        }
+
+        node _atom() {
+
+            auto bytes = [](std::bitset<256> b) { return node { .type = kind::BYTES, .bytes = b, .children = {} }; };
+
+            char c = _pattern[_pos++];
+
+            switch(c) {
+
+                case '(': {
+
+                    auto inner = _alt();
+
+                    if(_pos >= _pattern.size() or _pattern[_pos] != ')') {
+                        _error("Unterminated (");
+                    }
+
+                    ++_pos;
+                    return inner;
+                }
+
+                case '[':
+                    return bytes(parse_class(_pattern, _pos, path_matcher::syntax::REGEX));
+
+                case '.':
+                    return bytes(~std::bitset<256>());
+
+                case '\\':
+
+                    if(_pos >= _pattern.size()) {
+                        _error("Trailing \\");
+                    }
+
+                    return bytes(escaped(_pattern[_pos++], path_matcher::syntax::REGEX));
+
+                case '*': case '+': case '?': case '{':
+                    _error(std::string("Nothing to repeat before ") + c);
+
+                case '^': case '$':
+                    _error("Anchors are only supported at the ends");
+
+                default:
+                    return bytes(single(c));
+            }
+        }
+
+    public:
+
+        explicit regex_parser(std::string_view pattern) : _pattern(pattern) {}
+
+        node parse() {
+
+            auto root = _alt();
+
+            if(_pos < _pattern.size()) {
+                _error("Unmatched )");
+            }
+
+            return root;
+        }
+};
+
+
+path_matcher::node path_matcher::_parse_regex(std::string_view pattern) {
+
+    /* The whole path is matched anyway */
+    if(pattern.starts_with('^')) {
+        pattern.remove_prefix(1);
+    }
+
+    if(pattern.ends_with('$')) {
+
+        /* Unless it is escaped */
+        std::size_t escapes = 0;
+
+        while(escapes + 1 < pattern.size() and pattern[pattern.size() - 2 - escapes] == '\\') {
+            ++escapes;
+        }
+
+        if(escapes % 2 == 0) {
+            pattern.remove_suffix(1);
+        }
+    }
+
+    return regex_parser(pattern).parse();
+}
+
+
+std::uint32_t path_matcher::_new_state() {
+
+    _nfa.emplace_back();
+
+    return static_cast<std::uint32_t>(_nfa.size() - 1);
+}
+
+
+/* Builds the states of n continuing at next, returns the first.  Only
+ * indices are held across calls as _nfa grows */
+std::uint32_t path_matcher::_build(const node &n, std::uint32_t next) {
+
+    using kind = node::kind;
+
+    switch(n.type) {
+
+        case kind::BYTES: {
+            auto s = _new_state();
+            _nfa[s].bytes = n.bytes;
+            _nfa[s].next = next;
+            return s;
+        }
+
+        case kind::CONCAT:
+
+            for(auto it = n.children.rbegin(); it != n.children.rend(); ++it) {
+                next = _build(*it, next);
+            }
+
+            return next;
+
+        case kind::ALT: {
+
+            auto s = _new_state();
+
+            for(const auto &child : n.children) {
+                auto first = _build(child, next);
+                _nfa[s].epsilon.push_back(first);
+            }
+
+            return s;
+        }
+
+        case kind::STAR:
+        case kind::PLUS: {
+
+            auto loop = _new_state();
+            auto body = _build(n.children.front(), loop);
+
+            _nfa[loop].epsilon = { body, next };
+
+            return n.type == kind::STAR ? loop : body;
+        }
+
+        case kind::OPT: {
+
+            auto s = _new_state();
+            auto body = _build(n.children.front(), next);
+
+            _nfa[s].epsilon = { body, next };
+
+            return s;
+        }
+    }
+
+    return next;
+}
+
+
+std::uint32_t path_matcher::add(std::string_view pattern, syntax type) {
+
+    auto it = std::ranges::find_if(_patterns, [&](const auto &p) {
+        return p.first == type and p.second == pattern;
+    });
+
+    if(it != _patterns.end()) {
+        return static_cast<std::uint32_t>(it - _patterns.begin());
+    }
+
+    auto root = (type == syntax::GLOB) ? _parse_glob(pattern) : _parse_regex(pattern);
+    auto index = static_cast<std::uint32_t>(_patterns.size());
+
+    auto accept = _new_state();
+    _nfa[accept].accept = index;
+
+    _starts.push_back(_build(root, accept));
+    _patterns.emplace_back(type, pattern);
+
+    return index;
+}
+
+
+/* Extends states to every state reachable without reading a byte and keeps
+ * only those that read one or accept, sorted, so equal sets compare equal */
+void path_matcher::_closure(std::vector<std::uint32_t> &states) const {
+
+    std::vector<bool> seen(_nfa.size());
+    std::vector<std::uint32_t> stack = std::move(states);
+
+    states.clear();
+
+    while(not stack.empty()) {
+
+        auto s = stack.back();
+        stack.pop_back();
+
+        if(seen[s]) {
+            continue;
+        }
+
+        seen[s] = true;
+
+        const auto &state = _nfa[s];
+
+        if(state.bytes.any() or state.accept != none) {
+            states.push_back(s);
+        }
+
+        stack.insert(stack.end(), state.epsilon.begin(), state.epsilon.end());
+    }
+
+    std::ranges::sort(states);
+}
+
+
+void path_matcher::compile(std::size_t max_states) {
+
+    /* Bytes every pattern treats the same share a column */
+    std::vector<std::bitset<256>> classes;
+
+    for(const auto &state : _nfa) {
+        if(state.bytes.any() and std::ranges::find(classes, state.bytes) == classes.end()) {
+            classes.push_back(state.bytes);
+        }
+    }
+
+    std::map<std::vector<bool>, std::uint8_t> signatures;
+    std::vector<unsigned char> representatives;
+
+    for(std::size_t b = 0; b < 256; ++b) {
+
+        std::vector<bool> signature(classes.size());
+
+        for(std::size_t i = 0; i < classes.size(); ++i) {
+            signature[i] = classes[i][b];
+        }
+
+        auto [it, inserted] = signatures.try_emplace(std::move(signature), 
+                                                     static_cast<std::uint8_t>(signatures.size()));
+
+        if(inserted) {
+            representatives.push_back(static_cast<unsigned char>(b));
+        }
+
+        _columns[b] = it->second;
+    }
+
+    _num_columns = representatives.size();
+
+    /* Subset construction, state 0 is the empty set */
+    std::map<std::vector<std::uint32_t>, std::uint32_t> ids;
+    std::vector<std::vector<std::uint32_t>> sets;
+
+    auto intern = [&](std::vector<std::uint32_t> set) {
+
+        auto [it, inserted] = ids.try_emplace(set, static_cast<std::uint32_t>(sets.size()));
+
+        if(inserted) {
+
+            if(sets.size() >= max_states) {
+                throw std::invalid_argument("Path patterns need more than " + 
+                                            std::to_string(max_states) + " automaton states");
+            }
+
+            sets.push_back(std::move(set));
+        }
+
+        return it->second;
+    };
+
+    intern({});
+
+    auto start = _starts;
+    _closure(start);
+    _start = intern(std::move(start));
+
+    _next.clear();
+
+    for(std::size_t k = 0; k < sets.size(); ++k) {
+
+        const auto current = sets[k];
+
+        for(std::size_t c = 0; c < _num_columns; ++c) {
+
+            std::vector<std::uint32_t> next;
+
+            for(auto s : current) {
+                if(_nfa[s].bytes[representatives[c]]) {
+                    next.push_back(_nfa[s].next);
+                }
+            }
+
+            _closure(next);
+            _next.push_back(intern(std::move(next)));
+        }
+    }
+
+    _words = (_patterns.size() + 63) / 64;
+    _accepts.assign(sets.size() * _words, 0);
+
+    for(std::size_t k = 0; k < sets.size(); ++k) {
+        for(auto s : sets[k]) {
+            if(auto pattern = _nfa[s].accept; pattern != none) {
+                _accepts[k * _words + pattern / 64] |= std::uint64_t(1) << (pattern % 64);
+            }
+        }
+    }
+
+    /* Only the tables are needed to match */
+    _nfa = {};
+    _starts = {};
+}
+
+
+std::string path_matcher::literal_prefix(std::string_view pattern, syntax type) {
+
+    if(type == syntax::GLOB) {
+        return std::string(pattern.substr(0, pattern.find_first_of("*?[\\")));
+    }
+
+    if(pattern.starts_with('^')) {
+        pattern.remove_prefix(1);
+    }
+
+    /* An alternative needn't start with the same characters */
+    if(pattern.find('|') != std::string_view::npos) {
+        return {};
+    }
+
+    auto end = pattern.find_first_of("\\.[]()*+?{}^$");
+    auto prefix = std::string(pattern.substr(0, end));
+
+    /* The last character may be repeated zero times */
+    if(end != std::string_view::npos and not prefix.empty() and 
+       (pattern[end] == '*' or pattern[end] == '?' or pattern[end] == '{')) {
+        prefix.pop_back();
+    }
+
+    return prefix;
+}
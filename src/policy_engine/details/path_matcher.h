@@ -0,0 +1,149 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+/**
+ * @brief Matches a path against all the globs and regular expressions of a
+ *        policy in one pass.
+ *
+ * Every pattern is translated to a nondeterministic automaton and all of them
+ * are combined into one deterministic automaton, so matching a path is one
+ * table lookup per byte whatever the number of patterns, and the state the
+ * path ends in tells which patterns matched it.  Bytes that no pattern tells
+ * apart share a column of the table to keep it small, and a path stops being
+ * read as soon as no pattern can match it any more.
+ *
+ * Patterns match the whole path.  Globs take * and ? within one path
+ * component, ** across components, including none when it is a component of
+ * its own, [...] and [!...] classes and \ escapes.  Regular expressions take
+ * . [...] [^...] * + ? | ( ) and the escapes \d \w \s, ^ and $ are implied.
+ */
+class path_matcher {
+
+    public:
+
+        enum class syntax : std::uint8_t { GLOB, REGEX };
+
+        /* The state of paths no pattern can match */
+        static constexpr std::uint32_t dead = 0;
+
+    private:
+
+        static constexpr std::uint32_t none = UINT32_MAX;
+
+        struct nfa_state {
+            std::bitset<256> bytes;
+            std::uint32_t next = none;
+            std::vector<std::uint32_t> epsilon;
+            std::uint32_t accept = none;
+        };
+
+        /* Pattern syntax tree, only used while adding a pattern */
+        struct node {
+            enum class kind : std::uint8_t { BYTES, CONCAT, ALT, STAR, PLUS, OPT };
+
+            kind type = kind::CONCAT;
+            std::bitset<256> bytes;
+            std::vector<node> children;
+        };
+
+        friend class regex_parser;
+
+        std::vector<std::pair<syntax, std::string>> _patterns;
+
+        /* Emptied by compile() */
+        std::vector<nfa_state> _nfa;
+        std::vector<std::uint32_t> _starts;
+
+        /* Byte to column of the transition table */
+        std::array<std::uint8_t, 256> _columns{};
+        std::size_t _num_columns = 1;
+
+        std::uint32_t _start = dead;
+        std::vector<std::uint32_t> _next;
+
+        /* Words of the set of patterns each state accepts */
+        std::size_t _words = 0;
+        std::vector<std::uint64_t> _accepts;
+
+        static node _parse_glob(std::string_view pattern);
+        static node _parse_regex(std::string_view pattern);
+
+        std::uint32_t _build(const node &n, std::uint32_t next);
+        std::uint32_t _new_state();
+
+        void _closure(std::vector<std::uint32_t> &states) const;
+
+    public:
+
+        /**
+         * @brief Adds a pattern unless it was already added.
+         *
+         * @return The index of the pattern.
+         * @throws std::invalid_argument if the pattern is malformed.
+         */
+        std::uint32_t add(std::string_view pattern, syntax type);
+
+        /**
+         * @brief Builds the automaton once all the patterns are added.
+         *
+         * @throws std::invalid_argument if it would have more than max_states
+         *         states.
+         */
+        void compile(std::size_t max_states = 1 << 16);
+
+        /* The state the path ends in, valid after compile() */
+        std::uint32_t run(std::string_view path) const {
+
+            auto state = _start;
+
+            for(std::size_t i = 0; i < path.size() and state != dead; ++i) {
+                state = _next[state * _num_columns + _columns[static_cast<unsigned char>(path[i])]];
+            }
+
+            return state;
+        }
+
+        /* Whether the pattern matches the paths ending in state */
+        bool matched(std::uint32_t state, std::uint32_t pattern) const {
+            return (_accepts[state * _words + pattern / 64] >> (pattern % 64)) & 1;
+        }
+
+        /* The characters every match of the pattern starts with */
+        static std::string literal_prefix(std::string_view pattern, syntax type);
+
+        bool empty() const {
+            return _patterns.empty();
+        }
+
+        /* Number of distinct patterns */
+        std::size_t size() const {
+            return _patterns.size();
+        }
+
+        const std::string &pattern(std::uint32_t index) const {
+            return _patterns[index].second;
+        }
+
+        std::size_t states() const {
+            return _next.size() / _num_columns;
+        }
+};
@@ -0,0 +1,1530 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <ranges>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "./policy_compiler.h"
+
+
+static constexpr std::array<std::string_view, num_numeric_policy_fields +
+                                              num_string_policy_fields> field_names = {
+    "type", "atime", "mtime", "atime_age", "mtime_age", "size", "uid", "gid",
+    "stripe_count", "uid_bytes", "uid_files", "gid_bytes", "gid_files", 
+    "pool_bytes", "pool_files", "atime_age_rank", "size_rank", "path", "ost_pool", "filesys", "fid"
+};
+
+static constexpr std::array<std::string_view, 9> op_names = {
+    "==", "!=", "<", "<=", ">", ">=", "startswith", "matches", "regex"
+};
+
+static constexpr std::array<std::string_view, 3> action_names = {
+    "purge", "migrate", "skip"
+};
+
+
+std::string_view policy_field_name(policy_field field) {
+    return field_names[static_cast<std::size_t>(field)];
+}
+
+std::string_view policy_op_name(policy_op op) {
+    return op_names[static_cast<std::size_t>(op)];
+}
+
+std::string_view policy_action_name(policy_action action) {
+    return action_names[static_cast<std::size_t>(action)];
+}
+
+policy_action parse_policy_action(std::string_view action) {
+
+    auto it = std::ranges::find(action_names, action);
+
+    if(it == action_names.end()) {
+        throw std::invalid_argument("Unknown policy action: " + std::string(action));
+    }
+
+    return static_cast<policy_action>(it - action_names.begin());
+}
+
+
+
+
+/* Recursive descent parser for
+ *
+ *      expr    := and ('or' and)*
+ *      and     := unary ('and' unary)*
+ *      unary   := 'not' unary | '(' expr ')' | field op literal
+ *      op      := '==' | '!=' | '<' | '<=' | '>' | '>=' | 'startswith' |
+ *                 'matches' | 'regex'
+ *      literal := number [unit] | 'string' | "string"
+ */
+class policy_parser {
+
+    private:
+
+        enum class token_type { IDENT, NUMBER, STRING, OP, LPAREN, RPAREN, END };
+
+        struct token {
+            token_type type;
+            std::string_view text;
+            std::size_t column;
+        };
+
+        std::string_view _text;
+        std::size_t _pos = 0;
+        token _token;
+
+        [[noreturn]] void _error(const std::string &what, std::size_t column) const {
+            throw std::invalid_argument(what + " at column " + std::to_string(column + 1));
+        }
+
+        void _next() {
+
+            while(_pos < _text.size() and std::isspace(static_cast<unsigned char>(_text[_pos]))) {
+                ++_pos;
+            }
+
+            auto start = _pos;
+
+            if(_pos == _text.size()) {
+                _token = { token_type::END, {}, start };
+                return;
+            }
+
+            char c = _text[_pos];
+
+            if(std::isalpha(static_cast<unsigned char>(c)) or c == '_') {
+
+                while(_pos < _text.size() and
+                      (std::isalnum(static_cast<unsigned char>(_text[_pos])) or _text[_pos] == '_')) {
+                    ++_pos;
+                }
+
+                _token = { token_type::IDENT, _text.substr(start, _pos - start), start };
+
+            /* The unit suffix is part of the number */
+            } else if(std::isdigit(static_cast<unsigned char>(c))) {
+
+                while(_pos < _text.size() and std::isalnum(static_cast<unsigned char>(_text[_pos]))) {
+                    ++_pos;
+                }
+
+                _token = { token_type::NUMBER, _text.substr(start, _pos - start), start };
+
+            } else if(c == '\'' or c == '"') {
+
+                auto end = _text.find(c, _pos + 1);
+
+                if(end == std::string_view::npos) {
+                    _error("Unterminated string", start);
+                }
+
+                _token = { token_type::STRING, _text.substr(start + 1, end - start - 1), start };
+                _pos = end + 1;
+
+            } else if(c == '(' or c == ')') {
+
+                _token = { c == '(' ? token_type::LPAREN : token_type::RPAREN,
+                           _text.substr(start, 1), start };
+                ++_pos;
+
+            } else if(c == '=' or c == '!' or c == '<' or c == '>') {
+
+                ++_pos;
+
+                if(_pos < _text.size() and _text[_pos] == '=') {
+                    ++_pos;
+                }
+
+                auto op = _text.substr(start, _pos - start);
+
+                if(op == "=" or op == "!") {
+                    _error("Unknown operator '" + std::string(op) + "'", start);
+                }
+
+                _token = { token_type::OP, op, start };
+
+            } else {
+                _error(std::string("Unexpected character '") + c + "'", start);
+            }
+        }
+
+        bool _keyword(std::string_view word) const {
+            return _token.type == token_type::IDENT and _token.text == word;
+        }
+
+        policy_expr _or() {
+
+            auto lhs = _and();
+
+            if(not _keyword("or")) {
+                return lhs;
+            }
+
+            policy_expr expr;
+            expr.type = policy_expr::kind::OR;
+            expr.children.emplace_back(std::move(lhs));
+
+            while(_keyword("or")) {
+                _next();
+                expr.children.emplace_back(_and());
+            }
+
+            return expr;
+        }
+
+        policy_expr _and() {
+
+            auto lhs = _unary();
+
+            if(not _keyword("and")) {
+                return lhs;
+            }
+
+            policy_expr expr;
+            expr.type = policy_expr::kind::AND;
+            expr.children.emplace_back(std::move(lhs));
+
+            while(_keyword("and")) {
+                _next();
+                expr.children.emplace_back(_unary());
+            }
+
+            return expr;
+        }
+
+        policy_expr _unary() {
+
+            if(_keyword("not")) {
+
+                _next();
+
+                policy_expr expr;
+                expr.type = policy_expr::kind::NOT;
+                expr.children.emplace_back(_unary());
+
+                return expr;
+            }
+
+            if(_token.type == token_type::LPAREN) {
+
+                _next();
+
+                auto expr = _or();
+
+                if(_token.type != token_type::RPAREN) {
+                    _error("Expected ')'", _token.column);
+                }
+
+                _next();
+
+                return expr;
+            }
+
+            return _comparison();
+        }
+
+        policy_expr _comparison() {
+
+            if(_token.type != token_type::IDENT) {
+                _error("Expected a field", _token.column);
+            }
+
+            auto field_it = std::ranges::find(field_names, _token.text);
+
+            if(field_it == field_names.end()) {
+                _error("Unknown field '" + std::string(_token.text) + "'", _token.column);
+            }
+
+            policy_expr expr;
+            expr.field = static_cast<policy_field>(field_it - field_names.begin());
+
+            _next();
+
+            if(_token.type == token_type::OP or _keyword("startswith") or 
+               _keyword("matches") or _keyword("regex")) {
+                expr.op = static_cast<policy_op>(std::ranges::find(op_names, _token.text) -
+                                                 op_names.begin());
+            } else {
+                _error("Expected a comparison operator", _token.column);
+            }
+
+            auto op_column = _token.column;
+
+            _next();
+
+            auto literal = _token;
+
+            _next();
+
+            auto field_name = std::string(policy_field_name(expr.field));
+
+            /* String fields compare against strings with ==, != and startswith */
+            if(not is_numeric(expr.field)) {
+
+                if(literal.type != token_type::STRING) {
+                    _error("Field " + field_name + " must be compared to a string", literal.column);
+                }
+
+                if(expr.op != policy_op::EQ and expr.op != policy_op::NE and
+                   expr.op != policy_op::STARTS_WITH and 
+                   not (is_pattern(expr.op) and expr.field == policy_field::PATH)) {
+                    _error("Operator not supported for field " + field_name, op_column);
+                }
+
+                expr.string = literal.text;
+
+                /* Checked here for the column, compiled with the others later */
+                if(is_pattern(expr.op)) {
+                    try {
+                        path_matcher().add(expr.string, expr.op == policy_op::MATCHES ? 
+                                           path_matcher::syntax::GLOB : path_matcher::syntax::REGEX);
+                    } catch(const std::invalid_argument &e) {
+                        _error(e.what(), literal.column);
+                    }
+                }
+
+                return expr;
+            }
+
+            if(expr.op == policy_op::STARTS_WITH) {
+                _error("startswith is only supported for string fields", op_column);
+            }
+
+            if(is_pattern(expr.op)) {
+                _error(std::string(policy_op_name(expr.op)) + " is only supported for path", op_column);
+            }
+
+            /* The type is a single character, e.g. 'f' or 'd' */
+            if(expr.field == policy_field::TYPE) {
+
+                if(literal.type != token_type::STRING or literal.text.size() != 1) {
+                    _error("Field type must be compared to a single character string", literal.column);
+                }
+
+                if(expr.op != policy_op::EQ and expr.op != policy_op::NE) {
+                    _error("Operator not supported for field type", op_column);
+                }
+
+                expr.number = static_cast<unsigned char>(literal.text[0]);
+
+                return expr;
+            }
+
+            if(literal.type != token_type::NUMBER) {
+                _error("Field " + field_name + " must be compared to a number", literal.column);
+            }
+
+            expr.number = _number(expr.field, literal);
+
+            return expr;
+        }
+
+        /* Converts the number to the units of the field */
+        std::int64_t _number(policy_field field, const token &literal) const {
+
+            auto digits = literal.text.substr(0, literal.text.find_first_not_of("0123456789"));
+            auto unit = literal.text.substr(digits.size());
+
+            std::int64_t value = 0;
+
+            for(char c : digits) {
+
+                if(value > (std::numeric_limits<std::int64_t>::max() - (c - '0')) / 10) {
+                    _error("Number out of range", literal.column);
+                }
+
+                value = value * 10 + (c - '0');
+            }
+
+            std::int64_t scale = 1;
+
+            if(field == policy_field::ATIME_AGE or field == policy_field::MTIME_AGE) {
+
+                if(unit == "m") {
+                    scale = 60;
+                } else if(unit == "h") {
+                    scale = 60 * 60;
+                } else if(unit == "d") {
+                    scale = 24 * 60 * 60;
+                } else if(unit == "w") {
+                    scale = 7 * 24 * 60 * 60;
+                } else if(not unit.empty() and unit != "s") {
+                    _error("Unknown duration unit '" + std::string(unit) + "'", literal.column);
+                }
+
+            } else if(field == policy_field::SIZE or field == policy_field::UID_BYTES or
+                      field == policy_field::GID_BYTES or field == policy_field::POOL_BYTES) {
+
+                static constexpr std::string_view size_units = "KMGTP";
+
+                if(unit.size() == 1 and size_units.find(unit[0]) != std::string_view::npos) {
+                    scale = std::int64_t(1) << (10 * (size_units.find(unit[0]) + 1));
+                } else if(not unit.empty()) {
+                    _error("Unknown size unit '" + std::string(unit) + "'", literal.column);
+                }
+
+            } else if(not unit.empty()) {
+
+                if(field == policy_field::ATIME or field == policy_field::MTIME) {
+                    _error("Field " + std::string(policy_field_name(field)) +
+                           " is seconds since the epoch, use " +
+                           std::string(policy_field_name(field)) + "_age for durations",
+                           literal.column);
+                }
+
+                _error("Field " + std::string(policy_field_name(field)) + " takes no unit",
+                       literal.column);
+            }
+
+            if(value > std::numeric_limits<std::int64_t>::max() / scale) {
+                _error("Number out of range", literal.column);
+            }
+
+            return value * scale;
+        }
+
+    public:
+
+        explicit policy_parser(std::string_view text) : _text(text) {
+            _next();
+        }
+
+        policy_expr parse() {
+
+            auto expr = _or();
+
+            if(_token.type != token_type::END) {
+                _error("Unexpected '" + std::string(_token.text) + "'", _token.column);
+            }
+
+            return expr;
+        }
+};
+
+
+policy_expr parse_policy_expression(std::string_view text) {
+    return policy_parser(text).parse();
+}
+
+
+std::ostream &operator<<(std::ostream &os, const policy_expr &expr) {
+
+    switch(expr.type) {
+
+        case policy_expr::kind::COMPARE:
+
+            os << policy_field_name(expr.field) << " " << policy_op_name(expr.op) << " ";
+
+            if(not is_numeric(expr.field)) {
+                os << "'" << expr.string << "'";
+            } else if(expr.field == policy_field::TYPE) {
+                os << "'" << static_cast<char>(expr.number) << "'";
+            } else {
+                os << expr.number;
+            }
+
+            return os;
+
+        case policy_expr::kind::NOT:
+            return os << "not (" << expr.children.front() << ")";
+
+        default:
+
+            os << "(";
+
+            for(std::size_t i = 0; i < expr.children.size(); ++i) {
+                os << (i > 0 ? (expr.type == policy_expr::kind::AND ? " and " : " or ") : "")
+                   << expr.children[i];
+            }
+
+            return os << ")";
+    }
+}
+
+
+/* A size with an optional K, M, G, T or P suffix */
+static std::int64_t parse_size(const std::string &text) {
+
+    static constexpr std::string_view units = "KMGTP";
+
+    std::size_t end = 0;
+    auto value = std::stoll(text, &end);
+    auto unit = std::string_view(text).substr(end);
+
+    if(unit.size() == 1 and units.find(unit[0]) != std::string_view::npos) {
+        value <<= 10 * (units.find(unit[0]) + 1);
+    } else if(not unit.empty()) {
+        throw std::invalid_argument("Unknown size unit '" + std::string(unit) + "'");
+    }
+
+    return value;
+}
+
+
+/* A duration with an optional s, m, h, d or w suffix */
+static std::chrono::seconds parse_duration(const std::string &text) {
+
+    static constexpr std::array<std::pair<std::string_view, std::int64_t>, 5> units = {{
+        { "s", 1 }, { "m", 60 }, { "h", 3600 }, { "d", 86400 }, { "w", 604800 }
+    }};
+
+    std::size_t end = 0;
+    auto value = std::stoll(text, &end);
+    auto unit = std::string_view(text).substr(end);
+
+    if(unit.empty()) {
+        return std::chrono::seconds(value);
+    }
+
+    for(const auto &[name, scale] : units) {
+        if(unit == name) {
+            return std::chrono::seconds(value * scale);
+        }
+    }
+
+    throw std::invalid_argument("Unknown duration unit '" + std::string(unit) + "'");
+}
+
+
+/* A percentage, e.g. 90%, or a fraction */
+static double parse_fraction(const std::string &text) {
+
+    std::size_t end = 0;
+    auto value = std::stod(text, &end);
+
+    if(text.substr(end) == "%") {
+        value /= 100;
+    } else if(end != text.size()) {
+        throw std::invalid_argument("Invalid fraction '" + text + "'");
+    }
+
+    return value;
+}
+
+
+std::optional<watermark_settings> 
+parse_watermark_settings(const std::map<std::string, std::string> &parameters, 
+                         policy_action action) {
+
+    if(parameters.empty()) {
+        return std::nullopt;
+    }
+
+    if(action != policy_action::PURGE) {
+        throw std::invalid_argument("Only purge rules take watermarks");
+    }
+
+    watermark_settings settings;
+
+    /* stoll and stod throw std::invalid_argument themselves, but with
+     * messages that don't say what was wrong */
+    static constexpr std::array<std::string_view, 5> known = {
+        "capacity", "high_watermark", "low_watermark", "max_candidates", "order"
+    };
+
+    for(const auto &[name, value] : parameters) {
+
+        if(std::ranges::find(known, name) == known.end()) {
+            throw std::invalid_argument("Unknown rule parameter " + name);
+        }
+
+        try {
+
+            if(name == "capacity") {
+                settings.capacity = parse_size(value);
+            } else if(name == "high_watermark") {
+                settings.high = parse_fraction(value);
+            } else if(name == "low_watermark") {
+                settings.low = parse_fraction(value);
+            } else if(name == "max_candidates") {
+                settings.max_candidates = std::stoull(value);
+            } else if(name == "order" and value == "atime") {
+                settings.order = purge_order::ATIME;
+            } else if(name == "order" and value == "age_size") {
+                settings.order = purge_order::AGE_SIZE;
+            } else {
+                throw std::invalid_argument("must be atime or age_size");
+            }
+
+        } catch(const std::logic_error &e) {
+            throw std::invalid_argument("Invalid " + name + " '" + value + "': " + e.what());
+        }
+    }
+
+    if(settings.capacity <= 0) {
+        throw std::invalid_argument("Watermark rules need a positive capacity");
+    }
+
+    if(not (0 <= settings.low and settings.low < settings.high and settings.high <= 1)) {
+        throw std::invalid_argument("Watermarks must satisfy 0 <= low < high <= 1");
+    }
+
+    if(settings.max_candidates == 0) {
+        throw std::invalid_argument("max_candidates must be positive");
+    }
+
+    return settings;
+}
+
+
+std::optional<directory_settings>
+parse_directory_settings(const std::map<std::string, std::string> &parameters,
+                         policy_action action) {
+
+    if(not parameters.contains("directory")) {
+        return std::nullopt;
+    }
+
+    if(action == policy_action::SKIP) {
+        throw std::invalid_argument("Only purge and migrate rules act on directories");
+    }
+
+    directory_settings settings;
+
+    static constexpr std::array<std::string_view, 4> known = {
+        "directory", "idle", "settle", "max_directories"
+    };
+
+    for(const auto &[name, value] : parameters) {
+
+        if(std::ranges::find(known, name) == known.end()) {
+            throw std::invalid_argument("Unknown directory rule parameter " + name);
+        }
+
+        try {
+
+            if(name == "directory") {
+                settings.depth = (value == "parent") ? 0 : std::stoull(value);
+
+                if(value != "parent" and settings.depth == 0) {
+                    throw std::invalid_argument("must be parent or a positive depth");
+                }
+
+            } else if(name == "idle") {
+                settings.idle = parse_duration(value);
+            } else if(name == "settle") {
+                settings.settle = parse_duration(value);
+            } else {
+                settings.max_directories = std::stoull(value);
+            }
+
+        } catch(const std::logic_error &e) {
+            throw std::invalid_argument("Invalid " + name + " '" + value + "': " + e.what());
+        }
+    }
+
+    if(settings.idle.count() < 0 or settings.settle.count() < 0) {
+        throw std::invalid_argument("idle and settle can't be negative");
+    }
+
+    if(settings.max_directories == 0) {
+        throw std::invalid_argument("max_directories must be positive");
+    }
+
+    return settings;
+}
+
+
+std::optional<migration_settings>
+parse_migration_settings(const std::map<std::string, std::string> &parameters,
+                         policy_action action) {
+
+    if(not parameters.contains("target_pools")) {
+
+        if(parameters.contains("stripe_count")) {
+            throw std::invalid_argument("stripe_count needs target_pools");
+        }
+
+        return std::nullopt;
+    }
+
+    if(action != policy_action::MIGRATE) {
+        throw std::invalid_argument("Only migrate rules take target pools");
+    }
+
+    migration_settings settings;
+
+    for(const auto &[name, value] : parameters) {
+
+        if(name == "target_pools") {
+
+            for(auto pool : value | std::views::split(',')) {
+
+                std::string_view sv(pool.begin(), pool.end());
+
+                auto first = sv.find_first_not_of(" \t");
+                auto last = sv.find_last_not_of(" \t");
+
+                if(first == std::string_view::npos) {
+                    throw std::invalid_argument("Empty pool name in target_pools '" + value + "'");
+                }
+
+                settings.pools.emplace_back(sv.substr(first, last - first + 1));
+            }
+
+        } else if(name == "stripe_count") {
+
+            try {
+                auto count = std::stoul(value);
+
+                if(count == 0 or count > 2000) {
+                    throw std::out_of_range("must be between 1 and 2000");
+                }
+
+                settings.stripe_count = static_cast<std::uint32_t>(count);
+
+            } catch(const std::logic_error &e) {
+                throw std::invalid_argument("Invalid " + name + " '" + value + "': " + e.what());
+            }
+
+        } else {
+            throw std::invalid_argument("Unknown migration rule parameter " + name);
+        }
+    }
+
+    return settings;
+}
+
+
+std::vector<policy_rule_spec> default_policy_rules() {
+
+    return {
+        { "purge-unused", "type == 'f' and atime_age > 30d", "purge" },
+        { "migrate-performance",
+          "type == 'f' and atime_age > 2d and ost_pool == 'performance'", "migrate" }
+    };
+}
+
+
+
+
+policy_registers compiled_policy::load(const scan_message &msg,
+                                       std::chrono::system_clock::time_point now,
+                                       const usage_totals &usage) {
+
+    using std::chrono::duration_cast;
+    using std::chrono::seconds;
+
+    policy_registers regs;
+
+    auto atime = duration_cast<seconds>(msg.atime.time_since_epoch()).count();
+    auto mtime = duration_cast<seconds>(msg.mtime.time_since_epoch()).count();
+    auto now_s = duration_cast<seconds>(now.time_since_epoch()).count();
+
+    regs.numbers = {
+        static_cast<unsigned char>(msg.type),
+        atime,
+        mtime,
+        now_s - atime,
+        now_s - mtime,
+        static_cast<std::int64_t>(msg.size),
+        static_cast<std::int64_t>(msg.uid),
+        static_cast<std::int64_t>(msg.gid),
+        static_cast<std::int64_t>(msg.stripe_count),
+        usage.uid_bytes,
+        usage.uid_files,
+        usage.gid_bytes,
+        usage.gid_files,
+        usage.pool_bytes,
+        usage.pool_files,
+        usage.atime_age_rank,
+        usage.size_rank
+    };
+
+    regs.strings = { msg.path, msg.ost_pool, msg.filesys, msg.fid };
+
+    return regs;
+}
+
+
+/* Adds the path patterns of expr to the path matcher and keeps their index */
+void compiled_policy::_add_patterns(policy_expr &expr) {
+
+    for(auto &child : expr.children) {
+        _add_patterns(child);
+    }
+
+    if(expr.type == policy_expr::kind::COMPARE and is_pattern(expr.op)) {
+        expr.number = _paths.add(expr.string, expr.op == policy_op::MATCHES ? 
+                                 path_matcher::syntax::GLOB : path_matcher::syntax::REGEX);
+    }
+}
+
+
+std::uint32_t compiled_policy::_emit(const policy_expr &expr,
+                                     std::uint32_t on_true,
+                                     std::uint32_t on_false) {
+
+    switch(expr.type) {
+
+        case policy_expr::kind::NOT:
+            return _emit(expr.children.front(), on_false, on_true);
+
+        /* Each child continues to the next one on true, the last one to
+         * on_true, so emit them back to front */
+        case policy_expr::kind::AND:
+
+            for(auto it = expr.children.rbegin(); it != expr.children.rend(); ++it) {
+                on_true = _emit(*it, on_true, on_false);
+            }
+
+            return on_true;
+
+        case policy_expr::kind::OR:
+
+            for(auto it = expr.children.rbegin(); it != expr.children.rend(); ++it) {
+                on_false = _emit(*it, on_true, on_false);
+            }
+
+            return on_false;
+
+        default:
+            break;
+    }
+
+    /* Canonicalize the operator so the evaluator only needs EQ, LT, LE and
+     * STARTS_WITH */
+    auto op = expr.op;
+
+    switch(op) {
+        case policy_op::NE: op = policy_op::EQ; std::swap(on_true, on_false); break;
+        case policy_op::GT: op = policy_op::LE; std::swap(on_true, on_false); break;
+        case policy_op::GE: op = policy_op::LT; std::swap(on_true, on_false); break;
+        default: break;
+    }
+
+    std::int64_t operand = expr.number;
+
+    /* Share string constants between rules, patterns are already shared by
+     * the path matcher */
+    if(not is_numeric(expr.field) and not is_pattern(op)) {
+
+        auto it = std::ranges::find(_strings, expr.string);
+
+        operand = it - _strings.begin();
+
+        if(it == _strings.end()) {
+            _strings.emplace_back(expr.string);
+        }
+    }
+
+    if(_code.size() >= reject) {
+        throw std::invalid_argument("Policy is too large");
+    }
+
+    _code.push_back({ op, expr.field, on_true, on_false, operand });
+
+    return static_cast<std::uint32_t>(_code.size() - 1);
+}
+
+
+/* Tests expr the way its code does, counting each operand reached, whether
+ * it selected the record and what it cost.  Strings cost more to compare
+ * than numbers and the path patterns, already run by match_path() */
+bool compiled_policy::_profile(const policy_expr &expr, operand_profile &profile,
+                               const policy_registers &regs, double &cost) const {
+
+    double spent = 0;
+    bool result = false;
+
+    switch(expr.type) {
+
+        case policy_expr::kind::NOT:
+            result = not _profile(expr.children.front(), profile.children.front(), regs, spent);
+            break;
+
+        case policy_expr::kind::AND:
+
+            result = true;
+
+            for(std::size_t i = 0; i < expr.children.size() and result; ++i) {
+                result = _profile(expr.children[i], profile.children[i], regs, spent);
+            }
+
+            break;
+
+        case policy_expr::kind::OR:
+
+            for(std::size_t i = 0; i < expr.children.size() and not result; ++i) {
+                result = _profile(expr.children[i], profile.children[i], regs, spent);
+            }
+
+            break;
+
+        default:
+
+            if(is_numeric(expr.field)) {
+
+                auto value = regs.numbers[static_cast<std::size_t>(expr.field)];
+
+                switch(expr.op) {
+                    case policy_op::EQ: result = value == expr.number; break;
+                    case policy_op::NE: result = value != expr.number; break;
+                    case policy_op::LT: result = value <  expr.number; break;
+                    case policy_op::LE: result = value <= expr.number; break;
+                    case policy_op::GT: result = value >  expr.number; break;
+                    default:            result = value >= expr.number; break;
+                }
+
+                spent = 1;
+
+            } else if(is_pattern(expr.op)) {
+
+                result = _paths.matched(regs.path_state, static_cast<std::uint32_t>(expr.number));
+                spent = 1;
+
+            } else {
+
+                auto value = regs.strings[static_cast<std::size_t>(expr.field) -
+                                          num_numeric_policy_fields];
+
+                switch(expr.op) {
+                    case policy_op::EQ: result = value == expr.string; break;
+                    case policy_op::NE: result = value != expr.string; break;
+                    default:            result = value.starts_with(expr.string); break;
+                }
+
+                spent = 2;
+            }
+
+            break;
+    }
+
+    profile.entered += 1;
+    profile.selected += result ? 1 : 0;
+    profile.cost += spent;
+    cost += spent;
+
+    return result;
+}
+
+
+const compiled_policy::rule *compiled_policy::_evaluate_profiled(const policy_registers &regs) {
+
+    static thread_local rule_set candidates;
+
+    const rule *first = nullptr;
+
+    _index.candidates(regs, candidates);
+
+    candidates.for_each([&](std::size_t i) {
+
+        double cost = 0;
+
+        if(_profile(_rules[i].expr, _profiles[i], regs, cost)) {
+            first = &_rules[i];
+            return true;
+        }
+
+        return false;
+    });
+
+    if(++_profiled % _reorder_every == 0) {
+        _reorder();
+    }
+
+    return first;
+}
+
+
+/* Moves the operands of an 'and' or 'or' with the lowest cost per record
+ * they decide to the front, false deciding an 'and' and true an 'or'.
+ * Operands no profiled record reached keep their place, and the counts are
+ * halved so the order follows the records as they change */
+void compiled_policy::_reorder(policy_expr &expr, operand_profile &profile) {
+
+    if(expr.type == policy_expr::kind::AND or expr.type == policy_expr::kind::OR) {
+
+        std::vector<std::size_t> reached;
+        std::vector<double> ranks(expr.children.size());
+
+        for(std::size_t i = 0; i < expr.children.size(); ++i) {
+
+            const auto &child = profile.children[i];
+
+            if(child.entered < 1) {
+                continue;
+            }
+
+            auto selected = child.selected / child.entered;
+            auto decided = expr.type == policy_expr::kind::AND ? 1 - selected : selected;
+
+            ranks[i] = child.cost / child.entered / std::max(decided, 1e-3);
+            reached.push_back(i);
+        }
+
+        auto order = reached;
+
+        std::ranges::stable_sort(order, {}, [&](std::size_t i) { return ranks[i]; });
+
+        auto children = expr.children;
+        auto profiles = profile.children;
+
+        for(std::size_t k = 0; k < reached.size(); ++k) {
+            expr.children[reached[k]] = std::move(children[order[k]]);
+            profile.children[reached[k]] = std::move(profiles[order[k]]);
+        }
+    }
+
+    for(std::size_t i = 0; i < expr.children.size(); ++i) {
+        _reorder(expr.children[i], profile.children[i]);
+    }
+
+    profile.entered /= 2;
+    profile.selected /= 2;
+    profile.cost /= 2;
+}
+
+
+/* Reorders every rule and emits the code again, the rule index and the
+ * order of the rules don't change */
+void compiled_policy::_reorder() {
+
+    _code.clear();
+
+    for(std::size_t i = 0; i < _rules.size(); ++i) {
+        _reorder(_rules[i].expr, _profiles[i]);
+        _rules[i].entry = _emit(_rules[i].expr, accept, reject);
+    }
+}
+
+
+std::string compiled_policy::evaluation_order() const {
+
+    std::ostringstream os;
+
+    auto print = [&](auto &self, const policy_expr &expr, const operand_profile &profile) -> void {
+
+        switch(expr.type) {
+
+            case policy_expr::kind::COMPARE:
+
+                os << expr << " [";
+
+                if(profile.entered > 0) {
+                    os << std::lround(100 * profile.selected / profile.entered) << "%";
+                } else {
+                    os << "-";
+                }
+
+                os << "]";
+                return;
+
+            case policy_expr::kind::NOT:
+                os << "not (";
+                self(self, expr.children.front(), profile.children.front());
+                os << ")";
+                return;
+
+            default:
+
+                os << "(";
+
+                for(std::size_t i = 0; i < expr.children.size(); ++i) {
+                    os << (i > 0 ? (expr.type == policy_expr::kind::AND ? " and " : " or ") : "");
+                    self(self, expr.children[i], profile.children[i]);
+                }
+
+                os << ")";
+                return;
+        }
+    };
+
+    for(std::size_t i = 0; i < _rules.size(); ++i) {
+        os << _rules[i].name << ": ";
+        print(print, _rules[i].expr, _profiles[i]);
+        os << "\n";
+    }
+
+    return os.str();
+}
+
+
+/* Adds the comparisons every match of expr must pass, pushing NOTs into the
+ * operators where they can be */
+static void collect_conjuncts(const policy_expr &expr, bool negated,
+                              std::vector<policy_expr> &conjuncts) {
+
+    switch(expr.type) {
+
+        case policy_expr::kind::NOT:
+            collect_conjuncts(expr.children.front(), not negated, conjuncts);
+            return;
+
+        /* not (a or b) is not a and not b */
+        case policy_expr::kind::AND:
+        case policy_expr::kind::OR:
+
+            if((expr.type == policy_expr::kind::AND) != negated) {
+                for(const auto &child : expr.children) {
+                    collect_conjuncts(child, negated, conjuncts);
+                }
+            }
+
+            return;
+
+        default:
+            break;
+    }
+
+    auto compare = expr;
+
+    if(negated) {
+
+        switch(expr.op) {
+            case policy_op::EQ: compare.op = policy_op::NE; break;
+            case policy_op::NE: compare.op = policy_op::EQ; break;
+            case policy_op::LT: compare.op = policy_op::GE; break;
+            case policy_op::LE: compare.op = policy_op::GT; break;
+            case policy_op::GT: compare.op = policy_op::LE; break;
+            case policy_op::GE: compare.op = policy_op::LT; break;
+            default: return;
+        }
+    }
+
+    conjuncts.emplace_back(std::move(compare));
+}
+
+
+rule_index::key rule_index::choose_key(const policy_expr &expr) {
+
+    using kind = rule_index::key::kind;
+
+    std::vector<policy_expr> conjuncts;
+    collect_conjuncts(expr, false, conjuncts);
+
+    key best;
+    int best_rank = INT_MAX;
+
+    for(const auto &compare : conjuncts) {
+
+        key candidate { .type = kind::NONE, .field = compare.field, .number = 0, .string = {} };
+
+        if(compare.field == policy_field::PATH) {
+
+            if((compare.op == policy_op::EQ or compare.op == policy_op::STARTS_WITH) and
+               not compare.string.empty()) {
+                candidate.type = kind::PREFIX;
+                candidate.string = compare.string;
+            }
+
+            /* A pattern's literal start */
+            if(is_pattern(compare.op)) {
+
+                candidate.string = path_matcher::literal_prefix(compare.string, 
+                    compare.op == policy_op::MATCHES ? path_matcher::syntax::GLOB : 
+                                                       path_matcher::syntax::REGEX);
+
+                if(not candidate.string.empty()) {
+                    candidate.type = kind::PREFIX;
+                }
+            }
+
+        } else if(not is_numeric(compare.field)) {
+
+            if(compare.op == policy_op::EQ) {
+                candidate.type = kind::EQUAL;
+                candidate.string = compare.string;
+            }
+
+        } else {
+
+            constexpr auto min = std::numeric_limits<std::int64_t>::min();
+            constexpr auto max = std::numeric_limits<std::int64_t>::max();
+
+            /* Bounds are kept inclusive */
+            switch(compare.op) {
+                case policy_op::EQ: candidate.type = kind::EQUAL; candidate.number = compare.number; break;
+                case policy_op::GE: candidate.type = kind::LOWER; candidate.number = compare.number; break;
+                case policy_op::LE: candidate.type = kind::UPPER; candidate.number = compare.number; break;
+
+                case policy_op::GT:
+                    candidate.type = kind::LOWER;
+                    candidate.number = compare.number == max ? max : compare.number + 1;
+                    break;
+
+                case policy_op::LT:
+                    candidate.type = kind::UPPER;
+                    candidate.number = compare.number == min ? min : compare.number - 1;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        /* Prefer path prefixes, longest first, then equalities, then bounds,
+         * the file type is nearly always 'f' so it comes last */
+        int rank;
+
+        switch(candidate.type) {
+            case kind::PREFIX: rank = -static_cast<int>(candidate.string.size()); break;
+            case kind::EQUAL:  rank = (candidate.field == policy_field::TYPE) ? 3 : 1; break;
+            case kind::LOWER:
+            case kind::UPPER:  rank = 2; break;
+            default:           continue;
+        }
+
+        if(rank < best_rank) {
+            best = std::move(candidate);
+            best_rank = rank;
+        }
+    }
+
+    return best;
+}
+
+
+rule_index::rule_index(std::vector<key> keys) : _keys(std::move(keys)), _unindexed(_keys.size()) {
+
+    const auto rules = _keys.size();
+
+    /* Bounds and their rules, sorted once all are known */
+    std::vector<std::vector<std::pair<std::int64_t, std::size_t>>> pending_bounds;
+
+    for(std::size_t r = 0; r < rules; ++r) {
+
+        const auto &k = _keys[r];
+
+        switch(k.type) {
+
+            case key::kind::NONE:
+                _unindexed.insert(r);
+                break;
+
+            case key::kind::EQUAL:
+
+                if(is_numeric(k.field)) {
+
+                    auto it = std::ranges::find(_numbers, k.field, &decltype(_numbers)::value_type::first);
+
+                    if(it == _numbers.end()) {
+                        it = _numbers.insert(it, { k.field, {} });
+                    }
+
+                    it->second.try_emplace(k.number, rules).first->second.insert(r);
+
+                } else {
+
+                    auto it = std::ranges::find(_strings, k.field, &decltype(_strings)::value_type::first);
+
+                    if(it == _strings.end()) {
+                        it = _strings.insert(it, { k.field, {} });
+                    }
+
+                    it->second.try_emplace(k.string, rules).first->second.insert(r);
+                }
+
+                break;
+
+            case key::kind::PREFIX: {
+
+                if(_trie.empty()) {
+                    _trie.emplace_back();
+                }
+
+                std::uint32_t node = 0;
+
+                for(char c : k.string) {
+
+                    auto &children = _trie[node].children;
+                    auto it = std::ranges::find(children, c, &std::pair<char, std::uint32_t>::first);
+
+                    if(it != children.end()) {
+                        node = it->second;
+                        continue;
+                    }
+
+                    auto child = static_cast<std::uint32_t>(_trie.size());
+
+                    children.emplace_back(c, child);
+                    _trie.emplace_back();
+                    node = child;
+                }
+
+                if(not _trie[node].has_rules) {
+                    _trie[node].rules = rule_set(rules);
+                    _trie[node].has_rules = true;
+                }
+
+                _trie[node].rules.insert(r);
+                break;
+            }
+
+            case key::kind::LOWER:
+            case key::kind::UPPER: {
+
+                bool lower = k.type == key::kind::LOWER;
+
+                auto it = std::ranges::find_if(_bounds, [&](const auto &b) {
+                    return b.field == k.field and b.lower == lower;
+                });
+
+                if(it == _bounds.end()) {
+                    it = _bounds.insert(it, { .field = k.field, .lower = lower, .bounds = {}, .sets = {} });
+                    pending_bounds.emplace_back();
+                }
+
+                pending_bounds[it - _bounds.begin()].emplace_back(k.number, r);
+                break;
+            }
+        }
+    }
+
+    /* Precompute the union of the rules each lookup can select so it is one
+     * binary search and one merge */
+    for(std::size_t b = 0; b < _bounds.size(); ++b) {
+
+        auto &index = _bounds[b];
+        auto &entries = pending_bounds[b];
+
+        std::ranges::sort(entries);
+
+        rule_set set(rules);
+
+        for(const auto &[bound, rule] : entries) {
+            index.bounds.push_back(bound);
+        }
+
+        index.sets.resize(entries.size());
+
+        if(index.lower) {
+
+            for(std::size_t i = 0; i < entries.size(); ++i) {
+                set.insert(entries[i].second);
+                index.sets[i] = set;
+            }
+
+        } else {
+
+            for(std::size_t i = entries.size(); i-- > 0;) {
+                set.insert(entries[i].second);
+                index.sets[i] = set;
+            }
+        }
+    }
+}
+
+
+void rule_index::candidates(const policy_registers &regs, rule_set &out) const {
+
+    out = _unindexed;
+
+    for(const auto &[field, table] : _numbers) {
+        if(auto it = table.find(regs.numbers[static_cast<std::size_t>(field)]); it != table.end()) {
+            out |= it->second;
+        }
+    }
+
+    for(const auto &[field, table] : _strings) {
+
+        auto value = regs.strings[static_cast<std::size_t>(field) - num_numeric_policy_fields];
+
+        if(auto it = table.find(value); it != table.end()) {
+            out |= it->second;
+        }
+    }
+
+    for(const auto &index : _bounds) {
+
+        auto value = regs.numbers[static_cast<std::size_t>(index.field)];
+
+        /* Rules whose lower bound is at most the value */
+        if(index.lower) {
+
+            auto count = std::ranges::upper_bound(index.bounds, value) - index.bounds.begin();
+
+            if(count > 0) {
+                out |= index.sets[count - 1];
+            }
+
+        /* Rules whose upper bound is at least the value */
+        } else {
+
+            auto first = std::ranges::lower_bound(index.bounds, value) - index.bounds.begin();
+
+            if(first < static_cast<std::ptrdiff_t>(index.bounds.size())) {
+                out |= index.sets[first];
+            }
+        }
+    }
+
+    if(_trie.empty()) {
+        return;
+    }
+
+    /* Every prefix of the path that some rule is filed under */
+    auto path = regs.strings[static_cast<std::size_t>(policy_field::PATH) - num_numeric_policy_fields];
+    std::uint32_t node = 0;
+
+    for(std::size_t i = 0; ; ++i) {
+
+        const auto &n = _trie[node];
+
+        if(n.has_rules) {
+            out |= n.rules;
+        }
+
+        if(i == path.size()) {
+            break;
+        }
+
+        auto it = std::ranges::find(n.children, path[i], &std::pair<char, std::uint32_t>::first);
+
+        if(it == n.children.end()) {
+            break;
+        }
+
+        node = it->second;
+    }
+}
+
+
+std::ostream &operator<<(std::ostream &os, const rule_index::key &key) {
+
+    using kind = rule_index::key::kind;
+
+    switch(key.type) {
+
+        case kind::NONE:
+            return os << "nothing";
+
+        case kind::PREFIX:
+            return os << "path startswith '" << key.string << "'";
+
+        case kind::LOWER:
+            return os << policy_field_name(key.field) << " >= " << key.number;
+
+        case kind::UPPER:
+            return os << policy_field_name(key.field) << " <= " << key.number;
+
+        case kind::EQUAL:
+            break;
+    }
+
+    os << policy_field_name(key.field) << " == ";
+
+    if(key.field == policy_field::TYPE) {
+        return os << "'" << static_cast<char>(key.number) << "'";
+    }
+
+    if(is_numeric(key.field)) {
+        return os << key.number;
+    }
+
+    return os << "'" << key.string << "'";
+}
+
+
+compiled_policy compile_policy(const std::vector<policy_rule_spec> &specs) {
+
+    compiled_policy policy;
+    std::vector<rule_index::key> keys;
+
+    for(const auto &spec : specs) {
+
+        try {
+
+            compiled_policy::rule rule {
+                .name = spec.name,
+                .action = parse_policy_action(spec.action),
+                .expr = parse_policy_expression(spec.match),
+                .entry = 0,
+                .watermark = {},
+                .directory = {},
+                .migration = {}
+            };
+
+            /* The target pools go with either of the others, so they are
+             * split off before the rest decide what kind of rule it is */
+            std::map<std::string, std::string> targets, others;
+
+            for(const auto &[name, value] : spec.parameters) {
+                (name == "target_pools" or name == "stripe_count" ? targets : others).emplace(name, value);
+            }
+
+            rule.migration = parse_migration_settings(targets, rule.action);
+            rule.directory = parse_directory_settings(others, rule.action);
+
+            if(not rule.directory) {
+                rule.watermark = parse_watermark_settings(others, rule.action);
+            }
+
+            policy._add_patterns(rule.expr);
+
+            rule.entry = policy._emit(rule.expr, compiled_policy::accept, compiled_policy::reject);
+            policy._profiles.emplace_back(rule.expr);
+
+            keys.push_back(rule_index::choose_key(rule.expr));
+            policy._rules.emplace_back(std::move(rule));
+
+        } catch(const std::invalid_argument &e) {
+            throw std::invalid_argument("Policy rule '" + spec.name + "': " + e.what());
+        }
+    }
+
+    policy._index = rule_index(std::move(keys));
+
+    try {
+        policy._paths.compile();
+    } catch(const std::invalid_argument &e) {
+        throw std::invalid_argument(std::string("Policy path patterns: ") + e.what());
+    }
+
+    return policy;
+}
+
+
+std::ostream &operator<<(std::ostream &os, const compiled_policy &policy) {
+
+    auto target = [](std::uint32_t pc) -> std::string {
+        return pc == compiled_policy::accept ? "accept" :
+               pc == compiled_policy::reject ? "reject" : std::to_string(pc);
+    };
+
+    for(std::size_t i = 0; i < policy.rules().size(); ++i) {
+
+        const auto &rule = policy.rules()[i];
+
+        os << "rule " << rule.name << " -> " << policy_action_name(rule.action)
+           << (rule.directory ? " per directory" : "")
+           << (rule.migration ? " to target pools" : "")
+           << " entry " << rule.entry << ": " << rule.expr 
+           << " [indexed on " << policy.index().keys()[i] << "]\n";
+    }
+
+    for(std::size_t pc = 0; pc < policy.code().size(); ++pc) {
+
+        const auto &ins = policy.code()[pc];
+
+        os << "  " << pc << ": " << policy_field_name(ins.field) << " "
+           << policy_op_name(ins.op) << " ";
+
+        if(is_numeric(ins.field)) {
+            os << ins.operand;
+        } else if(is_pattern(ins.op)) {
+            os << "'" << policy.paths().pattern(static_cast<std::uint32_t>(ins.operand)) << "'";
+        } else {
+            os << "'" << policy.strings()[ins.operand] << "'";
+        }
+
+        os << " ? " << target(ins.on_true) << " : " << target(ins.on_false) << "\n";
+    }
+
+    return os;
+}
@@ -0,0 +1,684 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../../messaging/details/messages.h"
+#include "./path_matcher.h"
+
+
+/* Fields of a scan record a policy can test.  The numeric fields come first
+ * and are loaded into registers as signed 64-bit integers, times are seconds
+ * since the epoch and ages seconds before the evaluation time. */
+enum class policy_field : std::uint8_t {
+    TYPE,
+    ATIME,
+    MTIME,
+    ATIME_AGE,
+    MTIME_AGE,
+    SIZE,
+    UID,
+    GID,
+    STRIPE_COUNT,
+
+    /* Totals of the record's owner, group and OST pool within its file
+     * system, from the engine's usage_store */
+    UID_BYTES,
+    UID_FILES,
+    GID_BYTES,
+    GID_FILES,
+    POOL_BYTES,
+    POOL_FILES,
+
+    /* Percentiles of the record's atime age and size among the files of
+     * its OST pool, from the engine's namespace sketches */
+    ATIME_AGE_RANK,
+    SIZE_RANK,
+
+    PATH,
+    OST_POOL,
+    FILESYS,
+    FID
+};
+
+inline constexpr std::size_t num_numeric_policy_fields = 17;
+inline constexpr std::size_t num_string_policy_fields = 4;
+
+constexpr bool is_numeric(policy_field field) {
+    return static_cast<std::size_t>(field) < num_numeric_policy_fields;
+}
+
+constexpr bool is_usage(policy_field field) {
+    return field >= policy_field::UID_BYTES and field <= policy_field::POOL_FILES;
+}
+
+constexpr bool is_rank(policy_field field) {
+    return field == policy_field::ATIME_AGE_RANK or field == policy_field::SIZE_RANK;
+}
+
+std::string_view policy_field_name(policy_field field);
+
+
+/* Comparison operators.  The compiler rewrites NE, GT and GE into EQ, LE and
+ * LT with the branch targets swapped so the evaluator only sees the rest.
+ * MATCHES and REGEX test the path against a glob or regular expression. */
+enum class policy_op : std::uint8_t {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+    STARTS_WITH,
+    MATCHES,
+    REGEX
+};
+
+constexpr bool is_pattern(policy_op op) {
+    return op == policy_op::MATCHES or op == policy_op::REGEX;
+}
+
+std::string_view policy_op_name(policy_op op);
+
+
+enum class policy_action : std::uint8_t {
+    PURGE,
+    MIGRATE,
+    SKIP
+};
+
+std::string_view policy_action_name(policy_action action);
+
+/* @throws std::invalid_argument if the action isn't purge, migrate or skip */
+policy_action parse_policy_action(std::string_view action);
+
+
+/**
+ * @brief Parsed policy expression.  AND and OR are n-ary with at least two
+ *        children, NOT has one and COMPARE none.  Literals are converted to
+ *        the units of the field at parse time: sizes to bytes, durations to
+ *        seconds and the file type to its character code.
+ */
+struct policy_expr {
+
+    enum class kind : std::uint8_t { AND, OR, NOT, COMPARE };
+
+    kind type = kind::COMPARE;
+    std::vector<policy_expr> children;
+
+    /* COMPARE only.  For path patterns string is the pattern and number
+     * its index in the policy's path_matcher, set by compile_policy() */
+    policy_field field = policy_field::TYPE;
+    policy_op op = policy_op::EQ;
+    std::int64_t number = 0;
+    std::string string;
+};
+
+std::ostream &operator<<(std::ostream &os, const policy_expr &expr);
+
+
+/**
+ * @brief Parses a policy expression, e.g.
+ *
+ *      type == 'f' and atime_age > 30d and not path startswith '/proj/keep'
+ *
+ * Durations take the suffixes s, m, h, d and w, sizes K, M, G, T and P
+ * (powers of 1024), and strings are single or double quoted.  The path can
+ * also be matched against a glob, path matches '**.tmp', or a
+ * regular expression, path regex '.*[.]o'.
+ *
+ * @throws std::invalid_argument with the column of the error.
+ */
+policy_expr parse_policy_expression(std::string_view text);
+
+
+/* A rule as written in the config file, parameters are its other keys */
+struct policy_rule_spec {
+    std::string name;
+    std::string match;
+    std::string action;
+    std::map<std::string, std::string> parameters = {};
+};
+
+
+/* Which candidates a watermark purge takes first */
+enum class purge_order : std::uint8_t {
+    ATIME,      /* Least recently accessed */
+    AGE_SIZE    /* Largest atime_age times size */
+};
+
+
+/**
+ * @brief Makes a purge rule capacity driven.  The files it matches are only
+ *        candidates, once the usage of their OST pool passes the high 
+ *        watermark the best candidates are purged until it is back down to
+ *        the low watermark.  Written as the rule parameters
+ *
+ *      capacity: 2P            bytes per pool, with size units
+ *      high_watermark: 90%     percent or a fraction of the capacity
+ *      low_watermark: 80%
+ *      order: atime            or age_size
+ *      max_candidates: 100000  most candidates kept per pool
+ */
+struct watermark_settings {
+    std::int64_t capacity = 0;
+    double high = 0.9;
+    double low = 0.8;
+    purge_order order = purge_order::ATIME;
+    std::size_t max_candidates = 100000;
+};
+
+/* @throws std::invalid_argument for unknown or invalid parameters */
+std::optional<watermark_settings> 
+parse_watermark_settings(const std::map<std::string, std::string> &parameters, 
+                         policy_action action);
+
+/**
+ * @brief Makes a purge or migrate rule act on whole directories.  The files
+ *        it matches are gathered by the directory at the given depth of
+ *        their path, and once the scan has moved past a directory and none
+ *        of its files was accessed for the idle time the directory is
+ *        decided as a whole.  Written as the rule parameters
+ *
+ *      directory: 5            depth, e.g. 5 for /lustre/proj/abc/runs/run42,
+ *                              or parent for each file's own directory
+ *      idle: 7d                with the duration units of expressions
+ *      settle: 10m             time without records before the scan is
+ *                              taken to be past a directory
+ *      max_directories: 100000 most directories tracked by the rule
+ */
+struct directory_settings {
+    std::size_t depth = 0;  /* 0 for the parent */
+    std::chrono::seconds idle{0};
+    std::chrono::seconds settle{600};
+    std::size_t max_directories = 100000;
+};
+
+/* Empty if there is no directory parameter.  @throws std::invalid_argument 
+ * for unknown or invalid parameters */
+std::optional<directory_settings>
+parse_directory_settings(const std::map<std::string, std::string> &parameters,
+                         policy_action action);
+
+/**
+ * @brief Lets the engine choose where a migrate rule's files go.  Each file
+ *        goes to the candidate pool with the most free space for its size,
+ *        striped over the OSTs of that pool with the most free space that
+ *        haven't just been given other files.  Written as the rule parameters
+ *
+ *      target_pools: capacity, archive     candidate pools
+ *      stripe_count: 4                     stripes of the migrated file, 
+ *                                          the pool's default if not given
+ */
+struct migration_settings {
+    std::vector<std::string> pools;
+    std::uint32_t stripe_count = 0;
+};
+
+/* Empty if there is no target_pools parameter.  @throws 
+ * std::invalid_argument for unknown or invalid parameters */
+std::optional<migration_settings>
+parse_migration_settings(const std::map<std::string, std::string> &parameters,
+                         policy_action action);
+
+/* The rules used when no policy is configured, purge files not accessed in
+ * 30 days and migrate files in the performance pool not accessed in 2 */
+std::vector<policy_rule_spec> default_policy_rules();
+
+
+/**
+ * @brief One step of the branch program.  Tests a register against an
+ *        immediate, or a string constant for string fields, and continues at
+ *        on_true or on_false.
+ */
+struct policy_instruction {
+    policy_op op;
+    policy_field field;
+    std::uint32_t on_true;
+    std::uint32_t on_false;
+
+    /* Immediate for numeric fields, index of the path pattern for MATCHES
+     * and REGEX and of the string constant otherwise */
+    std::int64_t operand;
+};
+
+
+/* Aggregated usage a record's usage and rank fields are loaded from */
+struct usage_totals {
+    std::int64_t uid_bytes = 0;
+    std::int64_t uid_files = 0;
+    std::int64_t gid_bytes = 0;
+    std::int64_t gid_files = 0;
+    std::int64_t pool_bytes = 0;
+    std::int64_t pool_files = 0;
+    std::int64_t atime_age_rank = 0;
+    std::int64_t size_rank = 0;
+};
+
+
+/* Fields of one scan record loaded for evaluation */
+struct policy_registers {
+    std::array<std::int64_t, num_numeric_policy_fields> numbers;
+    std::array<std::string_view, num_string_policy_fields> strings;
+
+    /* The state the policy's path patterns ended in on the path, see
+     * compiled_policy::match_path() */
+    std::uint32_t path_state = path_matcher::dead;
+};
+
+
+/* A set of rules by index, iterated in rule order */
+class rule_set {
+
+    private:
+
+        std::vector<std::uint64_t> _words;
+
+    public:
+
+        rule_set() = default;
+        explicit rule_set(std::size_t rules) : _words((rules + 63) / 64, 0) {}
+
+        void insert(std::size_t rule) {
+            _words[rule / 64] |= std::uint64_t(1) << (rule % 64);
+        }
+
+        bool contains(std::size_t rule) const {
+            return (_words[rule / 64] >> (rule % 64)) & 1;
+        }
+
+        rule_set &operator|=(const rule_set &other) {
+
+            for(std::size_t i = 0; i < _words.size(); ++i) {
+                _words[i] |= other._words[i];
+            }
+
+            return *this;
+        }
+
+        /* Calls f with each rule in ascending order until it returns true */
+        template<typename F>
+        void for_each(F &&f) const {
+
+            for(std::size_t w = 0; w < _words.size(); ++w) {
+
+                for(auto bits = _words[w]; bits != 0; bits &= bits - 1) {
+                    if(f(w * 64 + static_cast<std::size_t>(std::countr_zero(bits)))) {
+                        return;
+                    }
+                }
+            }
+        }
+};
+
+
+/**
+ * @brief Discrimination index over the rules of a policy.
+ *
+ * Each rule is filed under one comparison every record it matches must
+ * pass, picked from the conjuncts of its expression: a path prefix in a trie,
+ * an equality in a hash table per field, or a bound on a numeric field, e.g.
+ * atime_age > 30d, in a sorted array of bounds.  Looking a record up gives
+ * the rules that can match it, a superset of the rules that do, so only
+ * those need evaluating.  Rules with nothing to index on are always
+ * candidates.
+ */
+class rule_index {
+
+    public:
+
+        /* The comparison a rule is filed under */
+        struct key {
+
+            enum class kind : std::uint8_t { NONE, EQUAL, PREFIX, LOWER, UPPER };
+
+            kind type = kind::NONE;
+            policy_field field = policy_field::TYPE;
+
+            /* EQUAL on numeric fields, and the inclusive bound of LOWER
+             * (value >= number) and UPPER (value <= number) */
+            std::int64_t number = 0;
+
+            /* EQUAL on string fields and PREFIX */
+            std::string string;
+        };
+
+        /* The most selective key every match of expr must satisfy */
+        static key choose_key(const policy_expr &expr);
+
+    private:
+
+        struct string_hash : std::hash<std::string_view> {
+            using is_transparent = void;
+        };
+
+        struct bounds {
+            policy_field field;
+            bool lower;
+
+            /* Ascending, sets[i] holds the rules of bounds[0..i] for lower
+             * bounds and of bounds[i..] for upper bounds */
+            std::vector<std::int64_t> bounds;
+            std::vector<rule_set> sets;
+        };
+
+        struct trie_node {
+            std::vector<std::pair<char, std::uint32_t>> children;
+            rule_set rules;
+            bool has_rules = false;
+        };
+
+        std::vector<key> _keys;
+        rule_set _unindexed;
+
+        std::vector<std::pair<policy_field, std::unordered_map<std::int64_t, rule_set>>> _numbers;
+        std::vector<std::pair<policy_field, 
+                              std::unordered_map<std::string, rule_set, string_hash, std::equal_to<>>>> _strings;
+        std::vector<bounds> _bounds;
+
+        /* Path prefixes, empty if no rule is filed under one */
+        std::vector<trie_node> _trie;
+
+    public:
+
+        rule_index() = default;
+
+        /* keys[i] is the key of rule i */
+        explicit rule_index(std::vector<key> keys);
+
+        /* Sets out to the rules that may match the loaded record */
+        void candidates(const policy_registers &regs, rule_set &out) const;
+
+        const std::vector<key> &keys() const {
+            return _keys;
+        }
+};
+
+std::ostream &operator<<(std::ostream &os, const rule_index::key &key);
+
+
+/**
+ * @brief An ordered list of rules compiled to a single branch program.
+ *
+ * Every rule's expression is compiled to a DAG of compare and branch
+ * instructions ending in accept or reject, so evaluating a rule is a loop of
+ * one comparison and one jump per test with short circuiting falling out of
+ * the branch targets.  The fields of a record are loaded once into registers
+ * and shared by all the rules, the first rule that accepts decides the
+ * action.  Only the rules the rule index gives as candidates for the record
+ * are run.  The path globs and regular expressions of all the rules are
+ * matched together in one pass over the path before the rules run, a
+ * pattern test is then a bit lookup.
+ */
+class compiled_policy {
+
+    public:
+
+        static constexpr std::uint32_t accept = UINT32_MAX;
+        static constexpr std::uint32_t reject = UINT32_MAX - 1;
+
+        struct rule {
+            std::string name;
+            policy_action action;
+            policy_expr expr;
+
+            /* First instruction of the rule */
+            std::uint32_t entry;
+
+            /* Purge rules only, set for capacity driven purges */
+            std::optional<watermark_settings> watermark = {};
+
+            /* Set for rules deciding whole directories */
+            std::optional<directory_settings> directory = {};
+
+            /* Migrate rules only, set when the engine chooses the target */
+            std::optional<migration_settings> migration = {};
+        };
+
+    private:
+
+        std::vector<policy_instruction> _code;
+        std::vector<std::string> _strings;
+        std::vector<rule> _rules;
+        rule_index _index;
+        path_matcher _paths;
+
+        /* How often an operand of a rule was reached, how often it
+         * selected the record and what testing it cost, mirroring the
+         * rule's expression */
+        struct operand_profile {
+            double entered = 0;
+            double selected = 0;
+            double cost = 0;
+            std::vector<operand_profile> children;
+
+            explicit operand_profile(const policy_expr &expr) {
+                for(const auto &child : expr.children) {
+                    children.emplace_back(child);
+                }
+            }
+        };
+
+        /* One per rule, see evaluate_adaptive() */
+        std::vector<operand_profile> _profiles;
+        std::uint64_t _evaluated = 0;
+        std::uint64_t _profiled = 0;
+
+        /* Records between profiled ones, and profiled records between
+         * reorderings */
+        static constexpr std::uint64_t _profile_every = 16;
+        static constexpr std::uint64_t _reorder_every = 256;
+
+        void _add_patterns(policy_expr &expr);
+
+        bool _profile(const policy_expr &expr, operand_profile &profile,
+                      const policy_registers &regs, double &cost) const;
+
+        const rule *_evaluate_profiled(const policy_registers &regs);
+
+        static void _reorder(policy_expr &expr, operand_profile &profile);
+        void _reorder();
+
+        std::uint32_t _emit(const policy_expr &expr,
+                            std::uint32_t on_true,
+                            std::uint32_t on_false);
+
+        friend compiled_policy compile_policy(const std::vector<policy_rule_spec> &specs);
+
+    public:
+
+        static policy_registers load(const scan_message &msg,
+                                     std::chrono::system_clock::time_point now,
+                                     const usage_totals &usage = {});
+
+        /* Sets the registers' path state, needed after load() if the rules
+         * match path patterns */
+        void match_path(policy_registers &regs) const {
+            if(not _paths.empty()) {
+                regs.path_state = _paths.run(regs.strings[static_cast<std::size_t>(policy_field::PATH) -
+                                                          num_numeric_policy_fields]);
+            }
+        }
+
+        /* Whether the rule at index matches the loaded record */
+        bool matches(std::size_t index, const policy_registers &regs) const {
+
+            std::uint32_t pc = _rules[index].entry;
+
+            while(pc < reject) {
+
+                const auto &ins = _code[pc];
+                bool result;
+
+                if(is_numeric(ins.field)) {
+
+                    auto value = regs.numbers[static_cast<std::size_t>(ins.field)];
+
+                    switch(ins.op) {
+                        case policy_op::EQ: result = value == ins.operand; break;
+                        case policy_op::LT: result = value <  ins.operand; break;
+                        default:            result = value <= ins.operand; break;
+                    }
+
+                } else if(is_pattern(ins.op)) {
+                    result = _paths.matched(regs.path_state, static_cast<std::uint32_t>(ins.operand));
+
+                } else {
+
+                    auto value = regs.strings[static_cast<std::size_t>(ins.field) -
+                                              num_numeric_policy_fields];
+                    const auto &constant = _strings[ins.operand];
+
+                    result = (ins.op == policy_op::EQ) ? value == constant :
+                                                         value.starts_with(constant);
+                }
+
+                pc = result ? ins.on_true : ins.on_false;
+            }
+
+            return pc == accept;
+        }
+
+        /* The first rule matching the loaded record or nullptr */
+        const rule *evaluate(const policy_registers &regs) const {
+
+            static thread_local rule_set candidates;
+
+            const rule *first = nullptr;
+
+            _index.candidates(regs, candidates);
+
+            candidates.for_each([&](std::size_t i) {
+
+                if(matches(i, regs)) {
+                    first = &_rules[i];
+                    return true;
+                }
+
+                return false;
+            });
+
+            return first;
+        }
+
+        /* The first rule matching msg or nullptr, with its usage and rank
+         * fields read from usage */
+        const rule *evaluate(const scan_message &msg,
+                             std::chrono::system_clock::time_point now,
+                             const usage_totals &usage = {}) const {
+
+            auto regs = load(msg, now, usage);
+            match_path(regs);
+
+            return evaluate(regs);
+        }
+
+        /* As evaluate(), but profiles one record in _profile_every and
+         * periodically reorders the operands of each 'and' and 'or' so the
+         * cheap tests that decide the most records come first.  Rules keep
+         * their order and their pointers, only the code changes */
+        const rule *evaluate_adaptive(const policy_registers &regs) {
+
+            if(++_evaluated % _profile_every != 0) {
+                return evaluate(regs);
+            }
+
+            return _evaluate_profiled(regs);
+        }
+
+        const rule *evaluate_adaptive(const scan_message &msg,
+                                      std::chrono::system_clock::time_point now,
+                                      const usage_totals &usage = {}) {
+
+            auto regs = load(msg, now, usage);
+            match_path(regs);
+
+            return evaluate_adaptive(regs);
+        }
+
+        /* Each rule's operands in the order they are tested, with the
+         * share of the profiled records reaching each test it selected */
+        std::string evaluation_order() const;
+
+        const std::vector<rule> &rules() const {
+            return _rules;
+        }
+
+        const std::vector<policy_instruction> &code() const {
+            return _code;
+        }
+
+        const std::vector<std::string> &strings() const {
+            return _strings;
+        }
+
+        const rule_index &index() const {
+            return _index;
+        }
+
+        const path_matcher &paths() const {
+            return _paths;
+        }
+
+        /* Whether any rule tests a usage field or is a watermark purge */
+        bool uses_usage() const {
+
+            for(const auto &r : _rules) {
+                if(r.watermark) {
+                    return true;
+                }
+            }
+
+            for(const auto &ins : _code) {
+                if(is_usage(ins.field)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /* Whether any rule tests a rank field */
+        bool uses_ranks() const {
+
+            for(const auto &ins : _code) {
+                if(is_rank(ins.field)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+};
+
+std::ostream &operator<<(std::ostream &os, const compiled_policy &policy);
+
+
+/**
+ * @brief Parses and compiles the rules, in order of precedence.
+ *
+ * @throws std::invalid_argument naming the rule that failed to parse.
+ */
+compiled_policy compile_policy(const std::vector<policy_rule_spec> &specs);
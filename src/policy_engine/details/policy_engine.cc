@@ -17,12 +17,135 @@
 #include <array>
 #include <thread>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <ranges>
+#include <span>
+#include <atomic>
+#include <memory>
+#include <filesystem>
+#include <map>
+#include <semaphore>
+#include <sstream>
+#include <stop_token>
+#include <type_traits>
+#include <vector>
 
 #include <unistd.h>
 
+#include "../../common/bounded_queue.h"
+#include "../../common/work_stealing_pool.h"
 #include "../../messaging/messaging.h"
 #include "../policy_engine.h"
+#include "./decision_cache.h"
+#include "./directory_tracker.h"
+#include "./engine_snapshot.h"
+#include "./namespace_sketches.h"
+#include "./pool_balancer.h"
+#include "./usage_store.h"
+#include "./watermark_purge.h"
+
+
+/**
+ * @brief A batch of scan records moving through the pipeline.
+ *
+ * Every chunk being evaluated and every action waiting to be published holds
+ * a reference, whoever drops the last one acknowledges the batch, or retries
+ * it if publishing failed or the engine stopped before all of it was
+ * evaluated.  Retrying the whole batch may publish some actions twice, which
+ * the purge and migration agents already have to tolerate.
+ */
+struct inflight_batch {
+
+    inflight_batch(received_batch<scan_message> &&batch, std::size_t chunks, 
+                   std::counting_semaphore<> &slots) : 
+        batch(std::move(batch)), chunks_left(chunks), slots(slots) {}
+
+    inflight_batch(const inflight_batch &) = delete;
+    inflight_batch &operator=(const inflight_batch &) = delete;
+
+    ~inflight_batch() {
+
+        try {
+
+            if(failed.load() or chunks_left.load() > 0) {
+                batch.retry(failed.load() ? reason : "Policy engine stopped");
+            } else {
+                batch.ack();
+            }
+
+        } catch(const std::exception &e) {
+            std::clog << "Policy engine(" << std::this_thread::get_id() <<"): " 
+                      << "Error acknowledging batch: " << e.what() << std::endl;
+        }
+
+        slots.release();
+    }
+
+    /* Only the first failure is kept, it is read once all the references 
+     * are gone */
+    void fail(const std::string &why) {
+        if(not failed.exchange(true)) {
+            reason = why;
+        }
+    }
+
+    received_batch<scan_message> batch;
+
+    std::atomic<std::size_t> chunks_left;
+    std::atomic<bool> failed{false};
+    std::string reason;
+
+    /* Released when the batch is done so the receiver can fetch another */
+    std::counting_semaphore<> &slots;
+};
+
+
+/* A policy and the watermark purge and directory state built for it, 
+ * replaced together */
+struct policy_version {
+
+    explicit policy_version(const compiled_policy &policy) : 
+        policy(policy), watermarks(this->policy), directories(this->policy),
+        ranked(this->policy.uses_ranks()) {}
+
+    const compiled_policy policy;
+    watermark_purger watermarks;
+    directory_tracker directories;
+
+    /* Whether the records need ranking for the rank fields */
+    const bool ranked;
+};
+
+
+/* The namespace sketches of one evaluator thread, locked while the
+ * receiver merges them */
+struct worker_sketches {
+    std::mutex lock;
+    namespace_sketches sketches;
+};
+
+
+/* A decision waiting for a publisher thread */
+struct pending_action {
+    std::string path;
+    std::string rule;
+    std::shared_ptr<inflight_batch> batch;
+
+    /* The file's usage_store and decision_cache key when either is used */
+    std::string key;
+
+    /* Migrations only, where the file goes if the rule has target pools */
+    migration_target target = {};
+
+    /* What the publishers keep together besides the directory, the file
+     * system of purges and the source pool of migrations */
+    std::string group = {};
+
+    /* The lane the action is sent on, purges freeing a pool over its high
+     * watermark are urgent */
+    message_priority priority = message_priority::NORMAL;
+};
 
 
 class policy_engine_impl : public policy_engine {
@@ -32,9 +155,34 @@ class policy_engine_impl : public policy_engine {
         policy_engine_impl(const MsgSubscriber auto &scan_mq_sub, 
                            const MsgPublisher auto &removal_mq_pub, 
                            const MsgPublisher auto &migration_mq_pub, 
-                           const MsgPublisher auto &recorder_mq_pub) noexcept: 
+                           const compiled_policy &policy,
+                           const policy_engine_options &options): 
             _scan_mq_sub(scan_mq_sub), _removal_mq_pub(removal_mq_pub), 
-            _migration_mq_pub(migration_mq_pub), _recorder_mq_pub(recorder_mq_pub) {};
+            _migration_mq_pub(migration_mq_pub),
+            _batch_size(std::max<std::size_t>(1, options.batch_size)),
+            _threads(options.evaluator_threads > 0 ? options.evaluator_threads :
+                     std::max(1U, std::thread::hardware_concurrency())),
+            _policy(std::make_shared<policy_version>(policy)),
+            _worker_policies(_threads, _policy.load()),
+            _adaptive_policies(_threads, policy),
+            _max_inflight(options.max_inflight_batches > 0 ? 
+                          options.max_inflight_batches : 2 * _threads),
+            _slots(static_cast<std::ptrdiff_t>(_max_inflight)),
+            _purge_actions(options.action_queue_size),
+            _migration_actions(options.action_queue_size),
+            _track_usage(options.track_usage),
+            _decisions(options.decision_cache_size > 0 ? 
+                       std::make_unique<decision_cache>(options.decision_cache_size, 
+                                                        options.decision_cache_ttl) : nullptr),
+            _balancer(pool_balancer::lfs_df(options.pool_usage_source)),
+            _pool_refresh_interval(options.pool_refresh_interval),
+            _action_window(options.action_window),
+            _action_batch_size(std::max<std::size_t>(1, options.action_batch_size)),
+            _snapshot_path(options.snapshot_path),
+            _snapshot_interval(options.snapshot_interval),
+            _sketches(options.namespace_stats_interval.count() > 0 ? _threads : 0),
+            _namespace_interval(options.namespace_stats_interval),
+            _namespace_window(options.namespace_stats_window) {};
 
         policy_engine_impl(policy_engine_impl &&) = delete;
         policy_engine_impl(const policy_engine_impl &) = delete;
@@ -47,12 +195,141 @@ class policy_engine_impl : public policy_engine {
         void run();
         void stop();
 
+        void set_policy(const compiled_policy &policy);
+
     private:
 
         message_queue_subscriber _scan_mq_sub;
         message_queue_publisher _removal_mq_pub;
         message_queue_publisher _migration_mq_pub;
-        message_queue_publisher _recorder_mq_pub;   
+
+        /* Most scan records fetched and evaluated together */
+        std::size_t _batch_size;
+
+        std::size_t _threads;
+
+        /* Rules compiled from the config, first match wins.  Replaced 
+         * whole by set_policy(), each worker notices at the start of its
+         * next chunk and switches to it */
+        std::atomic<std::shared_ptr<policy_version>> _policy;
+
+        /* The policy each worker evaluates with */
+        std::vector<std::shared_ptr<policy_version>> _worker_policies;
+
+        /* Each worker's copy of its policy, whose operands it reorders as
+         * it profiles the records */
+        std::vector<compiled_policy> _adaptive_policies;
+
+        /* Bounds the batches fetched but not yet acknowledged */
+        std::size_t _max_inflight;
+        std::counting_semaphore<> _slots;
+
+        /* Decisions on their way from the evaluators to the publishers */
+        bounded_queue<pending_action> _purge_actions;
+        bounded_queue<pending_action> _migration_actions;
+
+        /* Set while the receiver waits for batches to be acknowledged, no
+         * more decisions come until the publishers send what they hold */
+        std::atomic<bool> _throttled{false};
+
+        /* Totals behind the usage fields, only kept if _track_usage */
+        bool _track_usage;
+        usage_store _usage;
+
+        /* Actions already sent for files in their current state, so each 
+         * scan cycle doesn't send them again.  Null if disabled */
+        std::unique_ptr<decision_cache> _decisions;
+
+        /* Free space of the target pools of the migrate rules */
+        pool_balancer _balancer;
+        std::chrono::seconds _pool_refresh_interval;
+
+        /* The publishers gather decisions for _action_window and send them
+         * sorted, up to _action_batch_size to a message */
+        std::chrono::milliseconds _action_window;
+        std::size_t _action_batch_size;
+
+        /* Where the state is snapshotted to every _snapshot_interval, 
+         * empty if it isn't */
+        std::string _snapshot_path;
+        std::chrono::seconds _snapshot_interval;
+
+        /* Statistics of the namespace behind the rank fields, sketched by
+         * each worker and merged by the receiver every _namespace_interval.
+         * Records are ranked against the last complete _namespace_window, 
+         * or the current one until there is one.  Empty if not kept */
+        std::vector<worker_sketches> _sketches;
+        std::chrono::seconds _namespace_interval;
+        std::chrono::seconds _namespace_window;
+        std::shared_ptr<const namespace_summary> _last_window;
+        std::atomic<std::shared_ptr<const namespace_summary>> _ranks;
+
+        /* Highest stream sequence received, only used by the receiver */
+        std::uint64_t _last_sequence = 0;
+
+        std::stop_source _stop;
+
+        /* Declared last so they stop before the state they use goes away */
+        std::unique_ptr<work_stealing_pool> _pool;
+        std::vector<std::jthread> _publishers;
+
+        /* Applies the rules to rows [begin, end) of a batch and queues the
+         * actions, runs on the pool */
+        void _evaluate(std::size_t worker, const std::shared_ptr<inflight_batch> &inflight,
+                       std::size_t begin, std::size_t end);
+
+        /* Queues the purges of the pools above their high watermark */
+        bool _purge_watermarks(watermark_purger &watermarks, 
+                               const std::shared_ptr<inflight_batch> &inflight);
+
+        /* Queues the actions of the directories the directory rules decided */
+        bool _queue_directories(const compiled_policy &policy, directory_tracker &directories,
+                                std::chrono::system_clock::time_point now,
+                                const std::shared_ptr<inflight_batch> &inflight);
+
+        /* Publisher thread body, sends the actions of one queue */
+        template<typename MSG>
+        void _publish(std::stop_token stoken, bounded_queue<pending_action> &actions,
+                      message_queue_publisher &publisher, std::string_view need);
+
+        /* Sends actions as one message */
+        template<typename MSG>
+        void _send(std::span<pending_action> actions, message_queue_publisher &publisher,
+                   std::string_view need);
+
+        /* Refresher thread body, reads the free space of the target pools
+         * of the current policy every _pool_refresh_interval */
+        void _refresh_pools(std::stop_token stoken);
+
+        /* Where a file or directory of size bytes decided by a migrate
+         * rule goes, empty unless the rule has target pools */
+        migration_target _target(const compiled_policy::rule &rule, std::int64_t size);
+
+        /* Waits for the batches in flight to be acknowledged and writes the
+         * state they left to _snapshot_path, run by the receiver */
+        void _snapshot();
+
+        /* Loads the state of the snapshot at _snapshot_path, if any, and
+         * has the subscriber replay what was received after it */
+        void _restore_snapshot();
+
+        /* Merges the workers' sketches, logs the statistics and replaces
+         * the ranks, starting a new window if rotate, run by the receiver */
+        void _summarize_namespace(bool rotate);
+
+        /* Logs the messaging statistics */
+        void _log_stats();
+
+        static constexpr std::chrono::seconds _stats_interval{60};
+
+        /* Most bytes of paths packed in one message, the publishers
+         * serialize into an 8 KiB buffer */
+        static constexpr std::size_t _max_packed_bytes = 6 * 1024;
+
+        /* Rows of a batch evaluated by one task, small enough that idle 
+         * workers have something to steal and large enough to keep the 
+         * per task overhead small */
+        static constexpr std::size_t _min_chunk_size = 32;
 };
 
 
@@ -60,6 +337,19 @@ class policy_engine_impl : public policy_engine {
 
 policy_engine_impl::~policy_engine_impl() {
 
+    /* Stop the stages front to back so nothing is queued behind a stopped 
+     * one, then fail whatever didn't get published so it is redelivered */
+    _stop.request_stop();
+
+    _pool.reset();
+    _publishers.clear();
+
+    pending_action action;
+
+    while(_purge_actions.try_pop(action) or _migration_actions.try_pop(action)) {
+        action.batch->fail("Policy engine stopped");
+        action = {};
+    }
 }
 
 
@@ -68,60 +358,725 @@ policy_engine_impl::~policy_engine_impl() {
 void policy_engine_impl::run() {
     
     std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
-              << "Running..." << std::endl;
+              << "Running with " << _threads << " evaluator threads..." << std::endl;
 
-    
-    while(true) {
+    if(not _snapshot_path.empty()) {
+        _restore_snapshot();
+    }
 
-        std::vector<scan_message> messages;
+    _pool = std::make_unique<work_stealing_pool>(_threads);
 
-        /* Get the messages and add them to the list of messages */
-        try {
-            
-            auto message = _scan_mq_sub.receive<scan_message>();
+    _publishers.emplace_back([this](std::stop_token stoken) {
+        _publish<purge_message>(stoken, _purge_actions, _removal_mq_pub, "deletion");
+    });
+
+    _publishers.emplace_back([this](std::stop_token stoken) {
+        _publish<migration_message>(stoken, _migration_actions, _migration_mq_pub, "migration");
+    });
+
+    _publishers.emplace_back([this](std::stop_token stoken) {
+        _refresh_pools(stoken);
+    });
+
+    const auto chunk_size = std::max(_min_chunk_size, (_batch_size + _threads - 1) / _threads);
+
+    auto next_stats = std::chrono::steady_clock::now() + _stats_interval;
+    auto next_snapshot = std::chrono::steady_clock::now() + _snapshot_interval;
+    auto next_namespace = std::chrono::steady_clock::now() + _namespace_interval;
+    auto next_window = std::chrono::steady_clock::now() + _namespace_window;
+
+    /* This thread is the receiver, it only fetches and hands out the work */
+    while(not _stop.stop_requested()) {
+
+        if(auto now = std::chrono::steady_clock::now(); now >= next_stats) {
+            _log_stats();
+            next_stats = now + _stats_interval;
+        }
+
+        if(auto now = std::chrono::steady_clock::now(); 
+           not _snapshot_path.empty() and now >= next_snapshot) {
+            _snapshot();
+            next_snapshot = std::chrono::steady_clock::now() + _snapshot_interval;
+        }
 
-             //this->_recorder_mq.send(message);
+        if(auto now = std::chrono::steady_clock::now(); 
+           not _sketches.empty() and now >= next_namespace) {
 
-            messages.emplace_back(std::move(message));
+            bool rotate = now >= next_window;
+
+            _summarize_namespace(rotate);
+
+            next_namespace = now + _namespace_interval;
+            next_window = rotate ? now + _namespace_window : next_window;
+        }
+
+        /* Wait for a batch to finish before fetching another so the
+         * evaluators and publishers set the pace */
+        if(not _slots.try_acquire_for(std::chrono::milliseconds(100))) {
+            _throttled.store(true, std::memory_order_relaxed);
+            continue;
+        }
+
+        _throttled.store(false, std::memory_order_relaxed);
+
+        received_batch<scan_message> batch;
+
+        try {
+            batch = _scan_mq_sub.receive_batch<scan_message>(_batch_size);
 
         } catch (const std::exception &e) {
             std::clog << "Policy engine(" << std::this_thread::get_id() <<"): " 
                       << "Error receiving message: " << e.what() << std::endl;
+            _slots.release();
+            continue;
+        }
+
+        _last_sequence = std::max(_last_sequence, batch.last_sequence);
+
+        /* Everything fetched was dead lettered */
+        if(batch.messages.empty()) {
+            _slots.release();
+            continue;
+        }
+
+        const auto size = batch.messages.size();
+        const auto chunks = (size + chunk_size - 1) / chunk_size;
+
+        /* The scan records are only acknowledged once the resulting actions
+         * have been published, failures are retried and eventually dead 
+         * lettered */
+        auto inflight = std::make_shared<inflight_batch>(std::move(batch), chunks, _slots);
+
+        for(std::size_t begin = 0; begin < size; begin += chunk_size) {
+
+            _pool->submit([this, inflight, begin, end = std::min(size, begin + chunk_size)]
+                          (std::size_t worker) {
+                _evaluate(worker, inflight, begin, end);
+            });
+        }
+    }
+}
+
+void policy_engine_impl::_snapshot() {
+
+    const auto start = std::chrono::steady_clock::now();
+
+    /* Holding every slot means every batch received is done, and throttled
+     * the publishers send what they hold without waiting out the window */
+    _throttled.store(true, std::memory_order_relaxed);
+
+    std::size_t held = 0;
+
+    while(held < _max_inflight and not _stop.stop_requested()) {
+        if(_slots.try_acquire_for(std::chrono::milliseconds(100))) {
+            ++held;
+        }
+    }
+
+    if(held == _max_inflight) {
+
+        try {
+
+            std::map<std::string, std::string_view> sections;
+            snapshot_writer usage, decisions, directories;
+
+            if(_track_usage) {
+                _usage.save(usage);
+                sections.emplace("usage", usage.data());
+            }
+
+            if(_decisions) {
+                _decisions->save(decisions);
+                sections.emplace("decisions", decisions.data());
+            }
+
+            if(auto version = _policy.load(); not version->directories.empty()) {
+                version->directories.save(directories);
+                sections.emplace("directory_passes", directories.data());
+            }
+
+            write_snapshot(_snapshot_path, _last_sequence, std::chrono::system_clock::now(), sections);
+
+            auto took = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - start);
+
+            std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                      << "Snapshot at sequence " << _last_sequence << " written to " 
+                      << _snapshot_path << " in " << took.count() << "ms" << std::endl;
+
+        } catch(const std::exception &e) {
+            std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                      << "Error writing snapshot: " << e.what() << std::endl;
         }
+    }
+
+    _slots.release(static_cast<std::ptrdiff_t>(held));
+}
 
-        /* Create the time mark for the filter to judge what to purge */
-        std::chrono::time_point migration_timepoint = 
-            std::chrono::system_clock::now() - std::chrono::days(2);
 
-        std::chrono::time_point removal_timepoint = 
-            std::chrono::system_clock::now() - std::chrono::days(30);
+void policy_engine_impl::_restore_snapshot() {
 
+    std::error_code ec;
 
-        for(auto const &msg : messages) {
-            
-            /* Deletion filter */
-            if(msg.type == 'f' && msg.atime < removal_timepoint) {
+    if(not std::filesystem::exists(_snapshot_path, ec)) {
+        return;
+    }
+
+    try {
 
-                std::clog << "Policy engine(" << std::this_thread::get_id() <<"): " 
-                          << "Has decided that " << msg.path << " needs deletion" << std::endl;
-                
-                this->_removal_mq_pub.send(purge_message(msg.path));
+        mapped_snapshot snapshot(_snapshot_path);
 
-            /* Migration filter */
-            }else if(msg.type == 'f' && msg.atime < migration_timepoint &&
-                     msg.ost_pool.compare("performance") == 0) {
+        auto load = [&snapshot](std::string_view name, auto &state) {
+            if(auto data = snapshot.section(name); not data.empty()) {
+                snapshot_reader in(data);
+                state.load(in);
+            }
+        };
 
-                std::clog << "Policy engine(" << std::this_thread::get_id() <<"): " 
-                          << "Has decided that " << msg.path << " needs migration" << std::endl;
-                
-                this->_migration_mq_pub.send(migration_message(msg.path));
-            } 
+        if(_track_usage) {
+            load("usage", _usage);
+        }
+
+        if(_decisions) {
+            load("decisions", *_decisions);
+        }
+
+        /* Named apart from the older format without eligibility, whose
+         * directories are left out */
+        load("directory_passes", _policy.load()->directories);
+
+        _last_sequence = snapshot.sequence();
+
+        auto age = std::chrono::duration_cast<std::chrono::seconds>(
+                       std::chrono::system_clock::now() - snapshot.taken());
+
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                  << "Restored the snapshot at sequence " << _last_sequence << " taken "
+                  << age.count() << "s ago" << std::endl;
+
+    } catch(const std::exception &e) {
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                  << "Error restoring snapshot, starting without it: " << e.what() << std::endl;
+        return;
+    }
+
+    /* What was acknowledged after the snapshot isn't in it */
+    if(_last_sequence > 0) {
+
+        try {
+            _scan_mq_sub.replay_from(_last_sequence + 1);
+
+        } catch(const std::exception &e) {
+            std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                      << "Error replaying the scan records after the snapshot: " << e.what() << std::endl;
         }
     }
 }
 
+
+void policy_engine_impl::_refresh_pools(std::stop_token stoken) {
+
+    std::mutex mutex;
+    std::condition_variable_any wakeup;
+
+    while(not stoken.stop_requested()) {
+
+        std::vector<std::string> pools;
+
+        for(const auto &rule : _policy.load()->policy.rules()) {
+            if(rule.migration) {
+                pools.insert(pools.end(), rule.migration->pools.begin(), rule.migration->pools.end());
+            }
+        }
+
+        if(not pools.empty()) {
+
+            std::ranges::sort(pools);
+            pools.erase(std::unique(pools.begin(), pools.end()), pools.end());
+
+            if(auto errors = _balancer.refresh(pools); not errors.empty()) {
+                std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                          << "Error reading pool usage: " << errors << std::flush;
+            }
+        }
+
+        /* Only woken by a stop */
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeup.wait_for(lock, stoken, _pool_refresh_interval, [] { return false; });
+    }
+}
+
+
+migration_target policy_engine_impl::_target(const compiled_policy::rule &rule, 
+                                             std::int64_t size) {
+
+    if(rule.action != policy_action::MIGRATE or not rule.migration) {
+        return {};
+    }
+
+    /* Without a stripe count of its own the rule leaves striping to lfs */
+    return _balancer.choose(rule.migration->pools, size, rule.migration->stripe_count);
+}
+
+
+void policy_engine_impl::_summarize_namespace(bool rotate) {
+
+    namespace_sketches current;
+
+    for(auto &worker : _sketches) {
+
+        std::lock_guard lock(worker.lock);
+
+        current.merge(worker.sketches);
+
+        if(rotate) {
+            worker.sketches.clear();
+        }
+    }
+
+    const auto now = std::chrono::system_clock::now();
+    auto summary = std::make_shared<const namespace_summary>(current.summarize(now));
+
+    if(rotate) {
+        _last_window = summary;
+    }
+
+    _ranks.store(_last_window and not _last_window->empty() ? _last_window : summary);
+
+    std::ostringstream report;
+    report << *summary;
+
+    std::istringstream lines(report.str());
+
+    for(std::string line; std::getline(lines, line); ) {
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                  << "namespace " << line << std::endl;
+    }
+}
+
+
+void policy_engine_impl::_log_stats() {
+
+    std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+              << "scan " << _scan_mq_sub.stats() << std::endl;
+
+    std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+              << "purge " << _removal_mq_pub.stats() << std::endl;
+
+    std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+              << "migration " << _migration_mq_pub.stats() << std::endl;
+
+    if(_track_usage) {
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                  << "usage of " << _usage.files() << " files tracked" << std::endl;
+    }
+
+    if(_decisions) {
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                  << "decisions of " << _decisions->size() << " files cached, " 
+                  << _decisions->suppressed() << " repeats not sent" << std::endl;
+    }
+
+    if(auto version = _policy.load(); not version->directories.empty()) {
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                  << version->directories.size() << " directories tracked, " 
+                  << version->directories.evicted() << " dropped for room" << std::endl;
+    }
+}
+
+void policy_engine_impl::_evaluate(std::size_t worker, 
+                                   const std::shared_ptr<inflight_batch> &inflight,
+                                   std::size_t begin, std::size_t end) {
+
+    try {
+
+        if(auto version = _policy.load(); version != _worker_policies[worker]) {
+            _adaptive_policies[worker] = version->policy;
+            _worker_policies[worker] = std::move(version);
+        }
+
+        auto &policy = _adaptive_policies[worker];
+        auto &watermarks = _worker_policies[worker]->watermarks;
+        auto &directories = _worker_policies[worker]->directories;
+        const auto *first_rule = policy.rules().data();
+
+        std::span<const scan_message> msgs(inflight->batch.messages.data() + begin, end - begin);
+
+        /* Count the records before evaluating them so a rule sees totals
+         * including the file itself */
+        if(_track_usage) {
+            for(const auto &msg : msgs) {
+
+                if(msg.deleted) {
+                    _usage.remove(usage_store::file_key(msg.filesys, msg.fid, msg.path));
+                } else {
+                    _usage.record(msg);
+                }
+            }
+        }
+
+        if(not _sketches.empty()) {
+
+            std::lock_guard lock(_sketches[worker].lock);
+
+            for(const auto &msg : msgs) {
+                if(not msg.deleted) {
+                    _sketches[worker].sketches.add(msg);
+                }
+            }
+        }
+
+        /* Held so the receiver can replace it while this chunk is ranked */
+        auto ranks = _worker_policies[worker]->ranked ? _ranks.load() : nullptr;
+
+        const auto now = std::chrono::system_clock::now();
+
+        for(std::size_t i = 0; i < msgs.size(); ++i) {
+
+            /* A deleted file stops being a candidate and may be sent again
+             * if a new file gets its FID */
+            if(msgs[i].deleted) {
+
+                if(not watermarks.empty()) {
+                    watermarks.forget(msgs[i]);
+                }
+
+                if(_decisions) {
+                    _decisions->erase(usage_store::file_key(msgs[i].filesys, msgs[i].fid, msgs[i].path));
+                }
+
+                continue;
+            }
+
+            usage_totals totals;
+
+            if(_track_usage) {
+                totals = _usage.totals(msgs[i]);
+            }
+
+            if(ranks) {
+                ranks->rank(msgs[i], totals);
+            }
+
+            const auto *rule = policy.evaluate_adaptive(msgs[i], now, totals);
+
+            /* Every file below a directory counts, one a directory rule 
+             * didn't decide keeps the rule from acting on the directory */
+            if(not directories.empty()) {
+                directories.record(msgs[i], rule ? std::optional<std::size_t>(rule - first_rule) : std::nullopt,
+                                   now);
+            }
+
+            /* Watermark purges only make the file a candidate, and a file
+             * that no longer matches stops being one */
+            if(not watermarks.empty()) {
+
+                if(rule != nullptr and rule->watermark) {
+                    watermarks.offer(rule - first_rule, msgs[i], now, _usage);
+                    continue;
+                }
+
+                watermarks.forget(msgs[i]);
+            }
+
+            if(rule == nullptr) {
+                continue;
+            }
+
+            /* Decided with the rest of its directory */
+            if(rule->directory) {
+                continue;
+            }
+
+            bounded_queue<pending_action> *actions = nullptr;
+
+            switch(rule->action) {
+
+                case policy_action::PURGE:
+                    actions = &_purge_actions;
+                    break;
+
+                case policy_action::MIGRATE:
+                    actions = &_migration_actions;
+                    break;
+
+                /* Exempt from the rules after this one */
+                case policy_action::SKIP:
+                    continue;
+            }
+
+            pending_action action { 
+                .path = msgs[i].path, 
+                .rule = rule->name, 
+                .batch = inflight,
+                .key = (_track_usage or _decisions) ? 
+                    usage_store::file_key(msgs[i].filesys, msgs[i].fid, msgs[i].path) : "",
+                .target = {},
+                .group = (rule->action == policy_action::PURGE) ? msgs[i].filesys : msgs[i].ost_pool
+            };
+
+            /* Already sent and the file hasn't changed since */
+            if(_decisions and not _decisions->admit(action.key, msgs[i], rule->action, rule->name)) {
+                continue;
+            }
+
+            action.target = _target(*rule, static_cast<std::int64_t>(msgs[i].size));
+
+            /* Blocks while the publisher is behind */
+            if(not actions->push(std::move(action), _stop.get_token())) {
+                inflight->fail("Policy engine stopped");
+                break;
+            }
+        }
+
+        if(not watermarks.empty() and not _purge_watermarks(watermarks, inflight)) {
+            inflight->fail("Policy engine stopped");
+        }
+
+        if(not directories.empty() and 
+           not _queue_directories(policy, directories, now, inflight)) {
+            inflight->fail("Policy engine stopped");
+        }
+
+    } catch(const std::exception &e) {
+        inflight->fail(e.what());
+    }
+
+    inflight->chunks_left.fetch_sub(1);
+}
+
+
+bool policy_engine_impl::_purge_watermarks(watermark_purger &watermarks, 
+                                           const std::shared_ptr<inflight_batch> &inflight) {
+
+    for(auto &purge : watermarks.due(_usage)) {
+
+        std::int64_t freed = 0;
+
+        for(const auto &file : purge.files) {
+            freed += file.size;
+        }
+
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): " 
+                  << "Pool " << purge.pool << " of " << purge.filesys << " uses " 
+                  << purge.used << " of " << purge.capacity << " bytes, purging " 
+                  << purge.files.size() << " files of " << freed << " bytes to free " 
+                  << purge.needed << " (" << purge.rule << ")" << std::endl;
+
+        for(auto &file : purge.files) {
+
+            pending_action action {
+                .path = std::move(file.path),
+                .rule = purge.rule,
+                .batch = inflight,
+                .key = std::move(file.key),
+                .target = {},
+                .group = purge.filesys,
+                .priority = message_priority::HIGH
+            };
+
+            if(not _purge_actions.push(std::move(action), _stop.get_token())) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool policy_engine_impl::_queue_directories(const compiled_policy &policy, 
+                                            directory_tracker &directories,
+                                            std::chrono::system_clock::time_point now,
+                                            const std::shared_ptr<inflight_batch> &inflight) {
+
+    for(auto &directory : directories.due(now)) {
+
+        const auto &rule = policy.rules()[directory.rule];
+        auto idle = std::chrono::duration_cast<std::chrono::hours>(now - directory.atime);
+
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): " 
+                  << "Directory " << directory.path << " of " << directory.filesys << " with "
+                  << directory.files << " files of " << directory.bytes << " bytes has not been "
+                  << "accessed for " << idle.count() << "h (" << rule.name << ")" << std::endl;
+
+        pending_action action {
+            .path = std::move(directory.path),
+            .rule = rule.name,
+            .batch = inflight,
+            .key = "",
+            .target = _target(rule, directory.bytes),
+            .group = directory.filesys
+        };
+
+        /* The agent migrates the files a batch at a time, striping them all
+         * over the same OSTs would pile the directory onto them */
+        action.target.osts.clear();
+
+        auto &actions = (rule.action == policy_action::PURGE) ? _purge_actions : _migration_actions;
+
+        if(not actions.push(std::move(action), _stop.get_token())) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+template<typename MSG>
+void policy_engine_impl::_publish(std::stop_token stoken, bounded_queue<pending_action> &actions,
+                                  message_queue_publisher &publisher, std::string_view need) {
+
+    std::vector<pending_action> window;
+    pending_action action;
+
+    while(actions.pop(action, stoken)) {
+
+        window.push_back(std::move(action));
+
+        /* Gather the decisions of the window, or until the receiver can't
+         * fetch more before these are sent */
+        const auto end = std::chrono::steady_clock::now() + _action_window;
+
+        while(window.size() < actions.capacity() and not stoken.stop_requested()) {
+
+            if(actions.try_pop(action)) {
+                window.push_back(std::move(action));
+
+            } else if(_throttled.load(std::memory_order_relaxed) or 
+                      std::chrono::steady_clock::now() >= end) {
+                break;
+
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        /* Urgent actions first.  Files of the same directory next to each
+         * other, which for purges also keeps each MDT's files together as a
+         * directory's entries are on its MDT.  Migrations are grouped by 
+         * layout first so they can share messages, then by the pool they are
+         * leaving */
+        auto locality = [](const pending_action &a) {
+
+            std::string_view path(a.path);
+
+            return std::make_tuple(a.priority, std::string_view(a.target.pool), a.target.stripe_count, 
+                                   std::cref(a.target.osts), std::string_view(a.group),
+                                   path.substr(0, path.rfind('/') + 1), path);
+        };
+
+        std::ranges::sort(window, [&locality](const pending_action &a, const pending_action &b) {
+            return locality(a) < locality(b);
+        });
+
+        /* Pack runs of the same priority and layout up to the batch size */
+        for(std::size_t first = 0; first < window.size();) {
+
+            auto last = first + 1;
+            auto bytes = window[first].path.size();
+
+            while(last < window.size() and last - first < _action_batch_size and
+                  bytes + window[last].path.size() + 4 <= _max_packed_bytes and
+                  window[last].priority == window[first].priority and
+                  window[last].target.pool == window[first].target.pool and
+                  window[last].target.stripe_count == window[first].target.stripe_count and
+                  window[last].target.osts == window[first].target.osts) {
+
+                bytes += window[last].path.size() + 4;
+                ++last;
+            }
+
+            _send<MSG>({ window.data() + first, last - first }, publisher, need);
+
+            first = last;
+        }
+
+        /* Drop our references so the batches can be acknowledged */
+        window.clear();
+        action = {};
+    }
+}
+
+
+template<typename MSG>
+void policy_engine_impl::_send(std::span<pending_action> actions, 
+                               message_queue_publisher &publisher, std::string_view need) {
+
+    for(const auto &action : actions) {
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): " 
+                  << "Has decided that " << action.path << " needs " << need 
+                  << (action.target.pool.empty() ? "" : " to pool " + action.target.pool)
+                  << " (" << action.rule << ")" << std::endl;
+    }
+
+    try {
+        MSG msg(actions.front().path);
+
+        for(const auto &action : actions.subspan(1)) {
+            msg.paths.push_back(action.path);
+        }
+
+        msg.priority = actions.front().priority;
+
+        if constexpr (std::is_same_v<MSG, migration_message>) {
+            msg.pool = actions.front().target.pool;
+            msg.stripe_count = actions.front().target.stripe_count;
+            msg.osts = actions.front().target.osts;
+        }
+
+        publisher.send(msg);
+
+        /* Purged files no longer count, if the purge fails the next
+         * scan counts the file again */
+        if constexpr (std::is_same_v<MSG, purge_message>) {
+            if(_track_usage) {
+                for(const auto &action : actions) {
+                    _usage.remove(action.key);
+                }
+            }
+        }
+
+    } catch(const std::exception &e) {
+
+        for(auto &action : actions) {
+
+            /* Forgotten so the retried record is sent again */
+            if(_decisions) {
+                _decisions->erase(action.key);
+            }
+
+            action.batch->fail(e.what());
+        }
+    }
+}
+
+
 void policy_engine_impl::stop() {
-    
+    _stop.request_stop();
+}
+
+
+void policy_engine_impl::set_policy(const compiled_policy &policy) {
+
+    if(policy.uses_usage() and not _track_usage) {
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                  << "Usage is not tracked, the usage fields of the new policy are 0" << std::endl;
+    }
+
+    if(policy.uses_ranks() and _sketches.empty()) {
+        std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+                  << "Namespace statistics are not kept, the rank fields of the new policy are 0" 
+                  << std::endl;
+    }
+
+    /* Candidates of the old watermark rules are dropped, they come back as
+     * the files are scanned again */
+    _policy.store(std::make_shared<policy_version>(policy));
+
+    std::clog << "Policy engine(" << std::this_thread::get_id() <<"): "
+              << "Switched to a policy of " << policy.rules().size() << " rules" << std::endl;
 }
 
 
@@ -129,8 +1084,9 @@ void policy_engine_impl::stop() {
 policy_engine *create_policy_engine(const message_queue_subscriber &scan_mq_sub, 
                                     const message_queue_publisher &removal_mq_pub,
                                     const message_queue_publisher &migration_mq_pub,
-                                    const message_queue_publisher &recorder_mq_pub) {
+                                    const compiled_policy &policy,
+                                    const policy_engine_options &options) {
 
     return new policy_engine_impl(scan_mq_sub, removal_mq_pub, migration_mq_pub, 
-                                  recorder_mq_pub);
-}
\ No newline at end of file
+                                  policy, options);
+}
@@ -0,0 +1,292 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+#include "./policy_simulator.h"
+
+
+double simulation_report::records_per_second() const {
+
+    auto seconds = std::chrono::duration<double>(evaluation_time).count();
+
+    return seconds > 0 ? static_cast<double>(records) / seconds : 0;
+}
+
+
+std::ostream &operator<<(std::ostream &os, const simulation_report &report) {
+
+    std::size_t width = 4;
+
+    for(const auto &rule : report.rules) {
+        width = std::max(width, rule.name.size());
+    }
+
+    os << std::left << std::setw(static_cast<int>(width)) << "rule" << "  " 
+       << std::setw(7) << "action" << std::right << std::setw(14) << "files" 
+       << std::setw(20) << "bytes" << "\n";
+
+    for(const auto &rule : report.rules) {
+
+        os << std::left << std::setw(static_cast<int>(width)) << rule.name << "  " 
+           << std::setw(7) << policy_action_name(rule.action) << std::right 
+           << std::setw(14) << rule.files << std::setw(20) << rule.bytes;
+
+        if(rule.directories > 0) {
+            os << "  in " << rule.directories << " directories";
+        }
+
+        os << "\n";
+    }
+
+    if(report.probes > 0) {
+
+        auto estimate = [&](const sampled_total &total) {
+            os << std::setw(14) << static_cast<std::uint64_t>(std::llround(total.estimate())) << " +/- "
+               << std::left << std::setw(12) << static_cast<std::uint64_t>(std::llround(total.margin(report.probes))) 
+               << std::right;
+        };
+
+        os << "estimated from " << report.probes << " sampling probes, 95% confidence:\n";
+
+        for(const auto &rule : report.rules) {
+
+            os << std::left << std::setw(static_cast<int>(width)) << rule.name << "  " 
+               << std::setw(7) << policy_action_name(rule.action) << std::right;
+
+            estimate(rule.estimated_files);
+            os << " files";
+            estimate(rule.estimated_bytes);
+            os << " bytes\n";
+        }
+
+        os << "the records stand for";
+        estimate(report.estimated_records);
+        os << " entries\n";
+    }
+
+    auto seconds = std::chrono::duration<double>(report.evaluation_time).count();
+
+    if(report.deletions > 0) {
+        os << report.deletions << " of the records were deletions\n";
+    }
+
+    return os << report.records << " records, " << report.unmatched << " matched no rule, "
+              << "evaluated in " << seconds << "s (" 
+              << static_cast<std::uint64_t>(report.records_per_second()) << " records/s)\n";
+}
+
+
+policy_simulator::policy_simulator(const compiled_policy &policy, 
+                                   const simulation_options &options,
+                                   match_callback on_match) :
+    _options(options),
+    _policy(policy),
+    _track_usage(options.track_usage or policy.uses_usage()),
+    _watermarks(std::make_unique<watermark_purger>(_policy)),
+    _directories(std::make_unique<directory_tracker>(_policy)),
+    _keep_sketches(options.namespace_stats or policy.uses_ranks()),
+    _on_match(std::move(on_match)) {
+
+    if(_options.batch_size == 0) {
+        throw std::invalid_argument("Simulation batch size must be positive");
+    }
+
+    for(const auto &rule : policy.rules()) {
+        _report.rules.push_back({
+            .name = rule.name,
+            .action = rule.action,
+            .files = 0,
+            .bytes = 0,
+            .directories = 0,
+            .estimated_files = {},
+            .estimated_bytes = {}
+        });
+    }
+}
+
+
+void policy_simulator::_decided(std::size_t rule, std::string_view path, std::int64_t size) {
+
+    auto &totals = _report.rules[rule];
+
+    ++totals.files;
+    totals.bytes += static_cast<std::uint64_t>(std::max<std::int64_t>(size, 0));
+
+    if(_on_match) {
+        _on_match(_policy.rules()[rule], path, size);
+    }
+}
+
+
+void policy_simulator::evaluate(std::span<const scan_message> msgs) {
+
+    for(std::size_t begin = 0; begin < msgs.size(); begin += _options.batch_size) {
+
+        auto count = std::min(_options.batch_size, msgs.size() - begin);
+
+        auto start = std::chrono::steady_clock::now();
+
+        _evaluate_batch(msgs.subspan(begin, count));
+
+        _report.evaluation_time += std::chrono::steady_clock::now() - start;
+        _report.records += count;
+    }
+}
+
+
+/* The same steps as the engine's evaluators, with the actions counted
+ * instead of queued */
+void policy_simulator::_evaluate_batch(std::span<const scan_message> msgs) {
+
+    /* The probes are numbered from 1, every one sends at least the root */
+    for(const auto &msg : msgs) {
+        if(msg.sampled) {
+            _report.probes = std::max(_report.probes, msg.probe);
+            _report.estimated_records.add(msg);
+        }
+    }
+
+    if(_track_usage) {
+        for(const auto &msg : msgs) {
+
+            if(msg.deleted) {
+                _usage.remove(usage_store::file_key(msg.filesys, msg.fid, msg.path));
+            } else {
+                _usage.record(msg);
+            }
+        }
+    }
+
+    if(_keep_sketches) {
+
+        for(const auto &msg : msgs) {
+            if(not msg.deleted) {
+                _sketches.add(msg);
+            }
+        }
+
+        _since_ranked += msgs.size();
+
+        if(not _ranks or _since_ranked >= _options.rank_refresh) {
+            _ranks = _sketches.summarize(_options.now);
+            _since_ranked = 0;
+        }
+    }
+
+    /* The whole batch is decided on the usage before any of it is purged,
+     * as in the engine where purges only count once they are sent */
+    _decisions.assign(msgs.size(), nullptr);
+
+    for(std::size_t i = 0; i < msgs.size(); ++i) {
+
+        if(msgs[i].deleted) {
+            continue;
+        }
+
+        usage_totals totals;
+
+        if(_track_usage) {
+            totals = _usage.totals(msgs[i]);
+        }
+
+        if(_ranks) {
+            _ranks->rank(msgs[i], totals);
+        }
+
+        _decisions[i] = _policy.evaluate_adaptive(msgs[i], _options.now, totals);
+    }
+
+    const auto *first_rule = _policy.rules().data();
+
+    for(std::size_t i = 0; i < msgs.size(); ++i) {
+
+        const auto *rule = _decisions[i];
+
+        if(msgs[i].deleted) {
+
+            if(not _watermarks->empty()) {
+                _watermarks->forget(msgs[i]);
+            }
+
+            ++_report.deletions;
+            continue;
+        }
+
+        _directories->record(msgs[i], rule ? std::optional<std::size_t>(rule - first_rule) : std::nullopt,
+                             _options.now);
+
+        if(not _watermarks->empty()) {
+
+            if(rule != nullptr and rule->watermark) {
+                _watermarks->offer(rule - first_rule, msgs[i], _options.now, _usage);
+                continue;
+            }
+
+            _watermarks->forget(msgs[i]);
+        }
+
+        if(rule == nullptr) {
+            ++_report.unmatched;
+            continue;
+        }
+
+        if(rule->directory) {
+            continue;
+        }
+
+        _decided(rule - first_rule, msgs[i].path, static_cast<std::int64_t>(msgs[i].size));
+
+        if(msgs[i].sampled) {
+            _report.rules[rule - first_rule].estimated_files.add(msgs[i]);
+            _report.rules[rule - first_rule].estimated_bytes.add(msgs[i], static_cast<double>(msgs[i].size));
+        }
+
+        /* As if the purge agent had removed it */
+        if(_track_usage and rule->action == policy_action::PURGE) {
+            _usage.remove(usage_store::file_key(msgs[i].filesys, msgs[i].fid, msgs[i].path));
+        }
+    }
+
+    if(_watermarks->empty()) {
+        return;
+    }
+
+    /* Files taken by a watermark purge are already out of the usage totals */
+    for(const auto &purge : _watermarks->due(_usage)) {
+        for(const auto &file : purge.files) {
+            _decided(purge.rule_index, file.path, file.size);
+        }
+    }
+}
+
+
+void policy_simulator::finish() {
+
+    if(_keep_sketches) {
+        _ranks = _sketches.summarize(_options.now);
+    }
+
+    for(const auto &directory : _directories->due(_options.now, true)) {
+
+        auto &totals = _report.rules[directory.rule];
+
+        ++totals.directories;
+        totals.files += static_cast<std::uint64_t>(directory.files);
+        totals.bytes += static_cast<std::uint64_t>(std::max<std::int64_t>(directory.bytes, 0));
+
+        if(_on_match) {
+            _on_match(_policy.rules()[directory.rule], directory.path, directory.bytes);
+        }
+    }
+}
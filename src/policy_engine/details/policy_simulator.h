@@ -0,0 +1,177 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./directory_tracker.h"
+#include "./namespace_sketches.h"
+#include "./policy_compiler.h"
+#include "./sample_estimate.h"
+#include "./usage_store.h"
+#include "./watermark_purge.h"
+
+
+struct simulation_options {
+
+    /* Records evaluated together */
+    std::size_t batch_size = 4096;
+
+    /* The time the ages are taken from, pinned so a replay of an old
+     * capture decides the way it would have when it was taken */
+    std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+
+    /* Keep usage totals even if the policy doesn't need them */
+    bool track_usage = false;
+
+    /* Keep namespace statistics even if the policy doesn't rank records */
+    bool namespace_stats = false;
+
+    /* Records between refreshes of the ranks, standing in for the
+     * engine's refresh interval */
+    std::size_t rank_refresh = 1 << 18;
+};
+
+
+/* What a simulated policy would have done */
+struct simulation_report {
+
+    struct rule_totals {
+        std::string name;
+        policy_action action;
+        std::uint64_t files = 0;
+        std::uint64_t bytes = 0;
+
+        /* Directory rules only, the files and bytes are theirs */
+        std::uint64_t directories = 0;
+
+        /* Sampling scans only, what the rule would decide in the whole
+         * namespace.  Directory rules and watermark purges act on sets of
+         * files a sample doesn't have, so they have no estimate */
+        sampled_total estimated_files;
+        sampled_total estimated_bytes;
+    };
+
+    /* In the order of the policy */
+    std::vector<rule_totals> rules;
+
+    std::uint64_t records = 0;
+    std::uint64_t unmatched = 0;
+
+    /* Records of files a change filtering scan found gone */
+    std::uint64_t deletions = 0;
+
+    /* Probes of the sampling scan the records came from, 0 if they came
+     * from a full scan, and the records they stand for */
+    std::uint32_t probes = 0;
+    sampled_total estimated_records;
+
+    /* Time spent evaluating, not reading the records */
+    std::chrono::nanoseconds evaluation_time{0};
+
+    double records_per_second() const;
+};
+
+std::ostream &operator<<(std::ostream &os, const simulation_report &report);
+
+
+/**
+ * @brief Runs scan records through a policy the way the policy engine does,
+ *        without publishing anything.
+ *
+ * Records are evaluated a batch at a time with usage tracked and watermark
+ * purges triggered as in the engine, and files the
+ * policy purges are taken out of the usage totals as if the purge had been
+ * carried out.  Records are ranked against the namespace statistics of the
+ * records before them, refreshed every rank_refresh records and first after
+ * the first batch.  Each decision is counted against its rule and handed to the
+ * optional callback, e.g. to write a list of the files.  Directories are
+ * decided by finish(), as the replay has no time passing for them to 
+ * settle.  Not thread safe.
+ */
+class policy_simulator {
+
+    public:
+
+        /* A file a rule decided, the path is only valid during the call */
+        using match_callback = std::function<void(const compiled_policy::rule &rule, 
+                                                  std::string_view path,
+                                                  std::int64_t size)>;
+
+    private:
+
+        simulation_options _options;
+
+        /* The policy the rules point into, reordering its operands as the
+         * engine's workers do */
+        compiled_policy _policy;
+
+        /* The rule deciding each record of the batch being evaluated */
+        std::vector<const compiled_policy::rule *> _decisions;
+
+        bool _track_usage;
+        usage_store _usage;
+        std::unique_ptr<watermark_purger> _watermarks;
+        std::unique_ptr<directory_tracker> _directories;
+
+        bool _keep_sketches;
+        namespace_sketches _sketches;
+        std::optional<namespace_summary> _ranks;
+        std::size_t _since_ranked = 0;
+
+        match_callback _on_match;
+        simulation_report _report;
+
+        void _decided(std::size_t rule, std::string_view path, std::int64_t size);
+
+        void _evaluate_batch(std::span<const scan_message> msgs);
+
+    public:
+
+        explicit policy_simulator(const compiled_policy &policy, 
+                                  const simulation_options &options = {},
+                                  match_callback on_match = {});
+
+        policy_simulator(const policy_simulator &) = delete;
+        policy_simulator &operator=(const policy_simulator &) = delete;
+
+        /* Evaluates the records in batches of the batch size */
+        void evaluate(std::span<const scan_message> msgs);
+
+        /* Decides the directories of directory rules, once all the records
+         * have been evaluated */
+        void finish();
+
+        const simulation_report &report() const {
+            return _report;
+        }
+
+        /* The order the policy's operands are tested in after the records
+         * so far, see compiled_policy::evaluate_adaptive() */
+        std::string evaluation_order() const {
+            return _policy.evaluation_order();
+        }
+
+        /* Statistics of all the records after finish(), null if not kept */
+        const namespace_summary *namespace_stats() const {
+            return _keep_sketches and _ranks ? &*_ranks : nullptr;
+        }
+};
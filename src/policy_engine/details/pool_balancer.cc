@@ -0,0 +1,267 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+#include "../../common/process_control.h"
+#include "./pool_balancer.h"
+
+
+/* Lines look like
+ *
+ *  UUID                   1K-blocks        Used   Available Use% Mounted on
+ *  lustre-MDT0000_UUID      1030828       12920      930268   2% /lustre[MDT:0]
+ *  lustre-OST0000_UUID   1984224000    21528000  1856456000   2% /lustre[OST:0]
+ *  lustre-OST0001_UUID            : inactive device
+ *
+ *  filesystem_summary:   1984224000    21528000  1856456000   2% /lustre
+ */
+std::vector<ost_space> parse_lfs_df(std::istream &in) {
+
+    std::vector<ost_space> osts;
+
+    for(std::string line; std::getline(in, line);) {
+
+        std::istringstream fields(line);
+        std::string uuid;
+
+        fields >> uuid;
+
+        auto name = uuid.find("-OST");
+
+        if(name == std::string::npos or not uuid.ends_with("_UUID") or 
+           line.find("inactive") != std::string::npos) {
+            continue;
+        }
+
+        std::int64_t blocks, used, available;
+        std::string percent, mount;
+
+        if(not (fields >> blocks >> used >> available >> percent)) {
+            throw std::invalid_argument("Invalid lfs df line '" + line + "'");
+        }
+
+        fields >> mount;
+
+        /* The index is in the mount column, or else the hex after OST */
+        std::uint32_t index;
+
+        try {
+            if(auto tag = mount.find("[OST:"); tag != std::string::npos) {
+                index = std::stoul(mount.substr(tag + 5));
+            } else {
+                index = std::stoul(uuid.substr(name + 4), nullptr, 16);
+            }
+
+        } catch(const std::logic_error &e) {
+            throw std::invalid_argument("Invalid OST index in lfs df line '" + line + "'");
+        }
+
+        osts.push_back({ index, blocks * 1024, available * 1024 });
+    }
+
+    return osts;
+}
+
+
+std::string pool_balancer::refresh(std::span<const std::string> pools) {
+
+    /* Fetched without the lock as it runs lfs */
+    std::map<std::string, pool, std::less<>> fresh;
+    std::string errors;
+
+    for(const auto &name : pools) {
+
+        if(fresh.contains(name)) {
+            continue;
+        }
+
+        try {
+
+            pool p;
+
+            for(const auto &space : _fetch(name)) {
+                p.osts.push_back({ space.index, space.available });
+                p.available += space.available;
+            }
+
+            if(p.osts.empty()) {
+                throw std::runtime_error("no active OSTs");
+            }
+
+            fresh.emplace(name, std::move(p));
+
+        } catch(const std::exception &e) {
+            errors += "Pool " + name + ": " + e.what() + "\n";
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    /* Pools that failed keep their last view, but not what was reserved
+     * against it as that is in the view now */
+    for(const auto &name : pools) {
+
+        if(auto it = _pools.find(name); it != _pools.end() and not fresh.contains(name)) {
+
+            it->second.reserved = 0;
+
+            for(auto &o : it->second.osts) {
+                o.reserved = 0;
+            }
+
+            fresh.insert(_pools.extract(it));
+        }
+    }
+
+    _pools = std::move(fresh);
+
+    return errors;
+}
+
+
+migration_target pool_balancer::choose(std::span<const std::string> candidates,
+                                       std::int64_t size, std::uint32_t stripes) {
+
+    if(candidates.empty()) {
+        throw std::invalid_argument("No candidate pools");
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const std::string *best_name = nullptr;
+    pool *best = nullptr;
+
+    for(const auto &name : candidates) {
+
+        auto it = _pools.find(name);
+
+        if(it != _pools.end() and (best == nullptr or
+           it->second.available - it->second.reserved > best->available - best->reserved)) {
+            best_name = &it->first;
+            best = &it->second;
+        }
+    }
+
+    if(best == nullptr) {
+        return { candidates.front(), stripes, {} };
+    }
+
+    /* Default striping, lfs picks the OSTs */
+    if(stripes == 0) {
+        best->reserved += std::max<std::int64_t>(size, 0);
+        return { *best_name, 0, {} };
+    }
+
+    auto count = std::clamp<std::size_t>(stripes, 1, best->osts.size());
+
+    std::vector<std::size_t> order(best->osts.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    std::partial_sort(order.begin(), order.begin() + count, order.end(), 
+                      [&osts = best->osts](std::size_t a, std::size_t b) {
+        return osts[a].available - osts[a].reserved > osts[b].available - osts[b].reserved;
+    });
+
+    migration_target target { *best_name, static_cast<std::uint32_t>(count), {} };
+
+    auto share = (std::max<std::int64_t>(size, 0) + count - 1) / count;
+
+    for(std::size_t i = 0; i < count; ++i) {
+
+        auto &o = best->osts[order[i]];
+
+        o.reserved += share;
+        target.osts.push_back(o.index);
+    }
+
+    best->reserved += std::max<std::int64_t>(size, 0);
+
+    return target;
+}
+
+
+std::int64_t pool_balancer::available(const std::string &pool) const {
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _pools.find(pool);
+
+    return (it == _pools.end()) ? -1 : it->second.available - it->second.reserved;
+}
+
+
+static std::string expand(const std::string &text, const std::string &pool) {
+
+    std::string result;
+    std::size_t pos = 0;
+
+    for(auto at = text.find("{pool}"); at != std::string::npos; at = text.find("{pool}", pos)) {
+        result.append(text, pos, at - pos).append(pool);
+        pos = at + 6;
+    }
+
+    return result.append(text, pos);
+}
+
+
+pool_balancer::fetch_function pool_balancer::lfs_df(std::string source) {
+
+    if(source.starts_with("file:")) {
+
+        return [path = source.substr(5)](const std::string &pool) {
+
+            std::ifstream in(expand(path, pool));
+
+            if(not in) {
+                throw std::runtime_error("Can't read " + expand(path, pool));
+            }
+
+            return parse_lfs_df(in);
+        };
+    }
+
+    std::vector<std::string> words;
+    std::istringstream command(source);
+
+    for(std::string word; command >> word;) {
+        words.push_back(std::move(word));
+    }
+
+    if(words.empty()) {
+        throw std::invalid_argument("Empty pool usage command");
+    }
+
+    return [words = std::move(words)](const std::string &pool) {
+
+        std::vector<std::string> args;
+
+        for(const auto &word : words) {
+            args.push_back(expand(word, pool));
+        }
+
+        process lfs(args);
+
+        auto filebuf = lfs.launch();
+        std::istream out(&filebuf);
+
+        auto osts = parse_lfs_df(out);
+
+        if(int rc = lfs.wait(); rc != 0) {
+            throw std::runtime_error(args.front() + " exited with " + std::to_string(rc));
+        }
+
+        return osts;
+    };
+}
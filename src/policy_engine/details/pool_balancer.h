@@ -0,0 +1,116 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+
+/* One OST's line of lfs df */
+struct ost_space {
+    std::uint32_t index;
+    std::int64_t total;         /* Bytes */
+    std::int64_t available;
+};
+
+/**
+ * @brief The OSTs in the output of lfs df, in bytes.  Metadata targets, the
+ *        header, the summary and inactive OSTs are left out.
+ *
+ * @throws std::invalid_argument for an OST line that can't be read.
+ */
+std::vector<ost_space> parse_lfs_df(std::istream &in);
+
+
+/* Where a migrated file goes, osts is empty to leave the OSTs to lfs */
+struct migration_target {
+    std::string pool;
+    std::uint32_t stripe_count = 0;
+    std::vector<std::uint32_t> osts;
+};
+
+
+/**
+ * @brief Chooses the pool and OSTs of migrations from a periodically 
+ *        refreshed view of the free space of the candidate pools.
+ *
+ * Each file goes to the candidate pool with the most room left for its
+ * size, and within it to the OSTs with the most room left.  The space taken
+ * by the files sent since the last refresh is counted against the pools and
+ * OSTs they went to, which is both the nearest measure of the load each one
+ * is about to see that lfs df gives and what keeps a burst of migrations
+ * from all landing on the same few OSTs before the next refresh shows them
+ * filling up.
+ *
+ * A pool that couldn't be looked up is still chosen, as a last resort and
+ * without OSTs.  Safe to use from several threads.
+ */
+class pool_balancer {
+
+    public:
+
+        /* The lfs df output for a pool, throws if it can't be had */
+        using fetch_function = std::function<std::vector<ost_space>(const std::string &pool)>;
+
+    private:
+
+        struct ost {
+            std::uint32_t index;
+            std::int64_t available;
+            std::int64_t reserved = 0;
+        };
+
+        struct pool {
+            std::vector<ost> osts;
+            std::int64_t available = 0;
+            std::int64_t reserved = 0;
+        };
+
+        fetch_function _fetch;
+
+        mutable std::mutex _mutex;
+        std::map<std::string, pool, std::less<>> _pools;
+
+    public:
+
+        explicit pool_balancer(fetch_function fetch) : _fetch(std::move(fetch)) { }
+
+        /* Looks the pools up again and forgets what was reserved.  A pool 
+         * that can't be looked up keeps its last view, the errors are 
+         * returned one per line */
+        std::string refresh(std::span<const std::string> pools);
+
+        /* Chooses among candidates for a file of size bytes, reserving the
+         * space.  stripes is the stripe count to give it, clamped to the
+         * OSTs of the pool, or 0 to keep the default striping and leave the
+         * OSTs to lfs.  The first candidate if none has a view */
+        migration_target choose(std::span<const std::string> candidates,
+                                std::int64_t size, std::uint32_t stripes);
+
+        /* Free space of a pool less what was reserved, -1 if not known */
+        std::int64_t available(const std::string &pool) const;
+
+        /**
+         * @brief Fetches by running command with every {pool} replaced by the
+         *        pool's name, e.g. "/usr/bin/lfs df --pool lustre.{pool}",
+         *        or by reading the file after "file:" with {pool} replaced 
+         *        the same way, which is what the tests use.
+         */
+        static fetch_function lfs_df(std::string source);
+};
@@ -0,0 +1,50 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cmath>
+
+#include "./sample_estimate.h"
+
+
+void sampled_total::add(const scan_message &msg, double value) {
+
+    _total += msg.weight * value;
+
+    if(msg.probe == 0) {
+        return;
+    }
+
+    if(_probes.size() < msg.probe) {
+        _probes.resize(msg.probe, 0.0);
+    }
+
+    _probes[msg.probe - 1] += msg.weight * value;
+}
+
+
+double sampled_total::margin(std::uint32_t probes, double z) const {
+
+    if(probes < 2) {
+        return 0;
+    }
+
+    const auto n = static_cast<double>(probes);
+    const auto mean = _total;
+
+    double squares = 0;
+
+    /* A probe's own estimate is its sum scaled back up by the probes */
+    for(std::uint32_t k = 0; k < probes; ++k) {
+        auto estimate = n * (k < _probes.size() ? _probes[k] : 0.0);
+        squares += (estimate - mean) * (estimate - mean);
+    }
+
+    return z * std::sqrt(squares / (n * (n - 1)));
+}
@@ -0,0 +1,51 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../../messaging/details/messages.h"
+
+
+/**
+ * @brief Estimate of a namespace total, e.g. files or bytes, from the
+ *        weighted records of a sampling scan.
+ *
+ * The estimate is the sum of the records' values times their weights, which
+ * is unbiased.  Each probe of the scan is on its own an estimate of the
+ * total, the probes' estimates times the number of probes averaging to the
+ * estimate, so their spread gives its standard error.
+ */
+class sampled_total {
+
+    private:
+
+        double _total = 0;
+
+        /* Weighted sums of each probe, by probe - 1 */
+        std::vector<double> _probes;
+
+    public:
+
+        void add(const scan_message &msg, double value = 1.0);
+
+        double estimate() const {
+            return _total;
+        }
+
+        /**
+         * @brief Half the width of the confidence interval of the estimate
+         *        for a scan of probes probes, 1.96 standard errors for 95%.
+         *        Probes that added nothing count as estimates of 0.
+         */
+        double margin(std::uint32_t probes, double z = 1.96) const;
+};
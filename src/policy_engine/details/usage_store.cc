@@ -0,0 +1,288 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <stdexcept>
+
+#include "./usage_store.h"
+
+
+usage_store::usage_store(std::size_t shards) {
+
+    if(shards == 0) {
+        throw std::invalid_argument("Usage store needs at least one shard");
+    }
+
+    for(std::size_t i = 0; i < shards; ++i) {
+        _shards.emplace_back(std::make_unique<file_shard>());
+    }
+}
+
+
+std::string usage_store::file_key(std::string_view filesys, std::string_view fid, 
+                                  std::string_view path) {
+
+    std::string key;
+
+    key.reserve(filesys.size() + 1 + (fid.empty() ? path.size() : fid.size()));
+    key.append(filesys).append(1, ':').append(fid.empty() ? path : fid);
+
+    return key;
+}
+
+
+bool usage_store::_find_name(std::string_view name, std::uint32_t &id) const {
+
+    std::shared_lock lock(_names_mutex);
+
+    if(auto it = _names.find(name); it != _names.end()) {
+        id = it->second;
+        return true;
+    }
+
+    return false;
+}
+
+
+std::uint32_t usage_store::_intern(std::string_view name) {
+
+    std::uint32_t id;
+
+    if(_find_name(name, id)) {
+        return id;
+    }
+
+    std::unique_lock lock(_names_mutex);
+
+    return _names.try_emplace(std::string(name), static_cast<std::uint32_t>(_names.size())).first->second;
+}
+
+
+const usage_store::counters *usage_store::_find_counters(std::uint64_t key) const {
+
+    std::shared_lock lock(_totals_mutex);
+
+    auto it = _totals.find(key);
+
+    return it == _totals.end() ? nullptr : it->second.get();
+}
+
+
+usage_store::counters &usage_store::_counters(std::uint64_t key) {
+
+    if(const auto *c = _find_counters(key)) {
+        return const_cast<counters &>(*c);
+    }
+
+    std::unique_lock lock(_totals_mutex);
+
+    auto &c = _totals[key];
+
+    if(not c) {
+        c = std::make_unique<counters>();
+    }
+
+    return *c;
+}
+
+
+void usage_store::_apply(const contribution &c, std::int64_t sign) {
+
+    for(auto [s, value] : { std::pair{ scope::UID, c.uid }, 
+                            std::pair{ scope::GID, c.gid }, 
+                            std::pair{ scope::POOL, c.pool } }) {
+
+        auto &total = _counters(_key(s, c.filesys, value));
+
+        total.bytes.fetch_add(sign * c.bytes, std::memory_order_relaxed);
+        total.files.fetch_add(sign, std::memory_order_relaxed);
+    }
+
+    _files.fetch_add(sign, std::memory_order_relaxed);
+}
+
+
+usage_store::file_shard &usage_store::_shard(std::string_view key) {
+    return *_shards[std::hash<std::string_view>{}(key) % _shards.size()];
+}
+
+
+void usage_store::record(const scan_message &msg) {
+
+    contribution now {
+        .bytes = static_cast<std::int64_t>(msg.size),
+        .uid = static_cast<std::uint32_t>(msg.uid),
+        .gid = static_cast<std::uint32_t>(msg.gid),
+        .pool = _intern(msg.ost_pool),
+        .filesys = _intern(msg.filesys)
+    };
+
+    _replace(file_key(msg.filesys, msg.fid, msg.path), now);
+}
+
+
+void usage_store::_replace(std::string &&key, const contribution &now) {
+
+    auto &shard = _shard(key);
+
+    contribution before;
+    bool seen;
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto [it, inserted] = shard.files.try_emplace(std::move(key), now);
+
+        seen = not inserted;
+
+        if(seen) {
+            before = it->second;
+            it->second = now;
+        }
+    }
+
+    /* The updates commute so two threads recording the same file at once 
+     * still leave the right totals */
+    if(seen) {
+        _apply(before, -1);
+    }
+
+    _apply(now, 1);
+}
+
+
+void usage_store::remove(std::string_view key) {
+
+    auto &shard = _shard(key);
+
+    contribution before;
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.files.find(key);
+
+        if(it == shard.files.end()) {
+            return;
+        }
+
+        before = it->second;
+        shard.files.erase(it);
+    }
+
+    _apply(before, -1);
+}
+
+
+usage_totals usage_store::totals(const scan_message &msg) const {
+
+    usage_totals totals;
+    std::uint32_t filesys, pool;
+
+    if(not _find_name(msg.filesys, filesys)) {
+        return totals;
+    }
+
+    auto load = [&](scope s, std::uint32_t value, std::int64_t &bytes, std::int64_t &files) {
+        if(const auto *c = _find_counters(_key(s, filesys, value))) {
+            bytes = c->bytes.load(std::memory_order_relaxed);
+            files = c->files.load(std::memory_order_relaxed);
+        }
+    };
+
+    load(scope::UID, static_cast<std::uint32_t>(msg.uid), totals.uid_bytes, totals.uid_files);
+    load(scope::GID, static_cast<std::uint32_t>(msg.gid), totals.gid_bytes, totals.gid_files);
+
+    if(_find_name(msg.ost_pool, pool)) {
+        load(scope::POOL, pool, totals.pool_bytes, totals.pool_files);
+    }
+
+    return totals;
+}
+
+
+std::int64_t usage_store::pool_bytes(std::string_view filesys, std::string_view pool) const {
+
+    std::uint32_t filesys_id, pool_id;
+
+    if(not _find_name(filesys, filesys_id) or not _find_name(pool, pool_id)) {
+        return 0;
+    }
+
+    const auto *c = _find_counters(_key(scope::POOL, filesys_id, pool_id));
+
+    return c ? c->bytes.load(std::memory_order_relaxed) : 0;
+}
+
+
+void usage_store::save(snapshot_writer &out) const {
+
+    {
+        std::shared_lock lock(_names_mutex);
+
+        std::vector<std::string_view> names(_names.size());
+
+        for(const auto &[name, id] : _names) {
+            names[id] = name;
+        }
+
+        out.put(static_cast<std::uint32_t>(names.size()));
+
+        for(auto name : names) {
+            out.put_string(name);
+        }
+    }
+
+    for(const auto &shard : _shards) {
+
+        std::lock_guard<std::mutex> lock(shard->mutex);
+
+        out.put(static_cast<std::uint64_t>(shard->files.size()));
+
+        for(const auto &[key, c] : shard->files) {
+            out.put_string(key);
+            out.put(c);
+        }
+    }
+}
+
+
+void usage_store::load(snapshot_reader &in) {
+
+    /* The ids in the snapshot to ours */
+    std::vector<std::uint32_t> ids(in.get<std::uint32_t>());
+
+    for(auto &id : ids) {
+        id = _intern(in.get_string());
+    }
+
+    auto map = [&ids](std::uint32_t id) {
+
+        if(id >= ids.size()) {
+            throw std::runtime_error("Usage snapshot names an unknown pool or file system");
+        }
+
+        return ids[id];
+    };
+
+    /* The shards may differ from the ones saved */
+    while(not in.empty()) {
+
+        for(auto count = in.get<std::uint64_t>(); count > 0; --count) {
+
+            auto key = in.get_string();
+            auto c = in.get<contribution>();
+
+            c.pool = map(c.pool);
+            c.filesys = map(c.filesys);
+
+            _replace(std::string(key), c);
+        }
+    }
+}
\ No newline at end of file
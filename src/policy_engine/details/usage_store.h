@@ -0,0 +1,134 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "./engine_snapshot.h"
+#include "./policy_compiler.h"
+
+
+/**
+ * @brief Bytes and file counts per owner, group and OST pool of each file
+ *        system, kept up to date from the scan records.
+ *
+ * Every file's last contribution is remembered by its FID, or its path if
+ * it has none, so a file scanned again replaces what it counted for before
+ * instead of being counted twice, and a purged file is taken out.  Totals
+ * are atomics behind hash tables that are only locked exclusively to add a
+ * new owner, group or pool, so looking them up for a rule is a few hash 
+ * lookups.  Safe to use from several threads.
+ */
+class usage_store {
+
+    private:
+
+        enum class scope : std::uint8_t { UID, GID, POOL };
+
+        struct contribution {
+            std::int64_t bytes;
+            std::uint32_t uid;
+            std::uint32_t gid;
+            std::uint32_t pool;
+            std::uint32_t filesys;
+        };
+
+        struct counters {
+            std::atomic<std::int64_t> bytes{0};
+            std::atomic<std::int64_t> files{0};
+        };
+
+        struct string_hash : std::hash<std::string_view> {
+            using is_transparent = void;
+        };
+
+        using string_map = std::unordered_map<std::string, contribution, string_hash, std::equal_to<>>;
+
+        struct file_shard {
+            std::mutex mutex;
+            string_map files;
+        };
+
+        std::vector<std::unique_ptr<file_shard>> _shards;
+
+        /* Pool and file system names as small ids */
+        mutable std::shared_mutex _names_mutex;
+        std::unordered_map<std::string, std::uint32_t, string_hash, std::equal_to<>> _names;
+
+        /* Keyed by scope, file system and owner, group or pool */
+        mutable std::shared_mutex _totals_mutex;
+        std::unordered_map<std::uint64_t, std::unique_ptr<counters>> _totals;
+
+        std::atomic<std::int64_t> _files{0};
+
+        static std::uint64_t _key(scope s, std::uint32_t filesys, std::uint32_t value) {
+            return (std::uint64_t(s) << 62) | (std::uint64_t(filesys & 0x3fffffff) << 32) | value;
+        }
+
+        std::uint32_t _intern(std::string_view name);
+        bool _find_name(std::string_view name, std::uint32_t &id) const;
+
+        counters &_counters(std::uint64_t key);
+        const counters *_find_counters(std::uint64_t key) const;
+
+        void _apply(const contribution &c, std::int64_t sign);
+
+        /* Makes now the file's contribution */
+        void _replace(std::string &&key, const contribution &now);
+
+        file_shard &_shard(std::string_view key);
+
+    public:
+
+        explicit usage_store(std::size_t shards = 64);
+
+        usage_store(const usage_store &) = delete;
+        usage_store &operator=(const usage_store &) = delete;
+
+        /* The key a file is remembered by */
+        static std::string file_key(std::string_view filesys, std::string_view fid, 
+                                    std::string_view path);
+
+        /* Counts the file, replacing its previous contribution if it was seen
+         * before */
+        void record(const scan_message &msg);
+
+        /* Takes a file out of the totals, e.g. once it is purged */
+        void remove(std::string_view key);
+
+        /* The totals of the record's owner, group and pool */
+        usage_totals totals(const scan_message &msg) const;
+
+        /* Bytes in a pool of a file system */
+        std::int64_t pool_bytes(std::string_view filesys, std::string_view pool) const;
+
+        /* Writes every file's contribution, for a snapshot */
+        void save(snapshot_writer &out) const;
+
+        /* Adds the files save() wrote, replacing any already counted.
+         * @throws std::runtime_error if the section is damaged */
+        void load(snapshot_reader &in);
+
+        /* Number of files counted */
+        std::int64_t files() const {
+            return _files.load(std::memory_order_relaxed);
+        }
+};
@@ -0,0 +1,250 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+
+#include "./watermark_purge.h"
+
+
+void purge_candidates::_erase(ordered::iterator it) {
+
+    _bytes -= it->size;
+    _by_key.erase(it->key);
+    _by_score.erase(it);
+}
+
+
+void purge_candidates::erase(std::string_view key) {
+
+    if(auto it = _by_key.find(key); it != _by_key.end()) {
+        _erase(it->second);
+    }
+}
+
+
+void purge_candidates::offer(purge_candidate candidate, std::int64_t target) {
+
+    erase(candidate.key);
+
+    /* Worse than everything kept when there is already enough */
+    if(not _by_score.empty() and better()(*std::prev(_by_score.end()), candidate) and
+       (_by_score.size() >= _limit or _bytes >= target)) {
+        return;
+    }
+
+    _bytes += candidate.size;
+
+    auto it = _by_score.insert(std::move(candidate)).first;
+    _by_key.emplace(it->key, it);
+
+    /* Drop the worst while the rest still cover the target */
+    while(not _by_score.empty()) {
+
+        auto worst = std::prev(_by_score.end());
+
+        if(_by_score.size() <= _limit and _bytes - worst->size < target) {
+            break;
+        }
+
+        _erase(worst);
+    }
+}
+
+
+std::vector<purge_candidate> purge_candidates::take(std::int64_t bytes) {
+
+    std::vector<purge_candidate> taken;
+    std::int64_t freed = 0;
+
+    while(freed < bytes and not _by_score.empty()) {
+
+        auto best = _by_score.begin();
+
+        freed += best->size;
+        _bytes -= best->size;
+        _by_key.erase(best->key);
+
+        taken.push_back(std::move(_by_score.extract(best).value()));
+    }
+
+    return taken;
+}
+
+
+
+
+watermark_purger::watermark_purger(const compiled_policy &policy) {
+
+    for(std::size_t r = 0; r < policy.rules().size(); ++r) {
+
+        const auto &rule = policy.rules()[r];
+
+        _settings.push_back(rule.watermark);
+        _names.push_back(rule.name);
+
+        if(rule.watermark) {
+            _watermark_rules.push_back(r);
+        }
+    }
+}
+
+
+void watermark_purger::_pool_key(std::string &key, std::size_t rule, 
+                                 std::string_view filesys, std::string_view pool) {
+
+    key.assign(std::to_string(rule)).append(1, '\0').append(filesys).append(1, '\0').append(pool);
+}
+
+
+watermark_purger::pool_state *
+watermark_purger::_find(std::size_t rule, std::string_view filesys, std::string_view pool) const {
+
+    static thread_local std::string key;
+
+    _pool_key(key, rule, filesys, pool);
+
+    std::shared_lock lock(_mutex);
+
+    auto it = _pools.find(key);
+
+    return it == _pools.end() ? nullptr : it->second.get();
+}
+
+
+watermark_purger::pool_state &
+watermark_purger::_state(std::size_t rule, std::string_view filesys, std::string_view pool) {
+
+    if(auto *state = _find(rule, filesys, pool)) {
+        return *state;
+    }
+
+    std::string key;
+    _pool_key(key, rule, filesys, pool);
+
+    std::unique_lock lock(_mutex);
+
+    auto &state = _pools[key];
+
+    if(not state) {
+        state = std::make_unique<pool_state>(rule, filesys, pool, _settings[rule]->max_candidates);
+    }
+
+    return *state;
+}
+
+
+void watermark_purger::offer(std::size_t rule, const scan_message &msg,
+                             std::chrono::system_clock::time_point now, const usage_store &usage) {
+
+    const auto &settings = *_settings[rule];
+    auto &state = _state(rule, msg.filesys, msg.ost_pool);
+
+    auto age = std::max<double>(0, std::chrono::duration<double>(now - msg.atime).count());
+    auto score = (settings.order == purge_order::ATIME) ? age : age * static_cast<double>(msg.size);
+
+    /* Enough to cover a purge from the high to the low watermark, or more
+     * if the pool is already further above the low one, plus a margin for
+     * candidates forgotten or overshooting the high watermark before the 
+     * purge starts */
+    auto capacity = static_cast<double>(settings.capacity);
+    auto used = static_cast<double>(usage.pool_bytes(msg.filesys, msg.ost_pool));
+    auto band = (settings.high - settings.low) * capacity;
+    auto target = static_cast<std::int64_t>(std::max(band, used - settings.low * capacity) + band / 4);
+
+    purge_candidate candidate {
+        .key = usage_store::file_key(msg.filesys, msg.fid, msg.path),
+        .path = msg.path,
+        .size = static_cast<std::int64_t>(msg.size),
+        .score = score
+    };
+
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.candidates.offer(std::move(candidate), target);
+}
+
+
+void watermark_purger::forget(const scan_message &msg) {
+
+    std::string key;
+
+    for(auto rule : _watermark_rules) {
+
+        if(auto *state = _find(rule, msg.filesys, msg.ost_pool)) {
+
+            if(key.empty()) {
+                key = usage_store::file_key(msg.filesys, msg.fid, msg.path);
+            }
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->candidates.erase(key);
+        }
+    }
+}
+
+
+std::vector<watermark_purger::purge> watermark_purger::due(usage_store &usage) {
+
+    std::vector<purge> purges;
+    std::vector<pool_state *> states;
+
+    {
+        std::shared_lock lock(_mutex);
+
+        for(const auto &[key, state] : _pools) {
+            states.push_back(state.get());
+        }
+    }
+
+    for(auto *state : states) {
+
+        const auto &settings = *_settings[state->rule];
+        auto capacity = static_cast<double>(settings.capacity);
+
+        if(usage.pool_bytes(state->filesys, state->pool) <= settings.high * capacity) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+
+        /* Again under the lock, another thread may have just purged */
+        auto used = usage.pool_bytes(state->filesys, state->pool);
+
+        if(used <= settings.high * capacity) {
+            continue;
+        }
+
+        auto needed = static_cast<std::int64_t>(std::ceil(used - settings.low * capacity));
+
+        purge p {
+            .rule = _names[state->rule],
+            .rule_index = state->rule,
+            .filesys = state->filesys,
+            .pool = state->pool,
+            .used = used,
+            .capacity = settings.capacity,
+            .needed = needed,
+            .files = state->candidates.take(needed)
+        };
+
+        /* Nothing to take yet, the next scan records may bring some */
+        if(p.files.empty()) {
+            continue;
+        }
+
+        for(const auto &file : p.files) {
+            usage.remove(file.key);
+        }
+
+        purges.emplace_back(std::move(p));
+    }
+
+    return purges;
+}
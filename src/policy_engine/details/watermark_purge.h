@@ -0,0 +1,176 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "./policy_compiler.h"
+#include "./usage_store.h"
+
+
+/* A file a watermark purge may take */
+struct purge_candidate {
+    std::string key;    /* The file's usage_store key */
+    std::string path;
+    std::int64_t size;
+    double score;
+};
+
+
+/**
+ * @brief The best purge candidates of one pool in bounded memory.
+ *
+ * Ordered by score with an index by key, so a file seen again replaces its
+ * old entry and any candidate can be dropped, which a heap can't do.  Only
+ * the best candidates needed to cover the bytes a purge may have to free are
+ * kept, and never more than the limit, so memory doesn't grow with the
+ * namespace.
+ */
+class purge_candidates {
+
+    private:
+
+        struct better {
+            bool operator()(const purge_candidate &a, const purge_candidate &b) const {
+                return a.score != b.score ? a.score > b.score : a.key < b.key;
+            }
+        };
+
+        struct string_hash : std::hash<std::string_view> {
+            using is_transparent = void;
+        };
+
+        using ordered = std::set<purge_candidate, better>;
+
+        ordered _by_score;
+        std::unordered_map<std::string_view, ordered::iterator, string_hash> _by_key;
+
+        std::int64_t _bytes = 0;
+        std::size_t _limit;
+
+        void _erase(ordered::iterator it);
+
+    public:
+
+        explicit purge_candidates(std::size_t limit) : _limit(limit) {}
+
+        /* Adds or updates a candidate, keeping the best ones adding up to at
+         * least target bytes */
+        void offer(purge_candidate candidate, std::int64_t target);
+
+        void erase(std::string_view key);
+
+        /* Removes and returns the best candidates until they add up to at 
+         * least bytes, or all of them if they don't */
+        std::vector<purge_candidate> take(std::int64_t bytes);
+
+        std::size_t size() const {
+            return _by_score.size();
+        }
+
+        std::int64_t bytes() const {
+            return _bytes;
+        }
+};
+
+
+/**
+ * @brief Candidates and triggering of a policy's watermark purge rules.
+ *
+ * Files decided by a watermark rule are offered to the candidates of their
+ * rule, file system and pool instead of being purged, files decided
+ * otherwise are dropped from them.  due() checks every pool against its
+ * rule's high watermark and takes the candidates needed to bring those
+ * above it to the low watermark, taking them out of the usage store right
+ * away so the next check doesn't purge for the same bytes again.  Safe to
+ * use from several threads.
+ */
+class watermark_purger {
+
+    public:
+
+        /* The files to purge to bring one pool back to its low watermark */
+        struct purge {
+            std::string rule;
+            std::size_t rule_index;
+            std::string filesys;
+            std::string pool;
+            std::int64_t used;
+            std::int64_t capacity;
+            std::int64_t needed;
+            std::vector<purge_candidate> files;
+        };
+
+    private:
+
+        struct pool_state {
+
+            pool_state(std::size_t rule, std::string_view filesys, std::string_view pool,
+                       std::size_t limit) :
+                rule(rule), filesys(filesys), pool(pool), candidates(limit) {}
+
+            const std::size_t rule;
+            const std::string filesys;
+            const std::string pool;
+
+            std::mutex mutex;
+            purge_candidates candidates;
+        };
+
+        /* Indexed by rule, empty for the other rules */
+        std::vector<std::optional<watermark_settings>> _settings;
+        std::vector<std::string> _names;
+        std::vector<std::size_t> _watermark_rules;
+
+        /* Keyed by rule, file system and pool */
+        mutable std::shared_mutex _mutex;
+        std::map<std::string, std::unique_ptr<pool_state>, std::less<>> _pools;
+
+        static void _pool_key(std::string &key, std::size_t rule, 
+                              std::string_view filesys, std::string_view pool);
+
+        pool_state *_find(std::size_t rule, std::string_view filesys, std::string_view pool) const;
+        pool_state &_state(std::size_t rule, std::string_view filesys, std::string_view pool);
+
+    public:
+
+        explicit watermark_purger(const compiled_policy &policy);
+
+        watermark_purger(const watermark_purger &) = delete;
+        watermark_purger &operator=(const watermark_purger &) = delete;
+
+        /* Whether the policy has any watermark rules */
+        bool empty() const {
+            return _watermark_rules.empty();
+        }
+
+        /* A record decided by watermark rule index */
+        void offer(std::size_t rule, const scan_message &msg,
+                   std::chrono::system_clock::time_point now, const usage_store &usage);
+
+        /* A record decided by anything else */
+        void forget(const scan_message &msg);
+
+        std::vector<purge> due(usage_store &usage);
+};
@@ -0,0 +1,54 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#ifndef __POLICY_CONFIG_H__
+#define __POLICY_CONFIG_H__
+
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "details/policy_compiler.h"
+
+
+/**
+ * @brief The rules of a policy of the config file, in order of precedence.
+ *        Keys of a rule besides name, match and action parameterize its
+ *        action, e.g. watermarks.
+ * 
+ * @throws std::runtime_error if there is no such policy.
+ * @throws std::out_of_range if a rule is missing its name, match or action.
+ */
+std::vector<policy_rule_spec> get_policy_rules_by_name(const auto &config, std::string_view name) {
+
+    std::vector<policy_rule_spec> policy_rules;
+
+    for(auto rule : config.get_policy_rules_by_name(name)) {
+
+        policy_rule_spec spec { .name = rule.at("name"), 
+                                .match = rule.at("match"), 
+                                .action = rule.at("action") };
+
+        for(const auto *key : { "name", "match", "action" }) {
+            rule.erase(key);
+        }
+
+        spec.parameters = std::move(rule);
+        policy_rules.emplace_back(std::move(spec));
+    }
+
+    return policy_rules;
+}
+
+
+#endif // __POLICY_CONFIG_H__
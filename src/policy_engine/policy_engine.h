@@ -11,8 +11,76 @@
 #ifndef __POLICY_ENGINE_H__
 #define __POLICY_ENGINE_H__
 
+#include <chrono>
+#include <cstddef>
+#include <string>
+
 #include "../agents/agents.h"
 #include "../messaging/messaging.h"
+#include "details/policy_compiler.h"
+
+/* Tuning of the policy engine's pipeline */
+struct policy_engine_options {
+
+    /* Most scan records fetched and evaluated together */
+    std::size_t batch_size = 256;
+
+    /* Threads evaluating the rules, 0 for one per core */
+    std::size_t evaluator_threads = 0;
+
+    /* Batches fetched but not yet acknowledged, 0 for two per evaluator
+     * thread */
+    std::size_t max_inflight_batches = 0;
+
+    /* Purge or migration actions waiting to be published */
+    std::size_t action_queue_size = 4096;
+
+    /* Keep per owner, group and pool totals for the usage fields of the
+     * rules, costs memory for every file scanned */
+    bool track_usage = false;
+
+    /* Files whose purge or migration was sent are remembered so they are
+     * not sent again while unchanged, 0 to send every decision */
+    std::size_t decision_cache_size = 1 << 20;
+
+    /* How long a sent decision suppresses the same one, so one whose 
+     * action never completed is sent again */
+    std::chrono::seconds decision_cache_ttl = std::chrono::hours(24);
+
+    /* Where the free space of the target pools of migrate rules is read
+     * from, a command run with {pool} replaced by each pool or "file:" and
+     * a path to read lfs df output from */
+    std::string pool_usage_source = "/usr/bin/lfs df --pool {pool}";
+
+    /* How often the free space of the target pools is read again */
+    std::chrono::seconds pool_refresh_interval{60};
+
+    /* How long decisions are gathered before they are sorted by directory
+     * and published, 0 to publish what is queued right away */
+    std::chrono::milliseconds action_window{1000};
+
+    /* Most files sent in one purge or migration message, 1 for a message
+     * per file as agents before batching expect */
+    std::size_t action_batch_size = 64;
+
+    /* File the engine's state is snapshotted to and restored from at
+     * start, empty to start from nothing every time */
+    std::string snapshot_path = {};
+
+    /* How often the state is snapshotted, the engine pauses fetching
+     * while the batches in flight finish to take a consistent one */
+    std::chrono::seconds snapshot_interval{300};
+
+    /* How often the namespace statistics, atime and size percentiles of
+     * each OST pool, top owners and distinct directories, are logged and
+     * the rank fields refreshed from them, 0 not to keep them */
+    std::chrono::seconds namespace_stats_interval{0};
+
+    /* Span of the scan stream the statistics cover, about a scan cycle so
+     * each file counts once */
+    std::chrono::seconds namespace_stats_window = std::chrono::hours(24);
+};
+
 
 class policy_engine : public agent {
     public:
@@ -22,12 +90,18 @@ class policy_engine : public agent {
         policy_engine &operator=(policy_engine &&) = default;
         policy_engine &operator=(const policy_engine &) = default;
         virtual ~policy_engine() = default;
+
+        /* Switches to a new policy without stopping, batches already being
+         * evaluated finish with the old one.  Thread safe. */
+        virtual void set_policy(const compiled_policy &policy) = 0;
 };
 
 policy_engine *create_policy_engine(const message_queue_subscriber &scan_mq_sub, 
                                     const message_queue_publisher &removal_mq_pub,
                                     const message_queue_publisher &migration_mq_pub,
-                                    const message_queue_publisher &recorder_mq_pub);
+                                    const compiled_policy &policy = 
+                                        compile_policy(default_policy_rules()),
+                                    const policy_engine_options &options = {});
 
 
 
@@ -8,12 +8,18 @@
  * This file is part of the PoliMOR project.
  ****************************************************************************/
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <initializer_list>
 #include <string_view>
 #include <iostream>
 #include <numeric>
 #include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <utility>
 
 #include <boost/program_options.hpp>
 
@@ -21,8 +27,10 @@
 #include <tuple>
 
 #include "../common/config_parser.h"
+#include "../common/file_watcher.h"
 #include "../messaging/messaging.h"
 #include "../messaging/details/jetstream_messaging_impl.h"
+#include "policy_config.h"
 #include "policy_engine.h"
 
 
@@ -38,20 +46,28 @@
 // constexpr std::string_view migration_consumer = "migration-files-consumer";
 // constexpr std::string_view migration_subject = "migration.files.request";
 
-// constexpr std::string_view recorder_stream = "recorder";
-// constexpr std::string_view recorder_consumer = "recorder-files-consumer";
-// constexpr std::string_view recorder_subject = "recorder.files";
-
 
 
 struct args {
     std::string id;
     std::string nats_url;
 
+    /* Watched for policy changes if given */
+    std::string config_file;
+
     std::string scan_stream   = "scan";
     std::string scan_consumer = "scan-files-consumer";
     std::string scan_subject  = "scan.files.results";
 
+    /* Optional partitioning of the scan subject, scan_partition_range is the
+     * inclusive range "first-last" of partitions this engine consumes */
+    std::string scan_partitions;
+    std::string scan_partition_range;
+    std::string scan_partition_by = "fid";
+
+    /* How scan records that fail evaluation are retried and dead lettered */
+    retry_policy scan_retry_policy;
+
     std::string purge_stream = "purge";
     std::string purge_consumer = "purge-files-consumer";
     std::string purge_subject = "purge.files.request";
@@ -60,12 +76,100 @@ struct args {
     std::string migration_consumer = "migration-files-consumer";
     std::string migration_subject = "migration.files.request";
 
-    std::string recorder_stream = "recorder";
-    std::string recorder_consumer = "recorder-files-consumer";
-    std::string recorder_subject = "recorder.files";
+    /* Optional disk spools for the action publishers, empty means none */
+    std::string purge_spool_directory;
+    std::size_t purge_spool_segment_size = 64 * 1024 * 1024;
+    std::string migration_spool_directory;
+    std::size_t migration_spool_segment_size = 64 * 1024 * 1024;
+
+    /* Send urgent actions on the high priority lanes of the action queues,
+     * set when the queue has priority_weights */
+    bool purge_priority_lanes = false;
+    bool migration_priority_lanes = false;
+
+    /* Rules of the policy named by the agent's policy property */
+    std::vector<policy_rule_spec> policy_rules = default_policy_rules();
+
+    /* Sizes of the evaluation pipeline */
+    policy_engine_options engine_options;
 };
 
 
+/* Reads the optional spool properties of a queue */
+static std::pair<std::string, std::size_t> 
+parse_spool_properties(const std::map<std::string, std::string> &queue_properties) {
+
+    std::pair<std::string, std::size_t> spool = { "", 64 * 1024 * 1024 };
+
+    if(queue_properties.contains("spool_directory")) {
+        spool.first = queue_properties.at("spool_directory");
+    }
+
+    if(queue_properties.contains("spool_segment_size")) {
+        spool.second = std::stoull(queue_properties.at("spool_segment_size"));
+    }
+
+    return spool;
+}
+
+
+/* The rules of the policy named by the agent's policy property, the default
+ * rules if it has none */
+static std::vector<policy_rule_spec> 
+get_policy_rules(const auto &config, const std::map<std::string, std::string> &properties) {
+
+    if(not properties.contains("policy")) {
+        return default_policy_rules();
+    }
+
+    return get_policy_rules_by_name(config, properties.at("policy"));
+}
+
+
+/**
+ * @brief Checks that each engine sees every record below the directories of
+ *        the policy's directory rules, the agents act on the whole tree of a
+ *        decided directory.  Partitioning the scan subject by parent 
+ *        directory keeps a directory's own entries together, so only rules
+ *        deciding each file's parent can be used with it, and partitioning
+ *        by FID can't be used with any.
+ *
+ * @throws std::invalid_argument if the partitioning splits a directory.
+ */
+static void check_directory_rules(const compiled_policy &policy, const struct args &args) {
+
+    if(args.scan_partitions.empty()) {
+        return;
+    }
+
+    bool by_parent = parse_partition_by(args.scan_partition_by) == partition_by::PARENT_DIRECTORY;
+
+    for(const auto &rule : policy.rules()) {
+        if(rule.directory and (not by_parent or rule.directory->depth != 0)) {
+            throw std::invalid_argument("Directory rule " + rule.name + " needs the scan queue to be "
+                                        "partitioned by parent with directory: parent, or unpartitioned");
+        }
+    }
+}
+
+
+/**
+ * @brief Reads and compiles the agent's policy again, for reloading it.
+ * 
+ * @throws std::exception if the config file or the policy is invalid.
+ */
+static compiled_policy reload_policy(std::string_view config_file, std::string_view agent_id) {
+
+    using qs::common::parse_config; 
+    using qs::common::ConfigType;
+
+    auto config = parse_config<ConfigType::YAML>(config_file);
+    auto properties = config.get_agent_properties_by_id(agent_id);
+
+    return compile_policy(get_policy_rules(config, properties));
+}
+
+
 /**
  * @brief Parse the config file and create the args object based
  *        on the config file.
@@ -153,19 +257,85 @@ static struct args parse_config_file(std::string_view config_file,
                                                         *nats_servers.begin(), 
                                                         [](const std::string &a, const std::string &b) { 
                                                         return a + "," + b; });
+        /* Partitioning of the scan subject is optional, the engine consumes
+         * all partitions unless a range is given in its properties */
+        std::string scan_partitions;
+        std::string scan_partition_range;
+
+        if(scan_queue_properties.contains("partitions")) {
+            scan_partitions = scan_queue_properties.at("partitions");
+            scan_partition_range = properties.contains("partitions") ?
+                properties.at("partitions") : 
+                full_partition_range(scan_partitions);
+        }
+
+        auto [purge_spool_directory, purge_spool_segment_size] = 
+            parse_spool_properties(purge_queue_properties);
+
+        auto [migration_spool_directory, migration_spool_segment_size] = 
+            parse_spool_properties(migration_queue_properties);
+
+        /* The policy is optional, without one the default rules are used */
+        auto policy_rules = get_policy_rules(config, properties);
+
         /* Return the args */
         return {
             .id = std::move(properties.at("id")),
             .nats_url = std::move(nats_url),
+            .config_file = std::string(config_file),
             .scan_stream = std::move(scan_queue_properties.at("stream_name")),
             .scan_consumer = std::move(scan_queue_properties.at("consumer_name")),
             .scan_subject = std::move(scan_queue_properties.at("subject")),
+            .scan_partitions = std::move(scan_partitions),
+            .scan_partition_range = std::move(scan_partition_range),
+            .scan_partition_by = scan_queue_properties.contains("partition_by") ?
+                scan_queue_properties.at("partition_by") : "fid",
+            .scan_retry_policy = make_retry_policy(scan_queue_properties),
             .purge_stream = std::move(purge_queue_properties.at("stream_name")),
             .purge_consumer = std::move(purge_queue_properties.at("consumer_name")),
             .purge_subject = std::move(purge_queue_properties.at("subject")),
             .migration_stream = std::move(migration_queue_properties.at("stream_name")),
             .migration_consumer = std::move(migration_queue_properties.at("consumer_name")),
-            .migration_subject = std::move(migration_queue_properties.at("subject"))
+            .migration_subject = std::move(migration_queue_properties.at("subject")),
+            .purge_spool_directory = std::move(purge_spool_directory),
+            .purge_spool_segment_size = purge_spool_segment_size,
+            .migration_spool_directory = std::move(migration_spool_directory),
+            .migration_spool_segment_size = migration_spool_segment_size,
+            .purge_priority_lanes = purge_queue_properties.contains("priority_weights"),
+            .migration_priority_lanes = migration_queue_properties.contains("priority_weights"),
+            .policy_rules = std::move(policy_rules),
+            .engine_options = {
+                .batch_size = properties.contains("batch_size") ? 
+                    std::stoul(properties.at("batch_size")) : 256,
+                .evaluator_threads = properties.contains("evaluator_threads") ?
+                    std::stoul(properties.at("evaluator_threads")) : 0,
+                .max_inflight_batches = properties.contains("max_inflight_batches") ?
+                    std::stoul(properties.at("max_inflight_batches")) : 0,
+                .action_queue_size = properties.contains("action_queue_size") ?
+                    std::stoul(properties.at("action_queue_size")) : 4096,
+                .track_usage = properties.contains("track_usage") and
+                    properties.at("track_usage") == "true",
+                .decision_cache_size = properties.contains("decision_cache_size") ?
+                    std::stoul(properties.at("decision_cache_size")) : 1 << 20,
+                .decision_cache_ttl = std::chrono::seconds(properties.contains("decision_cache_ttl_s") ?
+                    std::stoul(properties.at("decision_cache_ttl_s")) : 24 * 60 * 60),
+                .pool_usage_source = properties.contains("pool_usage_source") ?
+                    properties.at("pool_usage_source") : "/usr/bin/lfs df --pool {pool}",
+                .pool_refresh_interval = std::chrono::seconds(properties.contains("pool_refresh_interval_s") ?
+                    std::stoul(properties.at("pool_refresh_interval_s")) : 60),
+                .action_window = std::chrono::milliseconds(properties.contains("action_window_ms") ?
+                    std::stoul(properties.at("action_window_ms")) : 1000),
+                .action_batch_size = properties.contains("action_batch_size") ?
+                    std::stoul(properties.at("action_batch_size")) : 64,
+                .snapshot_path = properties.contains("snapshot_path") ?
+                    properties.at("snapshot_path") : "",
+                .snapshot_interval = std::chrono::seconds(properties.contains("snapshot_interval_s") ?
+                    std::stoul(properties.at("snapshot_interval_s")) : 300),
+                .namespace_stats_interval = std::chrono::seconds(properties.contains("namespace_stats_interval_s") ?
+                    std::stoul(properties.at("namespace_stats_interval_s")) : 0),
+                .namespace_stats_window = std::chrono::seconds(properties.contains("namespace_stats_window_s") ?
+                    std::stoul(properties.at("namespace_stats_window_s")) : 24 * 60 * 60)
+            }
         };
 
     } catch(const std::out_of_range &e) {
@@ -201,12 +371,19 @@ static struct args parse_commandline(int argc, char *argv[]) {
         ("scan_stream", po::value<std::string>(), "Nats name of the scan stream")
         ("scan_consumer", po::value<std::string>(), "Nats name of the scan consumer")
         ("scan_subject", po::value<std::string>(), "Nats scan subject")
+        ("scan_partitions", po::value<std::string>(), "Number of partitions of the scan subject")
+        ("scan_partition_range", po::value<std::string>(), "Inclusive range of scan partitions to consume, e.g. 0-3")
+        ("scan_partition_by", po::value<std::string>(), "What the scan partitions are hashed on, fid or parent")
         ("purge_stream", po::value<std::string>(), "Nats name of the purge stream")
         ("purge_consumer", po::value<std::string>(), "Nats name of the purge consumer")
         ("purge_subject", po::value<std::string>(), "Nats purge subject")
         ("migration_stream", po::value<std::string>(), "Nats name of the migration stream")
         ("migration_consumer", po::value<std::string>(), "Nats name of the migration consumer")
-        ("migration_subject", po::value<std::string>(), "Nats migration subject");
+        ("migration_subject", po::value<std::string>(), "Nats migration subject")
+        ("batch_size", po::value<std::size_t>(), "Most scan records to fetch and evaluate together")
+        ("evaluator_threads", po::value<std::size_t>(), "Threads evaluating the rules, 0 for one per core")
+        ("max_inflight_batches", po::value<std::size_t>(), "Most batches fetched but not yet acknowledged, 0 for two per evaluator thread")
+        ("decision_cache_size", po::value<std::size_t>(), "Files whose sent action is remembered to avoid sending it again, 0 to disable");
 
     /* Progress the command line */
     po::variables_map vm;
@@ -280,6 +457,51 @@ static struct args parse_commandline(int argc, char *argv[]) {
         }
     }
 
+    if(vm.count("batch_size") == 1) {
+        args.engine_options.batch_size = vm["batch_size"].as<std::size_t>();
+    }
+
+    if(vm.count("evaluator_threads") == 1) {
+        args.engine_options.evaluator_threads = vm["evaluator_threads"].as<std::size_t>();
+    }
+
+    if(vm.count("max_inflight_batches") == 1) {
+        args.engine_options.max_inflight_batches = vm["max_inflight_batches"].as<std::size_t>();
+    }
+
+    if(vm.count("decision_cache_size") == 1) {
+        args.engine_options.decision_cache_size = vm["decision_cache_size"].as<std::size_t>();
+    }
+
+    /* Partitioning is optional so these may be empty */
+    if(vm.count("scan_partitions") == 1) {
+        args.scan_partitions = vm["scan_partitions"].as<std::string>();
+    }
+
+    if(vm.count("scan_partition_by") == 1) {
+        args.scan_partition_by = vm["scan_partition_by"].as<std::string>();
+    }
+
+    if(vm.count("scan_partition_range") == 1) {
+        args.scan_partition_range = vm["scan_partition_range"].as<std::string>();
+    }
+
+    /* Every partition unless a range is given */
+    if(not args.scan_partitions.empty()) {
+
+        try {
+            parse_partitions(args.scan_partitions);
+
+            if(args.scan_partition_range.empty()) {
+                args.scan_partition_range = full_partition_range(args.scan_partitions);
+            }
+
+        } catch(const std::invalid_argument &e) {
+            std::cerr << e.what() << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
     /* Return an arg struct of the arguments to the process */
     return std::move(args);
 }
@@ -297,26 +519,75 @@ int main(int argc, char* argv[]) {
     std::clog << "scan_stream: " << args.scan_stream << std::endl;
     std::clog << "scan_consumer: " << args.scan_consumer << std::endl;
     std::clog << "scan_subject: " << args.scan_subject << std::endl;
+    std::clog << "scan_partitions: " << args.scan_partitions << std::endl;
+    std::clog << "scan_partition_range: " << args.scan_partition_range << std::endl;
+    std::clog << "scan_partition_by: " << args.scan_partition_by << std::endl;
     std::clog << "purge_stream: " << args.purge_stream << std::endl;
     std::clog << "purge_consumer: " << args.purge_consumer << std::endl;
     std::clog << "purge_subject: " << args.purge_subject << std::endl;
     std::clog << "migration_stream: " << args.migration_stream << std::endl;
     std::clog << "migration_consumer: " << args.migration_consumer << std::endl;
     std::clog << "migration_subject: " << args.migration_subject << std::endl;
-    std::clog << "recorder_stream: " << args.recorder_stream << std::endl;
-    std::clog << "recorder_consumer: " << args.recorder_consumer << std::endl;
-    std::clog << "recorder_subject: " << args.recorder_subject << std::endl;
+    std::clog << "batch_size: " << args.engine_options.batch_size << std::endl;
+    std::clog << "evaluator_threads: " << args.engine_options.evaluator_threads << std::endl;
+    std::clog << "max_inflight_batches: " << args.engine_options.max_inflight_batches << std::endl;
+    std::clog << "decision_cache_size: " << args.engine_options.decision_cache_size << std::endl;
+    std::clog << "decision_cache_ttl: " << args.engine_options.decision_cache_ttl.count() << "s" << std::endl;
+    std::clog << "pool_usage_source: " << args.engine_options.pool_usage_source << std::endl;
+    std::clog << "pool_refresh_interval: " << args.engine_options.pool_refresh_interval.count() << "s" << std::endl;
+    std::clog << "action_window: " << args.engine_options.action_window.count() << "ms" << std::endl;
+    std::clog << "action_batch_size: " << args.engine_options.action_batch_size << std::endl;
+    std::clog << "snapshot_path: " << args.engine_options.snapshot_path << std::endl;
+    std::clog << "snapshot_interval: " << args.engine_options.snapshot_interval.count() << "s" << std::endl;
+    std::clog << "namespace_stats_window: " << args.engine_options.namespace_stats_window.count() << "s" << std::endl;
+
+    /* Compile the rules up front so a bad policy fails at start up */
+    compiled_policy policy;
+
+    try {
+        policy = compile_policy(args.policy_rules);
+        check_directory_rules(policy, args);
+
+    } catch(const std::invalid_argument &e) {
+        std::cerr << "Invalid policy: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::clog << "policy:\n" << policy;
+
+    /* Usage is always tracked for a policy that needs it */
+    args.engine_options.track_usage = args.engine_options.track_usage or policy.uses_usage();
+
+    std::clog << "track_usage: " << std::boolalpha << args.engine_options.track_usage << std::endl;
+
+    /* As are the namespace statistics for a policy ranking records */
+    if(policy.uses_ranks() and args.engine_options.namespace_stats_interval.count() == 0) {
+        args.engine_options.namespace_stats_interval = std::chrono::seconds(300);
+    }
+
+    std::clog << "namespace_stats_interval: " 
+              << args.engine_options.namespace_stats_interval.count() << "s" << std::endl;
 
     std::clog << "Starting policy agent..." << std::endl;
     
     MsgService auto ms = create_messaging_service<messaging_services::JETSTREAM>(
         std::string_view(args.nats_url));
 
-    MsgSubscriber auto scan_mq_sub = 
+    /* Bind to the assigned partitions of the scan subject if it is 
+     * partitioned */
+    MsgSubscriber auto scan_mq_sub = args.scan_partitions.empty() ?
+        ms.create_queue_subscriber(
+            std::string_view(args.scan_stream), 
+            std::string_view(args.scan_consumer), 
+            std::string_view(args.scan_subject)) :
         ms.create_queue_subscriber(
             std::string_view(args.scan_stream), 
             std::string_view(args.scan_consumer), 
-            std::string_view(args.scan_subject));
+            std::string_view(args.scan_subject),
+            std::string_view(args.scan_partitions),
+            std::string_view(args.scan_partition_range));
+
+    scan_mq_sub.set_retry_policy(args.scan_retry_policy);
     MsgPublisher auto removal_mq_pub = 
         ms.create_queue_publisher(
             std::string_view(args.purge_stream), 
@@ -328,18 +599,55 @@ int main(int argc, char* argv[]) {
             std::string_view(args.migration_stream), 
             std::string_view(args.migration_consumer), 
             std::string_view(args.migration_subject));
-    
-    MsgPublisher auto recorder_mq_pub = 
-        ms.create_queue_publisher(
-            std::string_view(args.recorder_stream), 
-            std::string_view(args.recorder_consumer), 
-            std::string_view(args.recorder_subject));
+
+    /* Spool per agent so agents sharing a host don't share a spool */
+    if(not args.purge_spool_directory.empty()) {
+        removal_mq_pub.enable_spool(
+            (std::filesystem::path(args.purge_spool_directory) / args.id / args.purge_stream).string(),
+            args.purge_spool_segment_size);
+    }
+
+    if(not args.migration_spool_directory.empty()) {
+        migration_mq_pub.enable_spool(
+            (std::filesystem::path(args.migration_spool_directory) / args.id / args.migration_stream).string(),
+            args.migration_spool_segment_size);
+    }
+
+    if(args.purge_priority_lanes) {
+        removal_mq_pub.enable_priority_lanes();
+    }
+
+    if(args.migration_priority_lanes) {
+        migration_mq_pub.enable_priority_lanes();
+    }
 
     policy_engine *policy_engine = create_policy_engine(scan_mq_sub, 
                                                         removal_mq_pub, 
                                                         migration_mq_pub, 
-                                                        recorder_mq_pub);
+                                                        policy,
+                                                        args.engine_options);
+
 
+    /* Pick up policy changes without a restart, a policy that doesn't 
+     * compile is logged and the current one kept */
+    std::unique_ptr<file_watcher> policy_watcher;
+
+    if(not args.config_file.empty()) {
+
+        policy_watcher = std::make_unique<file_watcher>(args.config_file, [&args, policy_engine] {
+
+            try {
+                auto policy = reload_policy(args.config_file, args.id);
+                check_directory_rules(policy, args);
+
+                std::clog << "policy:\n" << policy;
+                policy_engine->set_policy(policy);
+
+            } catch(const std::exception &e) {
+                std::cerr << "Keeping the current policy, reloading failed: " << e.what() << std::endl;
+            }
+        });
+    }
 
     policy_engine->run();
 
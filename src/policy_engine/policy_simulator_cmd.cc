@@ -0,0 +1,260 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "../common/config_parser.h"
+#include "../messaging/details/messages.h"
+#include "../messaging/details/serializers.h"
+#include "../messaging/details/message_json_deserializer_boost_impl.h"
+#include "details/policy_simulator.h"
+#include "policy_config.h"
+
+
+/* 
+ * Replays captured scan records through a policy and reports what it would
+ * have done, without connecting to NATS or publishing anything.  The input
+ * is one JSON scan record per line as published on the scan subject, e.g.
+ * the output of a scan agent's find command or a dump of the scan stream.
+ */
+
+
+struct args {
+    std::string config_file;
+
+    /* The policy is named directly or is that of a policy agent */
+    std::string policy;
+    std::string id;
+
+    /* "-" for stdin */
+    std::vector<std::string> inputs = { "-" };
+
+    /* Every file a rule decided, optional */
+    std::string matches_file;
+
+    simulation_options options;
+};
+
+
+static struct args parse_commandline(int argc, char *argv[]) {
+
+    namespace po = boost::program_options;
+
+    struct args args;
+
+    po::options_description desc("Options");
+    desc.add_options()
+        ("help,h", "This help message")
+        ("config", po::value<std::string>(), "Configuration file")
+        ("policy", po::value<std::string>(), "Name of the policy to simulate")
+        ("id", po::value<std::string>(), "Id of the policy agent whose policy to simulate")
+        ("input", po::value<std::vector<std::string>>(), "File of scan records, one JSON record per line, - for stdin (may be repeated)")
+        ("matches", po::value<std::string>(), "File to write the rule, action, size and path of every decided file to")
+        ("batch_size", po::value<std::size_t>(), "Records evaluated together")
+        ("now", po::value<std::int64_t>(), "Seconds since the epoch to take ages from, defaults to the current time")
+        ("track_usage", "Keep usage totals even if the policy doesn't need them")
+        ("namespace_stats", "Report namespace statistics even if the policy doesn't rank records");
+
+    po::positional_options_description positional;
+    positional.add("input", -1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+    po::notify(vm);
+
+    if(vm.count("help")) {
+        std::cerr << desc << std::endl;
+        exit(EXIT_SUCCESS);
+    }
+
+    if(vm.count("config") < 1) {
+        std::cerr << "Error, a config file must be provided." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    args.config_file = vm["config"].as<std::string>();
+
+    if(vm.count("policy") + vm.count("id") != 1) {
+        std::cerr << "Error, one of policy or id must be provided." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if(vm.count("policy") == 1) {
+        args.policy = vm["policy"].as<std::string>();
+    } else {
+        args.id = vm["id"].as<std::string>();
+    }
+
+    if(vm.count("input") > 0) {
+        args.inputs = vm["input"].as<std::vector<std::string>>();
+    }
+
+    if(vm.count("matches") == 1) {
+        args.matches_file = vm["matches"].as<std::string>();
+    }
+
+    if(vm.count("batch_size") == 1) {
+        args.options.batch_size = vm["batch_size"].as<std::size_t>();
+    }
+
+    if(vm.count("now") == 1) {
+        args.options.now = std::chrono::system_clock::time_point(
+            std::chrono::seconds(vm["now"].as<std::int64_t>()));
+    }
+
+    args.options.track_usage = vm.count("track_usage") > 0;
+    args.options.namespace_stats = vm.count("namespace_stats") > 0;
+
+    return args;
+}
+
+
+/* The rules of the named policy or of the agent's policy property, the 
+ * default rules if the agent has none */
+static std::vector<policy_rule_spec> load_policy_rules(const struct args &args) {
+
+    using qs::common::parse_config; 
+    using qs::common::ConfigType;
+
+    auto config = parse_config<ConfigType::YAML>(args.config_file);
+
+    if(not args.policy.empty()) {
+        return get_policy_rules_by_name(config, args.policy);
+    }
+
+    auto properties = config.get_agent_properties_by_id(args.id);
+
+    if(not properties.contains("policy")) {
+        return default_policy_rules();
+    }
+
+    return get_policy_rules_by_name(config, properties.at("policy"));
+}
+
+
+int main(int argc, char *argv[]) {
+
+    auto args = parse_commandline(argc, argv);
+
+    compiled_policy policy;
+
+    try {
+        policy = compile_policy(load_policy_rules(args));
+
+    } catch(const std::exception &e) {
+        std::cerr << "Invalid policy: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::clog << "policy:\n" << policy;
+
+    std::ofstream matches;
+
+    if(not args.matches_file.empty()) {
+
+        matches.open(args.matches_file);
+
+        if(not matches) {
+            std::cerr << "Unable to open " << args.matches_file << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    policy_simulator::match_callback on_match;
+
+    if(matches.is_open()) {
+        on_match = [&matches](const compiled_policy::rule &rule, std::string_view path, std::int64_t size) {
+            matches << rule.name << '\t' << policy_action_name(rule.action) << '\t' 
+                    << size << '\t' << path << '\n';
+        };
+    }
+
+    policy_simulator simulator(policy, args.options, std::move(on_match));
+
+    json_deserializer_impl<scan_message> deserializer;
+
+    std::vector<scan_message> batch;
+    batch.reserve(args.options.batch_size);
+
+    std::uint64_t invalid = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for(const auto &input : args.inputs) {
+
+        std::ifstream file;
+
+        if(input != "-") {
+
+            file.open(input);
+
+            if(not file) {
+                std::cerr << "Unable to open " << input << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        std::istream &in = (input == "-") ? std::cin : file;
+
+        for(std::string line; std::getline(in, line);) {
+
+            if(line.empty()) {
+                continue;
+            }
+
+            try {
+                batch.emplace_back(deserializer(line));
+
+            } catch(const std::exception &e) {
+
+                /* Only the first few, a bad capture could have millions */
+                if(invalid++ < 10) {
+                    std::cerr << "Skipping invalid scan record: " << line << ": " 
+                              << e.what() << std::endl;
+                }
+
+                continue;
+            }
+
+            if(batch.size() == args.options.batch_size) {
+                simulator.evaluate(batch);
+                batch.clear();
+            }
+        }
+    }
+
+    simulator.evaluate(batch);
+    simulator.finish();
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    std::cout << simulator.report();
+    std::cout << "evaluation order:\n" << simulator.evaluation_order();
+
+    if(const auto *stats = simulator.namespace_stats(); stats != nullptr) {
+        std::cout << "namespace:\n" << *stats;
+    }
+
+    if(invalid > 0) {
+        std::cout << invalid << " invalid records skipped\n";
+    }
+
+    std::cout << "replayed in " << elapsed.count() << "s including reading the records" << std::endl;
+
+    return EXIT_SUCCESS;
+}
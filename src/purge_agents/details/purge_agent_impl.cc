@@ -9,6 +9,9 @@
  ****************************************************************************/
 
 
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
 #include <string_view>
 #include <thread>
 
@@ -33,39 +36,63 @@ void purge_agent_impl::run() {
     while(_stop == false) {
 
         try {
-            auto msg = _mq_sub.receive<purge_message>();
-
-        
-            std::clog << "Purge agent(" << std::this_thread::get_id() <<"): " 
-                        << "Received message" << std::endl;
-        
-            std::clog << "Purge agent(" << std::this_thread::get_id() <<"): "
-                        << "Asked to remove " << msg.path << std::endl;
+            /* The message is only acknowledged if the removal succeeds, 
+             * otherwise it is retried and eventually dead lettered */
+            _mq_sub.process<purge_message>([&process_args](const purge_message &msg) {
 
+                std::clog << "Purge agent(" << std::this_thread::get_id() <<"): " 
+                            << "Received message" << std::endl;
             
-            /* Build a reference array for passing temp args */
-            /* TODO look at boost::static_vector for stack storage array */
-            std::vector<std::reference_wrapper<const std::string>> args{process_args.begin(), process_args.end()}; 
-            args.emplace_back(msg.path);
+                std::clog << "Purge agent(" << std::this_thread::get_id() <<"): "
+                            << "Asked to remove " << msg.path;
+
+                if(not msg.paths.empty()) {
+                    std::clog << " and " << msg.paths.size() << " more";
+                }
+
+                std::clog << std::endl;
+
                 
-            process removal_process(args);
-            
+                /* Build a reference array for passing temp args */
+                /* TODO look at boost::static_vector for stack storage array */
+                std::vector<std::reference_wrapper<const std::string>> args{process_args.begin(), process_args.end()}; 
+
+                /* Directory rules decide whole directories, -r doesn't 
+                 * change how rm removes the files of a batch with them */
+                static const std::string recursive = "-r";
+
+                auto is_directory = [](const std::string &path) {
+                    return std::filesystem::is_directory(std::filesystem::symlink_status(path));
+                };
+
+                if(is_directory(msg.path) or std::ranges::any_of(msg.paths, is_directory)) {
+                    args.emplace_back(recursive);
+                }
+
+                /* A batch of paths is removed by one rm */
+                args.emplace_back(msg.path);
+                args.insert(args.end(), msg.paths.begin(), msg.paths.end());
+                    
+                process removal_process(args);
+                
+                
+                std::basic_filebuf<char> filebuf = removal_process.launch();
             
-            std::basic_filebuf<char> filebuf = removal_process.launch();
-        
 
-            /* Read line by line until there is no more data */
-            for(std::string buffer; std::getline(std::istream(&filebuf), buffer);) {
-                std::clog << "output: " << buffer << std::endl;
-            }
+                /* Read line by line until there is no more data */
+                for(std::string buffer; std::getline(std::istream(&filebuf), buffer);) {
+                    std::clog << "output: " << buffer << std::endl;
+                }
 
-            removal_process.wait();
+                if(int rc = removal_process.wait(); rc != 0) {
+                    throw std::runtime_error("Removal of " + msg.path + 
+                                             " exited with " + std::to_string(rc));
+                }
+            });
 
-        /* TODO need a special deserialization message and to handle
-            * other error exceptions */
         } catch (const std::exception &e) {
             std::clog << "Purge agent(" << std::this_thread::get_id() << "): "
-                        << "Error receiving msg: " << e.what();
+                        << "Error receiving msg: " << e.what() << std::endl;
         }                
     }
 }
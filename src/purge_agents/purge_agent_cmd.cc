@@ -11,6 +11,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <numeric>
+#include <optional>
 
 #include <boost/program_options.hpp>
 
@@ -31,6 +32,13 @@ struct args {
     std::string purge_consumer;
     std::string purge_subject;
     bool dry_run;
+
+    /* How failed purge requests are retried and dead lettered */
+    retry_policy purge_retry_policy;
+
+    /* Weights of the high, normal and low priority lanes, none when the
+     * queue has no lanes */
+    std::optional<priority_weights> purge_priority_weights;
 };
 
 
@@ -94,7 +102,11 @@ static struct args parse_config_file(std::string_view config_file,
             .nats_url       = std::move(nats_url),
             .purge_stream   = std::move(queue_properties.at("stream_name")),
             .purge_consumer = std::move(queue_properties.at("consumer_name")),
-            .purge_subject  = std::move(queue_properties.at("subject"))
+            .purge_subject  = std::move(queue_properties.at("subject")),
+            .purge_retry_policy = make_retry_policy(queue_properties),
+            .purge_priority_weights = queue_properties.contains("priority_weights") ?
+                std::optional(parse_priority_weights(queue_properties.at("priority_weights"))) :
+                std::nullopt
         };
 
     } catch(const std::out_of_range &e) {
@@ -242,6 +254,12 @@ int main(int argc, char *argv[]) {
             std::string_view(args.purge_consumer), 
             std::string_view(args.purge_subject));
 
+    mq_sub.set_retry_policy(args.purge_retry_policy);
+
+    if(args.purge_priority_weights) {
+        mq_sub.enable_priority_lanes(*args.purge_priority_weights);
+    }
+
     purge_agent agent = create_purge_agent(mq_sub, args.dry_run);
 
     agent.run();
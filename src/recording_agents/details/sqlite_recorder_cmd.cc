@@ -32,6 +32,13 @@ std::string_view insert_into_sql =
         path, type, atime, mtime, size, uid, gid, filesys, ost_pool, stripe_count, fid, timestamp) \
     VALUES(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, CURRENT_TIMESTAMP)";
 
+/* Deleted files are only known by their file system and FID */
+std::string_view create_fid_index_sql = 
+    "CREATE INDEX IF NOT EXISTS Records_fid ON Records(fid, filesys)";
+
+std::string_view delete_from_sql = 
+    "DELETE FROM Records WHERE fid = ?1 AND filesys = ?2";
+
 
 
 struct args {
@@ -112,6 +119,7 @@ int main(int argc, char *argv[]) {
 
     sqlite3 *db = nullptr;
     sqlite3_stmt *ppStmt = nullptr;
+    sqlite3_stmt *deleteStmt = nullptr;
 
     int rc = sqlite3_open(args.db_name.c_str(), &db);
     
@@ -130,6 +138,14 @@ int main(int argc, char *argv[]) {
     }
 
 
+    rc = sqlite3_exec(db, create_fid_index_sql.data(), nullptr, nullptr, &err_msg);
+
+    if (rc != SQLITE_OK) {
+        std::cerr << "Can not create index: " << err_msg << std::endl;
+        sqlite3_free(err_msg); 
+    }
+
+
     rc = sqlite3_prepare_v3(db, insert_into_sql.data(), -1, SQLITE_PREPARE_PERSISTENT, &ppStmt, nullptr);
   
     if (rc != SQLITE_OK) {
@@ -137,11 +153,35 @@ int main(int argc, char *argv[]) {
         sqlite3_close(db);
     }
 
+    rc = sqlite3_prepare_v3(db, delete_from_sql.data(), -1, SQLITE_PREPARE_PERSISTENT, &deleteStmt, nullptr);
+  
+    if (rc != SQLITE_OK) {
+        std::cerr << "Error preparing sqlite statement: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+    }
+
     while(true) { 
 
         try {
             auto msg = mq_sub.receive<recorder_message>();
 
+            /* A file the scan found gone */
+            if(msg.deleted) {
+
+                sqlite3_bind_text(deleteStmt, 1, msg.fid.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(deleteStmt, 2, msg.filesys.c_str(), -1, SQLITE_TRANSIENT);
+
+                rc = sqlite3_step(deleteStmt);
+
+                if(rc != SQLITE_DONE) {
+                    std::cerr << "Error deleting record: " << sqlite3_errmsg(db) << std::endl;
+                }
+
+                sqlite3_reset(deleteStmt);
+
+                continue;
+            }
+
             sqlite3_bind_text(ppStmt, 1, msg.path.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(ppStmt, 2, &msg.type, -1, SQLITE_TRANSIENT);
             sqlite3_bind_int64(ppStmt, 3, std::chrono::system_clock::to_time_t(msg.atime));
@@ -169,6 +209,7 @@ int main(int argc, char *argv[]) {
     }
 
     sqlite3_finalize(ppStmt);
+    sqlite3_finalize(deleteStmt);
     sqlite3_close(db);
 
     return EXIT_SUCCESS;
@@ -70,6 +70,16 @@ void sqlite_recording_agent_impl::run()
         try {
             auto msg= _mq_sub.receive<recorder_message>();
 
+            /* Deletions have no path to route them by, every database
+             * removes the file if it has it */
+            if(msg.deleted) {
+
+                for(auto &db_queue : db_queues) {
+                    db_queue.send(msg);
+                }
+
+                continue;
+            }
 
             std::clog << "Sqlite recording agent(" << std::this_thread::get_id() <<"): " 
                          " Received message: " << std::endl;
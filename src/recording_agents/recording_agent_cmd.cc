@@ -10,6 +10,7 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <string>
 #include <string_view>
 #include <numeric>
 
@@ -20,19 +21,21 @@
 #include "./recording_agents.h"
 
 
-// constexpr std::string_view recorder_queue_name = "recorder";
-// constexpr std::string_view recorder_consumer = "recorder-files-consumer";
-// constexpr std::string_view recorder_subject = "recorder.files";
-
-
 struct args {
     
     std::string id;
 
     std::string nats_url;
-    std::string recorder_stream;
-    std::string recorder_consumer;
-    std::string recorder_subject;
+
+    /* The scan stream, read through the recorder's own durable consumer so 
+     * policy agents don't have to publish every record again */
+    std::string scan_stream;
+    std::string scan_consumer;
+    std::string scan_subject;
+
+    /* Number of partitions of the scan subject, empty if it isn't 
+     * partitioned.  The recorder reads all of them */
+    std::string scan_partitions;
 };
 
 
@@ -65,10 +68,12 @@ struct args parse_config_file(std::string_view config_file,
             exit(EXIT_FAILURE);
         }
 
-        /* Check that the queue exists in the config */
+        /* Check that the queue exists in the config, 'queue' is the name 
+         * older configs used */
         const auto &queue_names = config.get_messaging_service_nats_queue_names();
 
-        const auto &queue = properties.at("queue");
+        const auto &queue = properties.contains("scan_queue") ? 
+            properties.at("scan_queue") : properties.at("queue");
 
         auto result = std::ranges::find(queue_names, queue);
 
@@ -90,13 +95,20 @@ struct args parse_config_file(std::string_view config_file,
                                                             [](const std::string &a, const std::string &b) { 
                                                                 return a + "," + b; });
 
+        /* A consumer of its own, sharing the policy agents' would split the
+         * records between them */
+        auto consumer = properties.contains("consumer_name") ?
+            properties.at("consumer_name") : queue_properties.at("consumer_name") + "-recorder";
+
         /* Return the arg */
         return {
-            .id                = std::move(properties.at("id")),
-            .nats_url          = std::move(nats_url),
-            .recorder_stream   = std::move(queue_properties.at("stream_name")),
-            .recorder_consumer = std::move(queue_properties.at("consumer_name")),
-            .recorder_subject  = std::move(queue_properties.at("subject"))
+            .id              = std::move(properties.at("id")),
+            .nats_url        = std::move(nats_url),
+            .scan_stream     = std::move(queue_properties.at("stream_name")),
+            .scan_consumer   = std::move(consumer),
+            .scan_subject    = std::move(queue_properties.at("subject")),
+            .scan_partitions = queue_properties.contains("partitions") ? 
+                queue_properties.at("partitions") : ""
         };
 
     } catch(const std::out_of_range &e) {
@@ -199,10 +211,22 @@ int main(int argc, char *argv[]) {
         create_messaging_service<messaging_services::JETSTREAM>(
             std::string_view(args.nats_url));
 
-    MsgSubscriber auto mq_sub = ms.create_queue_subscriber(
-        std::string_view(args.recorder_stream), 
-        std::string_view(args.recorder_consumer), 
-        std::string_view(args.recorder_subject));
+    /* Every partition if the scan subject is partitioned */
+    auto scan_partition_range = args.scan_partitions.empty() ? std::string() :
+        full_partition_range(args.scan_partitions);
+
+    /* Scan records and recorder messages have the same format */
+    MsgSubscriber auto mq_sub = args.scan_partitions.empty() ?
+        ms.create_queue_subscriber(
+            std::string_view(args.scan_stream), 
+            std::string_view(args.scan_consumer), 
+            std::string_view(args.scan_subject)) :
+        ms.create_queue_subscriber(
+            std::string_view(args.scan_stream), 
+            std::string_view(args.scan_consumer), 
+            std::string_view(args.scan_subject),
+            std::string_view(args.scan_partitions),
+            std::string_view(scan_partition_range));
 
     recording_agent *agent = 
             create_recording_agent<RECORDING_AGENTS::SQLITE>(ms, mq_sub);
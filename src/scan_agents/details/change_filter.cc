@@ -0,0 +1,516 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "./change_filter.h"
+
+
+/* The state file is
+ *
+ *      "PMCHNG01" | u32 scan | u32 checksum | u64 slots | u32 filesys length |
+ *      filesys | slot ...
+ *
+ * in the machine's byte order, where checksum covers what follows the
+ * header */
+static constexpr std::uint64_t change_filter_magic = 0x3130474e48434d50ULL;
+static constexpr std::size_t change_filter_header_size = 24;
+
+/* Slots read or written at a time */
+static constexpr std::size_t change_filter_chunk = 65536;
+
+/* Bit of slot::flags set on slots in use, and on FIDs printed in brackets */
+static constexpr std::uint8_t slot_used = 1;
+static constexpr std::uint8_t slot_bracketed = 2;
+
+
+static std::uint64_t _mix(std::uint64_t x) {
+
+    /* splitmix64 finalizer */
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    return x;
+}
+
+
+static std::uint64_t _key_hash(std::uint64_t sequence, std::uint32_t oid, std::uint32_t version) {
+    return _mix(sequence * 0x9e3779b97f4a7c15ULL ^ ((static_cast<std::uint64_t>(oid) << 32) | version));
+}
+
+
+/* 64-bit FNV-1a, folded over the fields a policy can test */
+class _fingerprint {
+
+    private:
+
+        std::uint64_t _hash = 0xcbf29ce484222325ULL;
+
+    public:
+
+        _fingerprint &add(std::string_view bytes) {
+
+            for(auto c : bytes) {
+                _hash ^= static_cast<unsigned char>(c);
+                _hash *= 0x100000001b3ULL;
+            }
+
+            /* So "ab" "c" and "a" "bc" differ */
+            _hash ^= bytes.size();
+            _hash *= 0x100000001b3ULL;
+
+            return *this;
+        }
+
+        template<typename T>
+        _fingerprint &add(const T &value) {
+            return add(std::string_view(reinterpret_cast<const char *>(&value), sizeof(T)));
+        }
+
+        std::uint64_t value() const {
+            return _hash;
+        }
+};
+
+
+static std::uint64_t _fingerprint_of(const scan_message &msg) {
+
+    return _fingerprint().add(msg.type)
+                         .add(msg.atime.time_since_epoch().count())
+                         .add(msg.mtime.time_since_epoch().count())
+                         .add(msg.size)
+                         .add(msg.uid)
+                         .add(msg.gid)
+                         .add(msg.stripe_count)
+                         .add(std::string_view(msg.ost_pool))
+                         .add(std::string_view(msg.path))
+                         .value();
+}
+
+
+/* The next 0x prefixed hex number of a FID */
+template<typename T>
+static bool _parse_hex(std::string_view &sv, T &value) {
+
+    if(not sv.starts_with("0x")) {
+        return false;
+    }
+
+    sv.remove_prefix(2);
+
+    auto [end, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), value, 16);
+
+    if(ec != std::errc() or end == sv.data()) {
+        return false;
+    }
+
+    sv.remove_prefix(static_cast<std::size_t>(end - sv.data()));
+
+    return true;
+}
+
+
+/* Parses a Lustre FID, [0x200000403:0x1:0x0] with or without the brackets */
+static bool _parse_fid(std::string_view fid, std::uint64_t &sequence,
+                       std::uint32_t &oid, std::uint32_t &version, bool &bracketed) {
+
+    bracketed = fid.starts_with('[') and fid.ends_with(']');
+
+    if(bracketed) {
+        fid = fid.substr(1, fid.size() - 2);
+    }
+
+    if(not _parse_hex(fid, sequence) or not fid.starts_with(':')) {
+        return false;
+    }
+
+    fid.remove_prefix(1);
+
+    if(not _parse_hex(fid, oid) or not fid.starts_with(':')) {
+        return false;
+    }
+
+    fid.remove_prefix(1);
+
+    return _parse_hex(fid, version) and fid.empty();
+}
+
+
+change_filter::change_filter(std::uint32_t refresh_scans) :
+    _slots(1024), _refresh_scans(refresh_scans) {}
+
+
+change_filter::slot &change_filter::_find(std::uint64_t sequence, std::uint32_t oid,
+                                          std::uint32_t version, std::uint64_t hash) {
+
+    const auto mask = _slots.size() - 1;
+
+    for(auto i = hash & mask;; i = (i + 1) & mask) {
+
+        auto &s = _slots[i];
+
+        if(not (s.flags & slot_used) or
+           (s.sequence == sequence and s.oid == oid and s.version == version)) {
+            return s;
+        }
+    }
+}
+
+
+void change_filter::_rehash(std::size_t capacity) {
+
+    auto old = std::move(_slots);
+    _slots.assign(capacity, slot{});
+
+    for(const auto &s : old) {
+        if(s.flags & slot_used) {
+            _find(s.sequence, s.oid, s.version, _key_hash(s.sequence, s.oid, s.version)) = s;
+        }
+    }
+}
+
+
+void change_filter::begin_scan() {
+    ++_scan;
+}
+
+
+bool change_filter::admit(const scan_message &msg) {
+
+    std::uint64_t sequence;
+    std::uint32_t oid, version;
+    bool bracketed;
+
+    if(not _parse_fid(msg.fid, sequence, oid, version, bracketed)) {
+        return true;
+    }
+
+    if(msg.filesys != _filesys) {
+        _filesys = msg.filesys;
+    }
+
+    /* At most three quarters full */
+    if((_used + 1) * 4 > _slots.size() * 3) {
+        _rehash(_slots.size() * 2);
+    }
+
+    const auto hash = _key_hash(sequence, oid, version);
+    const auto fingerprint = _fingerprint_of(msg);
+
+    auto &s = _find(sequence, oid, version, hash);
+
+    if(not (s.flags & slot_used)) {
+
+        s = { .sequence = sequence, .oid = oid, .version = version,
+              .fingerprint = fingerprint, .seen = _scan, .type = msg.type,
+              .flags = static_cast<std::uint8_t>(slot_used | (bracketed ? slot_bracketed : 0)),
+              .unused = 0 };
+
+        ++_used;
+
+        return true;
+    }
+
+    bool changed = s.fingerprint != fingerprint;
+
+    s.fingerprint = fingerprint;
+    s.seen = _scan;
+    s.type = msg.type;
+
+    if(changed) {
+        return true;
+    }
+
+    return _refresh_scans != 0 and (hash + _scan) % _refresh_scans == 0;
+}
+
+
+void change_filter::invalidate(const scan_message &msg) {
+
+    std::uint64_t sequence;
+    std::uint32_t oid, version;
+    bool bracketed;
+
+    if(not _parse_fid(msg.fid, sequence, oid, version, bracketed)) {
+        return;
+    }
+
+    auto &s = _find(sequence, oid, version, _key_hash(sequence, oid, version));
+
+    /* Can't match the fingerprint of the same record any more */
+    if(s.flags & slot_used) {
+        s.fingerprint = ~_fingerprint_of(msg);
+    }
+}
+
+
+std::size_t change_filter::sweep(const emitter &emit) {
+
+    scan_message msg;
+
+    msg.filesys = _filesys;
+    msg.deleted = true;
+
+    std::size_t deleted = 0;
+    char fid[64];
+
+    for(auto &s : _slots) {
+
+        if(not (s.flags & slot_used) or s.seen == _scan) {
+            continue;
+        }
+
+        snprintf(fid, sizeof(fid), (s.flags & slot_bracketed) ? "[0x%llx:0x%x:0x%x]" : "0x%llx:0x%x:0x%x",
+                 static_cast<unsigned long long>(s.sequence), s.oid, s.version);
+
+        msg.type = s.type;
+        msg.fid = fid;
+
+        /* Kept and found missing again by the next sweep if not sent */
+        if(emit(msg)) {
+            s.flags = 0;
+            ++deleted;
+        }
+    }
+
+    if(deleted == 0) {
+        return 0;
+    }
+
+    _used -= deleted;
+
+    /* Freed slots would break the probe sequences through them */
+    _rehash(std::max<std::size_t>(1024, std::bit_ceil(_used * 2 + 1)));
+
+    return deleted;
+}
+
+
+/* 32-bit FNV-1a, enough to detect a damaged file */
+static std::uint32_t _checksum(std::uint32_t hash, const char *data, std::size_t len) {
+
+    for(std::size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x01000193U;
+    }
+
+    return hash;
+}
+
+
+void change_filter::save(const std::filesystem::path &path) const {
+
+    auto tmp = path;
+    tmp += ".tmp";
+
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    if(fd == -1) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Unable to create change filter state " + tmp.string());
+    }
+
+    auto fail = [&](const std::string &what) {
+        int err = errno;
+        close(fd);
+        unlink(tmp.c_str());
+        throw std::system_error(err, std::generic_category(), what + " " + tmp.string());
+    };
+
+    auto write_all = [&](const char *data, std::size_t size) {
+
+        while(size > 0) {
+
+            auto rc = write(fd, data, size);
+
+            if(rc == -1 and errno == EINTR) {
+                continue;
+            } else if(rc == -1) {
+                fail("Unable to write change filter state");
+            }
+
+            data += rc;
+            size -= static_cast<std::size_t>(rc);
+        }
+    };
+
+    /* The header is written last, once the checksum is known */
+    char header[change_filter_header_size] = {};
+    write_all(header, sizeof(header));
+
+    auto filesys_size = static_cast<std::uint32_t>(_filesys.size());
+
+    auto checksum = _checksum(0x811c9dc5U, reinterpret_cast<const char *>(&filesys_size), 4);
+    checksum = _checksum(checksum, _filesys.data(), _filesys.size());
+
+    write_all(reinterpret_cast<const char *>(&filesys_size), 4);
+    write_all(_filesys.data(), _filesys.size());
+
+    std::vector<slot> chunk;
+    chunk.reserve(change_filter_chunk);
+
+    auto flush = [&]() {
+
+        auto *data = reinterpret_cast<const char *>(chunk.data());
+        auto size = chunk.size() * sizeof(slot);
+
+        checksum = _checksum(checksum, data, size);
+        write_all(data, size);
+
+        chunk.clear();
+    };
+
+    for(const auto &s : _slots) {
+
+        if(s.flags & slot_used) {
+            chunk.push_back(s);
+        }
+
+        if(chunk.size() == change_filter_chunk) {
+            flush();
+        }
+    }
+
+    flush();
+
+    auto count = static_cast<std::uint64_t>(_used);
+
+    std::memcpy(header, &change_filter_magic, 8);
+    std::memcpy(header + 8, &_scan, 4);
+    std::memcpy(header + 12, &checksum, 4);
+    std::memcpy(header + 16, &count, 8);
+
+    if(pwrite(fd, header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+        fail("Unable to write change filter state");
+    }
+
+    if(fsync(fd) != 0) {
+        fail("Unable to sync change filter state");
+    }
+
+    close(fd);
+
+    if(rename(tmp.c_str(), path.c_str()) != 0) {
+        int err = errno;
+        unlink(tmp.c_str());
+        throw std::system_error(err, std::generic_category(),
+                                "Unable to replace change filter state " + path.string());
+    }
+}
+
+
+bool change_filter::load(const std::filesystem::path &path) {
+
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if(fd == -1 and errno == ENOENT) {
+        return false;
+
+    } else if(fd == -1) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Unable to open change filter state " + path.string());
+    }
+
+    /* Reads exactly size bytes or throws */
+    auto read_all = [&](char *data, std::size_t size) {
+
+        while(size > 0) {
+
+            auto rc = read(fd, data, size);
+
+            if(rc == -1 and errno == EINTR) {
+                continue;
+
+            } else if(rc == -1) {
+                int err = errno;
+                close(fd);
+                throw std::system_error(err, std::generic_category(),
+                                        "Unable to read change filter state " + path.string());
+
+            } else if(rc == 0) {
+                close(fd);
+                throw std::runtime_error("Change filter state " + path.string() + " is truncated");
+            }
+
+            data += rc;
+            size -= static_cast<std::size_t>(rc);
+        }
+    };
+
+    char header[change_filter_header_size];
+    read_all(header, sizeof(header));
+
+    std::uint64_t magic, count;
+    std::uint32_t scan, expected, filesys_size;
+
+    std::memcpy(&magic, header, 8);
+    std::memcpy(&scan, header + 8, 4);
+    std::memcpy(&expected, header + 12, 4);
+    std::memcpy(&count, header + 16, 8);
+
+    if(magic != change_filter_magic) {
+        close(fd);
+        throw std::runtime_error(path.string() + " is not a change filter state");
+    }
+
+    read_all(reinterpret_cast<char *>(&filesys_size), 4);
+
+    std::string filesys(filesys_size, '\0');
+    read_all(filesys.data(), filesys.size());
+
+    auto checksum = _checksum(0x811c9dc5U, reinterpret_cast<const char *>(&filesys_size), 4);
+    checksum = _checksum(checksum, filesys.data(), filesys.size());
+
+    std::vector<slot> slots(count);
+
+    for(std::size_t done = 0; done < count;) {
+
+        auto n = std::min<std::size_t>(change_filter_chunk, count - done);
+        auto *data = reinterpret_cast<char *>(slots.data() + done);
+
+        read_all(data, n * sizeof(slot));
+        checksum = _checksum(checksum, data, n * sizeof(slot));
+
+        done += n;
+    }
+
+    close(fd);
+
+    if(checksum != expected) {
+        throw std::runtime_error("Change filter state " + path.string() + " is damaged");
+    }
+
+    _slots.assign(std::max<std::size_t>(1024, std::bit_ceil(count * 2 + 1)), slot{});
+    _used = 0;
+
+    for(const auto &s : slots) {
+        _find(s.sequence, s.oid, s.version, _key_hash(s.sequence, s.oid, s.version)) = s;
+        ++_used;
+    }
+
+    _scan = scan;
+    _filesys = std::move(filesys);
+
+    return true;
+}
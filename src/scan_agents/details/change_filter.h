@@ -0,0 +1,130 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../../messaging/messaging.h"
+
+
+/* How a scan agent leaves out records that haven't changed */
+struct change_filter_options {
+
+    /* Where the fingerprints are kept between runs of the agent, empty to
+     * start from nothing, i.e. a full scan, every time */
+    std::string state_file;
+
+    /* An unchanged record is still sent once every refresh_scans scans,
+     * spread over the scans by FID, so rules on ages see every file.  0
+     * never sends them again */
+    std::uint32_t refresh_scans = 10;
+};
+
+
+/**
+ * @brief Remembers a fingerprint of every file a scan found, keyed by FID,
+ *        so only new and changed records are sent and files a complete scan
+ *        no longer finds are sent as deletions.
+ *
+ * The fingerprints are an open addressed table of 32 byte slots holding the
+ * FID packed into its sequence, object id and version, a hash of the
+ * record's type, times, size, owner, pool, stripe count and path, and the
+ * scan that last found it.  A scan marks every file it finds and sweeping
+ * after a complete scan takes out those it didn't.  Records whose FID isn't
+ * one, e.g. empty, aren't tracked and are always sent.
+ */
+class change_filter {
+
+    public:
+
+        /* Sends a deletion, false if it couldn't be and should be retried
+         * after the next scan */
+        using emitter = std::function<bool(const scan_message &msg)>;
+
+    private:
+
+        struct slot {
+            std::uint64_t sequence;
+            std::uint32_t oid;
+            std::uint32_t version;
+            std::uint64_t fingerprint;
+            std::uint32_t seen;
+            char type;
+            std::uint8_t flags;
+            std::uint16_t unused;
+        };
+
+        static_assert(sizeof(slot) == 32);
+
+        std::vector<slot> _slots;
+        std::size_t _used = 0;
+
+        std::uint32_t _scan = 0;
+        std::uint32_t _refresh_scans;
+
+        /* Of the records, deletions are sent with it */
+        std::string _filesys;
+
+        slot &_find(std::uint64_t sequence, std::uint32_t oid, std::uint32_t version,
+                    std::uint64_t hash);
+
+        /* Rehashes the slots in use into a table of capacity slots */
+        void _rehash(std::size_t capacity);
+
+    public:
+
+        explicit change_filter(std::uint32_t refresh_scans = 10);
+
+        /* Starts marking the files found by a new scan */
+        void begin_scan();
+
+        /* Records msg and tells whether it should be sent */
+        bool admit(const scan_message &msg);
+
+        /* Forgets the fingerprint of a record that couldn't be sent, so the
+         * next scan sends it again */
+        void invalidate(const scan_message &msg);
+
+        /* After a complete scan, sends a deletion for and drops every file
+         * it didn't find.  Returns the number of deletions sent */
+        std::size_t sweep(const emitter &emit);
+
+        /* Files tracked */
+        std::size_t size() const {
+            return _used;
+        }
+
+        std::uint32_t scan() const {
+            return _scan;
+        }
+
+        /**
+         * @brief Writes the fingerprints to path through a temporary file
+         *        renamed over it.
+         *
+         * @throws std::system_error if the file can't be written.
+         */
+        void save(const std::filesystem::path &path) const;
+
+        /**
+         * @brief Replaces the fingerprints with those saved at path.
+         *
+         * @return false if there is no such file.
+         * @throws std::system_error if it can't be read.
+         * @throws std::runtime_error if it isn't a complete state file.
+         */
+        bool load(const std::filesystem::path &path);
+};
@@ -12,6 +12,7 @@
 #include <chrono>
 #include <fstream>
 
+#include <iostream>
 #include <string_view>
 #include <system_error>
 #include <thread>
@@ -31,6 +32,45 @@
 
     
 
+void lfs_find_scan_agent_impl::_load_changes() {
+
+    if(_state_file.empty()) {
+        return;
+    }
+
+    /* A lost state only costs a full scan */
+    try {
+
+        if(_changes->load(_state_file)) {
+            std::clog << "Scan agent(" << std::this_thread::get_id() <<"): "
+                      << "Loaded fingerprints of " << _changes->size() << " files from " 
+                      << _state_file << std::endl;
+        }
+
+    } catch (const std::exception& e) {
+        std::clog << "Scan agent(" << std::this_thread::get_id() <<"): "
+                  << "Error loading " << _state_file << ", sending every record: " 
+                  << e.what() << std::endl;
+    }
+}
+
+
+void lfs_find_scan_agent_impl::_save_changes() const {
+
+    if(_state_file.empty()) {
+        return;
+    }
+
+    try {
+        _changes->save(_state_file);
+
+    } catch (const std::exception& e) {
+        std::clog << "Scan agent(" << std::this_thread::get_id() <<"): "
+                  << "Error saving " << _state_file << ": " << e.what() << std::endl;
+    }
+}
+
+
 void lfs_find_scan_agent_impl::run() {
 
     json_deserializer_impl<scan_message> deserializer;
@@ -38,12 +78,15 @@ void lfs_find_scan_agent_impl::run() {
     std::clog << "Scan agent(" << std::this_thread::get_id() <<"): "
                 << "Running..." << std::endl;
 
+    if(_changes) {
+        _load_changes();
+    }
+
     while(this->_stop == false) {
         //_launch_executable();
 
         process scan_process(_executable, 
-            "find", _path,  "--printf",  
-            "{ \"type\": \"%y\", \"path\": \"%p\", \"atime\": %A@, \"mtime\": %T@, \"size\": %s, \"uid\": %U, \"gid\": %G, \"format\": { \"filesys\": \"lustre\", \"ost_pool\": \"%Lp\", \"stripe_count\": %Lc, \"fid\": \"%LF\" } }\n");
+            "find", _path,  "--printf", lfs_find_printf);
 
         // __gnu_cxx::stdio_filebuf<char> filebuf(1, std::ios::in);
 
@@ -51,24 +94,78 @@ void lfs_find_scan_agent_impl::run() {
 
         std::basic_filebuf<char> filebuf = scan_process.launch();
 
+        std::uint64_t records = 0, sent = 0;
+
+        if(_changes) {
+            _changes->begin_scan();
+        }
+
         /* Read line by line until there is no more data */
         for(std::string buffer; std::getline(std::istream(&filebuf), buffer);) {
 
             std::clog << buffer << std::endl;
 
+            scan_message msg;
+
             /* TODO verify format of message and look for error messages from lfs_find */
             try {
                 
-                auto msg = deserializer(buffer);
+                msg = deserializer(buffer);
+                ++records;
+
+                /* Unchanged since the previous scan */
+                if(_changes and not _changes->admit(msg)) {
+                    continue;
+                }
 
                 /* send data to message queue */
                 _mq_pub.send(msg);
+                ++sent;
 
             /* TODO need to make a deserialize exception */
             } catch (const std::exception& e) {
                 std::clog << "Error deserializing and sending message: " << buffer << ": "
                             << e.what() << std::endl;
+
+                /* Sent again by the next scan */
+                if(_changes) {
+                    _changes->invalidate(msg);
+                }
+            }
+        }
+
+        if(_changes) {
+
+            std::size_t deleted = 0;
+
+            /* Only a complete scan tells which files are gone */
+            if(int status = scan_process.wait(); status == 0 and this->_stop == false) {
+
+                deleted = _changes->sweep([this](const scan_message &msg) {
+
+                    try {
+                        _mq_pub.send(msg);
+                        return true;
+
+                    } catch (const std::exception& e) {
+                        std::clog << "Error sending deletion: " << msg.fid << ": "
+                                  << e.what() << std::endl;
+                        return false;
+                    }
+                });
+
+            } else {
+                std::clog << "Scan agent(" << std::this_thread::get_id() <<"): "
+                          << "Scan incomplete (exit status " << status 
+                          << "), not looking for deleted files" << std::endl;
             }
+
+            _save_changes();
+
+            std::clog << "Scan agent(" << std::this_thread::get_id() <<"): "
+                      << "Scanned " << records << " records, sent " << sent 
+                      << " new or changed and " << deleted << " deletions, tracking " 
+                      << _changes->size() << " files" << std::endl;
         }
 
         std::this_thread::sleep_for(_scan_interval);
@@ -10,8 +10,15 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include "../../messaging/messaging.h"
+#include "./change_filter.h"
+
+
+/* What lfs find prints for each entry, a scan record as JSON */
+inline const std::string lfs_find_printf = 
+    "{ \"type\": \"%y\", \"path\": \"%p\", \"atime\": %A@, \"mtime\": %T@, \"size\": %s, \"uid\": %U, \"gid\": %G, \"format\": { \"filesys\": \"lustre\", \"ost_pool\": \"%Lp\", \"stripe_count\": %Lc, \"fid\": \"%LF\" } }\n";
 
 
 class lfs_find_scan_agent_impl {
@@ -22,6 +29,13 @@ class lfs_find_scan_agent_impl {
         std::string _path;
         std::chrono::seconds _scan_interval;
         bool _stop;
+
+        /* Only set if unchanged records are left out */
+        std::unique_ptr<change_filter> _changes;
+        std::string _state_file;
+
+        void _load_changes();
+        void _save_changes() const;
         
 
     public:
@@ -34,6 +48,18 @@ class lfs_find_scan_agent_impl {
                             std::string_view executable="/usr/bin/lfs") : 
             _mq_pub(mq_pub), _path(path), _scan_interval(scan_interval), _executable(executable), _stop(false) {} // _pid(-1), _stop(false), _pipefds{-1, -1}  {}
 
+        /* Sends only the records that changed since the previous scan, and
+         * deletions of the files it no longer finds */
+        lfs_find_scan_agent_impl(
+                            const message_queue_publisher &mq_pub, 
+                            std::string_view path,
+                            std::chrono::seconds scan_interval,
+                            const change_filter_options &options,
+                            std::string_view executable="/usr/bin/lfs") : 
+            _mq_pub(mq_pub), _executable(executable), _path(path), _scan_interval(scan_interval), 
+            _stop(false), _changes(std::make_unique<change_filter>(options.refresh_scans)),
+            _state_file(options.state_file) {}
+
 
         lfs_find_scan_agent_impl(const lfs_find_scan_agent_impl &) = delete;
         lfs_find_scan_agent_impl &operator=(const lfs_find_scan_agent_impl &) = delete;
@@ -43,7 +69,9 @@ class lfs_find_scan_agent_impl {
             _executable(std::move(o._executable)), 
             _path(std::move(o._path)),
             _scan_interval(std::move(o._scan_interval)),
-            _stop(o._stop) {
+            _stop(o._stop),
+            _changes(std::move(o._changes)),
+            _state_file(std::move(o._state_file)) {
 
         }
 
@@ -53,6 +81,8 @@ class lfs_find_scan_agent_impl {
             _path = std::move(rhs._path);
             _scan_interval = std::move(rhs._scan_interval);
             _stop = rhs._stop;
+            _changes = std::move(rhs._changes);
+            _state_file = std::move(rhs._state_file);
         
             return *this;
         }
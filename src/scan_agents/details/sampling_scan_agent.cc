@@ -0,0 +1,200 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+#include "../../common/process_control.h"
+#include "./lfs_find_scan_agent.h"
+#include "./sampling_scan_agent.h"
+
+
+/* The path without trailing slashes, so a directory's own record can be told
+ * from its entries */
+static std::string_view _trimmed(std::string_view path) {
+
+    while(path.size() > 1 and path.back() == '/') {
+        path.remove_suffix(1);
+    }
+
+    return path;
+}
+
+
+directory_sampler::directory_sampler(const sampling_options &options, lister list) :
+    _options(options), _list(std::move(list)),
+    _random(options.seed != 0 ? options.seed : std::random_device()()) {
+
+    _options.probes = std::max<std::uint32_t>(_options.probes, 1);
+    _options.fanout = std::max<std::size_t>(_options.fanout, 1);
+}
+
+
+template<typename T>
+void directory_sampler::_pick(std::vector<T> &items, std::size_t k) {
+
+    /* The first k steps of a Fisher-Yates shuffle */
+    for(std::size_t i = 0; i < k and i + 1 < items.size(); ++i) {
+        std::uniform_int_distribution<std::size_t> next(i, items.size() - 1);
+        std::swap(items[i], items[next(_random)]);
+    }
+}
+
+
+sample_totals directory_sampler::sample(const std::string &root, const emitter &emit) {
+
+    sample_totals totals;
+
+    struct visit {
+        std::string path;
+        double probability;
+    };
+
+    std::vector<visit> pending;
+    std::vector<scan_message> files;
+    std::vector<std::string> subdirectories;
+
+    for(std::uint32_t probe = 1; probe <= _options.probes; ++probe) {
+
+        pending.push_back({ root, 1.0 });
+
+        while(not pending.empty()) {
+
+            auto [directory, probability] = std::move(pending.back());
+            pending.pop_back();
+
+            ++totals.directories;
+
+            files.clear();
+            subdirectories.clear();
+
+            const auto weight = 1.0 / (probability * _options.probes);
+
+            for(auto &msg : _list(directory)) {
+
+                msg.sampled = true;
+                msg.probe = probe;
+
+                if(_trimmed(msg.path) == _trimmed(directory)) {
+                    msg.weight = weight;
+                    emit(msg);
+                    ++totals.records;
+
+                } else if(msg.type == 'd') {
+                    subdirectories.push_back(std::move(msg.path));
+
+                } else {
+                    files.push_back(std::move(msg));
+                }
+            }
+
+            /* A subsample of a large directory's files stands for all of them */
+            auto kept = files.size();
+
+            if(_options.max_files_per_directory > 0 and kept > _options.max_files_per_directory) {
+                kept = _options.max_files_per_directory;
+                _pick(files, kept);
+            }
+
+            for(std::size_t i = 0; i < kept; ++i) {
+                files[i].weight = weight * static_cast<double>(files.size()) / static_cast<double>(kept);
+                emit(files[i]);
+                ++totals.records;
+            }
+
+            auto descend = std::min(_options.fanout, subdirectories.size());
+
+            if(descend == 0) {
+                continue;
+            }
+
+            _pick(subdirectories, descend);
+
+            auto child_probability = probability * static_cast<double>(descend) /
+                                     static_cast<double>(subdirectories.size());
+
+            for(std::size_t i = 0; i < descend; ++i) {
+                pending.push_back({ std::move(subdirectories[i]), child_probability });
+            }
+        }
+
+        ++totals.probes;
+    }
+
+    return totals;
+}
+
+
+std::vector<scan_message> lfs_sampling_scan_agent_impl::_list(const std::string &directory) const {
+
+    json_deserializer_impl<scan_message> deserializer;
+
+    std::vector<std::string> args = {
+        _executable, "find", directory, "--maxdepth", "1", "--printf", lfs_find_printf
+    };
+
+    process find_process(args);
+
+    std::basic_filebuf<char> filebuf = find_process.launch();
+    std::istream input(&filebuf);
+
+    std::vector<scan_message> entries;
+
+    for(std::string buffer; std::getline(input, buffer);) {
+
+        try {
+            entries.push_back(deserializer(buffer));
+
+        } catch (const std::exception& e) {
+            std::clog << "Error deserializing message: " << buffer << ": "
+                      << e.what() << std::endl;
+        }
+    }
+
+    return entries;
+}
+
+
+void lfs_sampling_scan_agent_impl::run() {
+
+    std::clog << "Scan agent(" << std::this_thread::get_id() <<"): "
+              << "Sampling with " << _options.probes << " probes..." << std::endl;
+
+    while(this->_stop == false) {
+
+        directory_sampler sampler(_options, [this](const std::string &directory) {
+            return _list(directory);
+        });
+
+        auto start = std::chrono::steady_clock::now();
+
+        auto totals = sampler.sample(_path, [this](const scan_message &msg) {
+
+            try {
+                _mq_pub.send(msg);
+
+            } catch (const std::exception& e) {
+                std::clog << "Error sending message: " << msg.path << ": "
+                          << e.what() << std::endl;
+            }
+        });
+
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+        std::clog << "Scan agent(" << std::this_thread::get_id() <<"): "
+                  << "Sampled " << _path << " with " << totals.probes << " probes, "
+                  << totals.directories << " directories listed and "
+                  << totals.records << " records sent in " << elapsed.count() << "s" << std::endl;
+
+        std::this_thread::sleep_for(_scan_interval);
+    }
+}
@@ -0,0 +1,147 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../../messaging/messaging.h"
+
+
+/* How a sampling scan descends the namespace */
+struct sampling_options {
+
+    /* Independent descents from the root each scan */
+    std::uint32_t probes = 1000;
+
+    /* Subdirectories of each visited directory descended into, picked at
+     * random.  1 is a random walk, more visits more of the tree for a
+     * smaller error at a cost growing with the depth */
+    std::size_t fanout = 1;
+
+    /* Most files of a directory sent, picked at random, 0 for all of them */
+    std::size_t max_files_per_directory = 1000;
+
+    /* Seed of the random choices, 0 for a different one every scan */
+    std::uint64_t seed = 0;
+};
+
+
+/* What a sampling scan visited */
+struct sample_totals {
+    std::uint32_t probes = 0;
+    std::uint64_t directories = 0;
+    std::uint64_t records = 0;
+};
+
+
+/**
+ * @brief Estimates a namespace from randomized descents of its directory
+ *        tree, listing only the directories on the way.
+ *
+ * Each probe starts at the root and in every directory it visits sends the
+ * directory and its files, then descends into fanout of its subdirectories
+ * picked uniformly at random, so a directory is visited with the product of
+ * fanout / subdirectories along its path.  A directory with more than
+ * max_files_per_directory files has that many of them picked uniformly.
+ * Every record is weighted by the inverse of its inclusion probability over
+ * the number of probes, so the sum of the weights of any set of records is
+ * an unbiased estimate of the count in the whole tree, and the probes are
+ * independent so the spread of their totals gives a confidence interval.
+ */
+class directory_sampler {
+
+    public:
+
+        /* The records of a directory and its entries, in any order */
+        using lister = std::function<std::vector<scan_message>(const std::string &directory)>;
+
+        using emitter = std::function<void(const scan_message &msg)>;
+
+    private:
+
+        sampling_options _options;
+        lister _list;
+        std::mt19937_64 _random;
+
+        /* Moves k of the items picked uniformly to the front */
+        template<typename T>
+        void _pick(std::vector<T> &items, std::size_t k);
+
+    public:
+
+        directory_sampler(const sampling_options &options, lister list);
+
+        /* Runs the probes from root, handing each record to emit */
+        sample_totals sample(const std::string &root, const emitter &emit);
+};
+
+
+class lfs_sampling_scan_agent_impl {
+
+    private:
+        message_queue_publisher _mq_pub;
+        std::string _executable;
+        std::string _path;
+        std::chrono::seconds _scan_interval;
+        sampling_options _options;
+        bool _stop;
+
+        /* The records lfs find gives for the directory and its entries */
+        std::vector<scan_message> _list(const std::string &directory) const;
+
+    public:
+
+        lfs_sampling_scan_agent_impl(
+                            const message_queue_publisher &mq_pub,
+                            std::string_view path,
+                            std::chrono::seconds scan_interval,
+                            const sampling_options &options,
+                            std::string_view executable="/usr/bin/lfs") :
+            _mq_pub(mq_pub), _executable(executable), _path(path),
+            _scan_interval(scan_interval), _options(options), _stop(false) {}
+
+        lfs_sampling_scan_agent_impl(const lfs_sampling_scan_agent_impl &) = delete;
+        lfs_sampling_scan_agent_impl &operator=(const lfs_sampling_scan_agent_impl &) = delete;
+
+        lfs_sampling_scan_agent_impl(lfs_sampling_scan_agent_impl &&o) :
+            _mq_pub(o._mq_pub),
+            _executable(std::move(o._executable)),
+            _path(std::move(o._path)),
+            _scan_interval(o._scan_interval),
+            _options(o._options),
+            _stop(o._stop) {}
+
+        lfs_sampling_scan_agent_impl &operator=(lfs_sampling_scan_agent_impl &&rhs) {
+            _mq_pub = rhs._mq_pub;
+            _executable = std::move(rhs._executable);
+            _path = std::move(rhs._path);
+            _scan_interval = rhs._scan_interval;
+            _options = rhs._options;
+            _stop = rhs._stop;
+
+            return *this;
+        }
+
+        ~lfs_sampling_scan_agent_impl() = default;
+
+        void run();
+
+        void stop() {
+            this->_stop = true;
+        }
+};
@@ -20,4 +20,29 @@ scan_agent create_scan_agent<scan_agents::LFS_FIND>(
                     std::chrono::seconds scan_interval) {
 
     return scan_agent(lfs_find_scan_agent_impl(mq_publisher, path, scan_interval));
+}
+
+
+/* Template specialization for creating the lfs_find scanner that leaves out
+ * unchanged records */
+template<> 
+scan_agent create_scan_agent<scan_agents::LFS_FIND>(
+                    const message_queue_publisher &mq_publisher, 
+                    std::string_view path,
+                    std::chrono::seconds scan_interval,
+                    const change_filter_options &options) {
+
+    return scan_agent(lfs_find_scan_agent_impl(mq_publisher, path, scan_interval, options));
+}
+
+
+/* Template specialization for creating the lfs find sampler */
+template<> 
+scan_agent create_scan_agent<scan_agents::LFS_SAMPLE>(
+                    const message_queue_publisher &mq_publisher, 
+                    std::string_view path,
+                    std::chrono::seconds scan_interval,
+                    const sampling_options &options) {
+
+    return scan_agent(lfs_sampling_scan_agent_impl(mq_publisher, path, scan_interval, options));
 }
\ No newline at end of file
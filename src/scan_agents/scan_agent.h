@@ -15,13 +15,15 @@
 #include <variant>
 
 #include "./details/lfs_find_scan_agent.h"
+#include "./details/sampling_scan_agent.h"
 
 
 enum class scan_agents {
     LFS_FIND,
+    LFS_SAMPLE,
 };
 
-class scan_agent : std::variant<lfs_find_scan_agent_impl> {
+class scan_agent : std::variant<lfs_find_scan_agent_impl, lfs_sampling_scan_agent_impl> {
 
     public:
         /* No default constructor */
@@ -53,6 +55,22 @@ scan_agent create_scan_agent(const message_queue_publisher &mq_publisher,
                              std::string_view path,
                              std::chrono::seconds scan_interval);
 
+/* The same for scan agents that sample the namespace rather than scan all
+   of it */
+template<scan_agents> 
+scan_agent create_scan_agent(const message_queue_publisher &mq_publisher, 
+                             std::string_view path,
+                             std::chrono::seconds scan_interval,
+                             const sampling_options &options);
+
+/* The same for scan agents that only send the records that changed since 
+   their previous scan */
+template<scan_agents> 
+scan_agent create_scan_agent(const message_queue_publisher &mq_publisher, 
+                             std::string_view path,
+                             std::chrono::seconds scan_interval,
+                             const change_filter_options &options);
+
 
 
 
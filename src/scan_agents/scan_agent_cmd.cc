@@ -16,6 +16,7 @@
 #include <regex>
 #include <ranges>
 #include <numeric>
+#include <filesystem>
 
 #include <mqueue.h>
 
@@ -42,6 +43,22 @@ struct args {
     std::string scan_stream;
     std::string scan_consumer;
     std::string scan_subject;
+
+    /* Optional subject partitioning, empty means not partitioned */
+    std::string scan_partitions;
+    std::string scan_partition_by;
+
+    /* Optional disk spool for the publisher, empty means no spool */
+    std::string spool_directory;
+    std::size_t spool_segment_size = 64 * 1024 * 1024;
+
+    /* Sample the namespace instead of scanning all of it */
+    bool sample = false;
+    sampling_options sampling;
+
+    /* Only send records that changed since the previous scan */
+    bool changes = false;
+    change_filter_options change_filter;
 };
 
 
@@ -206,13 +223,77 @@ static struct args parse_config_file(std::string_view config_file,
                                                             [](const std::string &a, const std::string &b) { 
                                                                 return a + "," + b; });
 
+        /* Partitioning of the subject is optional */
+        std::string partitions;
+        std::string partition_by = "fid";
+
+        if(queue_properties.contains("partitions")) {
+            partitions = queue_properties.at("partitions");
+        }
+
+        if(queue_properties.contains("partition_by")) {
+            partition_by = queue_properties.at("partition_by");
+        }
+
+        /* Spooling is optional too */
+        std::string spool_directory;
+        std::size_t spool_segment_size = 64 * 1024 * 1024;
+
+        if(queue_properties.contains("spool_directory")) {
+            spool_directory = queue_properties.at("spool_directory");
+        }
+
+        if(queue_properties.contains("spool_segment_size")) {
+            spool_segment_size = std::stoull(queue_properties.at("spool_segment_size"));
+        }
+
+        /* So is sampling rather than a full scan */
+        bool sample = properties.contains("mode") and properties.at("mode") == "sample";
+        sampling_options sampling;
+
+        if(properties.contains("probes")) {
+            sampling.probes = static_cast<std::uint32_t>(std::stoul(properties.at("probes")));
+        }
+
+        if(properties.contains("fanout")) {
+            sampling.fanout = std::stoul(properties.at("fanout"));
+        }
+
+        if(properties.contains("max_files_per_directory")) {
+            sampling.max_files_per_directory = std::stoul(properties.at("max_files_per_directory"));
+        }
+
+        if(properties.contains("seed")) {
+            sampling.seed = std::stoull(properties.at("seed"));
+        }
+
+        /* Or leaving out the records that didn't change */
+        bool changes = properties.contains("mode") and properties.at("mode") == "changes";
+        change_filter_options change_filter;
+
+        if(properties.contains("state_file")) {
+            change_filter.state_file = properties.at("state_file");
+        }
+
+        if(properties.contains("refresh_scans")) {
+            change_filter.refresh_scans = static_cast<std::uint32_t>(std::stoul(properties.at("refresh_scans")));
+        }
+
         return {  .id            = std::move(properties.at("id")),
                   .directory     = std::move(properties.at("root_directory")),
                   .scan_interval = std::move(parse_interval(properties.at("interval"))), 
                   .nats_url      = std::move(nats_url),
                   .scan_stream   = std::move(queue_properties.at("stream_name")),
                   .scan_consumer = std::move(queue_properties.at("consumer_name")),
-                  .scan_subject  = std::move(queue_properties.at("subject"))
+                  .scan_subject  = std::move(queue_properties.at("subject")),
+                  .scan_partitions   = std::move(partitions),
+                  .scan_partition_by = std::move(partition_by),
+                  .spool_directory   = std::move(spool_directory),
+                  .spool_segment_size = spool_segment_size,
+                  .sample             = sample,
+                  .sampling           = sampling,
+                  .changes            = changes,
+                  .change_filter      = change_filter
                 };
 
     } catch(const std::out_of_range &e) {
@@ -247,6 +328,18 @@ static struct args parse_commandline(int argc, char *argv[]) {
         ("stream", po::value<std::string>(), "Nats name of the scan stream")
         ("consumer", po::value<std::string>(), "Nats name of the scan consumer")
         ("subject", po::value<std::string>(), "Nats scan subject")
+        ("partitions", po::value<std::string>(), "Number of partitions of the scan subject, messages are published on <subject>.<k>")
+        ("partition_by", po::value<std::string>(), "What to hash to select the partition: fid (default) or parent")
+        ("spool_directory", po::value<std::string>(), "Spool scan results to this directory while NATS is unreachable")
+        ("spool_segment_size", po::value<std::size_t>(), "Size in bytes of each spool segment file")
+        ("sample", "Sample the namespace with random descents instead of scanning all of it")
+        ("probes", po::value<std::uint32_t>(), "Descents from the top level directory of each sampling scan")
+        ("fanout", po::value<std::size_t>(), "Subdirectories each sampled directory descends into")
+        ("max_files_per_directory", po::value<std::size_t>(), "Most files of a sampled directory sent, 0 for all")
+        ("seed", po::value<std::uint64_t>(), "Seed of the sampling, random if not given")
+        ("changes", "Only send records that changed since the previous scan, and deletions")
+        ("state_file", po::value<std::string>(), "File keeping the fingerprints of the files between runs")
+        ("refresh_scans", po::value<std::uint32_t>(), "Send unchanged records again once every this many scans, 0 never")
         ("interval", po::value<std::string>(), "Scan interval of the form [#days][#hours][#minutes][#seconds], e.g. 1d2h3m4s, 2h4s, 4s")
         ("directory", po::value<std::string>(), "Top level directory to start scan");
 
@@ -355,6 +448,72 @@ static struct args parse_commandline(int argc, char *argv[]) {
     } else if(vm.count("subject") == 1) {
         args.scan_subject = vm["subject"].as<std::string>();
     }
+
+    /* Partitioning is optional, command line overrides the config file */
+    if(vm.count("partitions") == 1) {
+        args.scan_partitions = vm["partitions"].as<std::string>();
+    }
+
+    if(vm.count("partition_by") == 1) {
+        args.scan_partition_by = vm["partition_by"].as<std::string>();
+
+    } else if(args.scan_partition_by.empty()) {
+        args.scan_partition_by = "fid";
+    }
+
+    /* Spooling is optional, command line overrides the config file */
+    if(vm.count("spool_directory") == 1) {
+        args.spool_directory = vm["spool_directory"].as<std::string>();
+    }
+
+    if(vm.count("spool_segment_size") == 1) {
+        args.spool_segment_size = vm["spool_segment_size"].as<std::size_t>();
+    }
+
+    /* Sampling is optional, command line overrides the config file */
+    if(vm.count("sample") > 0) {
+        args.sample = true;
+    }
+
+    if(vm.count("probes") == 1) {
+        args.sampling.probes = vm["probes"].as<std::uint32_t>();
+    }
+
+    if(vm.count("fanout") == 1) {
+        args.sampling.fanout = vm["fanout"].as<std::size_t>();
+    }
+
+    if(vm.count("max_files_per_directory") == 1) {
+        args.sampling.max_files_per_directory = vm["max_files_per_directory"].as<std::size_t>();
+    }
+
+    if(vm.count("seed") == 1) {
+        args.sampling.seed = vm["seed"].as<std::uint64_t>();
+    }
+
+    /* So is change filtering */
+    if(vm.count("changes") > 0) {
+        args.changes = true;
+    }
+
+    if(vm.count("state_file") == 1) {
+        args.change_filter.state_file = vm["state_file"].as<std::string>();
+    }
+
+    if(vm.count("refresh_scans") == 1) {
+        args.change_filter.refresh_scans = vm["refresh_scans"].as<std::uint32_t>();
+    }
+
+    if(args.changes and args.sample) {
+        std::cerr << "Error, a scan can't both sample and send changes" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    /* A deletion only has a FID, so it can't follow the file's parent */
+    if(args.changes and not args.scan_partitions.empty() and args.scan_partition_by != "fid") {
+        std::cerr << "Error, sending changes needs the scan queue partitioned by fid" << std::endl;
+        exit(EXIT_FAILURE);
+    }
        
 
     /* Return an arg struct of the arguments to the process */
@@ -379,8 +538,27 @@ int main(int argc, char *argv[]) {
     std::clog << "Scan stream: " << args.scan_stream << std::endl;
     std::clog << "Scan consumer: " << args.scan_consumer << std::endl;
     std::clog << "Scan subject: " << args.scan_subject << std::endl;
+
+    if(not args.scan_partitions.empty()) {
+        std::clog << "Scan partitions: " << args.scan_partitions 
+                  << " by " << args.scan_partition_by << std::endl;
+    }
+
     std::clog << "Scan interval: " << args.scan_interval.count() << std::endl;
     std::clog << "Top level directory: " << args.directory << std::endl;
+
+    if(args.sample) {
+        std::clog << "Sampling: " << args.sampling.probes << " probes, fanout " 
+                  << args.sampling.fanout << ", at most " << args.sampling.max_files_per_directory 
+                  << " files per directory" << std::endl;
+    }
+
+    if(args.changes) {
+        std::clog << "Sending changes, unchanged records every " << args.change_filter.refresh_scans 
+                  << " scans, state in " 
+                  << (args.change_filter.state_file.empty() ? "memory" : args.change_filter.state_file) 
+                  << std::endl;
+    }
     
     std::clog << "Starting scan agent..." << std::endl;
     
@@ -388,17 +566,41 @@ int main(int argc, char *argv[]) {
     MsgService auto ms = create_messaging_service<messaging_services::JETSTREAM>(
                                     std::string_view(args.nats_url));
 
-    /* Create the publisher for the scan queue*/
-    MsgPublisher auto mq_publisher = 
+    /* Create the publisher for the scan queue, partitioned if requested */
+    MsgPublisher auto mq_publisher = args.scan_partitions.empty() ?
                 ms.create_queue_publisher(std::string_view(args.scan_stream), 
                                           std::string_view(args.scan_consumer), 
-                                          std::string_view(args.scan_subject));
+                                          std::string_view(args.scan_subject)) :
+                ms.create_queue_publisher(std::string_view(args.scan_stream), 
+                                          std::string_view(args.scan_consumer), 
+                                          std::string_view(args.scan_subject),
+                                          std::string_view(args.scan_partitions),
+                                          std::string_view(args.scan_partition_by));
+
+    /* Spool per agent so agents sharing a host don't share a spool */
+    if(not args.spool_directory.empty()) {
+
+        auto spool_directory = std::filesystem::path(args.spool_directory) / args.id / args.scan_stream;
+
+        std::clog << "Spool directory: " << spool_directory << std::endl;
+
+        mq_publisher.enable_spool(spool_directory.string(), args.spool_segment_size);
+    }
 
     /* Create the agent */
-    scan_agent agent = create_scan_agent<scan_agents::LFS_FIND>(
-                                    mq_publisher, 
-                                    std::string_view(args.directory),
-                                    args.scan_interval);
+    scan_agent agent = args.sample ? 
+        create_scan_agent<scan_agents::LFS_SAMPLE>(mq_publisher, 
+                                                   std::string_view(args.directory),
+                                                   args.scan_interval,
+                                                   args.sampling) :
+                       args.changes ?
+        create_scan_agent<scan_agents::LFS_FIND>(mq_publisher, 
+                                                 std::string_view(args.directory),
+                                                 args.scan_interval,
+                                                 args.change_filter) :
+        create_scan_agent<scan_agents::LFS_FIND>(mq_publisher, 
+                                                 std::string_view(args.directory),
+                                                 args.scan_interval);
 
     /* Run the agent */
     agent.run();
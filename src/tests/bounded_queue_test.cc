@@ -0,0 +1,126 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <atomic>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+#include "../common/bounded_queue.h"
+
+
+void test_fifo() {
+
+    bounded_queue<std::string> queue(3);
+
+    /* Rounded up to a power of two */
+    assert(queue.capacity() == 4);
+
+    for(int i = 0; i < 4; ++i) {
+        std::string value = std::to_string(i);
+        assert(queue.try_push(value));
+    }
+
+    std::string extra = "extra";
+    assert(not queue.try_push(extra));
+    assert(extra == "extra");
+    assert(queue.size() == 4);
+
+    std::string value;
+
+    for(int i = 0; i < 4; ++i) {
+        assert(queue.try_pop(value));
+        assert(value == std::to_string(i));
+    }
+
+    assert(not queue.try_pop(value));
+    assert(queue.size() == 0);
+}
+
+
+void test_stop() {
+
+    bounded_queue<int> queue(1);
+    std::stop_source stop;
+
+    assert(queue.capacity() == 2);
+    assert(queue.push(1, stop.get_token()));
+    assert(queue.push(2, stop.get_token()));
+
+    std::jthread stopper([&stop] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        stop.request_stop();
+    });
+
+    /* Full, so this waits until stopped */
+    assert(not queue.push(3, stop.get_token()));
+
+    int value;
+    assert(queue.try_pop(value) and value == 1);
+    assert(queue.try_pop(value) and value == 2);
+    assert(not queue.pop(value, stop.get_token()));
+}
+
+
+/* Every element pushed by the producers is popped exactly once */
+void test_mpmc() {
+
+    constexpr int producers = 4;
+    constexpr int consumers = 4;
+    constexpr int per_producer = 50000;
+
+    bounded_queue<int> queue(64);
+    std::vector<std::atomic<int>> seen(producers * per_producer);
+    std::atomic<int> popped{0};
+
+    {
+        std::vector<std::jthread> threads;
+
+        for(int p = 0; p < producers; ++p) {
+            threads.emplace_back([&queue, p] {
+                for(int i = 0; i < per_producer; ++i) {
+                    assert(queue.push(p * per_producer + i));
+                }
+            });
+        }
+
+        for(int c = 0; c < consumers; ++c) {
+            threads.emplace_back([&] {
+                int value;
+                while(popped.load() < producers * per_producer) {
+                    if(queue.try_pop(value)) {
+                        seen[value].fetch_add(1);
+                        popped.fetch_add(1);
+                    }
+                }
+            });
+        }
+    }
+
+    for(const auto &count : seen) {
+        assert(count.load() == 1);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_fifo();
+    test_stop();
+    test_mpmc();
+
+    std::clog << "bounded queue tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,307 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include <unistd.h>
+
+#include "../scan_agents/details/change_filter.h"
+#include "../policy_engine/details/policy_simulator.h"
+
+
+static const auto now = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+
+static std::string make_fid(int i) {
+    return (i % 2 ? "[0x200000403:0x" : "0x200000403:0x") + std::to_string(i + 1) + ":0x0" + (i % 2 ? "]" : "");
+}
+
+
+static scan_message make_file(int i) {
+
+    scan_message msg;
+
+    msg.type = 'f';
+    msg.atime = now - std::chrono::hours(24 * (i % 100));
+    msg.mtime = msg.atime;
+    msg.size = static_cast<std::uint64_t>(i) * 1024;
+    msg.filesys = "lustre";
+    msg.ost_pool = "scratch";
+    msg.fid = make_fid(i);
+    msg.path = "/lustre/scratch/f" + std::to_string(i);
+
+    return msg;
+}
+
+
+/* Runs one scan of files through filter, returning the records sent and
+ * collecting the deletions */
+static std::vector<scan_message> scan(change_filter &filter, const std::vector<scan_message> &files,
+                                      std::vector<scan_message> *deletions = nullptr) {
+
+    std::vector<scan_message> sent;
+
+    filter.begin_scan();
+
+    for(const auto &msg : files) {
+        if(filter.admit(msg)) {
+            sent.push_back(msg);
+        }
+    }
+
+    filter.sweep([&](const scan_message &msg) {
+
+        assert(msg.deleted and msg.filesys == "lustre");
+
+        if(deletions) {
+            deletions->push_back(msg);
+        }
+
+        return true;
+    });
+
+    return sent;
+}
+
+
+void test_changes() {
+
+    change_filter filter(0);
+    std::vector<scan_message> files;
+
+    for(int i = 0; i < 10000; ++i) {
+        files.push_back(make_file(i));
+    }
+
+    /* Everything is new, then nothing changed */
+    assert(scan(filter, files).size() == files.size());
+    assert(filter.size() == files.size());
+    assert(scan(filter, files).empty());
+
+    /* Touched, moved and restriped files are sent */
+    files[1].atime += std::chrono::seconds(1);
+    files[2].path = "/lustre/scratch/renamed";
+    files[3].stripe_count = 4;
+    files[4].ost_pool = "capacity";
+
+    auto sent = scan(filter, files);
+    assert(sent.size() == 4 and sent[0].fid == files[1].fid and sent[3].fid == files[4].fid);
+
+    /* Files the scan no longer finds are deleted with their FID as printed */
+    std::vector<scan_message> deletions;
+    std::set<std::string> removed = { files[5].fid, files[6].fid };
+
+    files.erase(files.begin() + 5, files.begin() + 7);
+
+    assert(scan(filter, files, &deletions).empty());
+    assert(deletions.size() == 2 and filter.size() == files.size());
+
+    for(const auto &msg : deletions) {
+        assert(removed.contains(msg.fid) and msg.type == 'f');
+    }
+
+    /* Records without a FID can't be tracked so they are always sent */
+    auto unknown = make_file(20000);
+    unknown.fid.clear();
+
+    files.push_back(unknown);
+    assert(scan(filter, files).size() == 1);
+    assert(scan(filter, files).size() == 1);
+}
+
+
+void test_refresh_and_retry() {
+
+    change_filter filter(10);
+    std::vector<scan_message> files;
+
+    for(int i = 0; i < 10000; ++i) {
+        files.push_back(make_file(i));
+    }
+
+    scan(filter, files);
+
+    /* Over refresh_scans scans every unchanged record is sent once */
+    std::set<std::string> refreshed;
+    std::size_t total = 0;
+
+    for(int s = 0; s < 10; ++s) {
+
+        auto sent = scan(filter, files);
+        total += sent.size();
+
+        assert(sent.size() > 800 and sent.size() < 1200);
+
+        for(const auto &msg : sent) {
+            refreshed.insert(msg.fid);
+        }
+    }
+
+    assert(total == files.size() and refreshed.size() == files.size());
+
+    /* A record that couldn't be sent is sent by the next scan */
+    change_filter quiet(0);
+
+    scan(quiet, files);
+
+    quiet.begin_scan();
+
+    for(const auto &msg : files) {
+        if(quiet.admit(msg)) {
+            assert(false);
+        }
+    }
+
+    quiet.invalidate(files[42]);
+
+    /* A deletion that couldn't be sent is retried by the next sweep */
+    auto gone = files.back();
+    files.pop_back();
+
+    assert(quiet.sweep([](const scan_message &) { return true; }) == 0);
+
+    quiet.begin_scan();
+
+    for(const auto &msg : files) {
+        if(quiet.admit(msg)) {
+            assert(msg.fid == files[42].fid);
+        }
+    }
+
+    assert(quiet.sweep([](const scan_message &) { return false; }) == 0);
+
+    std::vector<scan_message> deletions;
+    assert(scan(quiet, files, &deletions).empty());
+    assert(deletions.size() == 1 and deletions[0].fid == gone.fid);
+}
+
+
+void test_steady_state() {
+
+    change_filter filter;
+    std::vector<scan_message> files;
+
+    for(int i = 0; i < 100000; ++i) {
+        files.push_back(make_file(i));
+    }
+
+    scan(filter, files);
+
+    /* 1% of the files change between scans */
+    for(int s = 0; s < 5; ++s) {
+
+        for(std::size_t i = s; i < files.size(); i += 100) {
+            files[i].atime += std::chrono::hours(1);
+        }
+
+        auto sent = scan(filter, files);
+
+        /* An order of magnitude less than a full scan */
+        assert(sent.size() * 8 < files.size());
+    }
+}
+
+
+void test_persistence() {
+
+    auto path = std::filesystem::temp_directory_path() /
+                ("change_filter_test." + std::to_string(getpid()));
+
+    std::vector<scan_message> files;
+
+    for(int i = 0; i < 100000; ++i) {
+        files.push_back(make_file(i));
+    }
+
+    {
+        change_filter filter(0);
+
+        assert(not filter.load(path));
+
+        scan(filter, files);
+        filter.save(path);
+    }
+
+    change_filter restarted(0);
+
+    assert(restarted.load(path) and restarted.size() == files.size());
+    assert(scan(restarted, files).empty());
+
+    /* A deletion found after the restart has the saved filesystem */
+    std::vector<scan_message> deletions;
+    files.pop_back();
+
+    scan(restarted, files, &deletions);
+    assert(deletions.size() == 1 and deletions[0].fid == make_fid(99999));
+
+    /* A damaged file is refused */
+    {
+        std::fstream damage(path, std::ios::in | std::ios::out | std::ios::binary);
+        damage.seekp(1000);
+        damage.put('\xff');
+    }
+
+    try {
+        change_filter(0).load(path);
+        assert(false);
+    } catch(const std::runtime_error &e) {
+    }
+
+    std::filesystem::remove(path);
+}
+
+
+void test_simulation() {
+
+    std::vector<scan_message> records = { make_file(1), make_file(2) };
+
+    auto deletion = make_file(1);
+    deletion.deleted = true;
+    records.push_back(deletion);
+
+    auto policy = compile_policy({ { "all-files", "type == 'f'", "purge" } });
+
+    policy_simulator simulator(policy, { .now = now });
+    simulator.evaluate(records);
+    simulator.finish();
+
+    /* A deletion is neither decided nor unmatched */
+    const auto &report = simulator.report();
+
+    assert(report.deletions == 1 and report.unmatched == 0 and report.rules[0].files == 2);
+
+    std::ostringstream out;
+    out << report;
+
+    assert(out.str().find("1 of the records were deletions") != std::string::npos);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_changes();
+    test_refresh_and_retry();
+    test_steady_state();
+    test_persistence();
+    test_simulation();
+
+    std::clog << "change filter tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+#include "../policy_engine/details/decision_cache.h"
+
+
+static const auto start = std::chrono::steady_clock::time_point(std::chrono::hours(1));
+
+
+static scan_message make_file(int id) {
+
+    scan_message msg;
+
+    msg.type = 'f';
+    msg.mtime = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+    msg.atime = msg.mtime;
+    msg.size = 4096;
+    msg.ost_pool = "performance";
+    msg.filesys = "lustre";
+    msg.fid = std::to_string(id);
+    msg.path = "/lustre/f" + msg.fid;
+
+    return msg;
+}
+
+
+/* The same decision for an unchanged file is only sent once */
+void test_repeats() {
+
+    decision_cache cache(100, std::chrono::hours(1));
+    auto msg = make_file(1);
+
+    assert(cache.admit("lustre:1", msg, policy_action::PURGE, "old", start));
+    assert(not cache.admit("lustre:1", msg, policy_action::PURGE, "old", start));
+    assert(not cache.admit("lustre:1", msg, policy_action::PURGE, "old", start + std::chrono::minutes(59)));
+    assert(cache.suppressed() == 2 and cache.size() == 1);
+
+    /* Another file */
+    assert(cache.admit("lustre:2", make_file(2), policy_action::PURGE, "old", start));
+    assert(cache.size() == 2);
+}
+
+
+/* A change of the file or of the decision is sent again */
+void test_changes() {
+
+    decision_cache cache(100, std::chrono::hours(1));
+    auto msg = make_file(1);
+
+    assert(cache.admit("lustre:1", msg, policy_action::MIGRATE, "cold", start));
+
+    msg.size += 1;
+    assert(cache.admit("lustre:1", msg, policy_action::MIGRATE, "cold", start));
+
+    msg.mtime += std::chrono::seconds(10);
+    assert(cache.admit("lustre:1", msg, policy_action::MIGRATE, "cold", start));
+
+    /* Migrated away and back */
+    msg.ost_pool = "capacity";
+    assert(cache.admit("lustre:1", msg, policy_action::MIGRATE, "cold", start));
+
+    assert(cache.admit("lustre:1", msg, policy_action::MIGRATE, "colder", start));
+    assert(cache.admit("lustre:1", msg, policy_action::PURGE, "colder", start));
+    assert(not cache.admit("lustre:1", msg, policy_action::PURGE, "colder", start));
+
+    assert(cache.size() == 1);
+}
+
+
+/* Entries expire and can be forgotten */
+void test_expiry_and_erase() {
+
+    decision_cache cache(100, std::chrono::hours(1));
+    auto msg = make_file(1);
+
+    assert(cache.admit("lustre:1", msg, policy_action::PURGE, "old", start));
+    assert(cache.admit("lustre:1", msg, policy_action::PURGE, "old", start + std::chrono::hours(1)));
+    assert(not cache.admit("lustre:1", msg, policy_action::PURGE, "old", start + std::chrono::hours(1)));
+
+    cache.erase("lustre:1");
+    cache.erase("lustre:missing");
+    assert(cache.size() == 0);
+    assert(cache.admit("lustre:1", msg, policy_action::PURGE, "old", start));
+}
+
+
+/* The least recently used files are dropped beyond the capacity */
+void test_capacity() {
+
+    decision_cache cache(10, std::chrono::hours(1), 1);
+
+    for(int i = 0; i < 10; ++i) {
+        assert(cache.admit("lustre:" + std::to_string(i), make_file(i), policy_action::PURGE, "old", start));
+    }
+
+    /* Keeps file 0 in use */
+    assert(not cache.admit("lustre:0", make_file(0), policy_action::PURGE, "old", start));
+    assert(cache.admit("lustre:10", make_file(10), policy_action::PURGE, "old", start));
+
+    assert(cache.size() == 10);
+    assert(not cache.admit("lustre:0", make_file(0), policy_action::PURGE, "old", start));
+    assert(cache.admit("lustre:1", make_file(1), policy_action::PURGE, "old", start));
+
+    /* Many shards still hold no more than the capacity rounded up */
+    decision_cache sharded(100, std::chrono::hours(1), 8);
+
+    for(int i = 0; i < 10000; ++i) {
+        sharded.admit("lustre:" + std::to_string(i), make_file(i), policy_action::PURGE, "old", start);
+    }
+
+    assert(sharded.size() <= 104);
+
+    bool rejected = false;
+
+    try {
+        decision_cache empty(0, std::chrono::hours(1));
+    } catch(const std::invalid_argument &) {
+        rejected = true;
+    }
+
+    assert(rejected);
+}
+
+
+/* Each file is admitted once however many threads see it */
+void test_threads() {
+
+    decision_cache cache(100000, std::chrono::hours(1));
+    std::atomic<int> admitted{0};
+    std::vector<std::thread> threads;
+
+    for(int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for(int i = 0; i < 5000; ++i) {
+                admitted += cache.admit("lustre:" + std::to_string(i), make_file(i), 
+                                        policy_action::PURGE, "old", start);
+            }
+        });
+    }
+
+    for(auto &thread : threads) {
+        thread.join();
+    }
+
+    assert(admitted == 5000 and cache.suppressed() == 15000);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_repeats();
+    test_changes();
+    test_expiry_and_erase();
+    test_capacity();
+    test_threads();
+
+    std::clog << "decision cache tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
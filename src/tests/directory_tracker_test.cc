@@ -0,0 +1,314 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+#include "../policy_engine/details/directory_tracker.h"
+#include "../policy_engine/details/policy_simulator.h"
+
+
+using namespace std::chrono_literals;
+
+static const auto now = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+
+static scan_message make_file(std::string path, std::chrono::seconds age, std::uint64_t size = 1024) {
+
+    scan_message msg;
+
+    msg.type = 'f';
+    msg.atime = now - age;
+    msg.mtime = msg.atime;
+    msg.size = size;
+    msg.filesys = "lustre";
+    msg.path = std::move(path);
+
+    return msg;
+}
+
+
+static compiled_policy runs_policy(std::string depth = "5", std::string idle = "7d") {
+
+    return compile_policy({
+        { "idle-runs", "path startswith '/lustre/proj/'", "migrate",
+          { { "directory", depth }, { "idle", idle }, { "settle", "10m" }, { "max_directories", "1000" } } }
+    });
+}
+
+
+void test_directory_of() {
+
+    assert(directory_tracker::directory_of("/lustre/proj/abc/runs/run42/out/x", 5) == "/lustre/proj/abc/runs/run42");
+    assert(directory_tracker::directory_of("/lustre/proj/abc/runs/run42/x", 5) == "/lustre/proj/abc/runs/run42");
+    assert(directory_tracker::directory_of("/lustre/proj/abc/runs/run42", 5).empty());
+    assert(directory_tracker::directory_of("/lustre/proj/abc", 5).empty());
+    assert(directory_tracker::directory_of("//lustre//proj/x", 2) == "//lustre//proj");
+    assert(directory_tracker::directory_of("/lustre/proj/x", 0) == "/lustre/proj");
+    assert(directory_tracker::directory_of("/x", 0).empty());
+    assert(directory_tracker::directory_of("x", 0).empty());
+}
+
+
+void test_settings() {
+
+    auto policy = runs_policy();
+    const auto &settings = *policy.rules()[0].directory;
+
+    assert(settings.depth == 5 and settings.idle == std::chrono::days(7) and 
+           settings.settle == 10min and settings.max_directories == 1000);
+    assert(not policy.rules()[0].watermark);
+    assert(runs_policy("parent").rules()[0].directory->depth == 0);
+
+    for(const auto &parameters : std::vector<std::map<std::string, std::string>> {
+            { { "directory", "0" } }, { { "directory", "x" } }, { { "directory", "2" }, { "idle", "3y" } },
+            { { "directory", "2" }, { "capacity", "1T" } }, { { "directory", "2" }, { "max_directories", "0" } } }) {
+
+        try {
+            compile_policy({ { "bad", "uid == 1", "migrate", parameters } });
+            assert(false);
+        } catch(const std::invalid_argument &e) {
+        }
+    }
+
+    try {
+        compile_policy({ { "bad", "uid == 1", "skip", { { "directory", "2" } } } });
+        assert(false);
+    } catch(const std::invalid_argument &e) {
+    }
+}
+
+
+/* A directory is decided once settled and idle, and once only */
+void test_due() {
+
+    auto policy = runs_policy();
+    directory_tracker tracker(policy);
+
+    tracker.record(make_file("/lustre/proj/a/runs/r1/x", 8 * 24h, 100), 0, now);
+    tracker.record(make_file("/lustre/proj/a/runs/r1/sub/y", 9 * 24h, 200), 0, now);
+    tracker.record(make_file("/lustre/proj/a/runs/r2/x", 2 * 24h), 0, now);
+    tracker.record(make_file("/lustre/proj/a/runs", 30 * 24h), 0, now);
+
+    assert(tracker.size() == 2);
+
+    /* Not settled yet */
+    assert(tracker.due(now + 5min).empty());
+
+    auto due = tracker.due(now + 11min);
+
+    assert(due.size() == 1);
+    assert(due[0].path == "/lustre/proj/a/runs/r1" and due[0].filesys == "lustre");
+    assert(due[0].files == 2 and due[0].bytes == 300 and due[0].atime == now - 8 * 24h);
+
+    assert(tracker.due(now + 1h).empty());
+
+    /* r2 becomes idle with time */
+    due = tracker.due(now + 5 * 24h + 1s);
+    assert(due.size() == 1 and due[0].path == "/lustre/proj/a/runs/r2");
+
+    /* The next scan finds r1 unchanged, then a file of it accessed */
+    auto later = now + 7 * 24h;
+
+    tracker.record(make_file("/lustre/proj/a/runs/r1/x", 15 * 24h, 100), 0, later);
+    assert(tracker.due(later + 1h).empty());
+
+    auto accessed = make_file("/lustre/proj/a/runs/r1/sub/y", 0s, 200);
+    accessed.atime = later + 1h;
+
+    tracker.record(accessed, 0, later + 2h);
+    assert(tracker.due(later + 3h).empty());
+
+    due = tracker.due(later + 1h + 7 * 24h);
+    assert(due.size() == 1 and due[0].path == "/lustre/proj/a/runs/r1");
+
+    /* Counts start over with each pass */
+    assert(due[0].files == 1 and due[0].bytes == 200);
+}
+
+
+/* Anything below a directory the rule didn't decide keeps it from being
+ * decided that pass, the agents act on the whole tree */
+void test_ineligible() {
+
+    auto policy = runs_policy();
+    directory_tracker tracker(policy);
+
+    /* Exempted or decided by an earlier rule, or not matched */
+    tracker.record(make_file("/lustre/proj/a/runs/r1/x", 8 * 24h), 0, now);
+    tracker.record(make_file("/lustre/proj/a/runs/r1/sub/keep", 8 * 24h), std::nullopt, now);
+    tracker.record(make_file("/lustre/proj/a/runs/r2/x", 8 * 24h), 0, now);
+    tracker.record(make_file("/lustre/proj/a/runs/r2/y", 8 * 24h), 1, now);
+    tracker.record(make_file("/lustre/proj/a/runs/r3/x", 8 * 24h), 0, now);
+
+    /* Subdirectories are below the directory at a depth, their files count */
+    auto sub = make_file("/lustre/proj/a/runs/r3/sub", 8 * 24h);
+    sub.type = 'd';
+    tracker.record(sub, std::nullopt, now);
+
+    auto due = tracker.due(now + 11min);
+    assert(due.size() == 1 and due[0].path == "/lustre/proj/a/runs/r3" and due[0].files == 1);
+
+    /* The next pass starts over */
+    auto later = now + 24h;
+
+    tracker.record(make_file("/lustre/proj/a/runs/r1/x", 8 * 24h), 0, later);
+    tracker.record(make_file("/lustre/proj/a/runs/r1/sub/keep", 8 * 24h), 0, later);
+
+    due = tracker.due(later + 11min);
+    assert(due.size() == 1 and due[0].path == "/lustre/proj/a/runs/r1" and due[0].files == 2);
+
+    /* Deciding each file's parent, a subdirectory's files are its own */
+    auto parents = compile_policy({
+        { "dirs", "type == 'f'", "purge", { { "directory", "parent" }, { "idle", "7d" } } }
+    });
+
+    directory_tracker by_parent(parents);
+
+    auto d = make_file("/lustre/d/sub", 8 * 24h);
+    d.type = 'd';
+
+    by_parent.record(make_file("/lustre/d/f", 8 * 24h), 0, now);
+    by_parent.record(d, std::nullopt, now);
+    by_parent.record(make_file("/lustre/d/sub/g", 8 * 24h), 0, now);
+    by_parent.record(make_file("/lustre/e/f", 8 * 24h), 0, now);
+
+    due = by_parent.due(now + 1h);
+    assert(due.size() == 2);
+
+    for(const auto &directory : due) {
+        assert(directory.path == "/lustre/d/sub" or directory.path == "/lustre/e");
+    }
+}
+
+
+/* Memory stays bounded, the least recently seen directories go first */
+void test_bounded() {
+
+    auto policy = compile_policy({
+        { "dirs", "type == 'f'", "purge", { { "directory", "parent" }, { "max_directories", "64" } } }
+    });
+
+    directory_tracker tracker(policy);
+
+    for(int i = 0; i < 10000; ++i) {
+        tracker.record(make_file("/lustre/d" + std::to_string(i) + "/f", 10 * 24h), 0, now);
+    }
+
+    assert(tracker.size() <= 64 + 16);
+    assert(tracker.evicted() == 10000 - tracker.size());
+    assert(tracker.due(now + 1h).size() == tracker.size());
+}
+
+
+void test_threads() {
+
+    auto policy = runs_policy("3", "0s");
+    directory_tracker tracker(policy);
+
+    std::vector<std::jthread> threads;
+
+    for(int t = 0; t < 4; ++t) {
+        threads.emplace_back([&tracker, t] {
+            for(int i = 0; i < 2000; ++i) {
+                tracker.record(make_file("/lustre/proj/d" + std::to_string(i % 100) + "/f" + 
+                                         std::to_string(t), 24h), 0, now);
+            }
+        });
+    }
+
+    threads.clear();
+
+    std::int64_t files = 0;
+
+    for(const auto &directory : tracker.due(now + 1h)) {
+        files += directory.files;
+    }
+
+    assert(files == 8000);
+}
+
+
+/* The simulator decides the directories at the end of the replay */
+void test_simulator() {
+
+    simulation_options options;
+    options.now = now;
+
+    std::vector<std::string> decided;
+
+    policy_simulator simulator(runs_policy(), options, 
+        [&decided](const compiled_policy::rule &rule, std::string_view path, std::int64_t size) {
+            decided.emplace_back(path);
+        });
+
+    std::vector<scan_message> records = {
+        make_file("/lustre/proj/a/runs/r1/x", 8 * 24h, 100),
+        make_file("/lustre/proj/a/runs/r1/y", 8 * 24h, 100),
+        make_file("/lustre/proj/a/runs/r2/x", 1 * 24h, 100),
+        make_file("/lustre/scratch/z", 100 * 24h, 100)
+    };
+
+    simulator.evaluate(records);
+    assert(decided.empty());
+
+    simulator.finish();
+
+    assert(decided == std::vector<std::string> { "/lustre/proj/a/runs/r1" });
+
+    const auto &totals = simulator.report().rules[0];
+    assert(totals.directories == 1 and totals.files == 2 and totals.bytes == 200);
+
+    std::clog << simulator.report();
+
+    /* A file exempted by an earlier rule keeps its directory */
+    std::vector<std::string> kept;
+
+    policy_simulator exempting(compile_policy({
+            { "keep", "path matches '**.keep'", "skip" },
+            { "idle-runs", "path startswith '/lustre/proj/'", "migrate",
+              { { "directory", "5" }, { "idle", "7d" }, { "settle", "10m" } } }
+        }), options,
+        [&kept](const compiled_policy::rule &rule, std::string_view path, std::int64_t size) {
+            if(rule.directory) {
+                kept.emplace_back(path);
+            }
+        });
+
+    records.push_back(make_file("/lustre/proj/a/runs/r1/results.keep", 8 * 24h, 100));
+
+    exempting.evaluate(records);
+    exempting.finish();
+
+    assert(kept.empty());
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_directory_of();
+    test_settings();
+    test_due();
+    test_ineligible();
+    test_bounded();
+    test_threads();
+    test_simulator();
+
+    std::clog << "directory tracker tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
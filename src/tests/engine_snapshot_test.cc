@@ -0,0 +1,258 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+#include <cassert>
+
+#include "../policy_engine/details/decision_cache.h"
+#include "../policy_engine/details/directory_tracker.h"
+#include "../policy_engine/details/engine_snapshot.h"
+#include "../policy_engine/details/usage_store.h"
+
+
+using namespace std::chrono_literals;
+
+static const auto now = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+
+static std::filesystem::path snapshot_file() {
+    return std::filesystem::temp_directory_path() /
+           ("engine_snapshot_test_" + std::to_string(getpid()) + ".snap");
+}
+
+
+static scan_message make_file(std::string path, std::uint64_t size, std::uint32_t uid,
+                              std::string pool) {
+
+    scan_message msg;
+
+    msg.type = 'f';
+    msg.atime = now - 10 * 24h;
+    msg.mtime = msg.atime;
+    msg.size = size;
+    msg.uid = uid;
+    msg.gid = uid + 100;
+    msg.ost_pool = std::move(pool);
+    msg.filesys = "lustre";
+    msg.fid = "0x200000403:0x" + std::to_string(size) + ":0x0";
+    msg.path = std::move(path);
+
+    return msg;
+}
+
+
+void test_file() {
+
+    auto path = snapshot_file();
+
+    snapshot_writer a, b;
+
+    a.put(std::uint64_t(42));
+    a.put_string("hello");
+    b.put_string("");
+
+    write_snapshot(path, 1234, now, { { "a", a.data() }, { "b", b.data() }, { "empty", "" } });
+
+    assert(not std::filesystem::exists(path.string() + ".tmp"));
+
+    {
+        mapped_snapshot snapshot(path);
+
+        assert(snapshot.sequence() == 1234);
+        assert(snapshot.taken() == now);
+        assert(snapshot.section("empty").empty());
+        assert(snapshot.section("missing").empty());
+
+        snapshot_reader in(snapshot.section("a"));
+
+        assert(in.get<std::uint64_t>() == 42);
+        assert(in.get_string() == "hello");
+        assert(in.empty());
+
+        bool threw = false;
+
+        try {
+            in.get<std::uint32_t>();
+        } catch(const std::runtime_error &) {
+            threw = true;
+        }
+
+        assert(threw);
+    }
+
+    /* A flipped byte in a section is caught by the checksum */
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-1, std::ios::end);
+        file.put('x');
+    }
+
+    bool threw = false;
+
+    try {
+        mapped_snapshot snapshot(path);
+    } catch(const std::runtime_error &e) {
+        threw = true;
+    }
+
+    assert(threw);
+
+    std::filesystem::remove(path);
+
+    threw = false;
+
+    try {
+        mapped_snapshot snapshot(path);
+    } catch(const std::system_error &e) {
+        threw = true;
+    }
+
+    assert(threw);
+}
+
+
+void test_usage() {
+
+    usage_store usage(8);
+
+    std::vector<scan_message> files = {
+        make_file("/lustre/a", 100, 1, "capacity"),
+        make_file("/lustre/b", 200, 1, "performance"),
+        make_file("/lustre/c", 400, 2, "capacity")
+    };
+
+    for(const auto &msg : files) {
+        usage.record(msg);
+    }
+
+    snapshot_writer out;
+    usage.save(out);
+
+    /* Different shards, and a name interned in another order */
+    usage_store restored(3);
+    restored.record(make_file("/lustre/d", 800, 3, "performance"));
+
+    snapshot_reader in(out.data());
+    restored.load(in);
+
+    assert(restored.files() == 4);
+    assert(restored.pool_bytes("lustre", "capacity") == 500);
+    assert(restored.pool_bytes("lustre", "performance") == 1000);
+
+    auto totals = restored.totals(files[0]);
+
+    assert(totals.uid_bytes == 300 and totals.uid_files == 2);
+    assert(totals.gid_bytes == 300 and totals.pool_bytes == 500);
+
+    /* A file scanned again replaces what was restored */
+    restored.record(make_file("/lustre/c", 400, 2, "performance"));
+
+    assert(restored.files() == 4);
+    assert(restored.pool_bytes("lustre", "capacity") == 100);
+}
+
+
+void test_decisions() {
+
+    const auto steady_now = std::chrono::steady_clock::now();
+
+    decision_cache cache(100, 1h);
+
+    auto kept = make_file("/lustre/kept", 1, 1, "capacity");
+    auto expired = make_file("/lustre/expired", 2, 1, "capacity");
+
+    assert(cache.admit("kept", kept, policy_action::PURGE, "old"));
+    assert(cache.admit("expired", expired, policy_action::PURGE, "old", steady_now - 2h));
+
+    snapshot_writer out;
+    cache.save(out);
+
+    decision_cache restored(100, 1h, 4);
+
+    snapshot_reader in(out.data());
+    restored.load(in);
+
+    assert(restored.size() == 1);
+
+    /* Still suppressed, but not for another rule */
+    assert(not restored.admit("kept", kept, policy_action::PURGE, "old"));
+    assert(restored.admit("kept", kept, policy_action::PURGE, "other"));
+    assert(restored.admit("expired", expired, policy_action::PURGE, "old"));
+}
+
+
+static compiled_policy runs_policy(std::string name) {
+
+    return compile_policy({
+        { name, "path startswith '/lustre/proj/'", "migrate",
+          { { "directory", "4" }, { "idle", "7d" }, { "settle", "10m" }, { "max_directories", "1000" } } }
+    });
+}
+
+
+void test_directories() {
+
+    auto policy = runs_policy("idle-runs");
+    directory_tracker tracker(policy);
+
+    tracker.record(make_file("/lustre/proj/a/r1/x", 100, 1, ""), 0, now);
+    tracker.record(make_file("/lustre/proj/a/r1/y", 200, 1, ""), 0, now);
+    tracker.record(make_file("/lustre/proj/a/r2/x", 400, 1, ""), 0, now);
+
+    /* Decided before the snapshot so not again after it */
+    assert(tracker.due(now + 11min).size() == 2);
+    tracker.record(make_file("/lustre/proj/a/r3/x", 800, 1, ""), 0, now + 12min);
+
+    snapshot_writer out;
+    tracker.save(out);
+
+    directory_tracker restored(policy);
+    snapshot_reader in(out.data());
+    restored.load(in);
+
+    assert(restored.size() == 3);
+    assert(restored.due(now + 15min).empty());
+
+    auto due = restored.due(now + 30min);
+
+    assert(due.size() == 1);
+    assert(due[0].path == "/lustre/proj/a/r3" and due[0].filesys == "lustre");
+    assert(due[0].files == 1 and due[0].bytes == 800);
+
+    /* A renamed rule starts over */
+    auto renamed = runs_policy("runs");
+    directory_tracker other(renamed);
+    snapshot_reader again(out.data());
+    other.load(again);
+
+    assert(other.size() == 0);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_file();
+    test_usage();
+    test_decisions();
+    test_directories();
+
+    std::clog << "engine snapshot tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <cassert>
+
+#include <unistd.h>
+
+#include "../common/file_watcher.h"
+
+
+using namespace std::chrono_literals;
+
+
+static bool wait_for(const std::atomic<int> &counter, int value) {
+
+    for(int i = 0; i < 300 and counter.load() < value; ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+
+    return counter.load() >= value;
+}
+
+
+static void write_file(const std::filesystem::path &path, const std::string &content) {
+    std::ofstream(path) << content;
+}
+
+
+void test_changes() {
+
+    auto directory = std::filesystem::temp_directory_path() / 
+                     ("file_watcher_test." + std::to_string(getpid()));
+
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    auto config = directory / "config.yaml";
+    write_file(config, "a");
+
+    std::atomic<int> changes{0};
+
+    {
+        file_watcher watcher(config, [&changes] { changes.fetch_add(1); }, 50ms);
+
+        /* Rewritten in place */
+        write_file(config, "b");
+        assert(wait_for(changes, 1));
+
+        /* Several writes in a row are one change */
+        for(int i = 0; i < 5; ++i) {
+            write_file(config, std::to_string(i));
+        }
+
+        assert(wait_for(changes, 2));
+        std::this_thread::sleep_for(200ms);
+        assert(changes.load() == 2);
+
+        /* Replaced by a rename, as editors do */
+        write_file(directory / "config.yaml.tmp", "c");
+        std::filesystem::rename(directory / "config.yaml.tmp", config);
+        assert(wait_for(changes, 3));
+
+        /* Other files in the directory are ignored */
+        write_file(directory / "other", "d");
+        std::this_thread::sleep_for(200ms);
+        assert(changes.load() == 3);
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+
+/* A throwing callback doesn't stop the watcher */
+void test_callback_errors() {
+
+    auto directory = std::filesystem::temp_directory_path() / 
+                     ("file_watcher_test_errors." + std::to_string(getpid()));
+
+    std::filesystem::create_directories(directory);
+
+    std::atomic<int> calls{0};
+
+    {
+        file_watcher watcher(directory / "f", [&calls] { 
+            calls.fetch_add(1); 
+            throw std::runtime_error("bad config");
+        }, 20ms);
+
+        write_file(directory / "f", "1");
+        assert(wait_for(calls, 1));
+
+        write_file(directory / "f", "2");
+        assert(wait_for(calls, 2));
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+
+void test_missing_directory() {
+
+    try {
+        file_watcher watcher("/nonexistent/directory/config.yaml", [] {});
+        assert(false);
+    } catch(const std::system_error &) {}
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_changes();
+    test_callback_errors();
+    test_missing_directory();
+
+    std::clog << "file watcher tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
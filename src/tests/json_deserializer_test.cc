@@ -11,6 +11,7 @@
 
 
 #include <cstdlib>
+#include <cassert>
 #include <string>
 #include <iostream>
 #include <array>
@@ -21,7 +22,7 @@
 #include "../messaging/details/message_json_serializer_boost_impl.h"
 
 
-const std::array<std::string, 7> scan_messages = {
+const std::array<std::string, 9> scan_messages = {
     "{ \"type\": \"d\", \"path\": \"/lustre/ldev/rmohr\", \"atime\": 1642662012, \"mtime\": 1642661471, \"size\": 4096, \"uid\": 6598, \"gid\": 9294, \"format\": { \"filesys\": \"lustre\", \"ost_pool\": \"\", \"stripe_count\": 0, \"fid\": \"0x200000403:0x295:0x0\" }}",
     "{ \"type\": \"d\", \"path\": \"/lustre/ldev/rmohr/dir1/subdir1\", \"atime\": 1642662138, \"mtime\": 1642661593, \"size\": 4096, \"uid\": 6598, \"gid\": 9294, \"format\": { \"filesys\": \"lustre\", \"ost_pool\": \"\", \"stripe_count\": 0, \"fid\": \"0x280000403:0x21:0x0\" }}",
     "{ \"type\": \"d\", \"path\": \"/lustre/ldev/rmohr/dir1/subdir2\", \"atime\": 1642661656, \"mtime\": 1642661652, \"size\": 4096, \"uid\": 6598, \"gid\": 9294, \"format\": { \"filesys\": \"lustre\", \"ost_pool\": \"\", \"stripe_count\": 0, \"fid\": \"0x200000403:0x296:0x0\" }}",
@@ -29,6 +30,8 @@ const std::array<std::string, 7> scan_messages = {
     "{ \"type\": \"f\", \"path\": \"/lustre/ldev/rmohr/dir1/subdir2/checkpoint.2\", \"atime\": 1642661652, \"mtime\": 1642661687, \"size\": 3145728, \"uid\": 6598, \"gid\": 9294, \"format\": { \"filesys\": \"lustre\", \"ost_pool\": \"\", \"stripe_count\": 2, \"fid\": \"0x200000403:0x298:0x0\" }}",
     "{ \"type\": \"f\", \"path\": \"/lustre/ldev/rmohr/dir1/output.txt\", \"atime\": 1633093200, \"mtime\": 1633093200, \"size\": 54272, \"uid\": 6598, \"gid\": 9294, \"format\": { \"filesys\": \"lustre\", \"ost_pool\": \"\", \"stripe_count\": 3, \"fid\": \"0x240000403:0xc:0x0\" }}",
     "{ \"type\": \"f\", \"path\": \"/lustre/ldev/rmohr/dir1/input-data\", \"atime\": 1642661510, \"mtime\": 1592936581, \"size\": 10485760, \"uid\": 6598, \"gid\": 9294, \"format\": { \"filesys\": \"lustre\", \"ost_pool\": \"\", \"stripe_count\": 1, \"fid\": \"0x240000403:0xb:0x0\" }}",
+    "{ \"type\": \"f\", \"path\": \"\", \"atime\": 0, \"mtime\": 0, \"size\": 0, \"uid\": 0, \"gid\": 0, \"format\": { \"filesys\": \"lustre\", \"ost_pool\": \"\", \"stripe_count\": 0, \"fid\": \"0x240000403:0xe:0x0\" }, \"deleted\": true}",
+    "{ \"type\": \"f\", \"path\": \"/lustre/ldev/rmohr/dir1/sampled\", \"atime\": 1642661510, \"mtime\": 1592936581, \"size\": 1048576, \"uid\": 6598, \"gid\": 9294, \"format\": { \"filesys\": \"lustre\", \"ost_pool\": \"\", \"stripe_count\": 1, \"fid\": \"0x240000403:0xd:0x0\" }, \"sample\": { \"probe\": 3, \"weight\": 1.25000000000000000e+03 }}",
 };
 
 
@@ -43,7 +46,7 @@ const std::array<std::string, 7> recorder_messages = {
 };
 
 
-const std::array<std::string, 7> purge_messages = {
+const std::array<std::string, 8> purge_messages = {
     "{ \"path\": \"/lustre/ldev/rmohr\" }",
     "{ \"path\": \"/lustre/ldev/rmohr/dir1/subdir1\" }",
     "{ \"path\": \"/lustre/ldev/rmohr/dir1/subdir2\" }",
@@ -51,9 +54,10 @@ const std::array<std::string, 7> purge_messages = {
     "{ \"path\": \"/lustre/ldev/rmohr/dir1/subdir2/checkpoint.2\" }",
     "{ \"path\": \"/lustre/ldev/rmohr/dir1/output.txt\" }",
     "{ \"path\": \"/lustre/ldev/rmohr/dir1/input-data\" }",
+    "{ \"path\": \"/lustre/ldev/rmohr/dir1/input-data\", \"paths\": [\"/lustre/ldev/rmohr/dir1/output.txt\", \"/lustre/ldev/rmohr/dir1/subdir1\"] }",
 };
 
-const std::array<std::string, 7> migration_messages = {
+const std::array<std::string, 12> migration_messages = {
     "{ \"path\": \"/lustre/ldev/rmohr\" }",
     "{ \"path\": \"/lustre/ldev/rmohr/dir1/subdir1\" }",
     "{ \"path\": \"/lustre/ldev/rmohr/dir1/subdir2\" }",
@@ -61,6 +65,11 @@ const std::array<std::string, 7> migration_messages = {
     "{ \"path\": \"/lustre/ldev/rmohr/dir1/subdir2/checkpoint.2\" }",
     "{ \"path\": \"/lustre/ldev/rmohr/dir1/output.txt\" }",
     "{ \"path\": \"/lustre/ldev/rmohr/dir1/input-data\" }",
+    "{ \"path\": \"/lustre/ldev/rmohr/dir1/output.txt\", \"pool\": \"capacity\", \"stripe_count\": 2, \"osts\": [3, 17] }",
+    "{ \"path\": \"/lustre/ldev/rmohr/dir1/input-data\", \"pool\": \"archive\", \"stripe_count\": 4, \"osts\": [] }",
+    "{ \"path\": \"/lustre/ldev/rmohr/dir1\", \"pool\": \"capacity\", \"stripe_count\": 0, \"osts\": [] }",
+    "{ \"path\": \"/lustre/ldev/rmohr/dir1/input-data\", \"paths\": [\"/lustre/ldev/rmohr/dir1/output.txt\"] }",
+    "{ \"path\": \"/lustre/ldev/rmohr/dir1/input-data\", \"paths\": [\"/lustre/ldev/rmohr/dir1/output.txt\"], \"pool\": \"capacity\", \"stripe_count\": 1, \"osts\": [3] }",
 };
 
 
@@ -78,6 +87,18 @@ void test_scan_message() {
         assert(scan_record.compare(res1) == 0);
         assert(scan_record.compare(0, scan_record.length(), res2, 0, res2.length()-1) == 0);
     }
+
+    auto const &sampled = json_deserializer_impl<scan_message>()(scan_messages.back());
+
+    assert(sampled.sampled and sampled.probe == 3 and sampled.weight == 1250.0);
+
+    auto const &full = json_deserializer_impl<scan_message>()(scan_messages.front());
+
+    assert(not full.sampled and full.probe == 0 and full.weight == 1.0 and not full.deleted);
+
+    auto const &deleted = json_deserializer_impl<scan_message>()(scan_messages[7]);
+
+    assert(deleted.deleted and deleted.fid == "0x240000403:0xe:0x0" and deleted.path.empty());
 }
 
 void test_recorder_message() {
@@ -94,6 +115,11 @@ void test_recorder_message() {
         assert(recorder_record.compare(res1) == 0);
         assert(recorder_record.compare(0, recorder_record.length(), res2, 0, res2.length()-1) == 0);
     }
+
+    /* Recorders read the scan stream, deletions included */
+    auto const &deleted = json_deserializer_impl<recorder_message>()(scan_messages[7]);
+
+    assert(deleted.deleted and deleted.fid == "0x240000403:0xe:0x0");
 }
 
 void test_purge_message() {
@@ -110,6 +136,11 @@ void test_purge_message() {
         assert(purge_record.compare(res1) == 0);
         assert(purge_record.compare(0, purge_record.length(), res2, 0, res2.length()-1) == 0);
     }
+
+    auto const &msg = json_deserializer_impl<purge_message>()(purge_messages[7]);
+
+    assert(msg.path == "/lustre/ldev/rmohr/dir1/input-data" and msg.paths.size() == 2);
+    assert(msg.paths[1] == "/lustre/ldev/rmohr/dir1/subdir1");
 }
 
 void test_migration_message() {
@@ -126,6 +157,16 @@ void test_migration_message() {
         assert(migration_record.compare(res1) == 0);
         assert(migration_record.compare(0, migration_record.length(), res2, 0, res2.length()-1) == 0);
     }
+
+    auto const &msg = json_deserializer_impl<migration_message>()(migration_messages[7]);
+
+    assert(msg.pool == "capacity" and msg.stripe_count == 2);
+    assert(msg.osts.size() == 2 and msg.osts[0] == 3 and msg.osts[1] == 17);
+
+    auto const &batched = json_deserializer_impl<migration_message>()(migration_messages[11]);
+
+    assert(batched.paths.size() == 1 and batched.paths[0] == "/lustre/ldev/rmohr/dir1/output.txt");
+    assert(batched.pool == "capacity" and batched.osts.size() == 1);
 }
 
 int main(int argc, const char* argv[]) {
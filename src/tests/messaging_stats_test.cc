@@ -0,0 +1,110 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+#include "../messaging/details/messaging_stats.h"
+
+
+/* Every value maps into a bucket whose lower bound is within the 
+ * advertised error */
+void test_buckets() {
+
+    static_assert(latency_histogram::bucket_index(0) == 0);
+    static_assert(latency_histogram::bucket_index(63) == 63);
+    static_assert(latency_histogram::bucket_index(UINT64_MAX) == latency_histogram::num_buckets - 1);
+
+    std::size_t last_index = 0;
+
+    for(std::uint64_t v = 1; v < (1ULL << 40); v = v * 3 / 2 + 1) {
+
+        auto index = latency_histogram::bucket_index(v);
+        auto lower = latency_histogram::bucket_value(index);
+
+        assert(index >= last_index);
+        assert(lower <= v);
+        assert(v - lower <= v / 32);
+
+        last_index = index;
+    }
+}
+
+
+void test_quantiles() {
+
+    latency_histogram h;
+
+    for(std::uint64_t v = 1; v <= 10000; ++v) {
+        h.record(v * 1000);
+    }
+
+    auto snap = h.snapshot();
+
+    assert(snap.count == 10000);
+    assert(snap.max == 10000 * 1000);
+    assert(snap.mean() == 5000500);
+
+    auto p50 = snap.quantile(0.5);
+    auto p99 = snap.quantile(0.99);
+
+    assert(p50 > 5000000 * 0.96 and p50 <= 5000000);
+    assert(p99 > 9900000 * 0.96 and p99 <= 9900000);
+    assert(snap.quantile(1.0) <= snap.max);
+}
+
+
+/* Concurrent recording loses nothing */
+void test_concurrent() {
+
+    messaging_stats stats;
+
+    std::vector<std::jthread> threads;
+
+    for(int t = 0; t < 4; ++t) {
+        threads.emplace_back([&stats] {
+            for(int i = 0; i < 10000; ++i) {
+                stats.count_message(10);
+                stats.latency.record(std::uint64_t(i));
+            }
+        });
+    }
+
+    threads.clear();
+
+    auto snap = stats.snapshot();
+
+    assert(snap.messages == 40000);
+    assert(snap.bytes == 400000);
+    assert(snap.latency.count == 40000);
+    assert(snap.latency.max == 9999);
+
+    std::ostringstream os;
+    os << snap;
+
+    assert(os.str().find("messages=40000") != std::string::npos);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_buckets();
+    test_quantiles();
+    test_concurrent();
+
+    std::clog << "messaging_stats tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,227 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include "../policy_engine/details/namespace_sketches.h"
+#include "../policy_engine/details/policy_compiler.h"
+
+
+using namespace std::chrono_literals;
+
+static const auto now = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+
+static scan_message make_file(std::string path, std::uint64_t size, std::uint32_t uid,
+                              std::string pool, std::chrono::system_clock::duration age) {
+
+    scan_message msg;
+
+    msg.type = 'f';
+    msg.atime = now - age;
+    msg.mtime = msg.atime;
+    msg.size = size;
+    msg.uid = uid;
+    msg.gid = uid;
+    msg.ost_pool = std::move(pool);
+    msg.filesys = "lustre";
+    msg.path = std::move(path);
+
+    return msg;
+}
+
+
+void test_quantiles() {
+
+    std::vector<std::int64_t> values(100000);
+    std::iota(values.begin(), values.end(), 1);
+    std::shuffle(values.begin(), values.end(), std::mt19937_64(7));
+
+    quantile_sketch whole, first, second(200, 12345);
+
+    for(std::size_t i = 0; i < values.size(); ++i) {
+        whole.add(values[i]);
+        (i % 2 ? first : second).add(values[i]);
+    }
+
+    first.merge(second);
+
+    for(const auto *sketch : { &whole, &first }) {
+
+        assert(sketch->count() == values.size());
+        assert(sketch->quantile(0) == 1 and sketch->quantile(1) == 100000);
+
+        for(auto q : { 0.01, 0.25, 0.5, 0.9, 0.99 }) {
+            auto value = static_cast<double>(sketch->quantile(q));
+            assert(std::abs(value - q * 100000) < 2000);
+            assert(std::abs(sketch->rank(static_cast<std::int64_t>(q * 100000)) - q) < 0.02);
+        }
+    }
+
+    quantile_sketch empty;
+
+    assert(empty.empty() and empty.quantile(0.5) == 0 and empty.rank(10) == 0);
+}
+
+
+void test_heavy_hitters() {
+
+    heavy_hitters a(16), b(16);
+    std::mt19937_64 random(11);
+
+    for(int i = 0; i < 20000; ++i) {
+
+        auto &hitters = i % 2 ? a : b;
+
+        if(i % 5 < 2) {
+            hitters.add(1);
+        } else if(i % 5 == 2) {
+            hitters.add(2);
+        } else {
+            hitters.add(100 + random() % 10000);
+        }
+    }
+
+    a.merge(b);
+
+    auto top = a.top(2);
+
+    assert(top.size() == 2);
+    assert(top[0].key == 1 and top[0].count >= 8000 and top[0].count - top[0].error <= 8000);
+    assert(top[1].key == 2 and top[1].count >= 4000 and top[1].count - top[1].error <= 4000);
+
+    assert(heavy_hitters().top(5).empty());
+}
+
+
+void test_distinct() {
+
+    distinct_counter few, many, other;
+
+    for(int i = 0; i < 100; ++i) {
+        few.add("/lustre/dir" + std::to_string(i));
+        few.add("/lustre/dir" + std::to_string(i));
+    }
+
+    assert(std::abs(few.estimate() - 100) < 5);
+
+    for(int i = 0; i < 100000; ++i) {
+        (i < 60000 ? many : other).add("/lustre/proj/d" + std::to_string(i));
+    }
+
+    /* Overlapping parts merge into the union */
+    for(int i = 50000; i < 60000; ++i) {
+        other.add("/lustre/proj/d" + std::to_string(i));
+    }
+
+    many.merge(other);
+
+    assert(std::abs(many.estimate() - 100000) < 5000);
+    assert(distinct_counter().estimate() == 0);
+}
+
+
+void test_ranks() {
+
+    namespace_sketches sketches, worker;
+
+    /* Scratch files aged 1 to 1000 days and sized by their age, and a few
+     * on another pool */
+    for(int i = 1; i <= 1000; ++i) {
+
+        auto file = make_file("/lustre/scratch/u" + std::to_string(i % 10) + "/f" + std::to_string(i),
+                              static_cast<std::uint64_t>(i) * 1024, i % 3 == 0 ? 7 : i,
+                              "scratch", i * 24h);
+
+        (i % 2 ? sketches : worker).add(file);
+    }
+
+    for(int i = 0; i < 10; ++i) {
+        worker.add(make_file("/lustre/fast/f" + std::to_string(i), 1, 8, "fast", 1h));
+    }
+
+    sketches.merge(worker);
+
+    auto summary = sketches.summarize(now);
+
+    usage_totals totals;
+
+    summary.rank(make_file("/lustre/scratch/x", 1000 * 1024, 1, "scratch", 1000 * 24h), totals);
+    assert(totals.atime_age_rank == 100 and totals.size_rank == 100);
+
+    summary.rank(make_file("/lustre/scratch/x", 1024, 1, "scratch", 12h), totals);
+    assert(totals.atime_age_rank == 0 and totals.size_rank == 0);
+
+    summary.rank(make_file("/lustre/scratch/x", 500 * 1024, 1, "scratch", 950 * 24h), totals);
+    assert(std::abs(totals.atime_age_rank - 95) <= 1 and std::abs(totals.size_rank - 50) <= 1);
+
+    summary.rank(make_file("/lustre/unknown/x", 1024, 1, "unknown", 950 * 24h), totals);
+    assert(totals.atime_age_rank == 0 and totals.size_rank == 0);
+
+    std::ostringstream report;
+    report << summary;
+
+    /* Owner 7 has a third of the files, the counts of the rest are rough */
+    assert(report.str().find("lustre: 1010 files, ~11 directories, top owners 7 (") == 0);
+    assert(report.str().find("lustre/scratch: 1000 files") != std::string::npos);
+
+    /* Purge the oldest 5% of scratch */
+    auto policy = compile_policy({
+        { "oldest", "ost_pool == 'scratch' and atime_age_rank >= 95", "purge" }
+    });
+
+    assert(policy.uses_ranks() and not policy.uses_usage());
+
+    std::vector<scan_message> files;
+
+    for(int i = 1; i <= 1000; ++i) {
+        files.push_back(make_file("/lustre/scratch/f" + std::to_string(i), 1, 1, "scratch", i * 24h));
+    }
+
+    std::size_t purged = 0;
+
+    for(const auto &file : files) {
+
+        usage_totals totals;
+        summary.rank(file, totals);
+
+        purged += policy.evaluate(file, now, totals) != nullptr;
+    }
+
+    assert(purged >= 40 and purged <= 60);
+
+    /* Without the summary the ranks are 0 */
+    for(const auto &file : files) {
+        assert(policy.evaluate(file, now) == nullptr);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_quantiles();
+    test_heavy_hitters();
+    test_distinct();
+    test_ranks();
+
+    std::clog << "namespace sketches tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include "../messaging/details/partitioning.h"
+
+
+/* The hash is part of the wire contract between agents so pin it */
+static_assert(stable_hash("") == 0xcbf29ce484222325ULL);
+static_assert(stable_hash("a") == 0xaf63dc4c8601ec8cULL);
+
+
+void test_parent_directory() {
+
+    assert(parent_directory("/a/b/c") == "/a/b");
+    assert(parent_directory("/a") == "/");
+    assert(parent_directory("a").empty());
+}
+
+
+void test_partition_key() {
+
+    scan_message msg;
+
+    msg.path = "/lustre/dir/file.1";
+    msg.fid  = "0x200000403:0x297:0x0";
+
+    assert(partition_key(msg, partition_by::FID) == msg.fid);
+    assert(partition_key(msg, partition_by::PARENT_DIRECTORY) == "/lustre/dir");
+
+    /* Without a FID fall back to the parent directory */
+    msg.fid.clear();
+    assert(partition_key(msg, partition_by::FID) == "/lustre/dir");
+
+    /* Files in the same directory always land on the same partition */
+    scan_message other;
+    other.path = "/lustre/dir/file.2";
+
+    assert(stable_hash(partition_key(msg, partition_by::PARENT_DIRECTORY)) % 16 ==
+           stable_hash(partition_key(other, partition_by::PARENT_DIRECTORY)) % 16);
+}
+
+
+void test_parse() {
+
+    assert(parse_partition_by("fid") == partition_by::FID);
+    assert(parse_partition_by("parent") == partition_by::PARENT_DIRECTORY);
+
+    assert(parse_partition_range("0-3", 4) == std::make_pair(0u, 3u));
+    assert(parse_partition_range("2", 4) == std::make_pair(2u, 2u));
+
+    for(const char *bad : { "3-1", "0-4", "x", "1-", "" }) {
+
+        bool threw = false;
+
+        try {
+            parse_partition_range(bad, 4);
+
+        } catch(const std::invalid_argument &e) {
+            threw = true;
+        }
+
+        if(not threw) {
+            throw std::runtime_error(std::string("Failed to reject range: ") + bad);
+        }
+    }
+
+    assert(parse_partitions("4") == 4);
+    assert(full_partition_range("4") == "0-3");
+    assert(full_partition_range("1") == "0-0");
+
+    for(const char *bad : { "0", "-1", "x", "4x", "" }) {
+
+        bool threw = false;
+
+        try {
+            full_partition_range(bad);
+
+        } catch(const std::invalid_argument &e) {
+            threw = true;
+        }
+
+        if(not threw) {
+            throw std::runtime_error(std::string("Failed to reject partitions: ") + bad);
+        }
+    }
+
+    auto subjects = partition_subjects("scan.files.results", 3);
+
+    assert(subjects.size() == 3);
+    assert(subjects[2] == "scan.files.results.2");
+}
+
+
+int main(int argc, char *argv[]) {
+
+    try {
+
+        test_parent_directory();
+        test_partition_key();
+        test_parse();
+
+    } catch(const std::exception &e) {
+
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
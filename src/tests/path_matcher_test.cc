@@ -0,0 +1,196 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include <fnmatch.h>
+
+#include "../policy_engine/details/path_matcher.h"
+
+
+using syntax = path_matcher::syntax;
+
+
+static bool matches(std::string_view pattern, syntax type, std::string_view path) {
+
+    path_matcher matcher;
+    auto index = matcher.add(pattern, type);
+
+    matcher.compile();
+
+    return matcher.matched(matcher.run(path), index);
+}
+
+
+void test_globs() {
+
+    assert(matches("/lustre/*/projects/*/keep/**", syntax::GLOB, "/lustre/fs1/projects/abc/keep/a/b/c"));
+    assert(matches("/lustre/*/projects/*/keep/**", syntax::GLOB, "/lustre/fs1/projects/abc/keep/"));
+    assert(not matches("/lustre/*/projects/*/keep/**", syntax::GLOB, "/lustre/fs1/x/projects/abc/keep/a"));
+    assert(not matches("/lustre/*/projects/*/keep/**", syntax::GLOB, "/lustre/fs1/projects/abc/keeper/a"));
+
+    /* ** as a component also matches no components */
+    assert(matches("/a/**/b", syntax::GLOB, "/a/b"));
+    assert(matches("/a/**/b", syntax::GLOB, "/a/x/y/b"));
+    assert(not matches("/a/**/b", syntax::GLOB, "/a/xb"));
+    assert(matches("**/*.tmp", syntax::GLOB, "/scratch/u/job.tmp"));
+    assert(matches("/a/x**", syntax::GLOB, "/a/xy/z"));
+
+    assert(matches("/d/file?.[ch]", syntax::GLOB, "/d/file1.c"));
+    assert(not matches("/d/file?.[ch]", syntax::GLOB, "/d/file1.o"));
+    assert(matches("/d/[!a-c]*", syntax::GLOB, "/d/dir"));
+    assert(not matches("/d/[!a-c]*", syntax::GLOB, "/d/bin"));
+    assert(not matches("/d/?", syntax::GLOB, "/d//"));
+    assert(matches("/d/\\*", syntax::GLOB, "/d/*"));
+    assert(not matches("/d/\\*", syntax::GLOB, "/d/x"));
+    assert(matches("", syntax::GLOB, ""));
+    assert(not matches("", syntax::GLOB, "/"));
+}
+
+
+void test_regexes() {
+
+    assert(matches(".*\\.(tmp|swp)", syntax::REGEX, "/scratch/a.swp"));
+    assert(not matches(".*\\.(tmp|swp)", syntax::REGEX, "/scratch/a.swpx"));
+    assert(matches("^/home/[a-z]+/\\d+$", syntax::REGEX, "/home/bob/123"));
+    assert(not matches("^/home/[a-z]+/\\d+$", syntax::REGEX, "/home/Bob/123"));
+    assert(matches("/a\\$", syntax::REGEX, "/a$"));
+    assert(matches("(ab)*c?", syntax::REGEX, "ababab"));
+    assert(matches("x|", syntax::REGEX, ""));
+}
+
+
+void test_errors() {
+
+    for(const auto &[pattern, type] : std::vector<std::pair<std::string, syntax>>{
+            { "/a/[bc", syntax::GLOB }, { "/a\\", syntax::GLOB }, { "(a", syntax::REGEX },
+            { "a)", syntax::REGEX }, { "*a", syntax::REGEX }, { "a{2}", syntax::REGEX },
+            { "a^b", syntax::REGEX }, { "[z-a]", syntax::REGEX } }) {
+
+        bool rejected = false;
+
+        try {
+            path_matcher matcher;
+            matcher.add(pattern, type);
+        } catch(const std::invalid_argument &) {
+            rejected = true;
+        }
+
+        assert(rejected);
+    }
+
+    /* Too many states for the limit */
+    path_matcher matcher;
+    matcher.add("(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)", syntax::REGEX);
+
+    bool rejected = false;
+
+    try {
+        matcher.compile(100);
+    } catch(const std::invalid_argument &) {
+        rejected = true;
+    }
+
+    assert(rejected);
+}
+
+
+void test_literal_prefix() {
+
+    assert(path_matcher::literal_prefix("/lustre/*/keep/**", syntax::GLOB) == "/lustre/");
+    assert(path_matcher::literal_prefix("**/x", syntax::GLOB) == "");
+    assert(path_matcher::literal_prefix("^/home/ab*", syntax::REGEX) == "/home/a");
+    assert(path_matcher::literal_prefix("/home/ab+", syntax::REGEX) == "/home/ab");
+    assert(path_matcher::literal_prefix("/home/.*", syntax::REGEX) == "/home/");
+    assert(path_matcher::literal_prefix("/a|/b", syntax::REGEX) == "");
+}
+
+
+/* Many patterns at once agree with fnmatch and std::regex one at a time */
+void test_combined() {
+
+    std::vector<std::pair<std::string, syntax>> patterns = {
+        { "/lustre/*/projects/*/keep/*", syntax::GLOB },
+        { "/lustre/*/scratch/*/*.tmp", syntax::GLOB },
+        { "/lustre/fs?/*", syntax::GLOB },
+        { "*/core.[0-9]*", syntax::GLOB },
+        { "/tmp/*", syntax::GLOB },
+        { ".*/core\\.[0-9]+", syntax::REGEX },
+        { "/lustre/fs[12]/(projects|scratch)/.*", syntax::REGEX },
+        { ".*\\.(tmp|swp|o)", syntax::REGEX },
+        { "/home/[a-z]+/\\.cache/.*", syntax::REGEX },
+    };
+
+    path_matcher matcher;
+    std::vector<std::uint32_t> indices;
+    std::vector<std::regex> regexes;
+
+    for(const auto &[pattern, type] : patterns) {
+        indices.push_back(matcher.add(pattern, type));
+        regexes.emplace_back(type == syntax::REGEX ? pattern : "", std::regex::extended);
+    }
+
+    /* Added again it is the same pattern */
+    assert(matcher.add(patterns[0].first, patterns[0].second) == indices[0]);
+
+    matcher.compile();
+
+    static const std::vector<std::string> parts = {
+        "/lustre", "/fs1", "/fs2", "/fs3", "/projects", "/scratch", "/keep", "/home", "/bob",
+        "/.cache", "/tmp", "/core.12", "/core.x", "/a.tmp", "/b.swp", "/c.o", "/d.c", "/x"
+    };
+
+    std::mt19937 gen(7);
+
+    for(int n = 0; n < 5000; ++n) {
+
+        std::string path;
+
+        for(auto count = gen() % 6 + 1; count > 0; --count) {
+            path += parts[gen() % parts.size()];
+        }
+
+        auto state = matcher.run(path);
+
+        for(std::size_t i = 0; i < patterns.size(); ++i) {
+
+            const auto &[pattern, type] = patterns[i];
+
+            bool expected = (type == syntax::GLOB) ?
+                fnmatch(pattern.c_str(), path.c_str(), FNM_PATHNAME) == 0 :
+                std::regex_match(path, regexes[i]);
+
+            assert(matcher.matched(state, indices[i]) == expected);
+        }
+    }
+
+    std::clog << patterns.size() << " patterns in " << matcher.states() << " states" << std::endl;
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_globs();
+    test_regexes();
+    test_errors();
+    test_literal_prefix();
+    test_combined();
+
+    std::clog << "path matcher tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
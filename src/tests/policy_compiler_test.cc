@@ -0,0 +1,415 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include "../policy_engine/details/policy_compiler.h"
+
+
+using namespace std::chrono_literals;
+
+static const auto now = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+
+static scan_message make_file(std::chrono::seconds age, std::string ost_pool = "",
+                              std::uint64_t size = 4096, char type = 'f') {
+
+    scan_message msg;
+
+    msg.type = type;
+    msg.atime = now - age;
+    msg.mtime = now - age;
+    msg.size = size;
+    msg.uid = 6598;
+    msg.gid = 9294;
+    msg.path = "/lustre/proj/abc123/data/file";
+    msg.ost_pool = std::move(ost_pool);
+
+    return msg;
+}
+
+
+static bool matches(std::string_view match, const scan_message &msg) {
+
+    auto policy = compile_policy({ { "test", std::string(match), "purge" } });
+
+    return policy.evaluate(msg, now) != nullptr;
+}
+
+
+static bool rejected(std::string_view match) {
+
+    try {
+        compile_policy({ { "test", std::string(match), "purge" } });
+    } catch(const std::invalid_argument &e) {
+        return true;
+    }
+
+    return false;
+}
+
+
+/* The default rules reproduce the old hardcoded behaviour */
+void test_default_rules() {
+
+    auto policy = compile_policy(default_policy_rules());
+
+    auto *rule = policy.evaluate(make_file(std::chrono::days(31)), now);
+    assert(rule != nullptr and rule->action == policy_action::PURGE);
+
+    rule = policy.evaluate(make_file(std::chrono::days(3), "performance"), now);
+    assert(rule != nullptr and rule->action == policy_action::MIGRATE);
+
+    /* Purge takes precedence over migration */
+    rule = policy.evaluate(make_file(std::chrono::days(31), "performance"), now);
+    assert(rule != nullptr and rule->action == policy_action::PURGE);
+
+    assert(policy.evaluate(make_file(std::chrono::days(3), "capacity"), now) == nullptr);
+    assert(policy.evaluate(make_file(std::chrono::days(1), "performance"), now) == nullptr);
+    assert(policy.evaluate(make_file(std::chrono::days(31), "", 4096, 'd'), now) == nullptr);
+}
+
+
+void test_operators_and_units() {
+
+    auto msg = make_file(std::chrono::hours(36), "capacity", 3 * 1024 * 1024);
+
+    assert(matches("size == 3M", msg));
+    assert(matches("size >= 3M and size <= 3145728", msg));
+    assert(not matches("size > 3M", msg));
+    assert(matches("size < 1G", msg));
+    assert(matches("atime_age > 1d and atime_age < 2d", msg));
+    assert(matches("mtime_age >= 36h", msg));
+    assert(matches("atime < 1700000000", msg));
+    assert(matches("uid == 6598 and gid != 0", msg));
+    assert(matches("stripe_count == 0", msg));
+    assert(matches("path startswith '/lustre/proj/'", msg));
+    assert(not matches("path startswith \"/lustre/scratch\"", msg));
+    assert(matches("ost_pool != 'performance'", msg));
+    assert(matches("type != 'd'", msg));
+}
+
+
+void test_boolean_structure() {
+
+    auto msg = make_file(std::chrono::days(10), "performance");
+
+    assert(matches("not type == 'd'", msg));
+    assert(matches("type == 'd' or ost_pool == 'performance'", msg));
+    assert(not matches("type == 'd' or ost_pool == 'capacity' or uid == 0", msg));
+    assert(matches("(type == 'd' or uid == 6598) and not (size > 1G or gid == 0)", msg));
+    assert(not matches("not (atime_age > 1w and (ost_pool == 'x' or ost_pool == 'performance'))", msg));
+    assert(matches("not not uid == 6598", msg));
+
+    /* and binds tighter than or */
+    assert(matches("uid == 6598 or uid == 1 and gid == 1", msg));
+    assert(not matches("(uid == 6598 or uid == 1) and gid == 1", msg));
+}
+
+
+void test_errors() {
+
+    assert(rejected(""));
+    assert(rejected("owner == 1"));
+    assert(rejected("size = 1"));
+    assert(rejected("size == 1X"));
+    assert(rejected("atime > 30d"));
+    assert(rejected("atime_age > 30K"));
+    assert(rejected("uid == 1d"));
+    assert(rejected("uid == 'root'"));
+    assert(rejected("path == 1"));
+    assert(rejected("path < 'a'"));
+    assert(rejected("size startswith '1'"));
+    assert(rejected("type == 'file'"));
+    assert(rejected("type < 'f'"));
+    assert(rejected("(uid == 1"));
+    assert(rejected("uid == 1 uid == 2"));
+    assert(rejected("path == 'unterminated"));
+    assert(rejected("size == 99999999999999999999"));
+    assert(rejected("size == 9999999999999P"));
+
+    try {
+        compile_policy({ { "bad-action", "uid == 1", "delete" } });
+        assert(false);
+    } catch(const std::invalid_argument &e) {
+        assert(std::string(e.what()).find("bad-action") != std::string::npos);
+    }
+}
+
+
+/* Rules share the string table and each compare is one instruction */
+void test_code_size() {
+
+    auto policy = compile_policy({
+        { "a", "ost_pool == 'performance' and size > 1G", "migrate" },
+        { "b", "ost_pool == 'performance' or path startswith '/tmp'", "skip" },
+        { "c", "atime_age > 90d", "purge" }
+    });
+
+    assert(policy.code().size() == 5);
+    assert(policy.strings().size() == 2);
+    assert(policy.rules().size() == 3);
+
+    auto *rule = policy.evaluate(make_file(std::chrono::days(100), "performance"), now);
+    assert(rule != nullptr and rule->name == "b" and rule->action == policy_action::SKIP);
+
+    std::clog << policy;
+}
+
+
+static std::string key_of(std::string_view match) {
+
+    std::ostringstream os;
+    os << rule_index::choose_key(parse_policy_expression(match));
+
+    return os.str();
+}
+
+
+/* Each rule is filed under the most selective conjunct */
+void test_index_keys() {
+
+    assert(key_of("type == 'f' and atime_age > 30d and ost_pool == 'performance'") == 
+           "ost_pool == 'performance'");
+    assert(key_of("uid == 0 and path startswith '/a' and path startswith '/a/b'") == 
+           "path startswith '/a/b'");
+    assert(key_of("type == 'f' and atime_age > 30d") == "atime_age >= 2592001");
+    assert(key_of("type == 'd' and size < 1K") == "size <= 1023");
+    assert(key_of("type == 'f' and not uid != 7") == "uid == 7");
+    assert(key_of("not (ost_pool != 'a' or mtime < 100)") == "ost_pool == 'a'");
+    assert(key_of("type == 'f'") == "type == 'f'");
+
+    /* Nothing every match must satisfy */
+    assert(key_of("uid == 0 or gid == 0") == "nothing");
+    assert(key_of("not path startswith '/tmp'") == "nothing");
+    assert(key_of("ost_pool != 'performance'") == "nothing");
+}
+
+
+/* The index must never leave out a rule that matches */
+void test_index_agrees() {
+
+    std::vector<policy_rule_spec> specs;
+    std::mt19937 gen(5);
+
+    static const std::vector<std::string> templates = {
+        "uid == %",
+        "gid == % and atime_age > %d",
+        "path startswith '/lustre/proj/%' and size >= %M",
+        "ost_pool == 'pool%' and type == 'f'",
+        "mtime_age <= %h or uid == %",
+        "not (stripe_count > % or filesys != 'fs%')",
+        "path == '/lustre/proj/%/file%' and atime < 1699990000",
+        "type == 'd' and mtime_age < %w"
+    };
+
+    for(int i = 0; i < 300; ++i) {
+
+        auto match = templates[gen() % templates.size()];
+
+        for(auto pos = match.find('%'); pos != std::string::npos; pos = match.find('%')) {
+            match.replace(pos, 1, std::to_string(gen() % 8));
+        }
+
+        specs.push_back({ "rule" + std::to_string(i), match, "purge" });
+    }
+
+    auto policy = compile_policy(specs);
+
+    for(int n = 0; n < 20000; ++n) {
+
+        scan_message msg;
+
+        msg.type = (gen() % 4 == 0) ? 'd' : 'f';
+        msg.atime = now - std::chrono::hours(gen() % (24 * 14));
+        msg.mtime = msg.atime - std::chrono::hours(gen() % (24 * 60));
+        msg.size = (gen() % 16) << 20;
+        msg.uid = gen() % 10;
+        msg.gid = gen() % 10;
+        msg.stripe_count = gen() % 10;
+        msg.ost_pool = "pool" + std::to_string(gen() % 10);
+        msg.filesys = "fs" + std::to_string(gen() % 10);
+        msg.path = "/lustre/proj/" + std::to_string(gen() % 10) + "/file" + std::to_string(gen() % 10);
+
+        auto regs = compiled_policy::load(msg, now);
+
+        const compiled_policy::rule *expected = nullptr;
+
+        for(std::size_t i = 0; i < policy.rules().size() and expected == nullptr; ++i) {
+            if(policy.matches(i, regs)) {
+                expected = &policy.rules()[i];
+            }
+        }
+
+        assert(policy.evaluate(regs) == expected);
+    }
+}
+
+
+/* Path globs and regexes are matched by the policy's path matcher */
+void test_path_patterns() {
+
+    auto msg = make_file(std::chrono::days(10));
+
+    assert(matches("path matches '/lustre/proj/*/data/*'", msg));
+    assert(matches("path matches '/lustre/**/file'", msg));
+    assert(not matches("path matches '/lustre/*/file'", msg));
+    assert(matches("path matches '**/[a-f]ile' and not path matches '*.tmp'", msg));
+    assert(matches("path regex '/lustre/proj/[a-z]+[0-9]+/.*'", msg));
+    assert(not matches("path regex 'data/file'", msg));
+    assert(matches("path regex '^/lustre/(proj|scratch)/.*file$'", msg));
+
+    assert(rejected("path matches '[abc'"));
+    assert(rejected("path regex '(a'"));
+    assert(rejected("path regex 'a{2}'"));
+    assert(rejected("ost_pool matches 'p*'"));
+    assert(rejected("size regex '1'"));
+
+    /* A pattern's literal start is indexed like startswith */
+    assert(key_of("path matches '/lustre/proj/*.tmp'") == "path startswith '/lustre/proj/'");
+    assert(key_of("path regex '/tmp/a+'") == "path startswith '/tmp/a'");
+    assert(key_of("path matches '**.tmp'") == "nothing");
+
+    /* Rules sharing a pattern share its automaton state, rules evaluate in
+     * order */
+    auto policy = compile_policy({
+        { "keep", "path matches '**/keep/**'", "skip" },
+        { "tmp", "path matches '**.tmp' or path regex '.*/core[.][0-9]+'", "purge" },
+        { "old", "path matches '**.tmp' and atime_age > 30d", "purge" }
+    });
+
+    assert(policy.paths().size() == 3);
+
+    msg.path = "/lustre/proj/keep/x.tmp";
+    assert(policy.evaluate(msg, now)->name == "keep");
+
+    msg.path = "/lustre/proj/a/core.1234";
+    assert(policy.evaluate(msg, now)->name == "tmp");
+
+    msg.path = "/lustre/proj/a/core.x";
+    assert(policy.evaluate(msg, now) == nullptr);
+}
+
+
+/* Target pools go with the per file and the directory forms of a rule */
+void test_migration_settings() {
+
+    auto policy = compile_policy({
+        { "files", "uid == 1", "migrate", { { "target_pools", " capacity, archive " }, 
+                                            { "stripe_count", "4" } } },
+        { "dirs", "uid == 2", "migrate", { { "target_pools", "capacity" }, { "directory", "parent" } } },
+        { "plain", "uid == 3", "migrate" }
+    });
+
+    const auto &files = policy.rules()[0];
+
+    assert(files.migration and not files.directory and not files.watermark);
+    assert((files.migration->pools == std::vector<std::string>{ "capacity", "archive" }));
+    assert(files.migration->stripe_count == 4);
+
+    assert(policy.rules()[1].migration and policy.rules()[1].directory);
+    assert(policy.rules()[1].migration->stripe_count == 0);
+    assert(not policy.rules()[2].migration);
+
+    auto invalid = [](std::map<std::string, std::string> parameters, const char *action) {
+        try {
+            compile_policy({ { "bad", "uid == 1", action, std::move(parameters) } });
+            return false;
+        } catch(const std::invalid_argument &e) {
+            return true;
+        }
+    };
+
+    assert(invalid({ { "target_pools", "capacity" } }, "purge"));
+    assert(invalid({ { "target_pools", "capacity,,archive" } }, "migrate"));
+    assert(invalid({ { "target_pools", "capacity" }, { "stripe_count", "0" } }, "migrate"));
+    assert(invalid({ { "target_pools", "capacity" }, { "stripe_count", "four" } }, "migrate"));
+    assert(invalid({ { "stripe_count", "4" } }, "migrate"));
+    assert(invalid({ { "target_pools", "capacity" }, { "pools", "archive" } }, "migrate"));
+}
+
+
+void test_adaptive_order() {
+
+    /* Top level 'or's so the index doesn't rule the records out first */
+    auto reference = compile_policy({
+        { "old", "atime_age > 30d", "purge" },
+        { "never", "(type == 'f' and uid < 4 and size >= 1T) or uid == 99", "purge" },
+        { "either", "size >= 1T or path matches '**.tmp' or uid < 4", "skip" }
+    });
+
+    auto adaptive = reference;
+
+    auto order = [](const compiled_policy &policy, std::string_view rule) {
+        auto text = policy.evaluation_order();
+        auto begin = text.find(rule);
+        return text.substr(begin, text.find('\n', begin) - begin);
+    };
+
+    assert(order(reference, "never").find("size") > order(reference, "never").find("uid < 4"));
+    assert(order(reference, "either").find("uid") > order(reference, "either").find("size"));
+
+    for(int n = 0; n < 10000; ++n) {
+
+        auto msg = make_file(std::chrono::days(n % 40), "", 4096, n % 5 == 0 ? 'd' : 'f');
+
+        msg.uid = n % 4;
+        msg.path = n % 3 == 0 ? "/lustre/proj/abc123/data/file.tmp" : "/lustre/proj/abc123/data/file";
+
+        auto regs = compiled_policy::load(msg, now);
+        reference.match_path(regs);
+
+        const auto *expected = reference.evaluate(regs);
+        const auto *decided = adaptive.evaluate_adaptive(regs);
+
+        assert((expected == nullptr) == (decided == nullptr));
+        assert(expected == nullptr or expected->name == decided->name);
+    }
+
+    /* The test ruling everything out goes first, the one deciding every
+     * record reaching it ahead of the others */
+    assert(order(adaptive, "never").find("size") < order(adaptive, "never").find("uid < 4"));
+    assert(order(adaptive, "either").find("uid") < order(adaptive, "either").find("size"));
+    assert(order(adaptive, "either").find("uid") < order(adaptive, "either").find("path"));
+
+    assert(adaptive.code().size() == reference.code().size());
+
+    for(std::size_t i = 0; i < reference.rules().size(); ++i) {
+        assert(adaptive.rules()[i].name == reference.rules()[i].name);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_default_rules();
+    test_operators_and_units();
+    test_boolean_structure();
+    test_errors();
+    test_code_size();
+    test_index_keys();
+    test_index_agrees();
+    test_path_patterns();
+    test_migration_settings();
+    test_adaptive_order();
+
+    std::clog << "policy compiler tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -26,7 +26,6 @@
 constexpr std::string_view scan_queue_name  = "scan.files.results";
 constexpr std::string_view removal_queue_name = "purge.files.request";
 constexpr std::string_view migration_queue_name = "migration.files.request";
-constexpr std::string_view recorder_queue_name = "recorder.files";
 
 int main(int argc, const char* argv[]) {
 
@@ -45,12 +44,10 @@ int main(int argc, const char* argv[]) {
    std::string mq_scan_path = std::string("/").append(scan_queue_name);
    std::string mq_removal_path = std::string("/").append(removal_queue_name); 
    std::string mq_migration_path = std::string("/").append(migration_queue_name);
-   std::string mq_recorder_path = std::string("/").append(recorder_queue_name);
 
     mq_unlink(mq_scan_path.c_str());
     mq_unlink(mq_removal_path.c_str());
     mq_unlink(mq_migration_path.c_str());
-    mq_unlink(mq_recorder_path.c_str());
 
     try {
 
@@ -63,14 +60,12 @@ int main(int argc, const char* argv[]) {
         MsgPublisher auto scan_mq_pub = ms.create_queue_publisher(scan_queue_name);
         MsgPublisher auto removal_mq_pub = ms.create_queue_publisher(removal_queue_name);
         MsgPublisher auto migration_mq_pub = ms.create_queue_publisher(migration_queue_name);
-        MsgPublisher auto recorder_mq_pub = ms.create_queue_publisher(recorder_queue_name);
 
 
 
         policy_engine *policy_engine = create_policy_engine(scan_mq_sub, 
                                                             removal_mq_pub,
-                                                            migration_mq_pub,
-                                                            recorder_mq_pub);
+                                                            migration_mq_pub);
 
 
         std::thread scan_thread([&scan_mq_pub, &messages](){ 
@@ -103,7 +98,6 @@ int main(int argc, const char* argv[]) {
     mq_unlink(mq_scan_path.c_str());
     mq_unlink(mq_removal_path.c_str());
     mq_unlink(mq_migration_path.c_str());
-    mq_unlink(mq_recorder_path.c_str());
 
 
 
@@ -0,0 +1,178 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include "../policy_engine/details/policy_simulator.h"
+
+
+static const auto now = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+
+static std::vector<scan_message> make_files(int count, std::uint64_t size) {
+
+    std::vector<scan_message> files(count);
+
+    for(int i = 0; i < count; ++i) {
+
+        auto &msg = files[i];
+
+        msg.type = 'f';
+        msg.atime = now - std::chrono::days(i);
+        msg.mtime = msg.atime;
+        msg.size = size;
+        msg.uid = 1;
+        msg.gid = 1;
+        msg.ost_pool = "scratch";
+        msg.filesys = "lustre";
+        msg.fid = std::to_string(i);
+        msg.path = "/lustre/f" + msg.fid;
+    }
+
+    return files;
+}
+
+
+/* The totals agree with evaluating each record on its own */
+void test_report() {
+
+    auto policy = compile_policy({
+        { "keep", "path startswith '/lustre/f1'", "skip" },
+        { "old", "atime_age > 30d", "purge" },
+        { "big", "size >= 1K", "migrate" }
+    });
+
+    auto files = make_files(100, 100);
+
+    for(int i = 0; i < 100; i += 3) {
+        files[i].size = 4096;
+    }
+
+    std::map<std::string, std::uint64_t> expected_files;
+    std::map<std::string, std::uint64_t> expected_bytes;
+    std::uint64_t unmatched = 0;
+
+    for(const auto &msg : files) {
+
+        if(const auto *rule = policy.evaluate(msg, now); rule != nullptr) {
+            ++expected_files[rule->name];
+            expected_bytes[rule->name] += msg.size;
+        } else {
+            ++unmatched;
+        }
+    }
+
+    std::map<std::string, std::uint64_t> seen;
+
+    policy_simulator simulator(policy, { .batch_size = 7, .now = now },
+        [&](const compiled_policy::rule &rule, std::string_view path, std::int64_t size) {
+            assert(path.starts_with("/lustre/f") and size > 0);
+            ++seen[rule.name];
+        });
+
+    simulator.evaluate(files);
+
+    const auto &report = simulator.report();
+
+    assert(report.records == 100);
+    assert(report.unmatched == unmatched);
+    assert(report.rules.size() == 3);
+
+    for(const auto &rule : report.rules) {
+        assert(rule.files == expected_files[rule.name]);
+        assert(rule.bytes == expected_bytes[rule.name]);
+        assert(seen[rule.name] == rule.files);
+    }
+
+    std::clog << report;
+}
+
+
+/* A purged file no longer counts towards the usage of the next records */
+void test_purges_update_usage() {
+
+    auto policy = compile_policy({ { "quota", "uid_bytes > 50", "purge" } });
+    auto files = make_files(100, 10);
+
+    /* One at a time every file from the sixth on puts the owner over */
+    policy_simulator one_at_a_time(policy, { .batch_size = 1, .now = now });
+    one_at_a_time.evaluate(files);
+    assert(one_at_a_time.report().rules[0].files == 95);
+
+    /* Counted all together before any are purged */
+    policy_simulator together(policy, { .batch_size = 4096, .now = now });
+    together.evaluate(files);
+    assert(together.report().rules[0].files == 100);
+}
+
+
+/* Watermark purges are counted when they trigger, the oldest files first */
+void test_watermarks() {
+
+    auto policy = compile_policy({ 
+        { "scratch", "type == 'f'", "purge", 
+          { { "capacity", "1000" }, { "high_watermark", "90%" }, { "low_watermark", "50%" } } } 
+    });
+
+    auto files = make_files(100, 10);
+    std::vector<std::string> purged;
+
+    policy_simulator simulator(policy, { .batch_size = 4096, .now = now },
+        [&](const compiled_policy::rule &, std::string_view path, std::int64_t) {
+            purged.emplace_back(path);
+        });
+
+    simulator.evaluate(files);
+
+    const auto &report = simulator.report();
+
+    assert(report.rules[0].files == 50 and report.rules[0].bytes == 500);
+    assert(purged.size() == 50 and purged.front() == "/lustre/f99");
+}
+
+
+/* Ages are taken from the pinned time, not the clock */
+void test_pinned_now() {
+
+    auto policy = compile_policy({ { "old", "atime_age > 10d", "purge" } });
+    auto files = make_files(20, 1);
+
+    policy_simulator then(policy, { .now = now });
+    then.evaluate(files);
+    assert(then.report().rules[0].files == 9);
+
+    policy_simulator later(policy, { .now = now + std::chrono::days(365) });
+    later.evaluate(files);
+    assert(later.report().rules[0].files == 20);
+
+    policy_simulator empty(policy, { .now = now });
+    empty.evaluate({});
+    assert(empty.report().records == 0 and empty.report().records_per_second() == 0);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_report();
+    test_purges_update_usage();
+    test_watermarks();
+    test_pinned_now();
+
+    std::clog << "policy simulator tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,162 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include <unistd.h>
+
+#include "../policy_engine/details/pool_balancer.h"
+
+
+static const std::string capacity_df =
+    "UUID                   1K-blocks        Used   Available Use% Mounted on\n"
+    "lustre-MDT0000_UUID      1000000       10000      990000   1% /lustre[MDT:0]\n"
+    "lustre-OST0004_UUID      1000000      900000      100000  90% /lustre[OST:4]\n"
+    "lustre-OST0005_UUID      1000000      100000      900000  10% /lustre[OST:5]\n"
+    "lustre-OST0006_UUID            : inactive device\n"
+    "lustre-OST000a_UUID      1000000      200000      800000  20% /lustre[OST:10]\n"
+    "lustre-OST000b_UUID      1000000      300000      700000  30%\n"
+    "\n"
+    "filesystem_summary:      4000000     1500000     2500000  38% /lustre\n";
+
+static const std::string archive_df =
+    "UUID                   1K-blocks        Used   Available Use% Mounted on\n"
+    "lustre-OST0020_UUID      1000000      600000      400000  60% /lustre[OST:32]\n"
+    "lustre-OST0021_UUID      1000000      600000      400000  60% /lustre[OST:33]\n";
+
+
+static void write_file(const std::filesystem::path &path, const std::string &content) {
+    std::ofstream(path) << content;
+}
+
+
+void test_parse() {
+
+    std::istringstream in(capacity_df);
+    auto osts = parse_lfs_df(in);
+
+    /* The MDT, the inactive OST and the summary are left out, the index 
+     * without a mount column comes from the UUID */
+    assert(osts.size() == 4);
+    assert(osts[0].index == 4 and osts[0].available == 100000 * 1024LL);
+    assert(osts[1].index == 5 and osts[1].total == 1000000 * 1024LL);
+    assert(osts[2].index == 10);
+    assert(osts[3].index == 11 and osts[3].available == 700000 * 1024LL);
+
+    std::istringstream bad("lustre-OST0000_UUID  1000 ten\n");
+
+    try {
+        parse_lfs_df(bad);
+        assert(false);
+    } catch(const std::invalid_argument &e) {}
+}
+
+
+void test_choose() {
+
+    auto directory = std::filesystem::temp_directory_path() / 
+                     ("pool_balancer_test." + std::to_string(getpid()));
+
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    write_file(directory / "capacity.df", capacity_df);
+    write_file(directory / "archive.df", archive_df);
+
+    pool_balancer balancer(pool_balancer::lfs_df("file:" + (directory / "{pool}.df").string()));
+    std::vector<std::string> pools = { "archive", "capacity", "missing" };
+
+    /* Unknown pools before the first refresh */
+    auto target = balancer.choose(pools, 1 << 20, 2);
+    assert(target.pool == "archive" and target.osts.empty());
+
+    auto errors = balancer.refresh(pools);
+    assert(errors.find("missing") != std::string::npos);
+    assert(balancer.available("missing") == -1);
+
+    /* Capacity has more room, and OSTs 5 and 10 the most of it */
+    const std::int64_t gib = 1 << 30;
+
+    target = balancer.choose(pools, gib, 2);
+    assert(target.pool == "capacity" and target.stripe_count == 2);
+    assert((std::set<std::uint32_t>(target.osts.begin(), target.osts.end()) == std::set<std::uint32_t>{ 5, 10 }));
+    assert(balancer.available("capacity") == 2500000 * 1024LL - gib);
+
+    /* More stripes than OSTs, and no stripe count keeps the default
+     * striping, with only the pool */
+    target = balancer.choose(pools, 0, 8);
+    assert(target.stripe_count == 4 and target.osts.size() == 4);
+
+    target = balancer.choose(pools, 0, 0);
+    assert(target.pool == "capacity" and target.stripe_count == 0 and target.osts.empty());
+
+    /* The reservations spread a burst over the OSTs and then the pools */
+    std::set<std::uint32_t> used;
+
+    for(int i = 0; i < 6; ++i) {
+
+        target = balancer.choose({ pools.data() + 1, 1 }, 100 * 1024 * 1024, 1);
+        used.insert(target.osts.front());
+    }
+
+    assert(used.size() >= 2);
+
+    target = balancer.choose(pools, std::int64_t(1500) * 1024 * 1024, 1);
+    assert(target.pool == "capacity");
+
+    target = balancer.choose(pools, 1, 1);
+    assert(target.pool == "archive");
+
+    /* A pool that can no longer be read keeps its view, without the
+     * reservations */
+    std::filesystem::remove(directory / "capacity.df");
+
+    errors = balancer.refresh(pools);
+    assert(errors.find("capacity") != std::string::npos);
+    assert(balancer.available("capacity") == 2500000 * 1024LL);
+
+    std::filesystem::remove_all(directory);
+}
+
+
+void test_command() {
+
+    /* A command source is split on spaces and {pool} replaced in each */
+    auto fetch = pool_balancer::lfs_df("/bin/echo lustre-OST0007_UUID 100 20 80 20% /lustre[OST:7]-{pool}");
+    auto osts = fetch("capacity");
+
+    assert(osts.size() == 1 and osts[0].index == 7 and osts[0].available == 80 * 1024);
+
+    try {
+        pool_balancer::lfs_df("/bin/false {pool}")("capacity");
+        assert(false);
+    } catch(const std::runtime_error &e) {}
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_parse();
+    test_choose();
+    test_command();
+
+    std::clog << "pool balancer tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,162 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <array>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <cassert>
+
+#include "../messaging/details/priority_lanes.h"
+
+
+/* Queued messages by lane, receives through the scheduler the way the
+ * subscriber does, trying the lanes in order until one has a message */
+struct fake_lanes {
+
+    std::array<std::size_t, 3> queued = {};
+    std::array<std::size_t, 3> received = {};
+
+    /* The lane received from, nothing if they are all empty */
+    std::optional<message_priority> receive(priority_scheduler &scheduler) {
+
+        for(auto priority : scheduler.next()) {
+
+            auto lane = static_cast<std::size_t>(priority);
+
+            if(queued[lane] > 0) {
+                --queued[lane];
+                ++received[lane];
+                scheduler.served(priority);
+                return priority;
+            }
+
+            scheduler.idle(priority);
+        }
+
+        return std::nullopt;
+    }
+};
+
+
+void test_names() {
+
+    assert(lane_subject("purge.files.request", message_priority::HIGH) == "purge.files.request.high");
+    assert(lane_subject("purge.files.request.3", message_priority::LOW) == "purge.files.request.3.low");
+    assert(lane_subject("purge.files.request", message_priority::NORMAL) == "purge.files.request");
+
+    assert(lane_consumer("purge-files-consumer-3", message_priority::HIGH) == "purge-files-consumer-3-high");
+    assert(lane_consumer("purge-files-consumer", message_priority::NORMAL) == "purge-files-consumer");
+
+    /* Only action messages have a priority, normal unless the engine says */
+    static_assert(HasPriority<purge_message> and HasPriority<migration_message>);
+    static_assert(not HasPriority<scan_message>);
+
+    assert(purge_message("/lustre/f").priority == message_priority::NORMAL);
+}
+
+
+void test_parse() {
+
+    assert((parse_priority_weights("8,2,1") == priority_weights{ 8, 2, 1 }));
+    assert((parse_priority_weights("1,1,1") == priority_weights{ 1, 1, 1 }));
+
+    for(auto bad : { "", "8,2", "8,2,1,1", "8,0,1", "8,,1", "a,2,1", "8,2,1 " }) {
+        try {
+            parse_priority_weights(bad);
+            assert(false);
+        } catch(const std::invalid_argument &e) {
+        }
+    }
+}
+
+
+void test_shares() {
+
+    priority_scheduler scheduler({ 8, 2, 1 });
+    fake_lanes lanes;
+
+    lanes.queued = { 1000000, 1000000, 1000000 };
+
+    for(int i = 0; i < 11000; ++i) {
+        assert(lanes.receive(scheduler));
+    }
+
+    /* Every lane backlogged, they share by weight */
+    assert((lanes.received == std::array<std::size_t, 3>{ 8000, 2000, 1000 }));
+
+    /* Interleaved rather than in bursts, low never waits more than a round */
+    priority_scheduler smooth({ 8, 2, 1 });
+    fake_lanes backlog;
+
+    backlog.queued = { 1000000, 1000000, 1000000 };
+
+    int since_low = 0;
+
+    for(int i = 0; i < 1100; ++i) {
+
+        if(backlog.receive(smooth) == message_priority::LOW) {
+            since_low = 0;
+        } else {
+            assert(++since_low < 11);
+        }
+    }
+}
+
+
+void test_urgent() {
+
+    priority_scheduler scheduler;
+    fake_lanes lanes;
+
+    /* A deep backlog of routine actions */
+    lanes.queued = { 0, 1000000, 1000000 };
+
+    for(int i = 0; i < 10000; ++i) {
+        assert(lanes.receive(scheduler) != message_priority::HIGH);
+    }
+
+    /* Empty lanes don't bank turns, but one with messages is served within
+     * a few receives */
+    lanes.queued[0] = 1;
+
+    int waited = 0;
+
+    while(lanes.receive(scheduler) != message_priority::HIGH) {
+        ++waited;
+    }
+
+    assert(waited <= 1);
+
+    /* An empty lane gives its turns to the others */
+    lanes.queued = { 0, 0, 100 };
+    lanes.received = {};
+
+    for(int i = 0; i < 100; ++i) {
+        assert(lanes.receive(scheduler) == message_priority::LOW);
+    }
+
+    assert(not lanes.receive(scheduler));
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_names();
+    test_parse();
+    test_shares();
+    test_urgent();
+
+    std::clog << "priority lanes tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <cassert>
+
+#include "../messaging/details/rate_controller.h"
+
+using namespace std::chrono_literals;
+using clk = rate_controller::clock;
+
+
+/* Tokens are handed out at the current rate */
+void test_pacing() {
+
+    auto t0 = clk::now();
+
+    rate_controller::config c;
+    c.initial_rate = 100.0;
+
+    rate_controller rc(c, t0);
+
+    /* The first token is available immediately */
+    assert(rc.reserve(t0) == 0us);
+
+    /* The next one is owed 1/rate later */
+    auto wait = rc.reserve(t0);
+    assert(wait > 9ms and wait <= 10ms);
+
+    /* After waiting long enough a token is available again */
+    assert(rc.reserve(t0 + 30ms) == 0us);
+}
+
+
+/* Acks grow the rate, congestion cuts it once per interval */
+void test_aimd() {
+
+    auto t0 = clk::now();
+
+    rate_controller::config c;
+    c.initial_rate = 100.0;
+    c.additive_increase = 10.0;
+
+    rate_controller rc(c, t0);
+
+    /* Slow start, one per ack */
+    for(int i = 0; i < 100; ++i) {
+        rc.on_ack(1ms, t0);
+    }
+
+    assert(rc.rate() == 200.0);
+
+    /* Stream full halves the rate and backs off exponentially */
+    auto b1 = rc.on_store_failure(t0);
+    assert(rc.rate() == 100.0);
+
+    /* A second failure from the same event doesn't cut again */
+    auto b2 = rc.on_store_failure(t0 + 1ms);
+    assert(rc.rate() == 100.0);
+    assert(b2 == 2 * b1);
+
+    /* Out of slow start growth is additive, a second of acks adds about
+     * additive_increase */
+    for(int i = 0; i < 100; ++i) {
+        rc.on_ack(1ms, t0 + 1s);
+    }
+
+    assert(rc.rate() > 109.0 and rc.rate() < 110.0);
+
+    /* Slow acks count as congestion */
+    double before = rc.rate();
+    rc.on_ack(1s, t0 + 2s);
+    assert(rc.rate() < before);
+
+    /* Never below the minimum */
+    for(int i = 0; i < 100; ++i) {
+        rc.on_timeout(t0 + 3s + i * 1s);
+    }
+
+    assert(rc.rate() == c.min_rate);
+}
+
+
+/* The fill level of the stream holds and cuts the rate */
+void test_fill_level() {
+
+    auto t0 = clk::now();
+
+    rate_controller::config c;
+    c.initial_rate = 100.0;
+
+    rate_controller rc(c, t0);
+
+    assert(rc.fill_level_due(t0));
+    assert(not rc.fill_level_due(t0 + 1ms));
+
+    /* Between the watermarks the rate holds */
+    rc.on_fill_level(0.8, t0);
+    rc.on_ack(1ms, t0);
+    assert(rc.rate() == 100.0);
+
+    /* Above the high watermark it is cut */
+    rc.on_fill_level(0.95, t0);
+    assert(rc.rate() == 50.0);
+
+    /* Drained, it grows again */
+    rc.on_fill_level(0.1, t0 + 1s);
+    rc.on_ack(1ms, t0 + 1s);
+    assert(rc.rate() > 50.0);
+}
+
+
+void test_log_throttle() {
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    log_throttle throttle(10s);
+    std::uint64_t suppressed = 0;
+
+    assert(throttle.should_log(suppressed, t0));
+    assert(suppressed == 0);
+
+    for(int i = 0; i < 5; ++i) {
+        assert(not throttle.should_log(suppressed, t0 + 1s));
+    }
+
+    assert(throttle.should_log(suppressed, t0 + 11s));
+    assert(suppressed == 5);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_pacing();
+    test_aimd();
+    test_fill_level();
+    test_log_throttle();
+
+    std::clog << "rate_controller tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
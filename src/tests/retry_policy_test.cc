@@ -0,0 +1,117 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <chrono>
+#include <cassert>
+#include <stdexcept>
+
+#include "../messaging/details/retry_policy.h"
+
+using namespace std::chrono_literals;
+
+
+void test_backoff() {
+
+    retry_policy policy;
+
+    policy.initial_backoff = 100ms;
+    policy.max_backoff = 1s;
+
+    assert(policy.backoff(1) == 100ms);
+    assert(policy.backoff(2) == 200ms);
+    assert(policy.backoff(4) == 800ms);
+    assert(policy.backoff(5) == 1s);
+    assert(policy.backoff(1000) == 1s);
+}
+
+
+void test_exhausted() {
+
+    retry_policy policy;
+
+    policy.max_deliveries = 3;
+
+    assert(not policy.exhausted(1));
+    assert(not policy.exhausted(2));
+    assert(policy.exhausted(3));
+}
+
+
+void test_properties() {
+
+    std::map<std::string, std::string> properties = {
+        { "stream_name", "purge" },
+        { "max_deliveries", "7" },
+        { "retry_backoff_ms", "250" },
+        { "dead_letter_subject", "dead.purge" },
+    };
+
+    auto policy = make_retry_policy(properties);
+
+    assert(policy.max_deliveries == 7);
+    assert(policy.initial_backoff == 250ms);
+    assert(policy.max_backoff == retry_policy().max_backoff);
+    assert(policy.dead_letter_subject == "dead.purge");
+
+    /* No properties gives the defaults */
+    auto defaults = make_retry_policy({});
+
+    assert(defaults.max_deliveries == retry_policy().max_deliveries);
+    assert(defaults.dead_letter_subject.empty());
+}
+
+
+static bool invalid(const std::map<std::string, std::string> &properties) {
+
+    try {
+        make_retry_policy(properties);
+    } catch(const std::invalid_argument &e) {
+        return true;
+    }
+
+    return false;
+}
+
+
+void test_invalid_properties() {
+
+    /* Negative numbers are rejected rather than wrapped around */
+    assert(invalid({ { "max_deliveries", "-1" } }));
+    assert(invalid({ { "max_deliveries", "0" } }));
+    assert(invalid({ { "retry_backoff_ms", "-250" } }));
+    assert(invalid({ { "retry_backoff_ms", "0" } }));
+    assert(invalid({ { "max_retry_backoff_ms", "-1" } }));
+    assert(invalid({ { "max_deliveries", "many" } }));
+
+    /* The maximum backoff can't be below the first one */
+    assert(invalid({ { "retry_backoff_ms", "2000" }, { "max_retry_backoff_ms", "1000" } }));
+    assert(invalid({ { "max_retry_backoff_ms", "500" } }));
+
+    auto equal = make_retry_policy({ { "retry_backoff_ms", "1000" }, { "max_retry_backoff_ms", "1000" } });
+
+    assert(equal.backoff(3) == 1s);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_backoff();
+    test_exhausted();
+    test_properties();
+    test_invalid_properties();
+
+    std::clog << "retry_policy tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
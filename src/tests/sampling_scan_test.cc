@@ -0,0 +1,234 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include "../scan_agents/details/sampling_scan_agent.h"
+#include "../policy_engine/details/policy_simulator.h"
+#include "../policy_engine/details/sample_estimate.h"
+
+
+static const auto now = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+
+static scan_message make_entry(char type, std::string path, std::uint64_t size) {
+
+    scan_message msg;
+
+    msg.type = type;
+    msg.atime = now - std::chrono::hours(24 * (size % 100));
+    msg.mtime = msg.atime;
+    msg.size = size;
+    msg.filesys = "lustre";
+    msg.fid = "0x200000403:0x" + std::to_string(size) + ":0x0";
+    msg.path = std::move(path);
+
+    return msg;
+}
+
+
+/* A lopsided tree: /lustre/p<i> has i * 10 files and i subdirectories of
+ * 100 files each, so most files are deep in a few directories */
+struct fake_tree {
+
+    std::map<std::string, std::vector<scan_message>> directories;
+    std::uint64_t files = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t entries = 0;
+
+    void add_directory(const std::string &path, std::size_t nfiles) {
+
+        auto &entries = directories[path];
+        entries.push_back(make_entry('d', path, 4096));
+
+        for(std::size_t f = 0; f < nfiles; ++f) {
+            auto size = 1000 + (files * 7919) % 100000;
+            entries.push_back(make_entry('f', path + "/f" + std::to_string(f), size));
+            ++files;
+            bytes += size;
+        }
+
+        ++this->entries;
+        this->entries += nfiles;
+    }
+
+    fake_tree() {
+
+        add_directory("/lustre", 0);
+
+        for(int i = 1; i <= 8; ++i) {
+
+            auto project = "/lustre/p" + std::to_string(i);
+
+            add_directory(project, static_cast<std::size_t>(i) * 10);
+            directories["/lustre"].push_back(make_entry('d', project, 4096));
+
+            for(int j = 0; j < i; ++j) {
+                auto run = project + "/r" + std::to_string(j);
+                add_directory(run, 100);
+                directories[project].push_back(make_entry('d', run, 4096));
+            }
+        }
+    }
+
+    directory_sampler::lister lister(std::uint64_t &listed) const {
+        return [this, &listed](const std::string &directory) {
+
+            auto path = directory;
+
+            while(path.size() > 1 and path.back() == '/') {
+                path.pop_back();
+            }
+
+            ++listed;
+            return directories.at(path);
+        };
+    }
+};
+
+
+void test_unbiased() {
+
+    fake_tree tree;
+
+    constexpr int runs = 200;
+    constexpr std::uint32_t probes = 20;
+
+    double mean_files = 0;
+    int covered = 0;
+
+    for(int run = 0; run < runs; ++run) {
+
+        std::uint64_t listed = 0;
+
+        directory_sampler sampler({ .probes = probes, .fanout = 1,
+                                    .max_files_per_directory = 40,
+                                    .seed = static_cast<std::uint64_t>(run + 1) },
+                                  tree.lister(listed));
+
+        sampled_total files, entries;
+
+        auto totals = sampler.sample("/lustre/", [&](const scan_message &msg) {
+
+            assert(msg.sampled and msg.probe >= 1 and msg.probe <= probes);
+
+            entries.add(msg);
+
+            if(msg.type == 'f') {
+                files.add(msg);
+            }
+        });
+
+        /* A random walk lists a directory per level */
+        assert(totals.probes == probes and totals.directories == listed);
+        assert(listed <= probes * 3);
+
+        mean_files += files.estimate() / runs;
+
+        auto error = std::abs(files.estimate() - static_cast<double>(tree.files));
+
+        covered += error <= files.margin(probes);
+    }
+
+    /* Unbiased, and the 95% intervals mostly cover the true count */
+    assert(std::abs(mean_files - static_cast<double>(tree.files)) < 0.05 * static_cast<double>(tree.files));
+    assert(covered >= runs * 8 / 10);
+}
+
+
+void test_exhaustive() {
+
+    fake_tree tree;
+    std::uint64_t listed = 0;
+
+    /* Descending into every subdirectory and keeping every file is a full
+     * scan with weights of 1 */
+    directory_sampler sampler({ .probes = 1, .fanout = 1000, .max_files_per_directory = 0, .seed = 7 },
+                              tree.lister(listed));
+
+    sampled_total files, bytes;
+    std::uint64_t records = 0;
+
+    sampler.sample("/lustre", [&](const scan_message &msg) {
+
+        assert(msg.weight == 1.0);
+
+        ++records;
+
+        if(msg.type == 'f') {
+            files.add(msg);
+            bytes.add(msg, static_cast<double>(msg.size));
+        }
+    });
+
+    assert(records == tree.entries and listed == tree.directories.size());
+    assert(files.estimate() == static_cast<double>(tree.files));
+    assert(bytes.estimate() == static_cast<double>(tree.bytes));
+    assert(files.margin(1) == 0);
+}
+
+
+void test_simulation() {
+
+    fake_tree tree;
+    std::uint64_t listed = 0;
+    std::vector<scan_message> records;
+
+    directory_sampler sampler({ .probes = 50, .fanout = 2, .max_files_per_directory = 20, .seed = 3 },
+                              tree.lister(listed));
+
+    sampler.sample("/lustre", [&](const scan_message &msg) { records.push_back(msg); });
+
+    auto policy = compile_policy({ { "all-files", "type == 'f'", "purge" } });
+
+    policy_simulator simulator(policy, { .now = now });
+    simulator.evaluate(records);
+    simulator.finish();
+
+    const auto &report = simulator.report();
+
+    /* The records are counted as sent, their weights make the estimate */
+    auto sampled_files = std::count_if(records.begin(), records.end(),
+                                       [](const auto &msg) { return msg.type == 'f'; });
+
+    assert(report.probes == 50);
+    assert(report.rules[0].files == static_cast<std::uint64_t>(sampled_files));
+
+    auto estimate = report.rules[0].estimated_files.estimate();
+    auto margin = report.rules[0].estimated_files.margin(report.probes);
+
+    assert(margin > 0 and std::abs(estimate - static_cast<double>(tree.files)) < 3 * margin);
+
+    std::ostringstream out;
+    out << report;
+
+    assert(out.str().find("estimated from 50 sampling probes") != std::string::npos);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_unbiased();
+    test_exhaustive();
+    test_simulation();
+
+    std::clog << "sampling scan tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
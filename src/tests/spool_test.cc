@@ -0,0 +1,151 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <cassert>
+
+#include <unistd.h>
+
+#include "../messaging/details/spool.h"
+
+
+static std::size_t count_segments(const std::filesystem::path &dir) {
+
+    std::size_t count = 0;
+
+    for(const auto &entry : std::filesystem::directory_iterator(dir)) {
+        count += (entry.path().extension() == ".seg");
+    }
+
+    return count;
+}
+
+
+/* Records come back in order and segments roll over and get cleaned up */
+void test_append_and_drain(const std::filesystem::path &dir) {
+
+    std::stop_source stop;
+    spool::record rec;
+
+    spool s(dir, 64 * 1024);
+
+    std::string payload(1000, 'x');
+
+    for(int i = 0; i < 200; ++i) {
+        s.append("scan.files.results", "client-" + std::to_string(i), payload);
+    }
+
+    assert(s.pending() == 200);
+    assert(count_segments(dir) > 1);
+
+    for(int i = 0; i < 200; ++i) {
+
+        [[maybe_unused]] bool found = s.front(rec, stop.get_token());
+
+        assert(found);
+        assert(rec.subject == "scan.files.results");
+        assert(rec.msg_id == "client-" + std::to_string(i));
+        assert(rec.payload == payload);
+
+        s.pop();
+    }
+
+    assert(s.pending() == 0);
+
+    /* Nothing left so stop is honoured */
+    stop.request_stop();
+    [[maybe_unused]] bool found = s.front(rec, stop.get_token());
+
+    assert(not found);
+}
+
+
+/* Records not consumed before a restart are replayed, consumed ones aren't */
+void test_recovery(const std::filesystem::path &dir) {
+
+    std::stop_source stop;
+    spool::record rec;
+
+    {
+        spool s(dir, 64 * 1024);
+
+        for(int i = 0; i < 10; ++i) {
+            s.append("purge.files.requests", std::to_string(i), "payload-" + std::to_string(i));
+        }
+
+        for(int i = 0; i < 4; ++i) {
+            [[maybe_unused]] bool found = s.front(rec, stop.get_token());
+
+            assert(found);
+            s.pop();
+        }
+    }
+
+    spool s(dir, 64 * 1024);
+
+    assert(s.pending() == 6);
+
+    [[maybe_unused]] bool found = s.front(rec, stop.get_token());
+
+    assert(found);
+    assert(rec.msg_id == "4");
+    assert(rec.payload == "payload-4");
+
+    /* Appending after recovery keeps the order */
+    s.append("purge.files.requests", "10", "payload-10");
+    assert(s.pending() == 7);
+}
+
+
+/* A consumer waiting on an empty spool is woken by an append */
+void test_wakeup(const std::filesystem::path &dir) {
+
+    spool s(dir, 64 * 1024);
+
+    std::jthread consumer([&s](std::stop_token stoken) {
+
+        spool::record rec;
+
+        [[maybe_unused]] bool found = s.front(rec, stoken);
+
+        assert(found);
+        assert(rec.payload == "late");
+        s.pop();
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    s.append("a", "b", "late");
+    consumer.join();
+
+    assert(s.pending() == 0);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    auto base = std::filesystem::temp_directory_path() /
+                    ("spool_test." + std::to_string(getpid()));
+
+    std::filesystem::remove_all(base);
+
+    test_append_and_drain(base / "drain");
+    test_recovery(base / "recovery");
+    test_wakeup(base / "wakeup");
+
+    std::filesystem::remove_all(base);
+
+    std::clog << "spool tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+#include "../policy_engine/details/usage_store.h"
+
+
+static const auto now = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+
+static scan_message make_file(std::string fid, std::uint64_t size, std::uint64_t uid, 
+                              std::uint64_t gid = 100, std::string pool = "scratch",
+                              std::string filesys = "lustre") {
+
+    scan_message msg;
+
+    msg.type = 'f';
+    msg.atime = now;
+    msg.mtime = now;
+    msg.size = size;
+    msg.uid = uid;
+    msg.gid = gid;
+    msg.ost_pool = std::move(pool);
+    msg.filesys = std::move(filesys);
+    msg.fid = std::move(fid);
+    msg.path = "/lustre/file" + msg.fid;
+
+    return msg;
+}
+
+
+void test_totals() {
+
+    usage_store usage;
+
+    usage.record(make_file("a", 100, 1));
+    usage.record(make_file("b", 200, 1));
+    usage.record(make_file("c", 400, 2));
+    usage.record(make_file("d", 800, 1, 100, "scratch", "gpfs"));
+
+    auto totals = usage.totals(make_file("x", 0, 1));
+
+    assert(totals.uid_bytes == 300 and totals.uid_files == 2);
+    assert(totals.gid_bytes == 700 and totals.gid_files == 3);
+    assert(totals.pool_bytes == 700 and totals.pool_files == 3);
+    assert(usage.files() == 4);
+
+    /* Separate per file system */
+    totals = usage.totals(make_file("x", 0, 1, 100, "scratch", "gpfs"));
+    assert(totals.uid_bytes == 800 and totals.gid_files == 1);
+
+    /* Unknown owner, pool and file system */
+    totals = usage.totals(make_file("x", 0, 7, 100, "other"));
+    assert(totals.uid_bytes == 0 and totals.gid_bytes == 700 and totals.pool_files == 0);
+    assert(usage.totals(make_file("x", 0, 1, 100, "scratch", "nfs")).uid_files == 0);
+}
+
+
+/* A file seen again replaces its previous contribution */
+void test_rescan_and_remove() {
+
+    usage_store usage;
+
+    usage.record(make_file("a", 100, 1));
+    usage.record(make_file("a", 150, 1));
+    assert(usage.totals(make_file("x", 0, 1)).uid_bytes == 150);
+    assert(usage.files() == 1);
+
+    /* Changed owner and pool */
+    usage.record(make_file("a", 150, 2, 100, "capacity"));
+    assert(usage.totals(make_file("x", 0, 1)).uid_files == 0);
+    assert(usage.totals(make_file("x", 0, 2, 100, "capacity")).uid_bytes == 150);
+    assert(usage.totals(make_file("x", 0, 2, 100, "capacity")).pool_bytes == 150);
+    assert(usage.totals(make_file("x", 0, 2)).pool_bytes == 0);
+
+    /* Files without a FID are known by path */
+    auto nofid = make_file("", 10, 3);
+    nofid.path = "/lustre/nofid";
+    usage.record(nofid);
+    usage.record(nofid);
+    assert(usage.totals(nofid).uid_bytes == 10);
+
+    usage.remove(usage_store::file_key("lustre", "a", ""));
+    usage.remove(usage_store::file_key("lustre", "", "/lustre/nofid"));
+    usage.remove(usage_store::file_key("lustre", "missing", ""));
+
+    assert(usage.files() == 0);
+    assert(usage.totals(make_file("x", 0, 2, 100, "capacity")).gid_bytes == 0);
+}
+
+
+void test_concurrent() {
+
+    usage_store usage(8);
+
+    {
+        std::vector<std::jthread> threads;
+
+        /* Every thread records every file, with the same sizes */
+        for(int t = 0; t < 4; ++t) {
+            threads.emplace_back([&usage] {
+                for(int i = 0; i < 20000; ++i) {
+                    usage.record(make_file(std::to_string(i), 10, i % 5));
+                }
+            });
+        }
+    }
+
+    assert(usage.files() == 20000);
+
+    for(int uid = 0; uid < 5; ++uid) {
+        auto totals = usage.totals(make_file("x", 0, uid));
+        assert(totals.uid_files == 4000 and totals.uid_bytes == 40000);
+    }
+}
+
+
+/* Rules see the totals through the usage fields */
+void test_rules() {
+
+    usage_store usage;
+
+    auto policy = compile_policy({
+        { "over-quota", "uid_bytes > 1K and pool_files >= 3", "purge" },
+        { "many-files", "gid_files > 2", "migrate" }
+    });
+
+    std::vector<scan_message> msgs = {
+        make_file("a", 600, 1), make_file("b", 600, 1), make_file("c", 10, 2, 200)
+    };
+
+    for(const auto &msg : msgs) {
+        usage.record(msg);
+    }
+
+    const auto *a = policy.evaluate(msgs[0], now, usage.totals(msgs[0]));
+    const auto *b = policy.evaluate(msgs[1], now, usage.totals(msgs[1]));
+
+    assert(a != nullptr and a->name == "over-quota");
+    assert(b != nullptr and b->name == "over-quota");
+    assert(policy.evaluate(msgs[2], now, usage.totals(msgs[2])) == nullptr);
+
+    /* Without the totals the fields are 0 */
+    for(const auto &msg : msgs) {
+        assert(policy.evaluate(msg, now) == nullptr);
+    }
+
+    assert(policy.uses_usage());
+    assert(not compile_policy(default_policy_rules()).uses_usage());
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_totals();
+    test_rescan_and_remove();
+    test_concurrent();
+    test_rules();
+
+    std::clog << "usage store tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
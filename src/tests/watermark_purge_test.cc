@@ -0,0 +1,189 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include "../policy_engine/details/watermark_purge.h"
+
+
+static const auto now = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+
+static purge_candidate candidate(int id, std::int64_t size, double score) {
+    return { .key = "fs:" + std::to_string(id), .path = "/f" + std::to_string(id), 
+             .size = size, .score = score };
+}
+
+
+static scan_message make_file(int id, std::uint64_t size, int age_days, std::string pool = "scratch") {
+
+    scan_message msg;
+
+    msg.type = 'f';
+    msg.atime = now - std::chrono::days(age_days);
+    msg.mtime = msg.atime;
+    msg.size = size;
+    msg.uid = 1;
+    msg.gid = 1;
+    msg.ost_pool = std::move(pool);
+    msg.filesys = "lustre";
+    msg.fid = std::to_string(id);
+    msg.path = "/lustre/f" + msg.fid;
+
+    return msg;
+}
+
+
+/* Only the best candidates covering the target are kept */
+void test_candidates() {
+
+    purge_candidates candidates(100);
+
+    for(int i = 0; i < 50; ++i) {
+        candidates.offer(candidate(i, 10, i), 100);
+    }
+
+    /* The ten best cover 100 bytes */
+    assert(candidates.size() == 10 and candidates.bytes() == 100);
+
+    /* Worse than everything kept */
+    candidates.offer(candidate(100, 10, 0.5), 100);
+    assert(candidates.size() == 10);
+
+    /* A file seen again is updated, not duplicated */
+    candidates.offer(candidate(45, 10, 1000), 100);
+    assert(candidates.size() == 10);
+
+    auto taken = candidates.take(25);
+    assert(taken.size() == 3);
+    assert(taken[0].key == "fs:45" and taken[1].key == "fs:49" and taken[2].key == "fs:48");
+    assert(candidates.bytes() == 70);
+
+    candidates.erase("fs:47");
+    candidates.erase("fs:missing");
+    assert(candidates.size() == 6);
+
+    /* More than there is */
+    assert(candidates.take(1000).size() == 6);
+    assert(candidates.size() == 0 and candidates.bytes() == 0);
+}
+
+
+void test_candidate_limit() {
+
+    purge_candidates candidates(5);
+
+    for(int i = 0; i < 20; ++i) {
+        candidates.offer(candidate(i, 1, i), 1000);
+    }
+
+    auto taken = candidates.take(1000);
+
+    assert(taken.size() == 5 and taken.front().score == 19 and taken.back().score == 15);
+}
+
+
+/* A pool above its high watermark is purged oldest first to its low one */
+void test_purger() {
+
+    auto policy = compile_policy({
+        { "keep", "path startswith '/lustre/keep'", "skip" },
+        { "scratch-watermark", "type == 'f' and ost_pool == 'scratch'", "purge",
+          { { "capacity", "1K" }, { "high_watermark", "90%" }, { "low_watermark", "0.5" } } }
+    });
+
+    assert(policy.uses_usage());
+    assert(policy.rules()[1].watermark->capacity == 1024);
+
+    usage_store usage;
+    watermark_purger purger(policy);
+
+    assert(not purger.empty());
+
+    /* 60 files of 15 bytes, 900 in all, below 90% of 1024 */
+    for(int i = 0; i < 60; ++i) {
+        auto msg = make_file(i, 15, i);
+        usage.record(msg);
+        purger.offer(1, msg, now, usage);
+    }
+
+    assert(purger.due(usage).empty());
+
+    /* Other pools don't count */
+    usage.record(make_file(1000, 500, 100, "capacity"));
+    assert(purger.due(usage).empty());
+
+    /* 960 bytes is above, 448 must go to reach 512 */
+    for(int i = 60; i < 64; ++i) {
+        auto msg = make_file(i, 15, 0);
+        usage.record(msg);
+        purger.offer(1, msg, now, usage);
+    }
+
+    /* A file accessed since stops being a candidate */
+    auto touched = make_file(59, 15, 0);
+    usage.record(touched);
+    purger.forget(touched);
+
+    auto purges = purger.due(usage);
+
+    assert(purges.size() == 1);
+    assert(purges[0].rule == "scratch-watermark" and purges[0].pool == "scratch");
+    assert(purges[0].used == 960 and purges[0].needed == 448);
+
+    /* 30 files of 15 bytes, the oldest ones, exactly enough */
+    assert(purges[0].files.size() == 30);
+    assert(purges[0].files[0].path == "/lustre/f58" and purges[0].files[29].path == "/lustre/f29");
+
+    assert(usage.pool_bytes("lustre", "scratch") == 510);
+    assert(purger.due(usage).empty());
+}
+
+
+void test_settings_errors() {
+
+    auto rejected = [](std::map<std::string, std::string> parameters, std::string action = "purge") {
+        try {
+            compile_policy({ { "r", "uid == 0", action, parameters } });
+        } catch(const std::invalid_argument &e) {
+            return true;
+        }
+        return false;
+    };
+
+    assert(rejected({ { "high_watermark", "0.9" } }));
+    assert(rejected({ { "capacity", "1T" }, { "high_watermark", "50%" }, { "low_watermark", "60%" } }));
+    assert(rejected({ { "capacity", "1X" } }));
+    assert(rejected({ { "capacity", "lots" } }));
+    assert(rejected({ { "capacity", "1T" }, { "order", "newest" } }));
+    assert(rejected({ { "capacity", "1T" }, { "color", "red" } }));
+    assert(rejected({ { "capacity", "1T" } }, "migrate"));
+
+    assert(not rejected({ { "capacity", "1T" }, { "order", "age_size" }, { "max_candidates", "10" } }));
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_candidates();
+    test_candidate_limit();
+    test_purger();
+    test_settings_errors();
+
+    std::clog << "watermark purge tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+/****************************************************************************
+ * Copyright 2023 UT Battelle, LLC
+ *
+ * This work was supported by the Oak Ridge Leadership Computing Facility at
+ * the Oak Ridge National Laboratory, which is managed by UT Battelle, LLC for
+ * the U.S. DOE (under the contract No. DE-AC05-00OR22725).
+ *
+ * This file is part of the PoliMOR project.
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+#include "../common/work_stealing_pool.h"
+
+
+static void wait_for(const std::atomic<int> &counter, int value) {
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+
+    while(counter.load() < value) {
+        assert(std::chrono::steady_clock::now() < deadline);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+
+void test_runs_everything() {
+
+    constexpr int tasks = 10000;
+
+    work_stealing_pool pool(4);
+    std::vector<std::atomic<int>> runs(tasks);
+    std::atomic<int> done{0};
+
+    for(int i = 0; i < tasks; ++i) {
+        pool.submit([&, i](std::size_t worker) {
+            assert(worker < 4);
+            runs[i].fetch_add(1);
+            done.fetch_add(1);
+        });
+    }
+
+    wait_for(done, tasks);
+
+    for(const auto &count : runs) {
+        assert(count.load() == 1);
+    }
+}
+
+
+/* Tasks submitted by a worker land on its own deque, the others have to 
+ * steal them */
+void test_stealing() {
+
+    constexpr int tasks = 64;
+
+    work_stealing_pool pool(4);
+    std::vector<std::atomic<int>> ran_on(4);
+    std::atomic<int> done{0};
+
+    pool.submit([&](std::size_t) {
+
+        for(int i = 0; i < tasks; ++i) {
+            pool.submit([&](std::size_t worker) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                ran_on[worker].fetch_add(1);
+                done.fetch_add(1);
+            });
+        }
+    });
+
+    wait_for(done, tasks);
+
+    int workers_used = 0;
+
+    for(const auto &count : ran_on) {
+        workers_used += count.load() > 0;
+    }
+
+    assert(workers_used > 1);
+}
+
+
+/* Queued tasks are dropped, not run, once the pool is destroyed */
+void test_shutdown() {
+
+    std::atomic<int> started{0};
+
+    {
+        work_stealing_pool pool(1);
+
+        for(int i = 0; i < 100; ++i) {
+            pool.submit([&](std::size_t) {
+                started.fetch_add(1);
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            });
+        }
+
+        wait_for(started, 1);
+    }
+
+    assert(started.load() < 100);
+}
+
+
+void test_invalid() {
+
+    try {
+        work_stealing_pool pool(0);
+        assert(false);
+    } catch(const std::invalid_argument &) {}
+}
+
+
+int main(int argc, char *argv[]) {
+
+    test_runs_everything();
+    test_stealing();
+    test_shutdown();
+    test_invalid();
+
+    std::clog << "work stealing pool tests passed" << std::endl;
+
+    return EXIT_SUCCESS;
+}